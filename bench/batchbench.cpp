@@ -0,0 +1,385 @@
+/******************************************************************************
+* psx-comBINe library-scale batch benchmark
+* Fabricates a library of thousands of small multi-bin discs (some grouped in
+* multi-disc sets), then combines all of them, to measure the fixed cost of
+* each job rather than copy throughput. Modes:
+*   serial          - one process, one disc after another, with every phase of
+*                     CombineCue() and DumpBinaryFiles() timed on its own
+*   batch           - one process, discs on all cores like CombineDiscSets(),
+*                     i.e. what a long-lived daemon would do per job
+*   process-startup - psx-combine --help once per disc: exec, dynamic linking
+*                     (wxWidgets included) and exit, with no work
+*   process-per-disc- psx-combine once per disc, as scripts do today
+*   process-batch   - psx-combine once on the whole library directory
+* The process modes need a built psx-combine, given with --binary. Per disc
+* latencies are reported as percentiles, with discs per second.
+*
+* Usage: batchbench [--discs N] [--sectors N] [--process-discs N] [--dir DIR]
+*                   [--binary PATH] [--out FILE] [--filter TEXT]
+* ADBeta (c)
+******************************************************************************/
+#include "benchutil.hpp"
+#include "cuehandler.hpp"
+#include "utils.hpp"
+#include "outputsink.hpp"
+#include "audiofile.hpp"
+#include "workpool.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <spawn.h>
+#include <fcntl.h>
+
+extern char **environ;
+
+/*** Synthetic Library ********************************************************/
+namespace {
+constexpr uint32_t sector_bytes = 2352;
+
+// Copy buffer of DumpBinaryFiles()
+constexpr size_t dump_buffer_bytes = sector_bytes * 16;
+
+// Writes a .bin of the given sectors, filled with a pattern
+void WriteBin(const std::filesystem::path &path, uint32_t sectors, char fill) {
+	std::ofstream bin(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	std::string sector(sector_bytes, fill);
+	for(uint32_t s = 0; s < sectors; s++) bin.write(sector.data(), sector_bytes);
+	if(!bin) throw std::runtime_error("Could not write the synthetic library");
+}
+
+// Writes discs of one data TRACK and two AUDIO TRACKs, one FILE each. Every
+// fourth game has a second disc. Returns the .cue paths
+std::vector<std::filesystem::path> MakeLibrary(const std::filesystem::path &dir,
+                                               unsigned discs, uint32_t data_sectors) {
+	std::filesystem::create_directories(dir);
+	std::vector<std::filesystem::path> cues;
+
+	for(unsigned game = 1; cues.size() < discs; game++) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "Game %05u", game);
+		unsigned game_discs = (game % 4 == 0 && cues.size() + 1 < discs) ? 2 : 1;
+
+		for(unsigned d = 1; d <= game_discs; d++) {
+			std::string disc = name;
+			if(game_discs > 1) disc += " (Disc " + std::to_string(d) + ")";
+
+			std::string cue;
+			for(unsigned t = 1; t <= 3; t++) {
+				std::string bin = disc + " (Track " + std::to_string(t) + ").bin";
+				WriteBin(dir / bin, t == 1 ? data_sectors : 1, static_cast<char>(t));
+				cue += "FILE \"" + bin + "\" BINARY\n  TRACK 0" + std::to_string(t) +
+				       (t == 1 ? " MODE2/2352\n" : " AUDIO\n") + "    INDEX 01 00:00:00\n";
+			}
+
+			std::filesystem::path cue_path = dir / (disc + ".cue");
+			std::ofstream cue_file(cue_path, std::ios::out | std::ios::binary | std::ios::trunc);
+			cue_file << cue;
+			if(!cue_file) throw std::runtime_error("Could not write the synthetic library");
+			cues.push_back(cue_path);
+		}
+	}
+
+	return cues;
+}
+
+/*** In Process Combining *****************************************************/
+// The steps of combining one disc, in order
+enum Phase { Parse, Stat, Mkdir, Combine, WriteCue, Dump, phase_count };
+const char *const phase_names[phase_count] = {
+	"parse", "stat", "mkdir", "combine", "write_cue", "dump"
+};
+
+struct DiscTimes {
+	uint64_t ns[phase_count] = {};
+	uint64_t total = 0;
+};
+
+// Combines a disc the way CombineCue() then DumpBinaryFiles() do for .bin
+// output, timing each step
+void CombineDisc(const std::filesystem::path &cue_path, const std::filesystem::path &out_dir,
+                 DiscTimes &times) {
+	uint64_t start = bench::NowNs(), mark = start;
+	auto lap = [&times, &mark](Phase phase) {
+		uint64_t now = bench::NowNs();
+		times.ns[phase] = now - mark;
+		mark = now;
+	};
+
+	CueSheet in_sheet, out_sheet;
+	CueFile cue_in(cue_path.string().c_str());
+	cue_in.ReadCueData(in_sheet);
+	lap(Parse);
+
+	std::filesystem::path in_dir = cue_path.parent_path();
+	cue_in.GetCueFileSizes(in_sheet, "");  // Relative to the .cue
+	lap(Stat);
+
+	if(!std::filesystem::is_directory(out_dir)) std::filesystem::create_directory(out_dir);
+	lap(Mkdir);
+
+	std::filesystem::path out_cue = out_dir / cue_path.filename();
+	std::filesystem::path out_bin = out_cue;
+	out_bin.replace_extension("bin");
+	in_sheet.CopyTo(out_sheet);
+	out_sheet.Combine(out_bin.filename().string(), "BINARY");
+	lap(Combine);
+
+	CueFile cue_out(out_cue.string().c_str());
+	cue_out.WriteCueData(out_sheet);
+	lap(WriteCue);
+
+	RawOutputSink sink(out_bin);
+	std::vector<char> buffer(dump_buffer_bytes);
+	for(const auto &f_itr : in_sheet.FileList) {
+		std::filesystem::path bin_path = in_dir / f_itr.filename;
+		AudioLayout layout = GetAudioLayout(bin_path, f_itr.filetype);
+
+		std::ifstream in(bin_path, std::ios::in | std::ios::binary);
+		if(!in) throw std::runtime_error("Input binary file could not be opened");
+		in.seekg(static_cast<std::streamoff>(layout.data_offset), std::ios::beg);
+		CopyStreamToSink(in, layout.data_bytes, layout.swap, sink, buffer.data(), buffer.size());
+	}
+	sink.Close();
+	lap(Dump);
+
+	times.total = mark - start;
+}
+
+/*** Process Modes ************************************************************/
+// Runs a program with its output thrown away, returns its wall time in ns
+uint64_t RunProcess(const std::vector<std::string> &args) {
+	std::vector<char *> argv;
+	for(const auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+	uint64_t start = bench::NowNs();
+	pid_t pid;
+	int err = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if(err != 0) throw std::runtime_error("Could not run " + args.front());
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	uint64_t elapsed = bench::NowNs() - start;
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		throw std::runtime_error(args.front() + " failed on " + args.back());
+
+	return elapsed;
+}
+
+/*** Results ******************************************************************/
+struct ModeResult {
+	std::string mode;
+	size_t      discs = 0;
+	uint64_t    wall_ns = 0;
+	std::vector<uint64_t> latencies;                 // Per disc, empty if unknown
+	std::vector<std::vector<uint64_t>> phases;       // [phase][disc], in process only
+};
+
+uint64_t Sum(const std::vector<uint64_t> &ns) {
+	uint64_t total = 0;
+	for(uint64_t v : ns) total += v;
+	return total;
+}
+
+uint64_t Percentile(std::vector<uint64_t> sorted, double pct) {
+	if(sorted.empty()) return 0;
+	std::sort(sorted.begin(), sorted.end());
+	size_t idx = static_cast<size_t>(pct / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+	return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+double DiscsPerSec(const ModeResult &res) {
+	return res.wall_ns ? static_cast<double>(res.discs) * 1e9 / static_cast<double>(res.wall_ns) : 0;
+}
+
+void PrintMode(const ModeResult &res) {
+	std::fprintf(stderr, "%-17s %7zu discs %9.2f s %10.1f discs/s", res.mode.c_str(), res.discs,
+	             static_cast<double>(res.wall_ns) / 1e9, DiscsPerSec(res));
+	if(!res.latencies.empty()) {
+		std::fprintf(stderr, "   p50 %8.1f us  p99 %8.1f us  max %9.1f us",
+		             Percentile(res.latencies, 50) / 1e3, Percentile(res.latencies, 99) / 1e3,
+		             Percentile(res.latencies, 100) / 1e3);
+	}
+	std::fprintf(stderr, "\n");
+
+	uint64_t all = std::max<uint64_t>(1, Sum(res.latencies));
+	for(size_t p = 0; p < res.phases.size(); p++) {
+		uint64_t total = Sum(res.phases[p]);
+		std::fprintf(stderr, "  %-15s mean %8.1f us  p99 %8.1f us  (%4.1f%%)\n", phase_names[p],
+		             static_cast<double>(total) / 1e3 / static_cast<double>(res.phases[p].size()),
+		             Percentile(res.phases[p], 99) / 1e3,
+		             100.0 * static_cast<double>(total) / static_cast<double>(all));
+	}
+}
+
+std::string LatencyJson(const std::vector<uint64_t> &ns) {
+	char buf[200];
+	std::snprintf(buf, sizeof(buf),
+	              "{\"mean_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, "
+	              "\"p999_us\": %.1f, \"max_us\": %.1f}",
+	              static_cast<double>(Sum(ns)) / 1e3 / static_cast<double>(ns.size()),
+	              Percentile(ns, 50) / 1e3, Percentile(ns, 90) / 1e3, Percentile(ns, 99) / 1e3,
+	              Percentile(ns, 99.9) / 1e3, Percentile(ns, 100) / 1e3);
+	return buf;
+}
+
+std::string ResultsToJson(const std::vector<ModeResult> &results, unsigned discs,
+                          uint32_t sectors) {
+	std::string json = "{\n  \"benchmark\": \"batchbench\",\n";
+	json += "  \"compiler\": " + JsonString(__VERSION__) + ",\n";
+	json += "  \"library_discs\": " + std::to_string(discs) + ",\n";
+	json += "  \"data_sectors\": " + std::to_string(sectors) + ",\n";
+	json += "  \"results\": [\n";
+
+	for(size_t r = 0; r < results.size(); r++) {
+		const ModeResult &res = results[r];
+		char nums[128];
+		std::snprintf(nums, sizeof(nums), "\"discs\": %zu, \"wall_s\": %.4f, \"discs_per_s\": %.1f",
+		              res.discs, static_cast<double>(res.wall_ns) / 1e9, DiscsPerSec(res));
+		json += "    {\"mode\": " + JsonString(res.mode) + ", " + nums;
+
+		if(!res.latencies.empty()) json += ",\n     \"latency\": " + LatencyJson(res.latencies);
+		if(!res.phases.empty()) {
+			json += ",\n     \"phases\": {";
+			for(size_t p = 0; p < res.phases.size(); p++) {
+				json += std::string(p ? ",\n                " : "") + "\"" + phase_names[p] +
+				        "\": " + LatencyJson(res.phases[p]);
+			}
+			json += "}";
+		}
+		json += (r + 1 < results.size()) ? "},\n" : "}\n";
+	}
+
+	json += "  ]\n}\n";
+	return json;
+}
+
+// Runs the discs in process on the given threads
+ModeResult RunInProcess(const std::string &mode, const std::vector<std::filesystem::path> &cues,
+                        const std::filesystem::path &out_dir, unsigned threads) {
+	ModeResult res;
+	res.mode = mode;
+	res.discs = cues.size();
+	std::vector<DiscTimes> times(cues.size());
+
+	uint64_t start = bench::NowNs();
+	ParallelFor(cues.size(), [&](size_t disc) {
+		CombineDisc(cues[disc], out_dir, times[disc]);
+	}, threads);
+	res.wall_ns = bench::NowNs() - start;
+
+	res.phases.assign(phase_count, std::vector<uint64_t>());
+	for(const DiscTimes &t : times) {
+		res.latencies.push_back(t.total);
+		for(size_t p = 0; p < phase_count; p++) res.phases[p].push_back(t.ns[p]);
+	}
+	return res;
+}
+} // namespace
+
+/*** Main *********************************************************************/
+int main(int argc, char *argv[]) {
+	try {
+		bench::Options opts = bench::ParseOptions(argc, argv,
+			"Usage: batchbench [--discs N] [--sectors N] [--process-discs N] [--dir DIR]\n"
+			"                  [--binary PATH] [--out FILE] [--filter TEXT]");
+
+		std::filesystem::path base = ".";
+		std::string binary;
+		unsigned discs = 10000, process_discs = 500;
+		uint32_t sectors = 4;
+		for(size_t e = 0; e < opts.extra.size(); e++) {
+			const std::string &flag = opts.extra[e];
+			bool has_value = (e + 1 < opts.extra.size());
+
+			if(flag == "--dir" && has_value) base = opts.extra[++e];
+			else if(flag == "--binary" && has_value) binary = opts.extra[++e];
+			else if(flag == "--discs" && has_value) discs = static_cast<unsigned>(std::stoul(opts.extra[++e]));
+			else if(flag == "--sectors" && has_value) sectors = static_cast<uint32_t>(std::stoul(opts.extra[++e]));
+			else if(flag == "--process-discs" && has_value)
+				process_discs = static_cast<unsigned>(std::stoul(opts.extra[++e]));
+			else throw std::runtime_error("Unknown option " + flag);
+		}
+		if(discs == 0 || sectors == 0) throw std::runtime_error("--discs and --sectors must be over 0");
+		if(!binary.empty()) binary = std::filesystem::absolute(binary).string();
+
+		bench::TempDir dir("batchbench", base);
+		std::filesystem::path library = dir.Path() / "library";
+
+		uint64_t gen_start = bench::NowNs();
+		std::vector<std::filesystem::path> cues = MakeLibrary(library, discs, sectors);
+		std::fprintf(stderr, "Generated %zu discs in %.2f s\n", cues.size(),
+		             static_cast<double>(bench::NowNs() - gen_start) / 1e9);
+
+		std::vector<ModeResult> results;
+		auto wanted = [&opts](const std::string &mode) {
+			return opts.filter.empty() || mode.find(opts.filter) != std::string::npos;
+		};
+		auto finish = [&results, &dir](ModeResult res) {
+			PrintMode(res);
+			results.push_back(std::move(res));
+			std::filesystem::remove_all(dir.Path() / "out");
+		};
+
+		if(wanted("serial")) finish(RunInProcess("serial", cues, dir.Path() / "out", 1));
+		if(wanted("batch")) {
+			finish(RunInProcess("batch", cues, dir.Path() / "out", DefaultThreadCount()));
+		}
+
+		// The process modes run the real program, on a sample of the discs
+		std::vector<std::filesystem::path> sample(cues.begin(),
+			cues.begin() + static_cast<std::ptrdiff_t>(std::min<size_t>(process_discs, cues.size())));
+		if(binary.empty()) {
+			std::fprintf(stderr, "No --binary given, skipping the process modes\n");
+		} else {
+			if(wanted("process-startup")) {
+				ModeResult res;
+				res.mode = "process-startup";
+				res.discs = sample.size();
+				for(size_t d = 0; d < sample.size(); d++) res.latencies.push_back(RunProcess({binary, "--help"}));
+				res.wall_ns = Sum(res.latencies);
+				finish(std::move(res));
+			}
+
+			if(wanted("process-per-disc")) {
+				ModeResult res;
+				res.mode = "process-per-disc";
+				res.discs = sample.size();
+				std::string out = (dir.Path() / "out").string();
+				for(const auto &cue : sample) res.latencies.push_back(RunProcess({binary, cue.string(), "-d", out}));
+				res.wall_ns = Sum(res.latencies);
+				finish(std::move(res));
+			}
+
+			if(wanted("process-batch")) {
+				ModeResult res;
+				res.mode = "process-batch";
+				res.discs = cues.size();
+				res.wall_ns = RunProcess({binary, library.string(), "-d", (dir.Path() / "out").string()});
+				finish(std::move(res));
+			}
+		}
+
+		bench::WriteJson(opts, ResultsToJson(results, discs, sectors));
+	} catch(const std::exception &e) {
+		std::cerr << "batchbench: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
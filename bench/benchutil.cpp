@@ -0,0 +1,111 @@
+/******************************************************************************
+* psx-comBINe benchmark harness
+* Shared by the programs in bench/. Times an operation until a minimum run
+* time has passed, counts the heap allocations it makes (operator new is
+* replaced in benchutil.cpp), and writes the results as JSON.
+* ADBeta (c)
+******************************************************************************/
+#include "benchutil.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <new>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+/*** Allocation Counting ******************************************************/
+namespace {
+std::atomic<uint64_t> alloc_count {0};
+std::atomic<uint64_t> alloc_bytes {0};
+
+void *CountedAlloc(std::size_t bytes) {
+	alloc_count.fetch_add(1, std::memory_order_relaxed);
+	alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+	void *ptr = std::malloc(bytes ? bytes : 1);
+	if(!ptr) throw std::bad_alloc();
+	return ptr;
+}
+} // namespace
+
+void *operator new(std::size_t bytes) { return CountedAlloc(bytes); }
+void *operator new[](std::size_t bytes) { return CountedAlloc(bytes); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+uint64_t bench::AllocCount() {
+	return alloc_count.load(std::memory_order_relaxed);
+}
+
+uint64_t bench::AllocBytes() {
+	return alloc_bytes.load(std::memory_order_relaxed);
+}
+
+/*** JSON *********************************************************************/
+void bench::WriteJson(const Options &opts, const std::string &json) {
+	if(opts.out.empty()) {
+		std::cout << json;
+		return;
+	}
+
+	std::ofstream file(opts.out, std::ios::out | std::ios::binary | std::ios::trunc);
+	file << json;
+	if(!file) throw std::runtime_error("Could not write " + opts.out);
+}
+
+/*** Temp Directory ***********************************************************/
+bench::TempDir::TempDir(const std::string &tag, const std::filesystem::path &base) {
+	std::filesystem::path parent = base.empty() ? std::filesystem::temp_directory_path() : base;
+
+#ifndef _WIN32
+	std::string name = tag + "-" + std::to_string(getpid());
+#else
+	std::string name = tag;
+#endif
+	for(int n = 0; ; n++) {
+		this->path = parent / (name + "-" + std::to_string(n));
+		if(std::filesystem::create_directories(this->path)) break;
+		if(n > 1000) throw std::runtime_error("Could not create a temp directory");
+	}
+}
+
+bench::TempDir::~TempDir() {
+	std::error_code ec;
+	std::filesystem::remove_all(this->path, ec);
+}
+
+/*** Options ******************************************************************/
+bench::Options bench::ParseOptions(int argc, char *argv[], const char *usage) {
+	Options opts;
+	for(int arg = 1; arg < argc; arg++) {
+		std::string flag = argv[arg];
+		bool has_value = (arg + 1 < argc);
+
+		if(flag == "--help" || flag == "-h") {
+			std::cout << usage << std::endl;
+			std::exit(EXIT_SUCCESS);
+		} else if(flag == "--min-time" && has_value) {
+			opts.min_ns = std::stoull(argv[++arg]) * 1000000;
+		} else if(flag == "--out" && has_value) {
+			opts.out = argv[++arg];
+		} else if(flag == "--filter" && has_value) {
+			opts.filter = argv[++arg];
+		} else if(flag == "--min-time" || flag == "--out" || flag == "--filter") {
+			throw std::runtime_error(flag + " needs a value");
+		} else {
+			opts.extra.push_back(flag);
+		}
+	}
+
+	return opts;
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+* psx-comBINe benchmark harness
+* Shared by the programs in bench/. Times an operation until a minimum run
+* time has passed, counts the heap allocations it makes (operator new is
+* replaced in benchutil.cpp), and writes the results as JSON.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_BENCHUTIL
+#define PSXCOMBINE_BENCHUTIL
+
+#include <filesystem>
+#include <string_view>
+#include <ostream>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace bench {
+/// @brief Heap allocations, and bytes allocated, since the program started
+uint64_t AllocCount();
+uint64_t AllocBytes();
+
+/// @brief Result of one measured operation
+struct Measurement {
+	uint64_t iterations    = 0;
+	double   ns_per_op     = 0;
+	double   allocs_per_op = 0;
+	double   bytes_per_op  = 0;   // Heap bytes allocated per op
+};
+
+/// @brief Monotonic nanoseconds, for timing
+inline uint64_t NowNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/// @brief Runs op in doubling batches until min_ns have passed, and returns
+/// the per-op cost of everything run
+template<typename Op>
+Measurement Measure(Op &&op, const uint64_t min_ns) {
+	uint64_t iterations = 0, elapsed = 0, allocs = 0, bytes = 0;
+	for(uint64_t batch = 1; elapsed < min_ns; batch *= 2) {
+		uint64_t a0 = AllocCount(), b0 = AllocBytes(), t0 = NowNs();
+		for(uint64_t i = 0; i < batch; i++) op();
+		elapsed += NowNs() - t0;
+		allocs += AllocCount() - a0;
+		bytes += AllocBytes() - b0;
+		iterations += batch;
+	}
+
+	return {iterations, static_cast<double>(elapsed) / iterations,
+	        static_cast<double>(allocs) / iterations, static_cast<double>(bytes) / iterations};
+}
+
+/// @brief Like Measure, for an op that changes its input: setup runs before
+/// every op, untimed, and each op is timed on its own
+template<typename Setup, typename Op>
+Measurement MeasureEach(Setup &&setup, Op &&op, const uint64_t min_ns) {
+	uint64_t iterations = 0, elapsed = 0, allocs = 0, bytes = 0;
+	while(elapsed < min_ns) {
+		setup();
+		uint64_t a0 = AllocCount(), b0 = AllocBytes(), t0 = NowNs();
+		op();
+		elapsed += NowNs() - t0;
+		allocs += AllocCount() - a0;
+		bytes += AllocBytes() - b0;
+		iterations++;
+	}
+
+	return {iterations, static_cast<double>(elapsed) / iterations,
+	        static_cast<double>(allocs) / iterations, static_cast<double>(bytes) / iterations};
+}
+
+/// @brief A uniquely named directory under the system temp directory, removed
+/// with everything in it when destroyed
+class TempDir {
+	public:
+	/// @param tag, part of the directory name, e.g. "cuebench"
+	/// @param base, directory to create it in, the system temp dir if empty
+	explicit TempDir(const std::string &tag, const std::filesystem::path &base = {});
+	~TempDir();
+
+	TempDir(const TempDir &) = delete;
+	TempDir &operator=(const TempDir &) = delete;
+
+	const std::filesystem::path &Path() const { return this->path; }
+
+	private:
+	std::filesystem::path path;
+};
+
+/// @brief Command line options every benchmark takes
+struct Options {
+	uint64_t    min_ns = 200000000;    // --min-time MS, per measurement
+	std::string out;                   // --out FILE, JSON to stdout if empty
+	std::string filter;                // --filter TEXT, only matching names
+	std::vector<std::string> extra;    // Anything else, for the benchmark
+};
+
+/// @brief Parses the common options. Throws std::runtime_error on bad ones.
+/// --help or -h prints the usage and exits
+Options ParseOptions(int argc, char *argv[], const char *usage);
+
+/// @brief Writes JSON to opts.out, or stdout if it is empty. Throws
+/// std::runtime_error if the file cannot be written
+void WriteJson(const Options &opts, const std::string &json);
+} // namespace bench
+
+#endif
@@ -0,0 +1,289 @@
+/******************************************************************************
+* psx-comBINe cue sheet microbenchmarks
+* Generates a synthetic corpus of cue sheets (1 to 99 TRACKs, up to 99 INDEXs
+* each, mixed TRACK types, REM heavy and malformed-but-repairable variants),
+* then measures ReadCueData, CopyTo, Combine, ToString and the timestamp
+* helpers in ns/op and allocations/op. Results are written as JSON.
+*
+* Usage: cuebench [--min-time MS] [--filter TEXT] [--out FILE]
+* ADBeta (c)
+******************************************************************************/
+#include "benchutil.hpp"
+#include "cuehandler.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*** Synthetic Corpus *********************************************************/
+namespace {
+// A kind of sheet to generate
+struct CorpusSpec {
+	const char *name;
+	unsigned    tracks;      // 1 to 99
+	unsigned    indexes;     // Per TRACK, 1 to 99. More than 1 starts at INDEX 00
+	bool        mixed;       // One FILE, every TRACK type in turn
+	bool        rem_heavy;   // Disc and TRACK text, REMs, FLAGS, ISRC, gaps
+	bool        malformed;   // BOM, CRLF, tabs, blank lines, unquoted names
+};
+
+const CorpusSpec corpus_specs[] = {
+	{"t1_i1_plain",       1,  1, false, false, false},
+	{"t10_i2_plain",     10,  2, false, false, false},
+	{"t99_i2_plain",     99,  2, false, false, false},
+	{"t99_i99_plain",    99, 99, false, false, false},
+	{"t25_i2_rem",       25,  2, false, true,  false},
+	{"t99_i2_rem",       99,  2, false, true,  false},
+	{"t25_i2_malformed", 25,  2, false, false, true},
+	{"t99_i2_malformed", 99,  2, false, false, true},
+	{"t99_i3_mixed",     99,  3, true,  false, false},
+	{"t99_i99_mixed",    99, 99, true,  true,  true},
+};
+
+// Multi-FILE sheets only use the 2352 byte types, as a FILE has to end on a
+// whole sector of the next FILE's TRACK. Mixed sheets are one FILE
+const char *const multi_types[] = {"MODE2/2352", "AUDIO", "MODE1/2352", "CDI/2352"};
+const char *const mixed_types[] = {"MODE2/2352", "AUDIO", "CDG", "MODE1/2048",
+                                   "MODE1/2352", "MODE2/2336", "CDI/2336", "CDI/2352"};
+
+// Sectors between two INDEXs, and after the last one of a TRACK
+constexpr uint32_t index_gap_sectors = 2;
+constexpr uint32_t track_tail_sectors = 150;
+
+std::string Msf(uint32_t sectors) {
+	char msf[16];
+	std::snprintf(msf, sizeof(msf), "%02u:%02u:%02u", (sectors / 75) / 60,
+	              (sectors / 75) % 60, sectors % 75);
+	return msf;
+}
+
+uint32_t TrackSectors(const CorpusSpec &spec) {
+	return (spec.indexes * index_gap_sectors) + track_tail_sectors;
+}
+
+// Returns the text of a synthetic cue sheet
+std::string MakeCue(const CorpusSpec &spec) {
+	const char *eol = spec.malformed ? "\r\n" : "\n";
+	const char *ind = spec.malformed ? "\t" : "  ";
+
+	std::string cue;
+	if(spec.malformed) cue.append("\xEF\xBB\xBF");
+	if(spec.rem_heavy) {
+		cue.append(std::string("REM GENRE \"Action\"") + eol + "REM DATE 1997" + eol +
+		           "REM DISCID 8C0B3E0B" + eol + "REM COMMENT \"synthetic disc\"" + eol +
+		           "CATALOG 0000000000000" + eol + "PERFORMER \"Bench Band\"" + eol +
+		           "TITLE \"Synthetic Disc\"" + eol);
+	}
+
+	uint32_t file_sector = 0;
+	for(unsigned t = 1; t <= spec.tracks; t++) {
+		char num[12];
+		std::snprintf(num, sizeof(num), "%02u", t);
+		const char *type = spec.mixed ? mixed_types[(t - 1) % 8] : multi_types[(t - 1) % 4];
+
+		// Multi-FILE sheets start a FILE for every TRACK
+		if(!spec.mixed || t == 1) {
+			std::string name = std::string("Bench_Track_") + num + ".bin";
+			if(spec.mixed) name = "Bench_Disc.bin";
+			cue.append(spec.malformed ? "FILE " + name + " BINARY  " + eol
+			                          : "FILE \"" + name + "\" BINARY" + eol);
+			file_sector = 0;
+		}
+		if(spec.malformed) cue.append(eol);
+
+		cue.append(std::string(ind) + "TRACK " + num + " " + type + eol);
+		if(spec.rem_heavy) {
+			std::string in2 = std::string(ind) + ind;
+			cue.append(in2 + "TITLE \"Track " + num + "\"" + eol + in2 + "PERFORMER \"Bench Band\"" +
+			           eol + in2 + "REM COMPOSER \"Someone\"" + eol + in2 + "REM REPLAYGAIN 0.5" +
+			           eol + in2 + "FLAGS DCP" + eol + in2 + "ISRC USABC9700001" + eol);
+			if(t > 1) cue.append(in2 + "PREGAP 00:02:00" + eol);
+		}
+
+		for(unsigned i = 0; i < spec.indexes; i++) {
+			unsigned id = (spec.indexes == 1) ? 1 : i;
+			std::snprintf(num, sizeof(num), "%02u", id);
+			cue.append(std::string(ind) + ind + "INDEX " + num + " " +
+			           Msf(file_sector + (i * index_gap_sectors)) + (spec.malformed ? " " : "") + eol);
+		}
+		if(spec.rem_heavy && t == spec.tracks) cue.append(std::string(ind) + ind + "POSTGAP 00:02:00" + eol);
+
+		file_sector += TrackSectors(spec);
+	}
+
+	return cue;
+}
+
+// Sets the FILE sizes a parsed synthetic sheet would have on disk
+void SetFileBytes(CueSheet &cs, const CorpusSpec &spec) {
+	for(auto &f_itr : cs.FileList) {
+		uint32_t bytes = 0;
+		for(const auto &t_itr : f_itr.TrackList) {
+			bytes += TrackSectors(spec) * CueSheet::GetSectorBytesInTrackType(t_itr.type);
+		}
+		f_itr.bytes = bytes;
+	}
+}
+
+/*** Results ******************************************************************/
+struct Result {
+	std::string op, corpus;
+	bench::Measurement m;
+};
+
+bool Wanted(const bench::Options &opts, const std::string &op, const std::string &corpus) {
+	return opts.filter.empty() || (op + "/" + corpus).find(opts.filter) != std::string::npos;
+}
+
+void Report(std::vector<Result> &results, const std::string &op, const std::string &corpus,
+            const bench::Measurement &m) {
+	std::fprintf(stderr, "%-22s %-18s %12.1f ns/op %9.1f allocs/op %12.0f B/op\n",
+	             op.c_str(), corpus.c_str(), m.ns_per_op, m.allocs_per_op, m.bytes_per_op);
+	results.push_back({op, corpus, m});
+}
+
+std::string ResultsToJson(const bench::Options &opts, const std::vector<Result> &results) {
+	std::string json = "{\n  \"benchmark\": \"cuebench\",\n";
+	json += "  \"compiler\": " + JsonString(__VERSION__) + ",\n";
+	json += "  \"min_time_ms\": " + std::to_string(opts.min_ns / 1000000) + ",\n";
+	json += "  \"results\": [\n";
+
+	for(size_t r = 0; r < results.size(); r++) {
+		const Result &res = results[r];
+		char nums[160];
+		std::snprintf(nums, sizeof(nums),
+		              "\"iterations\": %llu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+		              "\"bytes_per_op\": %.0f",
+		              static_cast<unsigned long long>(res.m.iterations), res.m.ns_per_op,
+		              res.m.allocs_per_op, res.m.bytes_per_op);
+		json += "    {\"op\": " + JsonString(res.op) + ", \"corpus\": " +
+		        JsonString(res.corpus) + ", " + nums + "}";
+		json += (r + 1 < results.size()) ? ",\n" : "\n";
+	}
+
+	json += "  ]\n}\n";
+	return json;
+}
+
+/*** Benchmarks ***************************************************************/
+void BenchSheets(const bench::Options &opts, std::vector<Result> &results) {
+	bench::TempDir dir("cuebench");
+
+	for(const CorpusSpec &spec : corpus_specs) {
+		std::filesystem::path cue_path = dir.Path() / (std::string(spec.name) + ".cue");
+		{
+			std::ofstream cue(cue_path, std::ios::out | std::ios::binary);
+			cue << MakeCue(spec);
+			if(!cue) throw std::runtime_error("Could not write the synthetic corpus");
+		}
+
+		CueFile cue_file(cue_path.string().c_str());
+		CueSheet sheet;
+		cue_file.ReadCueData(sheet);
+		SetFileBytes(sheet, spec);
+
+		if(Wanted(opts, "ReadCueData", spec.name)) {
+			CueSheet parsed;
+			Report(results, "ReadCueData", spec.name, bench::Measure([&]() {
+				parsed.Clear();
+				cue_file.ReadCueData(parsed);
+			}, opts.min_ns));
+		}
+
+		if(Wanted(opts, "CopyTo", spec.name)) {
+			CueSheet copy;
+			Report(results, "CopyTo", spec.name, bench::Measure([&]() {
+				sheet.CopyTo(copy);
+			}, opts.min_ns));
+		}
+
+		if(Wanted(opts, "Combine", spec.name)) {
+			CueSheet work;
+			Report(results, "Combine", spec.name, bench::MeasureEach(
+				[&]() { sheet.CopyTo(work); },
+				[&]() { work.Combine("Bench.bin", "BINARY"); }, opts.min_ns));
+		}
+
+		// Written gaps of one TRACK type would misalign the next in a mixed sheet
+		if(Wanted(opts, "Combine(write_gaps)", spec.name) && spec.rem_heavy && !spec.mixed) {
+			CueSheet work;
+			Report(results, "Combine(write_gaps)", spec.name, bench::MeasureEach(
+				[&]() { sheet.CopyTo(work); },
+				[&]() { work.Combine("Bench.bin", "BINARY", true); }, opts.min_ns));
+		}
+
+		if(Wanted(opts, "ToString", spec.name)) {
+			size_t sink = 0;
+			Report(results, "ToString", spec.name, bench::Measure([&]() {
+				sink += sheet.ToString().size();
+			}, opts.min_ns));
+			if(sink == 0) throw std::runtime_error("ToString returned nothing");
+		}
+	}
+}
+
+void BenchTimestamps(const bench::Options &opts, std::vector<Result> &results) {
+	// Every 17th sector up to 99:59:74, so all fields change
+	std::vector<uint32_t> sectors;
+	std::vector<std::string> stamps;
+	for(uint32_t s = 0; s < 100 * 60 * 75; s += 17) {
+		sectors.push_back(s);
+		stamps.push_back(Msf(s));
+	}
+
+	const CueSheet::TrackType type = CueSheet::TrackType::MODE2_2352;
+	const uint32_t sect_bytes = CueSheet::GetSectorBytesInTrackType(type);
+	size_t n = 0;
+	uint64_t sink = 0;
+	auto next = [&n, &sectors]() { n = (n + 1 == sectors.size()) ? 0 : n + 1; return n; };
+
+	if(Wanted(opts, "TimestampToSectors", "timestamps")) {
+		Report(results, "TimestampToSectors", "timestamps", bench::Measure([&]() {
+			sink += CueSheet::TimestampToSectors(stamps[next()]);
+		}, opts.min_ns));
+	}
+	if(Wanted(opts, "SectorsToTimestamp", "timestamps")) {
+		Report(results, "SectorsToTimestamp", "timestamps", bench::Measure([&]() {
+			sink += CueSheet::SectorsToTimestamp(sectors[next()]).size();
+		}, opts.min_ns));
+	}
+	if(Wanted(opts, "TimestampToBytes", "timestamps")) {
+		Report(results, "TimestampToBytes", "timestamps", bench::Measure([&]() {
+			sink += CueSheet::TimestampToBytes(stamps[next()], type);
+		}, opts.min_ns));
+	}
+	if(Wanted(opts, "BytesToTimestamp", "timestamps")) {
+		Report(results, "BytesToTimestamp", "timestamps", bench::Measure([&]() {
+			sink += CueSheet::BytesToTimestamp(sectors[next()] * sect_bytes, type).size();
+		}, opts.min_ns));
+	}
+
+	// Keeps the results live, so the calls are not optimised out
+	if(sink == 1) std::fprintf(stderr, "\n");
+}
+} // namespace
+
+/*** Main *********************************************************************/
+int main(int argc, char *argv[]) {
+	try {
+		bench::Options opts = bench::ParseOptions(argc, argv,
+			"Usage: cuebench [--min-time MS] [--filter TEXT] [--out FILE]");
+		if(!opts.extra.empty()) throw std::runtime_error("Unknown option " + opts.extra.front());
+
+		std::vector<Result> results;
+		BenchSheets(opts, results);
+		BenchTimestamps(opts, results);
+		bench::WriteJson(opts, ResultsToJson(opts, results));
+	} catch(const std::exception &e) {
+		std::cerr << "cuebench: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,405 @@
+/******************************************************************************
+* psx-comBINe dump throughput benchmark
+* Generates synthetic multi-bin discs (different TRACK counts and sizes, some
+* with sparse regions) on a local filesystem, then dumps each one to a single
+* .bin with every copy engine, and buffer size, with cold and warm caches:
+*   stream  - the DumpBinaryFiles() path: read through a buffer of the given
+*             size with CopyStreamToSink() into a RawOutputSink
+*   kernel  - ConcatenateFiles(), as used by --store: reflinks, then
+*             copy_file_range(), then a buffered copy
+* Every run is a forked child, so it has its own peak RSS and CPU time. The
+* syscall counts are the read and write calls from /proc/self/io, which do
+* not include copy_file_range() or reflinks.
+* Cold runs drop the page cache (/proc/sys/vm/drop_caches, as root) or, if
+* that fails, POSIX_FADV_DONTNEED the input FILEs.
+*
+* Usage: dumpbench [--dir DIR] [--runs N] [--scale F] [--warm-only] [--out FILE]
+*                  [--filter TEXT]
+* ADBeta (c)
+******************************************************************************/
+#include "benchutil.hpp"
+#include "cuehandler.hpp"
+#include "utils.hpp"
+#include "outputsink.hpp"
+#include "audiofile.hpp"
+#include "filecopy.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/*** Synthetic Discs **********************************************************/
+namespace {
+constexpr uint32_t sector_bytes = 2352;
+constexpr uint32_t mib = 1024 * 1024;
+
+// A kind of disc to generate. Sizes are before --scale
+struct DiscSpec {
+	const char *name;
+	unsigned    tracks;
+	uint32_t    track_mib;   // Size of each TRACK's FILE
+	bool        sparse;      // Every other MiB of each FILE is a hole
+};
+
+const DiscSpec disc_specs[] = {
+	{"1x48MiB",         1, 48, false},
+	{"4x12MiB",         4, 12, false},
+	{"24x2MiB",        24,  2, false},
+	{"8x6MiB_sparse",   8,  6, true},
+};
+
+// Copy buffer sizes of the stream engine, whole sectors. The first is the
+// size DumpBinaryFiles() uses
+const uint32_t stream_buffers[] = {sector_bytes * 16, sector_bytes * 64,
+                                   sector_bytes * 256, sector_bytes * 1024};
+
+// Fills a buffer with xorshift noise, so no layer can compress or dedupe it
+void FillNoise(std::vector<char> &buf, uint64_t &state) {
+	for(size_t i = 0; i + 8 <= buf.size(); i += 8) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		std::memcpy(&buf[i], &state, 8);
+	}
+}
+
+// Writes the .bin FILEs and .cue of a disc into dir, returns the .cue path
+std::filesystem::path MakeDisc(const DiscSpec &spec, double scale,
+                               const std::filesystem::path &dir) {
+	std::filesystem::create_directories(dir);
+	uint64_t file_bytes = static_cast<uint64_t>(spec.track_mib * scale * mib);
+	file_bytes -= file_bytes % sector_bytes;
+	if(file_bytes == 0) file_bytes = sector_bytes;
+
+	std::string cue;
+	std::vector<char> chunk(mib);
+	uint64_t state = 0x9E3779B97F4A7C15ULL ^ spec.tracks;
+	for(unsigned t = 1; t <= spec.tracks; t++) {
+		char num[12];
+		std::snprintf(num, sizeof(num), "%02u", t);
+		std::string name = std::string("Track ") + num + ".bin";
+		cue += "FILE \"" + name + "\" BINARY\n  TRACK " + num +
+		       (t == 1 ? " MODE2/2352\n" : " AUDIO\n") + "    INDEX 01 00:00:00\n";
+
+		std::ofstream bin(dir / name, std::ios::out | std::ios::binary | std::ios::trunc);
+		for(uint64_t pos = 0; pos < file_bytes; pos += chunk.size()) {
+			size_t take = static_cast<size_t>(std::min<uint64_t>(chunk.size(), file_bytes - pos));
+
+			// A hole is left by seeking over it, the end is always written
+			if(spec.sparse && (pos / mib) % 2 == 1 && pos + take < file_bytes) {
+				bin.seekp(static_cast<std::streamoff>(take), std::ios::cur);
+				continue;
+			}
+			FillNoise(chunk, state);
+			bin.write(chunk.data(), static_cast<std::streamsize>(take));
+		}
+		if(!bin) throw std::runtime_error("Could not write a synthetic disc");
+	}
+
+	std::filesystem::path cue_path = dir / "disc.cue";
+	std::ofstream cue_file(cue_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	cue_file << cue;
+	if(!cue_file) throw std::runtime_error("Could not write a synthetic disc");
+	return cue_path;
+}
+
+/*** Measured Runs ************************************************************/
+// What a child sends back about its run
+struct RunStats {
+	bool     ok;
+	char     error[120];
+	uint64_t bytes;
+	double   wall_s;
+	double   cpu_s;
+	uint64_t read_calls, write_calls;
+	long     peak_rss_kib;   // Filled in by the parent, from wait4()
+};
+
+// Reads the syscr and syscw counters of /proc/self/io (0 if unavailable)
+void ReadIoCalls(uint64_t &reads, uint64_t &writes) {
+	reads = writes = 0;
+	std::ifstream io("/proc/self/io");
+	std::string key;
+	uint64_t value;
+	while(io >> key >> value) {
+		if(key == "syscr:") reads = value;
+		if(key == "syscw:") writes = value;
+	}
+}
+
+double CpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+	       static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Dumps a disc the way DumpBinaryFiles() does, or with ConcatenateFiles()
+// when buffer_bytes is 0. Returns the bytes written
+uint64_t DumpDisc(const std::filesystem::path &cue_path, const std::filesystem::path &out_path,
+                  uint32_t buffer_bytes) {
+	CueFile cue(cue_path.string().c_str());
+	CueSheet sheet;
+	cue.ReadCueData(sheet);
+	cue.GetCueFileSizes(sheet);
+	std::filesystem::path dir = cue_path.parent_path();
+
+	if(buffer_bytes == 0) {
+		std::vector<std::filesystem::path> srcs;
+		for(const auto &f_itr : sheet.FileList) srcs.push_back(dir / f_itr.filename);
+		ConcatenateFiles(srcs, out_path);
+		return std::filesystem::file_size(out_path);
+	}
+
+	RawOutputSink sink(out_path);
+	std::vector<char> buffer(buffer_bytes);
+	uint64_t total = 0;
+	for(const auto &f_itr : sheet.FileList) {
+		std::filesystem::path bin_path = dir / f_itr.filename;
+		AudioLayout layout = GetAudioLayout(bin_path, f_itr.filetype);
+
+		std::ifstream in(bin_path, std::ios::in | std::ios::binary);
+		if(!in) throw std::runtime_error("Input binary file could not be opened");
+		in.seekg(static_cast<std::streamoff>(layout.data_offset), std::ios::beg);
+		total += CopyStreamToSink(in, layout.data_bytes, layout.swap, sink, buffer.data(),
+		                          buffer.size());
+	}
+	sink.Close();
+	return total;
+}
+
+// Drops the cached pages of a disc. Returns how it was done
+std::string DropCaches(const std::filesystem::path &disc_dir) {
+	sync();
+	{
+		std::ofstream drop("/proc/sys/vm/drop_caches");
+		drop << "1\n";
+		drop.flush();
+		if(drop) return "drop_caches";
+	}
+
+	for(const auto &entry : std::filesystem::directory_iterator(disc_dir)) {
+		int fd = open(entry.path().c_str(), O_RDONLY);
+		if(fd < 0) continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+	return "fadvise";
+}
+
+// Runs one dump in a child process and returns its stats
+RunStats MeasureRun(const std::filesystem::path &cue_path, const std::filesystem::path &out_path,
+                    uint32_t buffer_bytes) {
+	int fds[2];
+	if(pipe(fds) != 0) throw std::runtime_error("pipe() failed");
+
+	pid_t pid = fork();
+	if(pid < 0) throw std::runtime_error("fork() failed");
+	if(pid == 0) {
+		close(fds[0]);
+		RunStats stats = {};
+		try {
+			uint64_t r0, w0, r1, w1;
+			ReadIoCalls(r0, w0);
+			double cpu0 = CpuSeconds();
+			uint64_t t0 = bench::NowNs();
+
+			stats.bytes = DumpDisc(cue_path, out_path, buffer_bytes);
+
+			stats.wall_s = static_cast<double>(bench::NowNs() - t0) / 1e9;
+			stats.cpu_s = CpuSeconds() - cpu0;
+			ReadIoCalls(r1, w1);
+			stats.read_calls = r1 - r0;
+			stats.write_calls = w1 - w0;
+			stats.ok = true;
+		} catch(const std::exception &e) {
+			std::snprintf(stats.error, sizeof(stats.error), "%s", e.what());
+		}
+
+		ssize_t sent = write(fds[1], &stats, sizeof(stats));
+		_exit(sent == static_cast<ssize_t>(sizeof(stats)) ? 0 : 1);
+	}
+
+	close(fds[1]);
+	RunStats stats = {};
+	ssize_t got = read(fds[0], &stats, sizeof(stats));
+	close(fds[0]);
+
+	int status = 0;
+	struct rusage usage;
+	wait4(pid, &status, 0, &usage);
+	if(got != static_cast<ssize_t>(sizeof(stats)) || !WIFEXITED(status))
+		throw std::runtime_error("Benchmark child process failed");
+	if(!stats.ok) throw std::runtime_error(stats.error);
+
+	stats.peak_rss_kib = usage.ru_maxrss;
+	return stats;
+}
+
+/*** Results ******************************************************************/
+struct Case {
+	std::string disc, engine, cache, cache_method;
+	uint32_t buffer_bytes;
+	uint64_t bytes;
+	std::vector<RunStats> runs;
+};
+
+double MibPerSec(const Case &c, const RunStats &run) {
+	return run.wall_s > 0 ? (static_cast<double>(c.bytes) / mib) / run.wall_s : 0;
+}
+
+// The run with the median wall time
+const RunStats &MedianRun(const Case &c) {
+	std::vector<const RunStats *> sorted;
+	for(const RunStats &run : c.runs) sorted.push_back(&run);
+	std::sort(sorted.begin(), sorted.end(),
+	          [](const RunStats *a, const RunStats *b) { return a->wall_s < b->wall_s; });
+	return *sorted[sorted.size() / 2];
+}
+
+void PrintTable(const std::vector<Case> &cases) {
+	std::fprintf(stderr, "\n%-16s %-7s %8s %-5s %10s %10s %10s %9s %9s %9s\n", "disc", "engine",
+	             "buffer", "cache", "MiB/s", "min MiB/s", "cpu s", "reads", "writes", "rss MiB");
+	for(const Case &c : cases) {
+		const RunStats &med = MedianRun(c);
+		double worst = MibPerSec(c, med);
+		for(const RunStats &run : c.runs) worst = std::min(worst, MibPerSec(c, run));
+
+		std::string buffer = c.buffer_bytes ? std::to_string(c.buffer_bytes / 1024) + "K" : "-";
+		std::fprintf(stderr, "%-16s %-7s %8s %-5s %10.1f %10.1f %10.3f %9llu %9llu %9.1f\n",
+		             c.disc.c_str(), c.engine.c_str(), buffer.c_str(), c.cache.c_str(),
+		             MibPerSec(c, med), worst, med.cpu_s,
+		             static_cast<unsigned long long>(med.read_calls),
+		             static_cast<unsigned long long>(med.write_calls),
+		             static_cast<double>(med.peak_rss_kib) / 1024.0);
+	}
+}
+
+std::string CasesToJson(const std::vector<Case> &cases, unsigned runs, double scale) {
+	std::string json = "{\n  \"benchmark\": \"dumpbench\",\n";
+	json += "  \"compiler\": " + JsonString(__VERSION__) + ",\n";
+	json += "  \"runs\": " + std::to_string(runs) + ",\n";
+	json += "  \"scale\": " + std::to_string(scale) + ",\n";
+	json += "  \"results\": [\n";
+
+	for(size_t i = 0; i < cases.size(); i++) {
+		const Case &c = cases[i];
+		const RunStats &med = MedianRun(c);
+
+		json += "    {\"disc\": " + JsonString(c.disc) + ", \"engine\": " +
+		        JsonString(c.engine) + ", \"buffer_bytes\": " +
+		        std::to_string(c.buffer_bytes) + ", \"cache\": " + JsonString(c.cache) +
+		        ", \"cache_method\": " + JsonString(c.cache_method) + ", \"bytes\": " +
+		        std::to_string(c.bytes) + ",\n";
+
+		char nums[256];
+		std::snprintf(nums, sizeof(nums),
+		              "     \"mib_per_s\": %.1f, \"wall_s\": %.4f, \"cpu_s\": %.4f, "
+		              "\"read_syscalls\": %llu, \"write_syscalls\": %llu, \"peak_rss_kib\": %ld,\n",
+		              MibPerSec(c, med), med.wall_s, med.cpu_s,
+		              static_cast<unsigned long long>(med.read_calls),
+		              static_cast<unsigned long long>(med.write_calls), med.peak_rss_kib);
+		json += nums;
+
+		json += "     \"runs_mib_per_s\": [";
+		for(size_t r = 0; r < c.runs.size(); r++) {
+			std::snprintf(nums, sizeof(nums), "%s%.1f", r ? ", " : "", MibPerSec(c, c.runs[r]));
+			json += nums;
+		}
+		json += (i + 1 < cases.size()) ? "]},\n" : "]}\n";
+	}
+
+	json += "  ]\n}\n";
+	return json;
+}
+} // namespace
+
+/*** Main *********************************************************************/
+int main(int argc, char *argv[]) {
+	try {
+		bench::Options opts = bench::ParseOptions(argc, argv,
+			"Usage: dumpbench [--dir DIR] [--runs N] [--scale F] [--warm-only] [--out FILE]\n"
+			"                 [--filter TEXT]");
+
+		std::filesystem::path base = ".";
+		unsigned runs = 3;
+		double scale = 1.0;
+		bool cold = true;
+		for(size_t e = 0; e < opts.extra.size(); e++) {
+			const std::string &flag = opts.extra[e];
+			bool has_value = (e + 1 < opts.extra.size());
+
+			if(flag == "--dir" && has_value) base = opts.extra[++e];
+			else if(flag == "--runs" && has_value) runs = static_cast<unsigned>(std::stoul(opts.extra[++e]));
+			else if(flag == "--scale" && has_value) scale = std::stod(opts.extra[++e]);
+			else if(flag == "--warm-only") cold = false;
+			else throw std::runtime_error("Unknown option " + flag);
+		}
+		if(runs == 0 || scale <= 0) throw std::runtime_error("--runs and --scale must be over 0");
+
+		bench::TempDir dir("dumpbench", base);
+		std::filesystem::path out_path = dir.Path() / "out.bin";
+		std::vector<Case> cases;
+
+		for(const DiscSpec &spec : disc_specs) {
+			std::filesystem::path disc_dir = dir.Path() / spec.name;
+			std::filesystem::path cue_path;
+
+			// Engines are the stream buffer sizes, then the kernel copy (0)
+			std::vector<uint32_t> engines(std::begin(stream_buffers), std::end(stream_buffers));
+			engines.push_back(0);
+
+			for(int warm = cold ? 0 : 1; warm <= 1; warm++) {
+				for(uint32_t buffer_bytes : engines) {
+					Case c;
+					c.disc = spec.name;
+					c.engine = buffer_bytes ? "stream" : "kernel";
+					c.cache = warm ? "warm" : "cold";
+					c.cache_method = warm ? "none" : "";
+					c.buffer_bytes = buffer_bytes;
+					c.bytes = 0;
+
+					std::string name = c.disc + "/" + c.engine + "/" + std::to_string(buffer_bytes) +
+					                   "/" + c.cache;
+					if(!opts.filter.empty() && name.find(opts.filter) == std::string::npos) continue;
+					if(cue_path.empty()) cue_path = MakeDisc(spec, scale, disc_dir);
+
+					// A warm cache is primed by one untimed run
+					if(warm) MeasureRun(cue_path, out_path, buffer_bytes);
+					for(unsigned r = 0; r < runs; r++) {
+						std::filesystem::remove(out_path);
+						if(!warm) c.cache_method = DropCaches(disc_dir);
+						else sync();
+
+						c.runs.push_back(MeasureRun(cue_path, out_path, buffer_bytes));
+						c.bytes = c.runs.back().bytes;
+					}
+
+					std::fprintf(stderr, "%-48s %8.1f MiB/s\n", name.c_str(), MibPerSec(c, MedianRun(c)));
+					cases.push_back(std::move(c));
+				}
+			}
+			std::filesystem::remove_all(disc_dir);
+		}
+
+		PrintTable(cases);
+		bench::WriteJson(opts, CasesToJson(cases, runs, scale));
+	} catch(const std::exception &e) {
+		std::cerr << "dumpbench: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
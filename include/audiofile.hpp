@@ -0,0 +1,38 @@
+/******************************************************************************
+* psx-comBINe audio FILE handling
+* Finds the PCM payload inside WAVE (RIFF) and AIFF/AIFC FILEs, and byte
+* swaps big-endian (AIFF, MOTOROLA) samples into the little-endian order
+* of a BINARY CD image.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_AUDIOFILE
+#define PSXCOMBINE_AUDIOFILE
+
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Where the CD audio samples are in a FILE, and how they are stored
+struct AudioLayout {
+	uint64_t data_offset;  // First PCM byte in the file
+	uint64_t data_bytes;   // PCM bytes, headers and trailing chunks excluded
+	bool     swap;         // Samples are big-endian, and need byte swapping
+};
+
+/// @brief Reads the layout of a cue FILE from its type and, for WAVE and
+/// AIFF, its header. BINARY and MOTOROLA FILEs are all payload.
+/// Throws std::runtime_error for unreadable files, unsupported types, and
+/// audio that is not 44.1kHz 16-bit stereo PCM
+/// @param path, the FILE on disk
+/// @param filetype, the cue FILE type, e.g. "WAVE"
+/// @return the file's AudioLayout
+AudioLayout GetAudioLayout(const std::filesystem::path &path, const std::string &filetype);
+
+/// @brief Swaps the bytes of every 16-bit sample in a buffer, in place
+/// @param data, buffer of samples
+/// @param len, bytes in the buffer. A trailing odd byte is left alone
+/// @return none
+void SwapAudioBytes(uint8_t *data, size_t len);
+
+#endif
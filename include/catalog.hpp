@@ -0,0 +1,170 @@
+/******************************************************************************
+* psx-comBINe library catalog
+* A binary file describing every disc of a library: the parsed cue sheet as
+* flat FILE/TRACK/INDEX tables, each FILE's size, mtime and inode (and SHA-1,
+* once hashed), and the game ID from SYSTEM.CNF. The file is memory-mapped,
+* so opening it and querying it costs no parsing. Updating it only lists the
+* directories, and parses the .cue files, that changed since the last scan.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_CATALOG
+#define PSXCOMBINE_CATALOG
+
+#include "cuehandler.hpp"
+
+#include <string_view>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*** Catalog File Records *****************************************************/
+// The records are stored as-is, in host byte order, each table 8 byte aligned.
+// Strings are offsets into a table of NUL terminated strings. Paths are
+// relative to the library root, with / separators
+namespace catalog {
+constexpr uint32_t version   = 1;
+constexpr uint32_t no_string = 0xFFFFFFFF;
+
+struct Header {
+	char     magic[8];        // "PSXCAT\0\0"
+	uint32_t version;
+	uint32_t byte_order;      // 0x01020304, as written
+	uint32_t root;            // String, the library directory
+	uint32_t dir_count, disc_count, file_count, track_count, index_count, child_count;
+	uint32_t string_bytes;
+	uint64_t dirs, discs, files, tracks, indexes, children, strings;  // Table offsets
+};
+
+// A directory. Its subdirectories and .cue files are kept so an unchanged
+// directory does not need listing again
+struct DirRecord {
+	uint32_t path;                      // "" for the root
+	uint32_t first_child, child_count;  // Indexes into the children table
+	uint32_t first_disc, disc_count;    // The .cue files directly inside, by name
+	uint32_t reserved;
+	int64_t  mtime;                     // ns
+};
+
+struct DiscRecord {
+	uint32_t cue;                       // Path of the .cue
+	uint32_t game_id;                   // e.g. "SLUS-00594", no_string if unknown
+	uint32_t error;                     // Why the .cue did not parse, or no_string
+	uint32_t first_file, file_count;
+	uint32_t reserved;
+	int64_t  mtime;                     // Of the .cue, ns
+	uint64_t size;                      // Of the .cue
+};
+
+struct FileRecord {
+	static constexpr uint32_t found  = 1 << 0;
+	static constexpr uint32_t hashed = 1 << 1;
+
+	uint32_t name, type;                // As written in the .cue
+	uint32_t first_track, track_count;
+	uint32_t flags;
+	uint8_t  sha1[20];                  // Of the whole file, if hashed
+	uint64_t size;                      // On disk
+	uint64_t data_bytes;                // Combined bytes, PCM only for WAVE/AIFF
+	int64_t  mtime;                     // ns
+	uint64_t inode;                     // 0 where there are none
+};
+
+struct TrackRecord {
+	uint16_t id, type;                  // type is a CueSheet::TrackType
+	uint32_t pregap, postgap;           // Sectors
+	uint32_t first_index, index_count;
+};
+
+struct IndexRecord {
+	uint16_t id, reserved;
+	uint32_t sector;
+};
+} // namespace catalog
+
+/*** Catalog ******************************************************************/
+// Throws std::runtime_error for missing, foreign or damaged catalog files
+class Catalog {
+	public:
+	// A run of records in the mapped file
+	template<typename T>
+	struct Table {
+		const T *items;
+		size_t   count;
+
+		const T *begin() const             { return this->items; }
+		const T *end() const               { return this->items + this->count; }
+		size_t size() const                { return this->count; }
+		const T &operator[](size_t i) const { return this->items[i]; }
+	};
+
+	// What an Update() had to do
+	struct UpdateStats {
+		size_t discs = 0, dirs = 0;
+		size_t dirs_listed = 0;    // Directories that changed, or were new
+		size_t cues_parsed = 0;    // .cue files that changed, or were new
+		size_t files_statted = 0;  // Every FILE, a .bin can change in place
+		size_t files_hashed = 0;
+		size_t game_ids = 0;
+		double seconds = 0;
+	};
+
+	/// @brief Maps a catalog file, and checks every table is inside it
+	/// @param file, catalog written by Update()
+	explicit Catalog(const std::filesystem::path &file);
+	~Catalog();
+
+	Catalog(const Catalog &) = delete;
+	Catalog &operator=(const Catalog &) = delete;
+
+	/// @brief Scans a library into a catalog file, reusing everything the old
+	/// catalog there knows about directories and .cue files whose mtime has not
+	/// changed. The new catalog is written beside the old one, then renamed
+	/// over it. Every FILE is statted, and a disc with a changed FILE is
+	/// parsed again
+	/// @param file, catalog file, created if missing or for another library
+	/// @param root, library directory
+	/// @param hash, SHA-1 any FILEs that have no hash yet, or that changed
+	/// @return what was scanned, and what was reused
+	static UpdateStats Update(const std::filesystem::path &file,
+	                          const std::filesystem::path &root, bool hash = false);
+
+	/// @brief Returns the library directory the catalog describes
+	std::string_view Root() const;
+
+	/// @brief Returns a string from the string table, empty for no_string
+	std::string_view String(uint32_t offset) const;
+
+	/// @brief Tables of the whole catalog, and of a single record's children
+	Table<catalog::DirRecord>   Dirs() const;
+	Table<catalog::DiscRecord>  Discs() const;
+	Table<catalog::DiscRecord>  Discs(const catalog::DirRecord &dir) const;
+	Table<uint32_t>             Children(const catalog::DirRecord &dir) const;
+	Table<catalog::FileRecord>  Files(const catalog::DiscRecord &disc) const;
+	Table<catalog::TrackRecord> Tracks(const catalog::FileRecord &file) const;
+	Table<catalog::IndexRecord> Indexes(const catalog::TrackRecord &track) const;
+
+	/// @brief Finds a directory or .cue by its path relative to the root
+	/// @return pointer to the record, nullptr if it is not in the catalog
+	const catalog::DirRecord  *FindDir(std::string_view path) const;
+	const catalog::DiscRecord *FindDisc(std::string_view cue) const;
+
+	/// @brief Rebuilds a disc's cue sheet, with FILE sizes filled in. Text
+	/// commands (REM, TITLE etc) are not kept in the catalog
+	/// @param disc, disc of this catalog
+	/// @param cs, CueSheet to fill. Cleared first
+	void GetSheet(const catalog::DiscRecord &disc, CueSheet &cs) const;
+
+	private:
+	const char              *data;
+	size_t                   size;
+	std::vector<char>        buffer;   // The file's contents, where it is not mapped
+	const catalog::Header   *header;
+
+	template<typename T>
+	Table<T> GetTable(uint64_t offset, uint32_t first, uint32_t count) const;
+	void Validate() const;
+};
+
+#endif
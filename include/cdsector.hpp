@@ -0,0 +1,98 @@
+/******************************************************************************
+* psx-comBINe CD-ROM sector helpers
+* Sector layout constants, EDC and ECC (P/Q parity) generation & verification
+* for raw 2352 byte sectors, as described by ECMA-130, and user data
+* extraction.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_CDSECTOR
+#define PSXCOMBINE_CDSECTOR
+
+#include <cstdint>
+#include <cstddef>
+
+namespace cdsector {
+// Raw sector, subcode and CHD-style frame sizes
+constexpr size_t raw_bytes     = 2352;
+constexpr size_t subcode_bytes = 96;
+constexpr size_t frame_bytes   = raw_bytes + subcode_bytes;
+
+// Sector field offsets
+constexpr size_t sync_bytes     = 12;
+constexpr size_t header_offset  = 12;
+constexpr size_t mode_offset    = 15;
+constexpr size_t subhead_offset = 16;
+constexpr size_t ecc_p_offset   = 0x81C;
+constexpr size_t ecc_q_offset   = 0x8C8;
+constexpr size_t ecc_p_bytes    = 172;
+constexpr size_t ecc_q_bytes    = 104;
+
+// User data (cooked ISO) sector size, and where it starts in each layout
+constexpr size_t user_bytes        = 2048;
+constexpr size_t user_offset_mode1 = 16;   // Raw Mode 1, after the header
+constexpr size_t user_offset_mode2 = 24;   // Raw Mode 2 XA, after the subheader
+constexpr size_t user_offset_2336  = 8;    // 2336 byte Mode 2, after the subheader
+
+// Sync pattern found at the start of every raw data sector
+extern const uint8_t sync_pattern[sync_bytes];
+
+/// @brief Checks if a raw sector starts with the data sync pattern
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return true if the sync pattern is present
+bool HasSync(const uint8_t *sector);
+
+/// @brief Computes the CD-ROM EDC (CRC32, poly 0xD8018001) over a buffer
+/// @param edc, running EDC value, 0 to start
+/// @param data, pointer to the data
+/// @param len, number of bytes
+/// @return updated EDC value
+uint32_t ComputeEdc(uint32_t edc, const uint8_t *data, size_t len);
+
+/// @brief Computes the P and Q parity of a raw sector into the passed buffers
+/// @param sector, pointer to a 2352 byte raw sector
+/// @param zero_address, treat the 4 header bytes as zero (Mode 2 Form 1)
+/// @param p_out, 172 byte buffer for P parity
+/// @param q_out, 104 byte buffer for Q parity
+/// @return none
+void ComputeEcc(const uint8_t *sector, bool zero_address,
+                uint8_t *p_out, uint8_t *q_out);
+
+/// @brief Checks the ECC of a Mode 1 raw sector (header included in parity)
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return true if both P and Q parity match
+bool VerifyEcc(const uint8_t *sector);
+
+/// @brief Regenerates the ECC of a Mode 1 raw sector in place
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return none
+void GenerateEcc(uint8_t *sector);
+
+/// @brief Zeroes the P and Q parity bytes of a raw sector
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return none
+void ClearEcc(uint8_t *sector);
+
+/// @brief Checks the stored EDC of a raw Mode 1 or Mode 2 sector
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return true if the sector has a sync pattern and its EDC matches
+bool VerifyEdc(const uint8_t *sector);
+
+/// @brief Regenerates the EDC (and ECC for Form 1) of a raw Mode 1 or Mode 2
+/// sector in place. Sectors without a sync pattern are left untouched
+/// @param sector, pointer to a 2352 byte raw sector
+/// @return true if the sector was recognised and regenerated
+bool RegenerateEdcEcc(uint8_t *sector);
+
+/// @brief Copies the 2048 byte user data out of a batch of sectors. For raw
+/// sectors the mode is read from each sector's header (Mode 2 uses offset 24,
+/// anything else offset 16)
+/// @param src, pointer to the first sector
+/// @param sectors, number of sectors
+/// @param sector_bytes, size of each sector: 2352, 2336 or 2048
+/// @param dest, buffer of sectors * 2048 bytes
+/// @return none
+void ExtractUserData(const uint8_t *src, size_t sectors, size_t sector_bytes,
+                     uint8_t *dest);
+} // namespace cdsector
+
+#endif
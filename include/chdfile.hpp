@@ -0,0 +1,183 @@
+/******************************************************************************
+* psx-comBINe CHD (MAME Compressed Hunks of Data) support
+* Writes CD-ROM CHD v5 images from a combined CueSheet, and reads them back
+* as a CueSheet plus binary stream. Hunks are (de)compressed in parallel and
+* handled in order.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_CHDFILE
+#define PSXCOMBINE_CHDFILE
+
+#include "cuehandler.hpp"
+#include "outputsink.hpp"
+#include "workpool.hpp"
+#include "sha1.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+
+namespace chd {
+// Frames (2352 sector + 96 subcode) per hunk, as used by chdman for CDs
+constexpr uint32_t frames_per_hunk = 8;
+// Tracks are padded to a multiple of this many frames
+constexpr uint32_t track_padding   = 4;
+
+// v5 map compression types
+enum Compression : uint8_t {
+	Type0 = 0, Type1, Type2, Type3, None, Self, Parent,
+	RleSmall, RleLarge, Self0, Self1, ParentSelf, Parent0, Parent1
+};
+
+// A CD track as described by CHD CHT2 metadata
+struct TrackMeta {
+	CueSheet::TrackType type;
+	uint32_t frames;       // Frames in the track, including any data pregap
+	uint32_t pregap;       // Pregap frames stored at the start of the track
+	bool     pregap_data;  // true if the pregap frames are stored ("V" type)
+	uint32_t postgap;      // Postgap frames (not stored)
+};
+
+/// @brief Converts a TrackType to the CHD track type string, e.g. MODE2_RAW
+/// @return CHD type string. Empty string on failure
+std::string TrackTypeToChd(const CueSheet::TrackType type);
+
+/// @brief Converts a CHD track type string back to a TrackType
+/// @return TrackType, ::Invalid if it has no cue equivalent
+CueSheet::TrackType ChdToTrackType(const std::string &type, const std::string &subtype);
+
+/// @brief Computes the CRC-16/CCITT used by CHD hunk maps
+uint16_t Crc16(const uint8_t *data, size_t len);
+
+/// @brief Returns the padded frame count of a track
+inline uint32_t PaddedFrames(const uint32_t frames) {
+	return ((frames + track_padding - 1) / track_padding) * track_padding;
+}
+} // namespace chd
+
+/*** CHD Writer ***************************************************************/
+// Output sink that turns the combined binary stream into a CD CHD v5 image.
+// The track layout is taken from the combined (single FILE) CueSheet.
+class ChdWriter : public OutputSink {
+	public:
+	/// @param path, output .chd path
+	/// @param combined, combined cue sheet describing the binary stream
+	/// @param threads, compression threads. 0 uses all hardware threads
+	ChdWriter(const std::filesystem::path &path, const CueSheet &combined,
+	          unsigned threads = 0);
+	~ChdWriter() override;
+
+	void Write(const char *data, size_t len) override;
+	void Close() override;
+
+	private:
+	// Layout of each track in the input stream
+	struct InputTrack {
+		chd::TrackMeta meta;
+		uint16_t       sector_bytes;
+		bool           swap_audio;
+	};
+
+	// Map entry for each compressed hunk
+	struct MapEntry {
+		uint8_t  compression;
+		uint32_t length;
+		uint64_t offset;
+		uint16_t crc;
+	};
+
+	std::fstream            file;
+	std::vector<InputTrack> tracks;
+	std::vector<MapEntry>   map;
+	uint64_t                logical_bytes;
+	uint64_t                next_hunk_offset;
+
+	// Stream position
+	size_t                  track_idx;
+	uint32_t                track_frame;     // Frames done in current track
+	size_t                  sector_fill;     // Bytes in the current frame
+	std::vector<uint8_t>    hunk;            // Hunk being assembled
+	size_t                  hunk_frames;     // Frames in the current hunk
+
+	Sha1                    raw_sha1;
+	std::vector<uint8_t>    metadata;        // Serialised metadata entries
+	std::vector<uint8_t>    metadata_hashes; // Sorted tag + SHA1 per entry
+	std::unique_ptr<OrderedPipeline> pipeline;
+	bool                    closed;
+
+	void BuildMetadata();
+	void FinishFrame();
+	void SkipFinishedTracks();
+	void SubmitHunk();
+	void WriteHunk(std::vector<uint8_t> &compressed);
+	void WriteMap();
+	void WriteHeader(uint64_t map_offset);
+};
+
+/*** CHD Reader ***************************************************************/
+// Reads a CD CHD v5 image as a single FILE cue sheet and its .bin stream.
+// Throws std::runtime_error for unsupported or corrupt files.
+class ChdReader {
+	public:
+	// Receives the unpacked .bin stream, in order
+	using StreamCallback = std::function<void(const char *data, size_t len)>;
+
+	ChdReader(const std::filesystem::path &path);
+
+	/// @brief Builds a single FILE CueSheet from the CHD track metadata
+	/// @param cs, CueSheet to fill. Cleared first
+	/// @param bin_name, FILE name to use in the sheet
+	void GetCueSheet(CueSheet &cs, const std::string &bin_name) const;
+
+	/// @brief Returns the number of bytes in the unpacked .bin stream
+	uint64_t BinaryBytes() const;
+
+	/// @brief Decompresses every hunk (in parallel) and streams the .bin data
+	/// @param out, callback receiving the data in order
+	/// @param threads, decompression threads. 0 uses all hardware threads
+	void Stream(const StreamCallback &out, unsigned threads = 0);
+
+	/// @brief Reads and decompresses a single hunk. Thread safe
+	/// @param hunk, hunk number
+	/// @param out, buffer filled with the hunk's frames
+	void ReadHunk(uint32_t hunk, std::vector<uint8_t> &out);
+
+	private:
+	// Track layout in CHD frames
+	struct InputTrack {
+		chd::TrackMeta meta;
+		uint32_t       start_frame;
+		uint16_t       sector_bytes;
+		bool           swap_audio;
+	};
+
+	struct MapEntry {
+		uint8_t  compression;
+		uint32_t length;
+		uint64_t offset;
+		uint16_t crc;
+	};
+
+	std::fstream            file;
+	std::mutex              file_mtx;
+	uint32_t                compressors[4];
+	uint64_t                logical_bytes;
+	uint32_t                hunk_bytes;
+	uint32_t                unit_bytes;
+	std::vector<MapEntry>   map;
+	std::vector<InputTrack> tracks;
+
+	void ReadAt(uint64_t offset, uint8_t *dest, size_t len);
+	void ReadMap(uint64_t map_offset);
+	void ReadMetadata(uint64_t meta_offset);
+	void Decompress(uint32_t codec, const uint8_t *src, size_t len, uint8_t *dest);
+	void ExtractSectors(uint32_t hunk, const std::vector<uint8_t> &frames,
+	                    std::vector<uint8_t> &out) const;
+};
+
+#endif
@@ -15,10 +15,13 @@
 #define CUEHANDLER_H
 
 #include <string>
-#include <list>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <fstream>
 #include <cstdint>
 #include <limits>
+#include <utility>
 
 /*** Cue File/Sheet Exceptions ************************************************/
 class CueException : public std::exception {
@@ -35,7 +38,9 @@ class CueException : public std::exception {
 //Exceptions
 extern CueException file_invalid;
 extern CueException internal_file_invalid;
+extern CueException internal_file_bad_audio;
 extern CueException line_invalid;
+extern CueException command_invalid;
 
 extern CueException file_push_null_input;
 extern CueException track_push_null_input;
@@ -51,13 +56,93 @@ extern CueException timestamp_bytes_mismatch;
 extern CueException track_push_null_file;
 extern CueException index_push_null_track;
 
+extern CueException split_multiple_files;
+extern CueException split_index_order;
+
+//Only reported as warnings, the throwing API accepts these lines
+extern CueException track_type_invalid;
+extern CueException index_timestamp_invalid;
+
+/*** Cue File/Sheet Diagnostics ***********************************************/
+//A problem found by the non-throwing API (TryReadCueText, TryCombine etc).
+//Errors are what the throwing API raises. Warnings are accepted by it, but
+//fail later, e.g. an unknown TRACK type cannot be written out
+struct CueDiagnostic {
+	enum class Severity { Warning, Error };
+	
+	Severity severity;
+	const CueException *reason;    //One of the exceptions above
+	uint32_t line, column;         //1 based position in the .cue, 0 if none
+	uint16_t track;                //TRACK it is about, 0 for none
+	std::string text;              //The offending word, empty for none
+	
+	//Returns eg 12:9: error: <reason>: "MODE3/2352"
+	std::string ToString() const;
+};
+
+//Every problem found by a parse or combine, in the order they were found.
+//Nothing is allocated unless there is a problem
+struct CueResult {
+	std::vector<CueDiagnostic> diagnostics;
+	size_t errors = 0, warnings = 0;
+	
+	bool ok() const { return this->errors == 0; }
+	
+	//Adds a diagnostic and counts it
+	void Add(const CueDiagnostic::Severity severity, const CueException &reason,
+	         const uint32_t line = 0, const uint32_t column = 0,
+	         const uint16_t track = 0, const std::string_view text = std::string_view());
+	
+	//Returns the first error, or nullptr if there are none
+	const CueDiagnostic *FirstError() const;
+	
+	//Throws the first error's exception, if there are any errors
+	void ThrowIfFailed() const;
+};
+
+/*** Cue Sheet Item Range *****************************************************/
+//A run of TRACKs or INDEXs, stored one after another in the CueSheet's flat 
+//TrackData/IndexData arrays. Iterates like a std::list did, but only the
+//CueSheet can add to it (see PushTrack/PushIndex)
+template<typename T>
+class CueItemRange {
+	public:
+	CueItemRange() : items(nullptr), first(0), count(0) {}
+	
+	T *begin()             { return this->items ? this->items->data() + this->first : nullptr; }
+	T *end()               { return this->begin() + this->count; }
+	const T *begin() const { return this->items ? this->items->data() + this->first : nullptr; }
+	const T *end() const   { return this->begin() + this->count; }
+	
+	size_t size() const    { return this->count; }
+	bool empty() const     { return this->count == 0; }
+	
+	T &front()             { return *this->begin(); }
+	T &back()              { return *(this->end() - 1); }
+	const T &front() const { return *this->begin(); }
+	const T &back() const  { return *(this->end() - 1); }
+	
+	//Detaches the range from its items, leaving them in the CueSheet
+	void clear()           { this->items = nullptr; this->first = this->count = 0; }
+	
+	private:
+	friend struct CueSheet;
+	std::vector<T> *items;
+	uint32_t first, count;
+};
+
 /*** Cue Sheet Data Handling & Structure **************************************/
 //Hierarchical structure of all the infomation contained in a .cue file and 
 //Functions to handle the data structures
 //All IDs and the Timestamp is limited to 99 to conform to the CUE/CD Standards
 struct CueSheet {
-	//Destructor carefully clears the nested data structures
-	~CueSheet();
+	//Copies and moves re-point the TRACK and INDEX ranges at the new arrays
+	CueSheet() = default;
+	CueSheet(const CueSheet &other);
+	CueSheet(CueSheet &&other) noexcept;
+	CueSheet &operator=(const CueSheet &other);
+	CueSheet &operator=(CueSheet &&other) noexcept;
+	~CueSheet() = default;
 
 	/*** Cue Sheet Data Structures ********************************************/
 	//Type similar to string::npos, to show timestamp bytes returned in invalid
@@ -82,15 +167,34 @@ struct CueSheet {
 		File,
 		Track,
 		Index,
-		Remark
+		Remark,
+		Catalog,
+		CdTextFile,
+		Flags,
+		Isrc,
+		Performer,
+		Title,
+		Songwriter,
+		Pregap,
+		Postgap
 	};
 	
 	/*** Cue Structure ********************************************************/
+	//Text commands of the disc or a TRACK, empty if not in the sheet. Only 
+	//allocated when there are any, most sheets have none. CATALOG and 
+	//CDTEXTFILE are disc only, FLAGS and ISRC are TRACK only
+	struct TextObj {
+		std::string catalog, cdtextfile;
+		std::string flags, isrc;
+		std::string performer, title, songwriter;
+		std::vector<std::string> RemarkList;
+	};
+	
 	//Cue "FILE" Object, Top level. Contains TRACKs and INDEXs
 	struct FileObj {
 		//Initializer list
 		FileObj(std::string fn, std::string ft, uint32_t fb) 
-			                          : filename(fn), filetype(ft), bytes(fb) {}
+			     : filename(std::move(fn)), filetype(std::move(ft)), bytes(fb) {}
 		std::string filename;
 		std::string filetype;
 		uint32_t bytes;
@@ -98,51 +202,100 @@ struct CueSheet {
 		//Cue "TRACK" Object, has "INDEX"s and some Track info
 		struct TrackObj {
 			TrackObj(uint16_t t_id, TrackType t_type)
-			                                         : id(t_id), type(t_type) {}
+			             : id(t_id), type(t_type), pregap(0), postgap(0) {}
+			//Copies take their own copy of the text commands
+			TrackObj(const TrackObj &other);
+			TrackObj &operator=(const TrackObj &other);
+			TrackObj(TrackObj &&other) noexcept = default;
+			TrackObj &operator=(TrackObj &&other) noexcept = default;
+			
 			uint16_t id;
 			TrackType type;
 			
-			//Cue "INDEX" Object. Has Index data
+			//PREGAP and POSTGAP are sectors of silence, not stored in the FILE
+			uint32_t pregap, postgap;
+			
+			//Track text commands, nullptr if there are none
+			std::unique_ptr<TextObj> text;
+			
+			//Cue "INDEX" Object. Has Index data. The position is kept in 
+			//sectors from the start of the FILE, as written in the sheet, 
+			//and is only turned into bytes with the TRACK's sector size
 			struct IndexObj {
-				IndexObj(uint16_t i_id, uint32_t i_offset)
-				                                 : id(i_id), offset(i_offset) {}
+				IndexObj(uint16_t i_id, uint32_t i_sector)
+				                                 : id(i_id), sector(i_sector) {}
 				uint16_t id;
-				uint32_t offset;
+				uint32_t sector;
+				
+				//Byte offset into the FILE for sectors of the given TrackType
+				uint32_t Bytes(const TrackType type) const {
+					return this->sector * GetSectorBytesInTrackType(type);
+				}
 			};
-			//List of INDEXs inside each TRACK
-			std::list<IndexObj> IndexList;
+			//INDEXs inside each TRACK, stored in IndexData
+			CueItemRange<IndexObj> IndexList;
 		};
-		//List of TRACKs inside each FILE
-		std::list<TrackObj> TrackList;
+		//TRACKs inside each FILE, stored in TrackData
+		CueItemRange<TrackObj> TrackList;
 	};
 	//List of FILEs inside each Cue Sheet
-	std::list<FileObj> FileList;
+	std::vector<FileObj> FileList;
+	
+	//Every TRACK and INDEX of the sheet, in order, so a sheet is three flat 
+	//arrays rather than a node per item. Read them through the FILE's 
+	//TrackList and the TRACK's IndexList
+	std::vector<FileObj::TrackObj> TrackData;
+	std::vector<FileObj::TrackObj::IndexObj> IndexData;
+	
+	//Disc text commands, written before the first FILE. nullptr if none
+	std::unique_ptr<TextObj> text;
+	
+	//A run of zero bytes that Combine() inserts for a PREGAP or POSTGAP, at a
+	//byte offset into all the FILEs laid end to end
+	struct GapObj {
+		uint64_t offset;
+		uint32_t bytes;
+	};
 	
 	/*** Structure Functions **************************************************/
 	//Take std::string, parse and return the type of line it is
 	//Returns ::Invalid on failure
-	static LineType StrToLineType(const std::string &input);
+	static LineType StrToLineType(const std::string_view input);
 	//Take LineType and return a string representation of it
 	//Returns Empty string on failure
 	static std::string LineTypeToStr(const LineType type);
 	
 	//Take a std::string of a string line and return the TrackType it is
 	//Returns ::Invalid on failure
-	static TrackType StrToTrackType(const std::string &input);
+	static TrackType StrToTrackType(const std::string_view input);
 	//Take a TrackType return the string Representation of it
 	//Returns Empty string on failure
 	static std::string TrackTypeToStr(const TrackType type);
 	
+	//Bytes per sector of each TrackType, indexed by its value
+	static constexpr uint16_t sector_bytes_table[] = {
+		0, 2352, 2448, 2048, 2352, 2336, 2352, 2336, 2352
+	};
+	
 	//Returns how many bytes are in a sector depending on TrackType.
 	//Returns 0 on error
-	static uint16_t GetSectorBytesInTrackType(const TrackType type); 
+	static constexpr uint16_t GetSectorBytesInTrackType(const TrackType type) {
+		return sector_bytes_table[static_cast<size_t>(type)];
+	}
+	
+	//Converts a sector count to a MM:SS:FF timestamp string
+	//Returns Empty string on error
+	static std::string SectorsToTimestamp(const uint32_t sectors);
+	//Converts a MM:SS:FF timestamp string to a sector count
+	//Returns timestamp_nval on error.
+	static uint32_t TimestampToSectors(const std::string_view timestamp);
 	
 	//Converts bytes value to a timestamp string
 	//Returns Empty string on error
 	static std::string BytesToTimestamp(const uint32_t bytes, const TrackType);	
 	//Convers a timestamp string to a bytes offset value
 	//Returns timestamp_nval on error.
-	static uint32_t TimestampToBytes(const std::string &timestamp, const TrackType);
+	static uint32_t TimestampToBytes(const std::string_view timestamp, const TrackType);
 	
 	//Convert CueSheet Objects into standard file strings
 	static std::string FileToStr(const FileObj                      *file_ptr);
@@ -158,8 +311,10 @@ struct CueSheet {
 	FileObj::TrackObj::IndexObj *GetLastIndex();	
 	
 	//Push a FILE, TRACK, or INDEX to the CueSheet. Always pushed to end.
+	//A pushed FILE starts with no TRACKs, and a pushed TRACK with no INDEXs
 	//Returns -1 and throws error on failure. Returns 0 on success
 	int PushFile(FileObj                      *file_ptr);
+	int PushFile(FileObj                      &&file);
 	int PushTrack(FileObj::TrackObj           *track_ptr);
 	int PushIndex(FileObj::TrackObj::IndexObj *index_ptr);
 	
@@ -169,24 +324,52 @@ struct CueSheet {
 	int PopTrack();
 	int PopIndex();
 	
-	//Deletes all data from the CueSheet and frees up memory
+	//Deletes all data from the CueSheet. The arrays keep their capacity, so
+	//a cleared sheet can be refilled without allocating
 	void Clear();
 	
-	//Copies the data from [this] to the passed CueSheet
+	//Copies the data from [this] to the passed CueSheet, reusing the target's
+	//arrays, so copying into a cleared sheet does not reallocate them. Use 
+	//std::move / move assignment instead when [this] is no longer needed
 	//Returns negative values on error. Target Object may get malformed on error
-	int CopyTo(CueSheet &target);
+	int CopyTo(CueSheet &target) const;
 	
 	//Combines multiple FILE Objects into one, with offset and indexing.
 	//Optional output filename and filetype. If left blank will inherit 
 	//file[0]'s name and type
+	//If write_gaps is set, PREGAPs and POSTGAPs become zero sectors in the 
+	//combined FILE (see GetGaps()), and a PREGAP becomes the TRACK's INDEX 00
+	//Works in place in linear time. Only written PREGAPs allocate, once.
+	//Throws the first error of TryCombine
+	void Combine(std::string op_filename = "", std::string op_filetype = "",
+	             bool write_gaps = false);
+	
+	//Combine without throwing. Every TRACK that cannot be combined, or has an
+	//invalid INDEX timestamp, is reported, and the sheet is left unmodified 
+	//if there are any errors
+	CueResult TryCombine(std::string op_filename = "", std::string op_filetype = "",
+	                     bool write_gaps = false);
+	
+	//Returns where Combine(write_gaps) inserts zero bytes, in stream order
+	std::vector<GapObj> GetGaps() const;
+	
+	//Splits a single FILE Object into one FILE per TRACK, the reverse of 
+	//Combine. Each FILE starts at its TRACK's first INDEX (the first FILE at 0)
+	//and index offsets are rebased to it. FILEs are named 
+	//"<op_basename> (Track N).<ext>", op_basename defaults to file[0]'s name.
+	//Throws on misaligned or out of order indexes.
 	//Leaves object unmodified if failed.
-	void Combine(std::string op_filename = "", std::string op_filetype = "");
+	void Split(std::string op_basename = "");
 	
 	//Creates a cue file spec string output based on CueSheet
 	std::string ToString() const;
 
 	//Prints all the information stored in the CueSheet to std out
 	int Print() const;
+	
+	private:
+	//Points every FILE's and TRACK's range at this sheet's arrays
+	void BindRanges();
 };
 
 /*** Cue File Management ******************************************************/
@@ -200,7 +383,24 @@ class CueFile {
 	//Returns 0 on success. Throws Exception and returns negative value on error
 	int ReadCueData(CueSheet &cs);
 	
-	//Reads the files inside the .cue data, and populates the FileObj's bytes
+	//Parses .cue data from any stream (e.g. a .cue inside an archive) into the
+	//passed CueSheet. Same returns and exceptions as ReadCueData
+	int ReadCueStream(CueSheet &cs, std::istream &in);
+	
+	//Parses .cue text already in memory into the passed CueSheet. Lines are
+	//tokenized in place, nothing is allocated except the stored values.
+	//Same returns and exceptions as ReadCueData
+	int ReadCueText(CueSheet &cs, std::string_view text);
+	
+	//Non-throwing versions of the above, for linting many sheets. A line with
+	//an error is skipped and parsing carries on, so every problem is reported
+	//with its line and column. ReadCueData etc throw the first error of these
+	CueResult TryReadCueData(CueSheet &cs);
+	CueResult TryReadCueStream(CueSheet &cs, std::istream &in);
+	CueResult TryReadCueText(CueSheet &cs, std::string_view text);
+	
+	//Reads the files inside the .cue data, and populates the FileObj's bytes.
+	//WAVE and AIFF files count only their PCM payload, without headers
 	//Returns -1 and throws on error
 	int GetCueFileSizes(CueSheet &cs, std::string base_dir = "");
 	
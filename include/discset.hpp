@@ -0,0 +1,32 @@
+/******************************************************************************
+* psx-comBINe disc sets
+* Groups the .cue files of a folder into multi-disc sets, by the disc marker
+* in their names, e.g. "Game (Disc 1).cue" and "Game (Disc 2).cue"
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_DISCSET
+#define PSXCOMBINE_DISCSET
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// One game, which may span several discs
+struct DiscSet {
+	std::string                        name;   // Filename without the disc marker
+	std::vector<std::filesystem::path> discs;  // In disc order
+};
+
+/// @brief Gets the disc number from a filename's disc marker, (Disc 2),
+/// [CD2], - Disk B, etc
+/// @param filename, filename or stem to look at
+/// @return disc number, 0 if the name has no disc marker
+unsigned GetDiscNumber(const std::string &filename);
+
+/// @brief Groups files into disc sets. Files with the same name once their
+/// disc marker is removed are one set, anything else is a set of its own
+/// @param files, files to group (.cue files)
+/// @return disc sets, in the order their first file was passed
+std::vector<DiscSet> GroupDiscSets(const std::vector<std::filesystem::path> &files);
+
+#endif
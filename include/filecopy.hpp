@@ -0,0 +1,45 @@
+/******************************************************************************
+* psx-comBINe file range copying
+* Copies byte ranges between files using the fastest method the OS offers:
+* reflinks (FICLONERANGE), then in-kernel copy_file_range(), then a plain
+* buffered copy.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_FILECOPY
+#define PSXCOMBINE_FILECOPY
+
+#include <filesystem>
+#include <cstdint>
+#include <vector>
+
+// A range of one file to be copied into a new file
+struct CopyJob {
+	std::filesystem::path src;
+	uint64_t              offset;
+	uint64_t              bytes;
+	std::filesystem::path dest;
+};
+
+/// @brief Copies a range of a file into a new (truncated) file.
+/// Throws std::runtime_error on failure
+/// @param job, source range and destination
+/// @return none
+void CopyFileRange(const CopyJob &job);
+
+/// @brief Creates a file from several whole files, one after the other. Each
+/// is reflinked where the filesystem allows it, so the result can share its
+/// extents with the sources. Throws std::runtime_error on failure
+/// @param srcs, files to join, in order
+/// @param dest, file to create (or truncate)
+/// @return bytes that were reflinked, rather than copied
+uint64_t ConcatenateFiles(const std::vector<std::filesystem::path> &srcs,
+                      const std::filesystem::path &dest);
+
+/// @brief Runs several CopyFileRange jobs at once with ParallelFor(). Rethrows
+/// the first error
+/// @param jobs, ranges to copy
+/// @param threads, copies in flight. 0 uses all hardware threads
+/// @return none
+void CopyFileRanges(const std::vector<CopyJob> &jobs, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,30 @@
+/******************************************************************************
+* psx-comBINe FUSE mount
+* Presents every multi-bin set in a library as a single combined .cue and
+* .bin pair, read on the fly from the original bins through a sector cache.
+* Only built with FUSE support (make FUSE=1), see PSXCOMBINE_FUSE.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_FUSEMOUNT
+#define PSXCOMBINE_FUSEMOUNT
+
+#include <filesystem>
+#include <cstddef>
+
+namespace fusemount {
+// Sector cache size and readahead, in 2352 byte sectors
+constexpr size_t cache_sectors     = 64 * 1024;   // ~147 MiB
+constexpr size_t readahead_sectors = 64;
+} // namespace fusemount
+
+/// @brief Mounts the combined images of every multi-FILE .cue found under a
+/// library directory, read-only, with the library's folder layout. Blocks
+/// until the mount is unmounted. Throws std::runtime_error on failure, or if
+/// built without FUSE support
+/// @param library, directory to search for .cue files
+/// @param mountpoint, empty directory to mount on
+/// @return number of images that were mounted
+size_t MountLibrary(const std::filesystem::path &library,
+                    const std::filesystem::path &mountpoint);
+
+#endif
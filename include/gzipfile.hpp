@@ -0,0 +1,95 @@
+/******************************************************************************
+* psx-comBINe seekable gzip support
+* The combined binary stream is split into sector-aligned frames, and each
+* frame is compressed (in parallel) as its own gzip member. A frame index is
+* kept in empty trailing members, so any sector range can be decompressed
+* without reading the whole file. Standard gzip tools see a normal .gz file.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_GZIPFILE
+#define PSXCOMBINE_GZIPFILE
+
+#include "outputsink.hpp"
+#include "workpool.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace seekgz {
+// Sectors (2352 bytes) per compressed frame
+constexpr uint32_t frame_sectors = 64;
+// Max frame sizes held by a single index member (FEXTRA is limited to 64KiB)
+constexpr uint32_t index_entries = 16000;
+} // namespace seekgz
+
+/*** Seekable gzip Writer *****************************************************/
+// Output sink that writes the combined stream as a seekable multi-member gzip
+class GzipWriter : public OutputSink {
+	public:
+	/// @param path, output .gz path
+	/// @param threads, compression threads. 0 uses all hardware threads
+	GzipWriter(const std::filesystem::path &path, unsigned threads = 0);
+	~GzipWriter() override;
+
+	void Write(const char *data, size_t len) override;
+	void Close() override;
+
+	private:
+	std::fstream          file;
+	std::vector<uint8_t>  frame;        // Frame being filled
+	size_t                frame_fill;
+	uint64_t              total_bytes;  // Uncompressed bytes written
+	uint64_t              file_bytes;   // Compressed bytes written
+	std::vector<uint32_t> frame_sizes;  // Compressed size of each member
+
+	std::unique_ptr<OrderedPipeline> pipeline;
+	bool                  closed;
+
+	void SubmitFrame();
+	void WriteMember(const std::vector<uint8_t> &member);
+	void WriteIndex();
+};
+
+/*** Seekable gzip Reader *****************************************************/
+// Random access to a seekable gzip written by GzipWriter.
+// Throws std::runtime_error for unsupported or corrupt files.
+class GzipReader {
+	public:
+	GzipReader(const std::filesystem::path &path);
+
+	/// @brief Returns the number of uncompressed bytes in the file
+	uint64_t BinaryBytes() const;
+
+	/// @brief Reads a range of uncompressed bytes, decompressing only the
+	/// frames that hold it
+	/// @param offset, uncompressed byte offset
+	/// @param len, number of bytes. Clamped to the end of the data
+	/// @param out, buffer filled with the data
+	void Read(uint64_t offset, size_t len, std::vector<uint8_t> &out);
+
+	/// @brief Reads a range of 2352 byte sectors
+	/// @param lba, first sector, counted from the start of the .bin
+	/// @param count, number of sectors
+	/// @param out, buffer filled with the sectors
+	void ReadSectors(uint32_t lba, uint32_t count, std::vector<uint8_t> &out);
+
+	/// @brief Reads and decompresses a single frame. Thread safe
+	/// @param index, frame number
+	/// @param out, buffer filled with the frame's data
+	void ReadFrame(uint32_t index, std::vector<uint8_t> &out);
+
+	private:
+	std::fstream          file;
+	std::mutex            file_mtx;
+	uint32_t              frame_bytes;
+	uint64_t              total_bytes;
+	std::vector<uint64_t> frame_offsets;  // File offset of each member, +end
+
+	void ReadAt(uint64_t offset, uint8_t *dest, size_t len);
+};
+
+#endif
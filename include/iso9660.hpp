@@ -0,0 +1,76 @@
+/******************************************************************************
+* psx-comBINe ISO9660 reader
+* Builds a directory index of the data track of a (multi-bin) cue sheet, and
+* extracts files from it with random access, without combining the image.
+* CD-XA Mode 2 Form 2 files (XA audio, STR video) can be extracted with their
+* full 2336 or 2324 byte sector payload.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_ISO9660
+#define PSXCOMBINE_ISO9660
+
+#include "cuehandler.hpp"
+#include "virtualimage.hpp"
+
+#include <filesystem>
+#include <ostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Throws std::runtime_error for unreadable images or filesystems
+class Iso9660Reader {
+	public:
+	// Sector payload sizes for XA extraction
+	static constexpr size_t xa_payload_full = 2336;  // Subheader, data and EDC
+	static constexpr size_t xa_payload_data = 2324;  // Form 2 data only
+
+	// A file or directory in the filesystem
+	struct Entry {
+		std::string path;       // Full path, e.g. /MOVIE/INTRO.STR (no ;1)
+		uint32_t    lba;        // First logical sector
+		uint32_t    bytes;      // Size recorded in the directory
+		bool        directory;
+		bool        xa_form2;   // CD-XA Form 2 or interleaved file
+	};
+
+	/// @param sheet, cue sheet with FILE sizes filled in (GetCueFileSizes)
+	/// @param base_dir, directory the FILEs are relative to
+	Iso9660Reader(const CueSheet &sheet, const std::filesystem::path &base_dir);
+
+	/// @brief Returns every file and directory, in directory order
+	const std::vector<Entry> &Entries() const;
+
+	/// @brief Finds an entry by path. Case-insensitive, the leading / and any
+	/// ;1 version suffix are optional
+	/// @return pointer to the Entry, nullptr if not found
+	const Entry *Find(const std::string &path) const;
+
+	/// @brief Reads whole sectors of the data track, as stored in the FILEs
+	/// @param lba, first logical sector
+	/// @param count, number of sectors
+	/// @param out, buffer filled with count * SectorBytes() bytes
+	void ReadSectors(uint32_t lba, uint32_t count, std::vector<uint8_t> &out);
+
+	/// @brief Returns the stored size of each data track sector (2352, 2336 or 2048)
+	size_t SectorBytes() const;
+
+	/// @brief Writes a file's data to a stream. Normal files are written as
+	/// 2048 byte user data, XA Form 2 files with xa_payload bytes per sector
+	/// @param entry, file to extract
+	/// @param out, stream to write to
+	/// @param xa_payload, xa_payload_full or xa_payload_data
+	void ExtractFile(const Entry &entry, std::ostream &out,
+	                 size_t xa_payload = xa_payload_full);
+
+	private:
+	VirtualImage         image;         // The FILEs, read as one combined image
+	uint64_t             track_offset;  // Image offset of the data track LBA 0
+	size_t               sector_bytes;
+	std::vector<Entry>   entries;
+
+	void ReadUserSector(uint32_t lba, uint8_t *dest);
+	void ReadDirectory(uint32_t lba, uint32_t bytes, const std::string &path, int depth);
+};
+
+#endif
@@ -0,0 +1,42 @@
+/******************************************************************************
+* psx-comBINe ISO support
+* Writes the cooked 2048 byte user data of a disc's data track out as an .iso
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_ISOFILE
+#define PSXCOMBINE_ISOFILE
+
+#include "cuehandler.hpp"
+#include "outputsink.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <vector>
+
+/*** ISO Writer ***************************************************************/
+// Output sink that keeps only the first data track of the combined stream,
+// and writes each sector's user data. The sector layout comes from the
+// track's TYPE, and raw sectors are checked for Mode 1 or Mode 2 one by one.
+class IsoWriter : public OutputSink {
+	public:
+	/// @param path, output .iso path
+	/// @param combined, combined cue sheet describing the binary stream
+	IsoWriter(const std::filesystem::path &path, const CueSheet &combined);
+
+	void Write(const char *data, size_t len) override;
+	void Close() override;
+
+	private:
+	std::fstream         file;
+	uint64_t             track_start;   // Stream range of the data track
+	uint64_t             track_end;
+	size_t               sector_bytes;
+	uint64_t             offset;        // Stream offset of the next byte in
+	std::vector<uint8_t> pending;       // Partial sector held back
+	std::vector<uint8_t> user;          // Extracted user data
+
+	void WriteSectors(const uint8_t *data, size_t sectors);
+};
+
+#endif
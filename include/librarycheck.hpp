@@ -0,0 +1,56 @@
+/******************************************************************************
+* psx-comBINe library check
+* Lints every .cue under a directory, on all CPU cores: each must parse, every
+* FILE it names must exist, and its TRACKs and INDEXs must fit their FILEs in
+* whole sectors of their TrackType. The results are reported as JSON.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_LIBRARYCHECK
+#define PSXCOMBINE_LIBRARYCHECK
+
+#include <filesystem>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One problem found with a disc
+struct CheckIssue {
+	std::string code;       // Stable identifier, e.g. "file_missing"
+	std::string message;    // Human readable detail
+	std::string file;       // FILE it is about, empty for the whole sheet
+	uint16_t    track = 0;  // TRACK it is about, 0 for none
+	uint32_t    line = 0, column = 0;  // Where in the .cue, 0 for none
+};
+
+// The result of checking one .cue
+struct DiscCheck {
+	std::filesystem::path   cue;
+	size_t                  files = 0, tracks = 0;
+	uint64_t                bytes = 0;   // Bytes of every FILE that was found
+	std::vector<CheckIssue> issues;      // Empty if the disc is fine
+};
+
+// The result of checking a whole library
+struct LibraryCheck {
+	std::filesystem::path  root;
+	std::vector<DiscCheck> discs;          // In path order
+	size_t                 failed = 0;     // Discs with any issues
+	unsigned               threads = 0;
+	double                 scan_seconds = 0, check_seconds = 0;
+};
+
+/// @brief Checks every .cue file under a directory, or a single .cue file.
+/// The tree is listed once, up front, and FILEs are looked up in that listing
+/// rather than opened, then the .cue files are parsed and checked in parallel.
+/// Problems with a disc are reported in its DiscCheck, never thrown
+/// @param root, library directory or .cue file
+/// @param threads, number of workers. 0 uses DefaultThreadCount()
+/// @return every disc's result. Throws std::runtime_error if root cannot be read
+LibraryCheck CheckLibrary(const std::filesystem::path &root, unsigned threads = 0);
+
+/// @brief Writes a LibraryCheck as a JSON report. Paths are relative to the root
+/// @param check, result of CheckLibrary
+/// @return JSON text
+std::string CheckReportToJson(const LibraryCheck &check);
+
+#endif
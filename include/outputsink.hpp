@@ -0,0 +1,98 @@
+/******************************************************************************
+* psx-comBINe output sinks
+* The combined binary stream is pushed through an OutputSink, which writes it
+* out in the requested output format.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_OUTPUTSINK
+#define PSXCOMBINE_OUTPUTSINK
+
+#include <filesystem>
+#include <istream>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Output formats selectable with --format
+enum class OutputFormat {Bin, Chd, Gzip, Iso, Invalid};
+
+/// @brief Takes a --format string and returns its OutputFormat
+/// @param str, format name, e.g. "bin", "chd", "gz" or "iso"
+/// @return OutputFormat, ::Invalid if not recognised
+OutputFormat StrToOutputFormat(const std::string &str);
+
+/// @brief Returns the file extension (with .) used by an OutputFormat
+/// @param format to get the extension of
+/// @return extension string, e.g. ".bin" or ".bin.gz"
+std::string OutputFormatExtension(const OutputFormat format);
+
+// Base class for all output writers. Throws std::runtime_error on failure
+class OutputSink {
+	public:
+	virtual ~OutputSink() = default;
+
+	/// @brief Writes the next chunk of the combined binary stream
+	virtual void Write(const char *data, size_t len) = 0;
+
+	/// @brief Writes a run of zero bytes. Sinks that can skip over them (e.g.
+	/// as a filesystem hole) override this, the default writes zero chunks
+	virtual void WriteZeros(uint64_t len);
+
+	/// @brief Flushes and finalises the output. Must be called once at the end
+	virtual void Close() = 0;
+};
+
+// Writes the combined stream verbatim to a single .bin file
+class RawOutputSink : public OutputSink {
+	public:
+	RawOutputSink(const std::filesystem::path &path);
+
+	void Write(const char *data, size_t len) override;
+	void WriteZeros(uint64_t len) override;
+	void Close() override;
+
+	private:
+	std::fstream file;
+	uint64_t     hole_bytes = 0;  // Zeros skipped over, but not yet seeked past
+};
+
+/// @brief Copies a stream into a sink through a caller owned buffer, as each
+/// input FILE is dumped. Throws std::runtime_error if the sink fails
+/// @param in, stream positioned at the first byte to copy
+/// @param bytes, most bytes to copy, stops early at the end of the stream
+/// @param swap, byte swap 16-bit samples on the way (buffer_bytes must be even)
+/// @param sink, sink to write to
+/// @param buffer, copy buffer of buffer_bytes
+/// @return bytes copied
+uint64_t CopyStreamToSink(std::istream &in, uint64_t bytes, bool swap, OutputSink &sink,
+                          char *buffer, size_t buffer_bytes);
+
+// Inserts runs of zeros (e.g. PREGAP/POSTGAP sectors) at set offsets of the
+// stream, then passes it on to another sink
+class ZeroFillSink : public OutputSink {
+	public:
+	// A run of zeros, inserted before the stream byte at offset
+	struct Fill {
+		uint64_t offset;
+		uint64_t bytes;
+	};
+
+	/// @param inner, sink receiving the filled stream
+	/// @param fills, runs to insert, sorted by offset
+	ZeroFillSink(std::unique_ptr<OutputSink> inner, std::vector<Fill> fills);
+
+	void Write(const char *data, size_t len) override;
+	void Close() override;
+
+	private:
+	std::unique_ptr<OutputSink> inner;
+	std::vector<Fill>           fills;
+	size_t                      next_fill;
+	uint64_t                    offset;     // Stream offset of the next byte in
+
+	void WriteFills();
+};
+
+#endif
@@ -0,0 +1,99 @@
+/******************************************************************************
+* psx-comBINe PPF (PlayStation Patch File) support
+* Loads PPF 1.0, 2.0 and 3.0 patches, and applies them to the combined binary
+* stream as it is written, optionally regenerating the EDC/ECC of patched
+* data sectors.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_PPFPATCH
+#define PSXCOMBINE_PPFPATCH
+
+#include "outputsink.hpp"
+
+#include <filesystem>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*** PPF Patch ****************************************************************/
+// A parsed patch. Records are flattened into sorted, non-overlapping runs of
+// patched bytes (later records win), so a buffer can be checked with a
+// single range compare. Throws std::runtime_error for invalid patch files.
+class PpfPatch {
+	public:
+	PpfPatch(const std::filesystem::path &path);
+
+	/// @brief Returns the PPF version, 1 to 3
+	int Version() const;
+
+	/// @brief Returns the image size the patch was made for (PPF 2.0 only)
+	/// @return size in bytes, 0 if the patch does not say
+	uint64_t ImageBytes() const;
+
+	/// @brief Returns the bytes the patch expects at BlockCheckOffset() of the
+	/// unpatched image. Empty if the patch has no block check
+	const std::vector<uint8_t> &BlockCheck() const;
+	uint64_t BlockCheckOffset() const;
+
+	/// @brief Checks if any patched byte falls inside a range. Calls with
+	/// increasing offsets (a stream) cost a single range compare
+	/// @param offset, image byte offset of the range
+	/// @param len, bytes in the range
+	/// @return true if the range needs patching
+	bool Touches(uint64_t offset, size_t len);
+
+	/// @brief Patches the bytes of a buffer that is at offset in the image
+	/// @param offset, image byte offset of data[0]
+	/// @param data, buffer to patch in place
+	/// @param len, bytes in the buffer
+	void Apply(uint64_t offset, uint8_t *data, size_t len);
+
+	private:
+	struct Run {
+		uint64_t offset;
+		uint64_t len;
+		size_t   data_idx;  // Start of the run's bytes in run_data
+	};
+
+	int                  version;
+	uint64_t             image_bytes;
+	uint64_t             block_offset;
+	std::vector<uint8_t> block_check;
+	std::vector<Run>     runs;
+	std::vector<uint8_t> run_data;
+	size_t               cursor;  // First run that ends after the last offset
+
+	void Seek(uint64_t offset);
+};
+
+/*** Patching Output Sink *****************************************************/
+// Output sink that patches the stream, then passes it on to another sink.
+// Unpatched buffers are passed through without a copy.
+class PatchSink : public OutputSink {
+	public:
+	/// @param inner, sink receiving the patched stream
+	/// @param patch, patch to apply
+	/// @param fix_edc, regenerate EDC/ECC of patched sectors that had valid EDC
+	PatchSink(std::unique_ptr<OutputSink> inner, PpfPatch &patch, bool fix_edc);
+
+	void Write(const char *data, size_t len) override;
+	void WriteZeros(uint64_t len) override;
+	void Close() override;
+
+	/// @brief Returns the number of sectors whose EDC/ECC was regenerated
+	size_t FixedSectors() const;
+
+	private:
+	std::unique_ptr<OutputSink> inner;
+	PpfPatch                   &patch;
+	bool                        fix_edc;
+	uint64_t                    offset;    // Image offset of the next byte in
+	std::vector<uint8_t>        pending;   // Partial sector held back (fix_edc)
+	std::vector<uint8_t>        scratch;
+	size_t                      fixed_sectors;
+
+	void CheckBlock(const uint8_t *data, size_t len);
+	void WriteSectors(uint64_t base, const uint8_t *data, size_t len);
+};
+
+#endif
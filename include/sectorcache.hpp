@@ -0,0 +1,64 @@
+/******************************************************************************
+* psx-comBINe sector cache
+* A thread safe, sector granular LRU cache in front of VirtualImage reads,
+* with readahead. Used to serve combined images to several readers at once.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_SECTORCACHE
+#define PSXCOMBINE_SECTORCACHE
+
+#include "virtualimage.hpp"
+
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <list>
+#include <mutex>
+
+class SectorCache {
+	public:
+	// Cache granularity, one raw CD sector of the combined image
+	static constexpr size_t sector_bytes = 2352;
+
+	/// @param capacity, sectors to keep cached, across all images
+	/// @param readahead, sectors read in one go after a miss
+	SectorCache(size_t capacity, size_t readahead);
+
+	/// @brief Reads bytes of an image through the cache. Safe to call from
+	/// several threads at once. Throws std::runtime_error on read failure
+	/// @param image, image to read
+	/// @param image_id, number unique to this image, for cache keys
+	/// @param offset, byte offset into the image
+	/// @param dest, buffer of at least len bytes
+	/// @param len, bytes to read. Must not run past the end of the image
+	void Read(const VirtualImage &image, uint32_t image_id, uint64_t offset,
+	          uint8_t *dest, size_t len);
+
+	private:
+	static constexpr size_t shard_count = 16;
+
+	using Key = uint64_t;  // Image id in the top 24 bits, sector number below
+	struct Entry {
+		Key                                 key;
+		std::array<uint8_t, sector_bytes>   data;
+	};
+
+	// Each shard is its own LRU with its own lock, so readers rarely wait.
+	// Evicted entries are reused, so a full cache does not allocate
+	struct Shard {
+		std::mutex                                            mtx;
+		std::list<Entry>                                      lru;  // Most recent first
+		std::unordered_map<Key, std::list<Entry>::iterator>   index;
+	};
+
+	std::array<Shard, shard_count> shards;
+	size_t                         shard_capacity;
+	size_t                         readahead;
+
+	Shard &GetShard(Key key);
+	bool   Lookup(Key key, size_t skip, uint8_t *dest, size_t len);
+	void   Insert(Key key, const uint8_t *data, size_t len);
+};
+
+#endif
@@ -0,0 +1,48 @@
+/******************************************************************************
+* psx-comBINe SHA-1 hashing
+* Small streaming SHA-1 implementation (FIPS 180-4), used for CHD headers and
+* content-addressed track hashes.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_SHA1
+#define PSXCOMBINE_SHA1
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <string>
+
+class Sha1 {
+	public:
+	// 20 byte binary digest
+	using Digest = std::array<uint8_t, 20>;
+
+	Sha1() { this->Reset(); }
+
+	/// @brief Resets the hash state to start a new digest
+	void Reset();
+
+	/// @brief Appends data to the running hash
+	/// @param data, pointer to the data
+	/// @param len, number of bytes
+	void Update(const void *data, size_t len);
+
+	/// @brief Finishes the hash and returns the digest. Resets the state
+	/// @return 20 byte digest
+	Digest Final();
+
+	/// @brief Converts a digest to a lowercase hex string
+	/// @param digest to convert
+	/// @return 40 character hex string
+	static std::string ToHex(const Digest &digest);
+
+	private:
+	uint32_t state[5];
+	uint64_t total_bytes;
+	uint8_t  block[64];
+	size_t   block_len;
+
+	void Transform(const uint8_t *chunk);
+};
+
+#endif
@@ -0,0 +1,93 @@
+/******************************************************************************
+* psx-comBINe content-addressed track store
+* Keeps one copy of every track across a library, named by its SHA-1. The
+* combined stream is split into tracks and hashed as it is written, and the
+* combined .bin is then built from the stored tracks with reflinks (or a
+* hardlink, for single track images).
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_TRACKSTORE
+#define PSXCOMBINE_TRACKSTORE
+
+#include "outputsink.hpp"
+#include "cuehandler.hpp"
+#include "sha1.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Throws std::runtime_error on failure
+class TrackStore {
+	public:
+	// What the store held already, for the savings report
+	struct Stats {
+		size_t   tracks     = 0;
+		size_t   dup_tracks = 0;
+		uint64_t bytes      = 0;
+		uint64_t dup_bytes  = 0;
+		uint64_t linked_bytes = 0;  // Of the outputs, sharing data with the store
+	};
+
+	/// @param dir, store directory. Created if it does not exist
+	TrackStore(const std::filesystem::path &dir);
+
+	/// @brief Returns a unique path to write a new track to, before Add(). The
+	/// name holds the process ID, so runs sharing a store do not collide
+	/// @param name, readable part of the name, e.g. the output filename
+	std::filesystem::path TempPath(const std::string &name);
+
+	/// @brief Moves a finished track file into the store under its hash. If
+	/// the store already has it, the file is deleted instead
+	/// @param temp, file written at a TempPath()
+	/// @param digest, SHA-1 of the file
+	/// @param bytes, size of the file
+	/// @return path of the stored track
+	std::filesystem::path Add(const std::filesystem::path &temp,
+	                          const Sha1::Digest &digest, uint64_t bytes);
+
+	/// @brief Counts bytes of an output that were hardlinked or reflinked to
+	/// stored tracks, rather than copied
+	/// @param bytes, bytes sharing their data with the store
+	void AddLinked(uint64_t bytes);
+
+	/// @brief Returns the running totals of tracks added
+	const Stats &GetStats() const;
+
+	private:
+	std::filesystem::path dir;
+	Stats                 stats;
+};
+
+// Output sink that writes each TRACK of the combined stream into a store,
+// then builds the combined .bin from the stored tracks on Close()
+class StoreSink : public OutputSink {
+	public:
+	/// @param store, store to add tracks to
+	/// @param combined, the combined (single FILE) cue sheet, for track starts
+	/// @param path, combined .bin to create
+	StoreSink(TrackStore &store, const CueSheet &combined,
+	          const std::filesystem::path &path);
+
+	void Write(const char *data, size_t len) override;
+	void Close() override;
+
+	private:
+	TrackStore                        &store;
+	std::filesystem::path              path;
+	std::vector<uint64_t>              track_ends;  // Stream offset each track ends at
+	size_t                             track;       // Track being written
+	uint64_t                           offset;      // Stream offset of the next byte in
+	uint64_t                           track_bytes;
+	Sha1                               sha;
+	std::filesystem::path              temp_path;
+	std::ofstream                      temp_file;
+	std::vector<std::filesystem::path> stored;      // Stored track of each track
+
+	void StartTrack();
+	void FinishTrack();
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <string_view>
 #include <string>
 #include <chrono>
 
@@ -28,6 +29,13 @@ FilesystemType GetPathType(const std::filesystem::path &path);
 std::filesystem::path FindFileWithExtension(const std::filesystem::path &path, 
 											const std::string &ext);
 
+/// @breif Finds every file with the passed extension, case-insensitive
+/// @param filesystem path to look in (not recursive)
+/// @param extension string, .cue for example
+/// @return filesystem paths of the files, sorted by name
+std::vector<std::filesystem::path> FindFilesWithExtension(const std::filesystem::path &path,
+                                                          const std::string &ext);
+
 /// @breif Returns the current Milliseconds
 /// @param none
 /// @return current millis
@@ -45,5 +53,10 @@ std::string StringToLower(const std::string &input);
 /// @return String of bytes in MiB, padded with spaces
 std::string BytesToPaddedMiBString(const size_t bytes, const size_t pad_len);
 
+/// @brief Returns a string as a quoted, escaped JSON string
+/// @param str, string to quote
+/// @return the JSON string, including its quotes
+std::string JsonString(std::string_view str);
+
 
 #endif
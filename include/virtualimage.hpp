@@ -0,0 +1,90 @@
+/******************************************************************************
+* psx-comBINe virtual combined image
+* A read-only view of a multi-FILE cue sheet as if it were already combined.
+* Reads are mapped onto the original FILEs through a binary searched offset
+* table and served with pread(), so any number of threads can read at once
+* without the image ever being written out.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_VIRTUALIMAGE
+#define PSXCOMBINE_VIRTUALIMAGE
+
+#include "cuehandler.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// Throws std::runtime_error for unreadable FILEs and reads outside the image
+class VirtualImage {
+	public:
+	/// @param sheet, cue sheet with FILE sizes filled in (GetCueFileSizes)
+	/// @param base_dir, directory the FILEs are relative to
+	/// @param combined_name, FILE name used in the combined cue sheet.
+	/// Defaults to the first FILE's name
+	VirtualImage(const CueSheet &sheet, const std::filesystem::path &base_dir,
+	             const std::string &combined_name = "");
+	~VirtualImage();
+
+	VirtualImage(const VirtualImage &) = delete;
+	VirtualImage &operator=(const VirtualImage &) = delete;
+
+	/// @brief Returns the size of the combined image in bytes
+	uint64_t Bytes() const;
+
+	/// @brief Returns the combined, single FILE cue sheet
+	const CueSheet &Combined() const;
+
+	/// @brief Returns the combined cue sheet as .cue file text
+	std::string ToString() const;
+
+	/// @brief Reads bytes of the combined image. Safe to call from several
+	/// threads at once, and does not allocate
+	/// @param offset, byte offset into the combined image
+	/// @param dest, buffer of at least len bytes
+	/// @param len, bytes to read
+	void Read(uint64_t offset, void *dest, size_t len) const;
+
+	/// @brief Reads whole sectors, counted from the first TRACK's INDEX 01
+	/// @param lba, first logical sector
+	/// @param count, number of sectors
+	/// @param dest, buffer of at least count * SectorBytes() bytes
+	void ReadSectors(uint32_t lba, uint32_t count, void *dest) const;
+
+	/// @brief Returns the stored size of each sector of the first TRACK
+	size_t SectorBytes() const;
+
+	private:
+	// A FILE's place in the combined image
+	struct Segment {
+		std::filesystem::path path;
+		uint64_t              bytes;
+		uint64_t              data_offset;  // Payload start in the file (WAVE/AIFF)
+		bool                  swap;         // Big-endian audio (MOTOROLA/AIFF)
+#ifdef _WIN32
+		std::unique_ptr<std::ifstream> file;  // No pread(), reads share file_mtx
+#else
+		int                   fd;
+#endif
+	};
+
+#ifdef _WIN32
+	mutable std::mutex    file_mtx;
+#endif
+
+	CueSheet              combined;
+	std::vector<Segment>  segments;
+	std::vector<uint64_t> starts;        // Image offset of each segment, sorted
+	uint64_t              total_bytes;
+	uint64_t              lba0_offset;   // Image offset of the first INDEX 01
+	size_t                sector_bytes;
+
+	void ReadFile(const Segment &seg, uint64_t offset, uint8_t *dest, size_t len) const;
+	void ReadSegment(const Segment &seg, uint64_t offset, uint8_t *dest, size_t len) const;
+};
+
+#endif
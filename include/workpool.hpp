@@ -0,0 +1,83 @@
+/******************************************************************************
+* psx-comBINe worker pool helpers
+* Threaded work primitives shared by the compressors and readers.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_WORKPOOL
+#define PSXCOMBINE_WORKPOOL
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+/// @brief Returns the number of worker threads to use by default
+/// @param none
+/// @return hardware thread count, at least 1
+unsigned DefaultThreadCount();
+
+/*** Parallel For *************************************************************/
+/// @brief Runs job(i) for every i in [0, count) on a pool of threads. Each
+/// worker claims the next index as soon as it is free, so a few slow jobs do
+/// not hold the others up. The calling thread works too. If a job throws, no
+/// more are started, and the first exception is rethrown once all have stopped
+/// @param count, number of jobs
+/// @param job, called once per index, from several threads at once
+/// @param threads, number of workers. 0 uses DefaultThreadCount()
+/// @return none
+void ParallelFor(size_t count, const std::function<void(size_t)> &job, unsigned threads = 0);
+
+/*** Ordered Pipeline *********************************************************/
+// Runs submitted jobs on a pool of worker threads and hands their output
+// buffers to a sink callback strictly in submission order (a reorder buffer).
+// The number of jobs in flight is bounded, Submit() blocks when it is full.
+// The sink is always called on the thread that calls Submit()/Finish().
+// Exceptions thrown by a job are rethrown from Submit()/Finish() in order.
+class OrderedPipeline {
+	public:
+	using Buffer = std::vector<uint8_t>;
+	using Job    = std::function<void(Buffer &out)>;
+	using Sink   = std::function<void(Buffer &out)>;
+
+	/// @param sink, callback receiving each job's output in order
+	/// @param threads, number of workers. 0 uses DefaultThreadCount()
+	/// @param depth, max jobs in flight. 0 uses 2x the worker count
+	OrderedPipeline(Sink sink, unsigned threads = 0, size_t depth = 0);
+	~OrderedPipeline();
+
+	OrderedPipeline(const OrderedPipeline &) = delete;
+	OrderedPipeline &operator=(const OrderedPipeline &) = delete;
+
+	/// @brief Queues a job. May deliver finished jobs to the sink first
+	void Submit(Job job);
+
+	/// @brief Waits for every queued job and delivers them to the sink
+	void Finish();
+
+	private:
+	struct Slot {
+		Job                job;
+		Buffer             output;
+		std::exception_ptr error;
+		bool               done = false;
+	};
+
+	Sink                     sink;
+	size_t                   depth;
+	std::vector<std::thread> workers;
+
+	std::mutex               mtx;
+	std::condition_variable  job_ready, job_done;
+	std::deque<Slot>         slots;       // In-flight jobs, oldest first
+	size_t                   dispatched;  // Slots already taken by a worker
+	bool                     stopping;
+
+	void WorkerLoop();
+	void DeliverFront(std::unique_lock<std::mutex> &lock);
+};
+
+#endif
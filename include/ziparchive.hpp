@@ -0,0 +1,68 @@
+/******************************************************************************
+* psx-comBINe ZIP archive input
+* Reads the central directory of a .zip (including ZIP64), and streams stored
+* or deflated members without extracting them to disk. Several members are
+* inflated in parallel, and handed out in order.
+* ADBeta (c)
+******************************************************************************/
+#ifndef PSXCOMBINE_ZIPARCHIVE
+#define PSXCOMBINE_ZIPARCHIVE
+
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Throws std::runtime_error for unsupported or corrupt archives
+class ZipArchive {
+	public:
+	// A member, as described by the central directory
+	struct Entry {
+		std::string name;              // Full path inside the archive, '/' separated
+		uint16_t    flags;
+		uint16_t    method;            // 0 = stored, 8 = deflate
+		uint32_t    crc;
+		uint64_t    compressed_bytes;
+		uint64_t    bytes;             // Uncompressed size
+		uint64_t    local_offset;      // Offset of the local file header
+	};
+
+	// Receives member data, in order. member is the index into the list given
+	// to Stream()
+	using StreamCallback = std::function<void(size_t member, const char *data, size_t len)>;
+
+	ZipArchive(const std::filesystem::path &path);
+
+	/// @brief Returns every member in the archive, in central directory order
+	const std::vector<Entry> &Entries() const;
+
+	/// @brief Finds a member by its path. Falls back to a case-insensitive match
+	/// @return pointer to the Entry, nullptr if not found
+	const Entry *Find(const std::string &name) const;
+
+	/// @brief Finds the first member with an extension, e.g. ".cue"
+	/// @return pointer to the Entry, nullptr if not found
+	const Entry *FindExtension(const std::string &ext) const;
+
+	/// @brief Reads a whole member into a string. Meant for small members
+	void ReadEntry(const Entry &entry, std::string &out) const;
+
+	/// @brief Decompresses the members (in parallel) and streams their data
+	/// @param members, members to stream, in output order
+	/// @param out, callback receiving the data in order
+	/// @param threads, members inflated at once. 0 uses all hardware threads
+	void Stream(const std::vector<const Entry *> &members, const StreamCallback &out,
+	            unsigned threads = 0) const;
+
+	private:
+	std::filesystem::path path;
+	std::vector<Entry>    entries;
+
+	void ReadCentralDirectory(std::ifstream &file);
+	void Extract(const Entry &entry,
+	             const std::function<void(const uint8_t *, size_t)> &out) const;
+};
+
+#endif
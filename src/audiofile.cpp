@@ -0,0 +1,218 @@
+/******************************************************************************
+* psx-comBINe audio FILE handling
+* Finds the PCM payload inside WAVE (RIFF) and AIFF/AIFC FILEs, and byte
+* swaps big-endian (AIFF, MOTOROLA) samples into the little-endian order
+* of a BINARY CD image.
+* ADBeta (c)
+******************************************************************************/
+#include "audiofile.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*** Audio Container Constants ************************************************/
+namespace {
+constexpr uint16_t cd_channels     = 2;
+constexpr uint16_t cd_sample_bits  = 16;
+constexpr uint32_t cd_sample_rate  = 44100;
+
+constexpr uint16_t wave_format_pcm = 0x0001;
+constexpr uint16_t wave_format_ext = 0xFFFE;  // WAVE_FORMAT_EXTENSIBLE
+
+// 44100 as the 80-bit extended float in an AIFF COMM chunk (exponent, mantissa)
+constexpr uint8_t  aiff_rate_44100[4] = {0x40, 0x0E, 0xAC, 0x44};
+
+// Chunks are only searched within this many bytes of the start
+constexpr size_t   max_header_bytes = 1024 * 1024;
+
+uint32_t GetLE(const uint8_t *src, int bytes) {
+	uint32_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--) value = (value << 8) | src[i];
+	return value;
+}
+
+uint32_t GetBE(const uint8_t *src, int bytes) {
+	uint32_t value = 0;
+	for(int i = 0; i < bytes; i++) value = (value << 8) | src[i];
+	return value;
+}
+
+// A chunk header, as read from the file
+struct Chunk {
+	char     id[4];
+	uint64_t data_offset;
+	uint64_t bytes;
+};
+
+// Reads the chunk header at offset. Returns false at the end of the file
+bool ReadChunk(std::ifstream &file, uint64_t offset, bool big_endian, Chunk &chunk) {
+	uint8_t head[8];
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	file.read(reinterpret_cast<char *>(head), sizeof(head));
+	if(file.gcount() != sizeof(head)) return false;
+
+	std::memcpy(chunk.id, head, 4);
+	chunk.data_offset = offset + sizeof(head);
+	chunk.bytes = big_endian ? GetBE(head + 4, 4) : GetLE(head + 4, 4);
+	return true;
+}
+
+// Reads a chunk's first len bytes
+void ReadChunkData(std::ifstream &file, const Chunk &chunk, uint8_t *dest, size_t len) {
+	if(chunk.bytes < len) throw std::runtime_error("Audio FILE header chunk is truncated");
+
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(chunk.data_offset), std::ios::beg);
+	file.read(reinterpret_cast<char *>(dest), static_cast<std::streamsize>(len));
+	if(!file) throw std::runtime_error("Audio FILE header chunk is truncated");
+}
+
+AudioLayout ReadWave(std::ifstream &file, uint64_t file_bytes) {
+	bool have_format = false;
+
+	// RIFF chunks follow the 12 byte "RIFF" <size> "WAVE" header, padded to even
+	Chunk chunk;
+	for(uint64_t offset = 12; offset < max_header_bytes &&
+	    ReadChunk(file, offset, false, chunk); offset = chunk.data_offset + chunk.bytes + (chunk.bytes & 1)) {
+
+		if(std::memcmp(chunk.id, "fmt ", 4) == 0) {
+			uint8_t fmt[16];
+			ReadChunkData(file, chunk, fmt, sizeof(fmt));
+
+			uint16_t format = static_cast<uint16_t>(GetLE(fmt, 2));
+			if((format != wave_format_pcm && format != wave_format_ext) ||
+			   GetLE(fmt + 2, 2) != cd_channels || GetLE(fmt + 4, 4) != cd_sample_rate ||
+			   GetLE(fmt + 14, 2) != cd_sample_bits) {
+				throw std::runtime_error("WAVE FILE is not 44.1kHz 16-bit stereo PCM");
+			}
+			have_format = true;
+		}
+
+		// Streaming writers leave the size unset, so it is capped to the file
+		if(std::memcmp(chunk.id, "data", 4) == 0) {
+			if(!have_format) throw std::runtime_error("WAVE FILE has no fmt chunk before its data");
+			uint64_t bytes = std::min(chunk.bytes, file_bytes - chunk.data_offset);
+			return {chunk.data_offset, bytes, false};
+		}
+	}
+
+	throw std::runtime_error("WAVE FILE has no data chunk");
+}
+
+AudioLayout ReadAiff(std::ifstream &file, uint64_t file_bytes, bool aifc) {
+	bool have_format = false, swap = true;
+
+	// IFF chunks follow the 12 byte "FORM" <size> "AIFF" header, padded to even
+	Chunk chunk;
+	for(uint64_t offset = 12; offset < max_header_bytes &&
+	    ReadChunk(file, offset, true, chunk); offset = chunk.data_offset + chunk.bytes + (chunk.bytes & 1)) {
+
+		// COMM: channels, frames, sample bits, rate [, compression type]
+		if(std::memcmp(chunk.id, "COMM", 4) == 0) {
+			uint8_t comm[22];
+			ReadChunkData(file, chunk, comm, aifc ? 22 : 18);
+
+			if(GetBE(comm, 2) != cd_channels || GetBE(comm + 6, 2) != cd_sample_bits ||
+			   std::memcmp(comm + 8, aiff_rate_44100, sizeof(aiff_rate_44100)) != 0) {
+				throw std::runtime_error("AIFF FILE is not 44.1kHz 16-bit stereo PCM");
+			}
+
+			// AIFC is only uncompressed PCM when big ("NONE") or little ("sowt") endian
+			if(aifc) {
+				if(std::memcmp(comm + 18, "sowt", 4) == 0) {
+					swap = false;
+				} else if(std::memcmp(comm + 18, "NONE", 4) != 0) {
+					throw std::runtime_error("AIFC FILE is compressed");
+				}
+			}
+			have_format = true;
+		}
+
+		// SSND: data offset, block size, then the samples
+		if(std::memcmp(chunk.id, "SSND", 4) == 0) {
+			if(!have_format) throw std::runtime_error("AIFF FILE has no COMM chunk before its data");
+
+			uint8_t ssnd[8];
+			ReadChunkData(file, chunk, ssnd, sizeof(ssnd));
+			uint64_t start = chunk.data_offset + 8 + GetBE(ssnd, 4);
+			uint64_t end = std::min(chunk.data_offset + chunk.bytes, file_bytes);
+			if(start > end) throw std::runtime_error("AIFF FILE sound data is truncated");
+
+			return {start, end - start, swap};
+		}
+	}
+
+	throw std::runtime_error("AIFF FILE has no SSND chunk");
+}
+} // namespace
+
+/*** Audio FILE Layout ********************************************************/
+AudioLayout GetAudioLayout(const std::filesystem::path &path, const std::string &filetype) {
+	std::string type = filetype;
+	std::transform(type.begin(), type.end(), type.begin(),
+	               [](unsigned char c) { return static_cast<char>(toupper(c)); });
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if(!file) throw std::runtime_error("FILE could not be opened");
+	file.seekg(0, std::ios::end);
+	uint64_t file_bytes = static_cast<uint64_t>(file.tellg());
+
+	// Raw data, in CD (little-endian) or Motorola (big-endian) sample order
+	if(type == "BINARY" || type.empty()) return {0, file_bytes, false};
+	if(type == "MOTOROLA") return {0, file_bytes, true};
+
+	uint8_t head[12] = {};
+	file.seekg(0, std::ios::beg);
+	file.read(reinterpret_cast<char *>(head), sizeof(head));
+
+	if(type == "WAVE") {
+		if(std::memcmp(head, "RIFF", 4) != 0 || std::memcmp(head + 8, "WAVE", 4) != 0)
+			throw std::runtime_error("WAVE FILE does not have a RIFF WAVE header");
+		return ReadWave(file, file_bytes);
+	}
+
+	if(type == "AIFF") {
+		bool aifc = std::memcmp(head + 8, "AIFC", 4) == 0;
+		if(std::memcmp(head, "FORM", 4) != 0 || (!aifc && std::memcmp(head + 8, "AIFF", 4) != 0))
+			throw std::runtime_error("AIFF FILE does not have a FORM AIFF header");
+		return ReadAiff(file, file_bytes, aifc);
+	}
+
+	throw std::runtime_error("FILE type is not supported (BINARY, MOTOROLA, WAVE or AIFF)");
+}
+
+/*** Sample Byte Swapping *****************************************************/
+void SwapAudioBytes(uint8_t *data, size_t len) {
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// SSE2 has no byte shuffle, but a 16-bit rotate by 8 is the same thing
+	for(; i + 64 <= len; i += 64) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 48));
+		a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+		b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+		c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+		d = _mm_or_si128(_mm_slli_epi16(d, 8), _mm_srli_epi16(d, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), a);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 16), b);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 32), c);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 48), d);
+	}
+#endif
+
+	for(; i + 1 < len; i += 2) std::swap(data[i], data[i + 1]);
+}
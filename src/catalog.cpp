@@ -0,0 +1,692 @@
+/******************************************************************************
+* psx-comBINe library catalog
+* A binary file describing every disc of a library: the parsed cue sheet as
+* flat FILE/TRACK/INDEX tables, each FILE's size, mtime and inode (and SHA-1,
+* once hashed), and the game ID from SYSTEM.CNF. The file is memory-mapped,
+* so opening it and querying it costs no parsing. Updating it only lists the
+* directories, and parses the .cue files, that changed since the last scan.
+* ADBeta (c)
+******************************************************************************/
+#include "catalog.hpp"
+#include "cuehandler.hpp"
+#include "audiofile.hpp"
+#include "iso9660.hpp"
+#include "sha1.hpp"
+#include "utils.hpp"
+
+#include <unordered_map>
+#include <system_error>
+#include <string_view>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+using namespace catalog;
+
+namespace {
+constexpr char     file_magic[8] = {'P', 'S', 'X', 'C', 'A', 'T', '\0', '\0'};
+constexpr uint32_t byte_order    = 0x01020304;
+constexpr uint32_t no_dir        = 0xFFFFFFFF;
+
+/*** Filesystem ***************************************************************/
+struct PathStat {
+	bool     exists = false, directory = false;
+	uint64_t size = 0;
+	int64_t  mtime = 0;   // ns
+	uint64_t inode = 0;
+};
+
+// Everything the catalog keeps about a path, from a single stat where there is one
+PathStat StatPath(const std::filesystem::path &path) {
+	PathStat st;
+#ifdef _WIN32
+	std::error_code ec;
+	std::filesystem::file_status status = std::filesystem::status(path, ec);
+	if(ec || !std::filesystem::exists(status)) return st;
+
+	st.exists = true;
+	st.directory = std::filesystem::is_directory(status);
+	if(!st.directory) st.size = std::filesystem::file_size(path, ec);
+	st.mtime = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::filesystem::last_write_time(path, ec).time_since_epoch()).count());
+#else
+	struct stat sb;
+	if(stat(path.c_str(), &sb) != 0) return st;
+
+	st.exists = true;
+	st.directory = S_ISDIR(sb.st_mode);
+	st.size = static_cast<uint64_t>(sb.st_size);
+	st.mtime = static_cast<int64_t>(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec;
+	st.inode = static_cast<uint64_t>(sb.st_ino);
+#endif
+	return st;
+}
+
+bool HashFile(const std::filesystem::path &path, uint8_t (&digest)[20]) {
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	if(!in) return false;
+
+	Sha1 sha;
+	std::vector<char> buffer(1 << 20);
+	while(in) {
+		in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		sha.Update(buffer.data(), static_cast<size_t>(in.gcount()));
+	}
+	if(in.bad()) return false;
+
+	Sha1::Digest sum = sha.Final();
+	std::copy(sum.begin(), sum.end(), digest);
+	return true;
+}
+
+// The boot executable named in SYSTEM.CNF, e.g. "BOOT = cdrom:\SLUS_005.94;1",
+// as the usual game ID "SLUS-00594". Empty if the disc has none
+std::string DetectGameId(const CueSheet &sheet, const std::filesystem::path &base_dir) {
+	try {
+		Iso9660Reader iso(sheet, base_dir);
+		const Iso9660Reader::Entry *cnf = iso.Find("/SYSTEM.CNF");
+		if(cnf == nullptr || cnf->directory || cnf->bytes > 4096) return "";
+
+		std::ostringstream text;
+		iso.ExtractFile(*cnf, text);
+
+		std::istringstream lines(text.str());
+		std::string line;
+		while(std::getline(lines, line)) {
+			// BOOT on a PS1 disc, BOOT2 on a PS2 one
+			size_t equals = line.find('=');
+			std::string key = StringToLower(line.substr(0, line.find_first_of(" \t=")));
+			if(equals == std::string::npos || (key != "boot" && key != "boot2")) continue;
+
+			std::string exe = line.substr(equals + 1);
+			size_t start = exe.find_last_of("\\:/");
+			exe = exe.substr(start == std::string::npos ? 0 : start + 1);
+			exe = exe.substr(0, exe.find_first_of(";\r \t"));
+
+			std::string id;
+			for(char c : exe) {
+				if(c == '_') id.push_back('-');
+				else if(c != '.') id.push_back(static_cast<char>(toupper(static_cast<unsigned char>(c))));
+			}
+			return id;
+		}
+	} catch(const std::exception &) {
+		// Audio discs, and discs without a filesystem, have no ID
+	}
+
+	return "";
+}
+
+std::string JoinPath(const std::string &dir, std::string_view name) {
+	return dir.empty() ? std::string(name) : dir + "/" + std::string(name);
+}
+
+std::string_view BaseName(std::string_view path) {
+	size_t slash = path.find_last_of('/');
+	return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+/*** Catalog Builder **********************************************************/
+// Scans a library into new tables, copying what it can from the old catalog
+class CatalogBuilder {
+	public:
+	CatalogBuilder(const std::filesystem::path &root, const Catalog *old, bool hash,
+	               Catalog::UpdateStats &stats)
+		: root(root), old(old), hash(hash), stats(stats) {}
+
+	void Scan() {
+		this->ScanDir("");
+		this->SortDirs();
+	}
+
+	void Write(const std::filesystem::path &file) const;
+
+	private:
+	std::filesystem::path root;
+	const Catalog        *old;
+	bool                  hash;
+	Catalog::UpdateStats &stats;
+
+	std::vector<DirRecord>   dirs;
+	std::vector<std::string> dir_paths;
+	std::vector<uint32_t>    children;
+	std::vector<DiscRecord>  discs;
+	std::vector<FileRecord>  files;
+	std::vector<TrackRecord> tracks;
+	std::vector<IndexRecord> indexes;
+
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> string_ids;
+
+	uint32_t AddString(std::string_view str);
+	uint32_t ScanDir(const std::string &path);
+	void ScanDisc(const std::string &cue, const DiscRecord *old_disc);
+	bool CopyDisc(DiscRecord &disc, const DiscRecord &old_disc);
+	void ParseDisc(DiscRecord &disc, const std::filesystem::path &cue_path,
+	               const DiscRecord *old_disc);
+	void HashIfNeeded(FileRecord &file, const std::filesystem::path &path);
+	void SortDirs();
+};
+
+uint32_t CatalogBuilder::AddString(std::string_view str) {
+	auto found = this->string_ids.find(std::string(str));
+	if(found != this->string_ids.end()) return found->second;
+
+	uint32_t offset = static_cast<uint32_t>(this->strings.size());
+	this->strings.append(str);
+	this->strings.push_back('\0');
+	this->string_ids.emplace(std::string(str), offset);
+	return offset;
+}
+
+// Adds a directory, its .cue files, then its subdirectories. A directory whose
+// mtime has not changed has the same entries as before, so is not listed
+uint32_t CatalogBuilder::ScanDir(const std::string &path) {
+	std::filesystem::path abs_path = path.empty() ? this->root : this->root / path;
+	PathStat st = StatPath(abs_path);
+	if(!st.directory) return no_dir;
+
+	const DirRecord *old_dir = this->old ? this->old->FindDir(path) : nullptr;
+	bool unchanged = old_dir && old_dir->mtime == st.mtime;
+
+	std::vector<std::string> subdirs, cues;
+	if(unchanged) {
+		for(uint32_t c_itr : this->old->Children(*old_dir)) {
+			subdirs.emplace_back(BaseName(this->old->String(this->old->Dirs()[c_itr].path)));
+		}
+		for(const auto &d_itr : this->old->Discs(*old_dir)) {
+			cues.emplace_back(BaseName(this->old->String(d_itr.cue)));
+		}
+	} else {
+		this->stats.dirs_listed++;
+
+		std::error_code ec;
+		auto options = std::filesystem::directory_options::skip_permission_denied;
+		for(const auto &entry : std::filesystem::directory_iterator(abs_path, options, ec)) {
+			std::error_code type_ec;
+			std::string name = entry.path().filename().string();
+			if(entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+				subdirs.push_back(name);
+			} else if(entry.is_regular_file(type_ec) &&
+			          StringToLower(entry.path().extension().string()) == ".cue") {
+				cues.push_back(name);
+			}
+		}
+		std::sort(subdirs.begin(), subdirs.end());
+		std::sort(cues.begin(), cues.end());
+	}
+
+	uint32_t idx = static_cast<uint32_t>(this->dirs.size());
+	DirRecord dir {};
+	dir.path = this->AddString(path);
+	dir.mtime = st.mtime;
+	dir.first_disc = static_cast<uint32_t>(this->discs.size());
+	this->dirs.push_back(dir);
+	this->dir_paths.push_back(path);
+
+	// The .cue files first, so they stay together in the disc table
+	for(const auto &name : cues) {
+		std::string cue = JoinPath(path, name);
+		const DiscRecord *old_disc = old_dir ? this->old->FindDisc(cue) : nullptr;
+		this->ScanDisc(cue, old_disc);
+	}
+	this->dirs[idx].disc_count = static_cast<uint32_t>(this->discs.size()) - this->dirs[idx].first_disc;
+
+	std::vector<uint32_t> child_ids;
+	for(const auto &name : subdirs) {
+		uint32_t child = this->ScanDir(JoinPath(path, name));
+		if(child != no_dir) child_ids.push_back(child);
+	}
+	this->dirs[idx].first_child = static_cast<uint32_t>(this->children.size());
+	this->dirs[idx].child_count = static_cast<uint32_t>(child_ids.size());
+	this->children.insert(this->children.end(), child_ids.begin(), child_ids.end());
+
+	this->stats.dirs++;
+	return idx;
+}
+
+void CatalogBuilder::ScanDisc(const std::string &cue, const DiscRecord *old_disc) {
+	std::filesystem::path cue_path = this->root / cue;
+	PathStat st = StatPath(cue_path);
+
+	DiscRecord disc {};
+	disc.cue = this->AddString(cue);
+	disc.game_id = disc.error = no_string;
+	disc.mtime = st.mtime;
+	disc.size = st.size;
+	disc.first_file = static_cast<uint32_t>(this->files.size());
+
+	// An unchanged .cue is copied, unless one of its FILEs changed
+	bool copied = old_disc && old_disc->mtime == st.mtime && old_disc->size == st.size &&
+	              this->CopyDisc(disc, *old_disc);
+	if(!copied) this->ParseDisc(disc, cue_path, old_disc);
+
+	disc.file_count = static_cast<uint32_t>(this->files.size()) - disc.first_file;
+	if(disc.game_id != no_string) this->stats.game_ids++;
+	this->discs.push_back(disc);
+	this->stats.discs++;
+}
+
+// Copies a disc's FILE, TRACK and INDEX records from the old catalog. The
+// FILEs are statted again, even in an unchanged directory, as rewriting a
+// .bin in place does not change its directory's mtime. If any of them changed
+// nothing is copied. Returns false if it was not copied
+bool CatalogBuilder::CopyDisc(DiscRecord &disc, const DiscRecord &old_disc) {
+	std::filesystem::path dir = (this->root / this->old->String(old_disc.cue)).parent_path();
+
+	for(const auto &f_itr : this->old->Files(old_disc)) {
+		this->stats.files_statted++;
+		PathStat st = StatPath(dir / this->old->String(f_itr.name));
+		bool found = st.exists && !st.directory;
+		if(found != bool(f_itr.flags & FileRecord::found) || st.size != f_itr.size ||
+		   st.mtime != f_itr.mtime || st.inode != f_itr.inode) return false;
+	}
+
+	for(const auto &f_itr : this->old->Files(old_disc)) {
+		FileRecord file = f_itr;
+		file.name = this->AddString(this->old->String(f_itr.name));
+		file.type = this->AddString(this->old->String(f_itr.type));
+		this->HashIfNeeded(file, dir / this->old->String(f_itr.name));
+
+		file.first_track = static_cast<uint32_t>(this->tracks.size());
+		for(const auto &t_itr : this->old->Tracks(f_itr)) {
+			TrackRecord track = t_itr;
+			track.first_index = static_cast<uint32_t>(this->indexes.size());
+			for(const auto &i_itr : this->old->Indexes(t_itr)) this->indexes.push_back(i_itr);
+			this->tracks.push_back(track);
+		}
+		this->files.push_back(file);
+	}
+
+	if(old_disc.game_id != no_string) disc.game_id = this->AddString(this->old->String(old_disc.game_id));
+	if(old_disc.error != no_string) disc.error = this->AddString(this->old->String(old_disc.error));
+	return true;
+}
+
+// Parses a new or changed .cue, and stats its FILEs. Hashes of FILEs that
+// have not changed are kept from the old catalog
+void CatalogBuilder::ParseDisc(DiscRecord &disc, const std::filesystem::path &cue_path,
+                               const DiscRecord *old_disc) {
+	this->stats.cues_parsed++;
+
+	// A .cue that does not parse keeps its first error, and where it is
+	CueSheet sheet;
+	CueFile cue_in(cue_path.string().c_str());
+	CueResult parsed = cue_in.TryReadCueData(sheet);
+	if(!parsed.ok()) {
+		disc.error = this->AddString(parsed.FirstError()->ToString());
+		return;
+	}
+
+	std::filesystem::path dir = cue_path.parent_path();
+	bool all_found = !sheet.FileList.empty();
+	for(auto &f_itr : sheet.FileList) {
+		std::filesystem::path path = dir / f_itr.filename;
+		this->stats.files_statted++;
+		PathStat st = StatPath(path);
+
+		FileRecord file {};
+		file.name = this->AddString(f_itr.filename);
+		file.type = this->AddString(f_itr.filetype);
+		file.flags = (st.exists && !st.directory) ? FileRecord::found : 0;
+		file.size = st.size;
+		file.mtime = st.mtime;
+		file.inode = st.inode;
+		file.data_bytes = st.size;
+		if(file.flags & FileRecord::found) {
+			try {
+				file.data_bytes = GetAudioLayout(path, f_itr.filetype).data_bytes;
+			} catch(const std::exception &) {
+				file.data_bytes = 0;
+			}
+		} else {
+			all_found = false;
+		}
+		f_itr.bytes = static_cast<uint32_t>(file.data_bytes);
+
+		// Keep the hash of an unchanged FILE
+		if(old_disc) {
+			for(const auto &o_itr : this->old->Files(*old_disc)) {
+				if(this->old->String(o_itr.name) != f_itr.filename) continue;
+				if((o_itr.flags & FileRecord::hashed) && o_itr.size == file.size &&
+				   o_itr.mtime == file.mtime && o_itr.inode == file.inode) {
+					std::memcpy(file.sha1, o_itr.sha1, sizeof(file.sha1));
+					file.flags |= FileRecord::hashed;
+				}
+				break;
+			}
+		}
+		this->HashIfNeeded(file, path);
+
+		file.first_track = static_cast<uint32_t>(this->tracks.size());
+		for(const auto &t_itr : f_itr.TrackList) {
+			TrackRecord track {};
+			track.id = t_itr.id;
+			track.type = static_cast<uint16_t>(t_itr.type);
+			track.pregap = t_itr.pregap;
+			track.postgap = t_itr.postgap;
+			track.first_index = static_cast<uint32_t>(this->indexes.size());
+			for(const auto &i_itr : t_itr.IndexList) {
+				this->indexes.push_back({i_itr.id, 0, i_itr.sector});
+			}
+			track.index_count = static_cast<uint32_t>(this->indexes.size()) - track.first_index;
+			this->tracks.push_back(track);
+		}
+		file.track_count = static_cast<uint32_t>(this->tracks.size()) - file.first_track;
+		this->files.push_back(file);
+	}
+
+	if(all_found) {
+		std::string game_id = DetectGameId(sheet, dir);
+		if(!game_id.empty()) disc.game_id = this->AddString(game_id);
+	}
+}
+
+void CatalogBuilder::HashIfNeeded(FileRecord &file, const std::filesystem::path &path) {
+	if(!this->hash || !(file.flags & FileRecord::found) || (file.flags & FileRecord::hashed)) return;
+
+	if(HashFile(path, file.sha1)) {
+		file.flags |= FileRecord::hashed;
+		this->stats.files_hashed++;
+	}
+}
+
+// Puts the directories in path order, for FindDir()
+void CatalogBuilder::SortDirs() {
+	std::vector<uint32_t> order(this->dirs.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return this->dir_paths[a] < this->dir_paths[b];
+	});
+
+	std::vector<uint32_t> new_idx(this->dirs.size());
+	std::vector<DirRecord> sorted(this->dirs.size());
+	for(size_t i = 0; i < order.size(); i++) {
+		new_idx[order[i]] = static_cast<uint32_t>(i);
+		sorted[i] = this->dirs[order[i]];
+	}
+	for(auto &c_itr : this->children) c_itr = new_idx[c_itr];
+	this->dirs = std::move(sorted);
+}
+
+void CatalogBuilder::Write(const std::filesystem::path &file) const {
+	Header header {};
+	std::memcpy(header.magic, file_magic, sizeof(header.magic));
+	header.version = version;
+	header.byte_order = byte_order;
+
+	std::string root_str = this->root.generic_string();
+	std::string strings = this->strings;
+	header.root = static_cast<uint32_t>(strings.size());
+	strings.append(root_str);
+	strings.push_back('\0');
+
+	header.dir_count = static_cast<uint32_t>(this->dirs.size());
+	header.disc_count = static_cast<uint32_t>(this->discs.size());
+	header.file_count = static_cast<uint32_t>(this->files.size());
+	header.track_count = static_cast<uint32_t>(this->tracks.size());
+	header.index_count = static_cast<uint32_t>(this->indexes.size());
+	header.child_count = static_cast<uint32_t>(this->children.size());
+	header.string_bytes = static_cast<uint32_t>(strings.size());
+
+	// Lay the tables out one after another, each 8 byte aligned
+	uint64_t offset = sizeof(Header);
+	auto place = [&offset](uint64_t bytes) {
+		offset = (offset + 7) & ~uint64_t(7);
+		uint64_t at = offset;
+		offset += bytes;
+		return at;
+	};
+	header.dirs     = place(this->dirs.size() * sizeof(DirRecord));
+	header.discs    = place(this->discs.size() * sizeof(DiscRecord));
+	header.files    = place(this->files.size() * sizeof(FileRecord));
+	header.tracks   = place(this->tracks.size() * sizeof(TrackRecord));
+	header.indexes  = place(this->indexes.size() * sizeof(IndexRecord));
+	header.children = place(this->children.size() * sizeof(uint32_t));
+	header.strings  = place(strings.size());
+
+	std::string out(offset, '\0');
+	auto put = [&out](uint64_t at, const void *src, size_t bytes) {
+		if(bytes) std::memcpy(&out[at], src, bytes);
+	};
+	put(0, &header, sizeof(header));
+	put(header.dirs, this->dirs.data(), this->dirs.size() * sizeof(DirRecord));
+	put(header.discs, this->discs.data(), this->discs.size() * sizeof(DiscRecord));
+	put(header.files, this->files.data(), this->files.size() * sizeof(FileRecord));
+	put(header.tracks, this->tracks.data(), this->tracks.size() * sizeof(TrackRecord));
+	put(header.indexes, this->indexes.data(), this->indexes.size() * sizeof(IndexRecord));
+	put(header.children, this->children.data(), this->children.size() * sizeof(uint32_t));
+	put(header.strings, strings.data(), strings.size());
+
+	std::ofstream cat(file, std::ios::out | std::ios::binary | std::ios::trunc);
+	cat.write(out.data(), static_cast<std::streamsize>(out.size()));
+	cat.close();
+	if(!cat) throw std::runtime_error("Could not write the catalog " + file.string());
+}
+} // namespace
+
+/*** Catalog ******************************************************************/
+Catalog::Catalog(const std::filesystem::path &file) : data(nullptr), size(0), header(nullptr) {
+#ifdef _WIN32
+	std::ifstream in(file, std::ios::in | std::ios::binary);
+	if(!in) throw std::runtime_error("Could not open the catalog " + file.string());
+	this->buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	this->data = this->buffer.data();
+	this->size = this->buffer.size();
+#else
+	// Catalogs are only ever replaced by renaming, never rewritten in place,
+	// so the mapping cannot change under a reader
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0) throw std::runtime_error("Could not open the catalog " + file.string());
+
+	struct stat sb;
+	if(fstat(fd, &sb) == 0 && sb.st_size > 0) {
+		this->size = static_cast<size_t>(sb.st_size);
+		void *map = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) this->data = static_cast<const char *>(map);
+	}
+	close(fd);
+	if(this->data == nullptr) throw std::runtime_error("Could not map the catalog " + file.string());
+#endif
+
+	if(this->size >= sizeof(Header)) this->header = reinterpret_cast<const Header *>(this->data);
+	try {
+		this->Validate();
+	} catch(...) {
+#ifndef _WIN32
+		munmap(const_cast<char *>(this->data), this->size);
+#endif
+		throw;
+	}
+}
+
+Catalog::~Catalog() {
+#ifndef _WIN32
+	munmap(const_cast<char *>(this->data), this->size);
+#endif
+}
+
+// Checks every table, range and string is inside the file, so queries never
+// need to
+void Catalog::Validate() const {
+	auto fail = []() { throw std::runtime_error("The catalog is damaged, or not a catalog"); };
+
+	if(this->header == nullptr) fail();
+	const Header &hdr = *this->header;
+	if(std::memcmp(hdr.magic, file_magic, sizeof(file_magic)) != 0 || hdr.byte_order != byte_order) fail();
+	if(hdr.version != version) throw std::runtime_error("The catalog is from another version");
+
+	auto table_ok = [this](uint64_t offset, uint64_t count, size_t item) {
+		return offset % 8 == 0 && offset <= this->size && count <= (this->size - offset) / item;
+	};
+	if(!table_ok(hdr.dirs, hdr.dir_count, sizeof(DirRecord)) ||
+	   !table_ok(hdr.discs, hdr.disc_count, sizeof(DiscRecord)) ||
+	   !table_ok(hdr.files, hdr.file_count, sizeof(FileRecord)) ||
+	   !table_ok(hdr.tracks, hdr.track_count, sizeof(TrackRecord)) ||
+	   !table_ok(hdr.indexes, hdr.index_count, sizeof(IndexRecord)) ||
+	   !table_ok(hdr.children, hdr.child_count, sizeof(uint32_t)) ||
+	   !table_ok(hdr.strings, hdr.string_bytes, 1)) fail();
+	if(hdr.string_bytes == 0 || this->data[hdr.strings + hdr.string_bytes - 1] != '\0') fail();
+
+	auto string_ok = [&hdr](uint32_t str, bool optional) {
+		return str < hdr.string_bytes || (optional && str == no_string);
+	};
+	auto range_ok = [](uint32_t first, uint32_t count, uint32_t total) {
+		return first <= total && count <= total - first;
+	};
+
+	if(!string_ok(hdr.root, false)) fail();
+	for(const auto &d_itr : this->Dirs()) {
+		if(!string_ok(d_itr.path, false) || !range_ok(d_itr.first_child, d_itr.child_count, hdr.child_count) ||
+		   !range_ok(d_itr.first_disc, d_itr.disc_count, hdr.disc_count)) fail();
+	}
+	for(uint32_t c_itr : this->GetTable<uint32_t>(hdr.children, 0, hdr.child_count)) {
+		if(c_itr >= hdr.dir_count) fail();
+	}
+	for(const auto &d_itr : this->Discs()) {
+		if(!string_ok(d_itr.cue, false) || !string_ok(d_itr.game_id, true) ||
+		   !string_ok(d_itr.error, true) || !range_ok(d_itr.first_file, d_itr.file_count, hdr.file_count)) fail();
+	}
+	for(const auto &f_itr : this->GetTable<FileRecord>(hdr.files, 0, hdr.file_count)) {
+		if(!string_ok(f_itr.name, false) || !string_ok(f_itr.type, false) ||
+		   !range_ok(f_itr.first_track, f_itr.track_count, hdr.track_count)) fail();
+	}
+	for(const auto &t_itr : this->GetTable<TrackRecord>(hdr.tracks, 0, hdr.track_count)) {
+		if(t_itr.type > static_cast<uint16_t>(CueSheet::TrackType::CDI_2352) ||
+		   !range_ok(t_itr.first_index, t_itr.index_count, hdr.index_count)) fail();
+	}
+}
+
+template<typename T>
+Catalog::Table<T> Catalog::GetTable(uint64_t offset, uint32_t first, uint32_t count) const {
+	return {reinterpret_cast<const T *>(this->data + offset) + first, count};
+}
+
+std::string_view Catalog::Root() const {
+	return this->String(this->header->root);
+}
+
+std::string_view Catalog::String(uint32_t offset) const {
+	if(offset >= this->header->string_bytes) return {};
+	return std::string_view(this->data + this->header->strings + offset);
+}
+
+Catalog::Table<DirRecord> Catalog::Dirs() const {
+	return this->GetTable<DirRecord>(this->header->dirs, 0, this->header->dir_count);
+}
+
+Catalog::Table<DiscRecord> Catalog::Discs() const {
+	return this->GetTable<DiscRecord>(this->header->discs, 0, this->header->disc_count);
+}
+
+Catalog::Table<DiscRecord> Catalog::Discs(const DirRecord &dir) const {
+	return this->GetTable<DiscRecord>(this->header->discs, dir.first_disc, dir.disc_count);
+}
+
+Catalog::Table<uint32_t> Catalog::Children(const DirRecord &dir) const {
+	return this->GetTable<uint32_t>(this->header->children, dir.first_child, dir.child_count);
+}
+
+Catalog::Table<FileRecord> Catalog::Files(const DiscRecord &disc) const {
+	return this->GetTable<FileRecord>(this->header->files, disc.first_file, disc.file_count);
+}
+
+Catalog::Table<TrackRecord> Catalog::Tracks(const FileRecord &file) const {
+	return this->GetTable<TrackRecord>(this->header->tracks, file.first_track, file.track_count);
+}
+
+Catalog::Table<IndexRecord> Catalog::Indexes(const TrackRecord &track) const {
+	return this->GetTable<IndexRecord>(this->header->indexes, track.first_index, track.index_count);
+}
+
+const DirRecord *Catalog::FindDir(std::string_view path) const {
+	Table<DirRecord> dirs = this->Dirs();
+	const DirRecord *found = std::lower_bound(dirs.begin(), dirs.end(), path,
+		[this](const DirRecord &dir, std::string_view p) { return this->String(dir.path) < p; });
+	return (found != dirs.end() && this->String(found->path) == path) ? found : nullptr;
+}
+
+const DiscRecord *Catalog::FindDisc(std::string_view cue) const {
+	size_t slash = cue.find_last_of('/');
+	const DirRecord *dir = this->FindDir(slash == std::string_view::npos ? "" : cue.substr(0, slash));
+	if(dir == nullptr) return nullptr;
+
+	Table<DiscRecord> discs = this->Discs(*dir);
+	const DiscRecord *found = std::lower_bound(discs.begin(), discs.end(), cue,
+		[this](const DiscRecord &disc, std::string_view c) { return this->String(disc.cue) < c; });
+	return (found != discs.end() && this->String(found->cue) == cue) ? found : nullptr;
+}
+
+void Catalog::GetSheet(const DiscRecord &disc, CueSheet &cs) const {
+	cs.Clear();
+	for(const auto &f_itr : this->Files(disc)) {
+		cs.PushFile(CueSheet::FileObj(std::string(this->String(f_itr.name)),
+		                              std::string(this->String(f_itr.type)),
+		                              static_cast<uint32_t>(f_itr.data_bytes)));
+
+		for(const auto &t_itr : this->Tracks(f_itr)) {
+			CueSheet::FileObj::TrackObj track(t_itr.id, static_cast<CueSheet::TrackType>(t_itr.type));
+			track.pregap = t_itr.pregap;
+			track.postgap = t_itr.postgap;
+			cs.PushTrack(&track);
+
+			for(const auto &i_itr : this->Indexes(t_itr)) {
+				CueSheet::FileObj::TrackObj::IndexObj index(i_itr.id, i_itr.sector);
+				cs.PushIndex(&index);
+			}
+		}
+	}
+}
+
+Catalog::UpdateStats Catalog::Update(const std::filesystem::path &file,
+                                     const std::filesystem::path &root, bool hash) {
+	auto start = std::chrono::steady_clock::now();
+	std::filesystem::path abs_root = std::filesystem::absolute(root).lexically_normal();
+	if(!abs_root.has_filename()) abs_root = abs_root.parent_path();
+	if(!std::filesystem::is_directory(abs_root)) {
+		throw std::runtime_error("The library " + root.string() + " is not a directory");
+	}
+
+	// An old catalog that cannot be read, or is of another library, is replaced
+	std::unique_ptr<Catalog> old;
+	if(std::filesystem::exists(file)) {
+		try {
+			old.reset(new Catalog(file));
+			if(old->Root() != abs_root.generic_string()) old.reset();
+		} catch(const std::runtime_error &) {
+			old.reset();
+		}
+	}
+
+	UpdateStats stats;
+	CatalogBuilder builder(abs_root, old.get(), hash, stats);
+	builder.Scan();
+
+	// Written beside the old catalog then renamed over it, so a reader never
+	// sees a half written file
+	std::filesystem::path temp = file;
+	temp += ".tmp";
+	builder.Write(temp);
+	old.reset();
+	std::filesystem::rename(temp, file);
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,215 @@
+/******************************************************************************
+* psx-comBINe CD-ROM sector helpers
+* Sector layout constants, EDC and ECC (P/Q parity) generation & verification
+* for raw 2352 byte sectors, as described by ECMA-130, and user data
+* extraction.
+* ADBeta (c)
+******************************************************************************/
+#include "cdsector.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cdsector {
+const uint8_t sync_pattern[sync_bytes] = {
+	0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00
+};
+
+/*** Lookup Tables ***********************************************************/
+// GF(2^8) multiply-by-2 and its inverse helper, plus the EDC CRC table.
+// Built at compile time so there is no static initialisation order to
+// worry about
+struct Tables {
+	uint8_t  ecc_f[256];
+	uint8_t  ecc_b[256];
+	uint32_t edc[256];
+};
+
+static constexpr Tables BuildTables() {
+	Tables t = {};
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t j = (i << 1) ^ ((i & 0x80) ? 0x11D : 0);
+		t.ecc_f[i] = static_cast<uint8_t>(j);
+		t.ecc_b[i ^ j] = static_cast<uint8_t>(i);
+
+		uint32_t edc = i;
+		for(int k = 0; k < 8; k++) edc = (edc >> 1) ^ ((edc & 1) ? 0xD8018001 : 0);
+		t.edc[i] = edc;
+	}
+	return t;
+}
+
+static constexpr Tables lut = BuildTables();
+
+// Computes one set of parity bytes (P or Q) over the 0x0C-based block
+static void ComputeEccBlock(const uint8_t *src, uint32_t major_count,
+                            uint32_t minor_count, uint32_t major_mult,
+                            uint32_t minor_inc, uint8_t *dest) {
+	uint32_t size = major_count * minor_count;
+	for(uint32_t major = 0; major < major_count; major++) {
+		uint32_t index = (major >> 1) * major_mult + (major & 1);
+		uint8_t ecc_a = 0, ecc_b = 0;
+
+		for(uint32_t minor = 0; minor < minor_count; minor++) {
+			uint8_t temp = src[index];
+			index += minor_inc;
+			if(index >= size) index -= size;
+			ecc_a ^= temp;
+			ecc_b ^= temp;
+			ecc_a = lut.ecc_f[ecc_a];
+		}
+
+		ecc_a = lut.ecc_b[lut.ecc_f[ecc_a] ^ ecc_b];
+		dest[major] = ecc_a;
+		dest[major + major_count] = ecc_a ^ ecc_b;
+	}
+}
+
+/*** API Functions ***********************************************************/
+bool HasSync(const uint8_t *sector) {
+	return std::memcmp(sector, sync_pattern, sync_bytes) == 0;
+}
+
+uint32_t ComputeEdc(uint32_t edc, const uint8_t *data, size_t len) {
+	while(len--) edc = (edc >> 8) ^ lut.edc[(edc ^ *data++) & 0xFF];
+	return edc;
+}
+
+void ComputeEcc(const uint8_t *sector, bool zero_address,
+                uint8_t *p_out, uint8_t *q_out) {
+	// P covers the header and data, Q covers the same plus P. Work on a copy
+	// so the address can be zeroed and the fresh P parity fed into Q
+	constexpr size_t p_rel = ecc_p_offset - header_offset;
+	constexpr size_t q_rel = ecc_q_offset - header_offset;
+	uint8_t block[q_rel + ecc_q_bytes];
+	std::memcpy(block, sector + header_offset, p_rel);
+	if(zero_address) std::memset(block, 0x00, 4);
+
+	ComputeEccBlock(block, 86, 24,  2, 86, block + p_rel);
+	ComputeEccBlock(block, 52, 43, 86, 88, block + q_rel);
+
+	std::memcpy(p_out, block + p_rel, ecc_p_bytes);
+	std::memcpy(q_out, block + q_rel, ecc_q_bytes);
+}
+
+bool VerifyEcc(const uint8_t *sector) {
+	uint8_t p[ecc_p_bytes], q[ecc_q_bytes];
+	ComputeEcc(sector, false, p, q);
+
+	return std::memcmp(p, sector + ecc_p_offset, ecc_p_bytes) == 0 &&
+	       std::memcmp(q, sector + ecc_q_offset, ecc_q_bytes) == 0;
+}
+
+void GenerateEcc(uint8_t *sector) {
+	ComputeEcc(sector, false, sector + ecc_p_offset, sector + ecc_q_offset);
+}
+
+void ClearEcc(uint8_t *sector) {
+	std::memset(sector + ecc_p_offset, 0x00, ecc_p_bytes);
+	std::memset(sector + ecc_q_offset, 0x00, ecc_q_bytes);
+}
+
+bool VerifyEdc(const uint8_t *sector) {
+	if(!HasSync(sector)) return false;
+
+	// Reads a 32-bit little-endian EDC value at the passed offset
+	auto get_edc = [sector](size_t offset) {
+		uint32_t edc = 0;
+		for(int i = 3; i >= 0; i--) edc = (edc << 8) | sector[offset + static_cast<size_t>(i)];
+		return edc;
+	};
+
+	switch(sector[mode_offset]) {
+		case 1:
+			return get_edc(0x810) == ComputeEdc(0, sector, 0x810);
+
+		case 2:
+			if(sector[subhead_offset + 2] & 0x20) {
+				return get_edc(0x92C) == ComputeEdc(0, sector + subhead_offset, 0x91C);
+			}
+			return get_edc(0x818) == ComputeEdc(0, sector + subhead_offset, 0x808);
+
+		default:
+			return false;
+	}
+}
+
+bool RegenerateEdcEcc(uint8_t *sector) {
+	if(!HasSync(sector)) return false;
+
+	// Writes a 32-bit EDC value little-endian at the passed offset
+	auto put_edc = [sector](size_t offset, uint32_t edc) {
+		for(int i = 0; i < 4; i++)
+			sector[offset + static_cast<size_t>(i)] = static_cast<uint8_t>(edc >> (8 * i));
+	};
+
+	switch(sector[mode_offset]) {
+		// Mode 1: EDC over sync, header and data. 8 reserved zero bytes
+		case 1:
+			put_edc(0x810, ComputeEdc(0, sector, 0x810));
+			std::memset(sector + 0x814, 0x00, 8);
+			ComputeEcc(sector, false, sector + ecc_p_offset, sector + ecc_q_offset);
+			return true;
+
+		// Mode 2 XA: the submode byte selects Form 1 or Form 2
+		case 2:
+			if(sector[subhead_offset + 2] & 0x20) {
+				put_edc(0x92C, ComputeEdc(0, sector + subhead_offset, 0x91C));
+			} else {
+				put_edc(0x818, ComputeEdc(0, sector + subhead_offset, 0x808));
+				ComputeEcc(sector, true, sector + ecc_p_offset, sector + ecc_q_offset);
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+/*** User Data ****************************************************************/
+// Copies one sector's user data. The source is only 8 byte aligned, so SSE2
+// uses unaligned 16 byte moves, 64 bytes per loop
+static inline void CopyUserData(uint8_t *dest, const uint8_t *src) {
+#if defined(__SSE2__)
+	for(size_t i = 0; i < user_bytes; i += 64) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), a);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i + 16), b);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i + 32), c);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i + 48), d);
+	}
+#else
+	std::memcpy(dest, src, user_bytes);
+#endif
+}
+
+void ExtractUserData(const uint8_t *src, size_t sectors, size_t sector_bytes,
+                     uint8_t *dest) {
+	// Cooked sectors are already user data
+	if(sector_bytes == user_bytes) {
+		std::memcpy(dest, src, sectors * user_bytes);
+		return;
+	}
+
+	for(size_t s = 0; s < sectors; s++, src += sector_bytes, dest += user_bytes) {
+		size_t offset = user_offset_2336;
+		if(sector_bytes == raw_bytes) {
+			offset = (src[mode_offset] == 2) ? user_offset_mode2 : user_offset_mode1;
+		}
+
+#if defined(__SSE2__)
+		// Pull the next sector in while this one is copied
+		_mm_prefetch(reinterpret_cast<const char *>(src + sector_bytes), _MM_HINT_T0);
+#endif
+		CopyUserData(dest, src + offset);
+	}
+}
+} // namespace cdsector
@@ -0,0 +1,1113 @@
+/******************************************************************************
+* psx-comBINe CHD (MAME Compressed Hunks of Data) support
+* Writes CD-ROM CHD v5 images from a combined CueSheet, and reads them back
+* as a CueSheet plus binary stream. Hunks are (de)compressed in parallel and
+* handled in order.
+* ADBeta (c)
+******************************************************************************/
+#include "chdfile.hpp"
+#include "cdsector.hpp"
+#include "audiofile.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <array>
+#include <vector>
+
+#include <zlib.h>
+#include <lzma.h>
+
+/*** CHD File Format Constants ***********************************************/
+namespace {
+constexpr uint32_t header_v5_bytes = 124;
+constexpr uint32_t header_version  = 5;
+constexpr uint32_t hunk_bytes      = chd::frames_per_hunk * cdsector::frame_bytes;
+
+// Four character codes, stored big-endian
+constexpr uint32_t FourCC(const char *s) {
+	return (static_cast<uint32_t>(static_cast<uint8_t>(s[0])) << 24) |
+	       (static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 16) |
+	       (static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 8)  |
+	       (static_cast<uint32_t>(static_cast<uint8_t>(s[3])));
+}
+
+constexpr uint32_t codec_zlib     = FourCC("zlib");
+constexpr uint32_t codec_lzma     = FourCC("lzma");
+constexpr uint32_t codec_cd_lzma  = FourCC("cdlz");
+constexpr uint32_t codec_cd_zlib  = FourCC("cdzl");
+constexpr uint32_t meta_track_tag = FourCC("CHT2");
+constexpr uint32_t meta_track_v1  = FourCC("CHTR");
+constexpr uint8_t  meta_checksum  = 0x01;
+
+// Compressors used, in map Type0..Type3 order
+constexpr uint32_t compressors[4] = {codec_cd_lzma, codec_cd_zlib, 0, 0};
+
+/*** Byte Helpers *************************************************************/
+void PutBE(uint8_t *dest, uint64_t value, int bytes) {
+	for(int i = bytes - 1; i >= 0; i--) {
+		dest[i] = static_cast<uint8_t>(value);
+		value >>= 8;
+	}
+}
+
+uint64_t GetBE(const uint8_t *src, int bytes) {
+	uint64_t value = 0;
+	for(int i = 0; i < bytes; i++) value = (value << 8) | src[i];
+	return value;
+}
+
+void AppendBE(std::vector<uint8_t> &dest, uint64_t value, int bytes) {
+	size_t pos = dest.size();
+	dest.resize(pos + static_cast<size_t>(bytes));
+	PutBE(dest.data() + pos, value, bytes);
+}
+
+// Number of bits needed to hold the passed value
+uint8_t BitsForValue(uint64_t value) {
+	uint8_t bits = 0;
+	while(value) { value >>= 1; ++bits; }
+	return bits;
+}
+
+// MSB-first bit writer, as used by the v5 compressed map
+class BitWriter {
+	public:
+	void Write(uint32_t value, int bits) {
+		for(int i = bits - 1; i >= 0; i--) {
+			this->accum = static_cast<uint8_t>((this->accum << 1) | ((value >> i) & 1));
+			if(++this->count == 8) {
+				this->data.push_back(this->accum);
+				this->accum = 0;
+				this->count = 0;
+			}
+		}
+	}
+
+	std::vector<uint8_t> &Flush() {
+		if(this->count) this->Write(0, 8 - this->count);
+		return this->data;
+	}
+
+	private:
+	std::vector<uint8_t> data;
+	uint8_t accum = 0;
+	int count = 0;
+};
+
+// MSB-first bit reader. Reads past the end return zero bits
+class BitReader {
+	public:
+	BitReader(const uint8_t *d, size_t l) : data(d), len(l) {}
+
+	uint32_t Peek(int bits) const {
+		uint32_t value = 0;
+		for(int i = 0; i < bits; i++) {
+			size_t bit = this->pos + static_cast<size_t>(i);
+			uint32_t set = (bit / 8 < this->len) ? ((this->data[bit / 8] >> (7 - (bit % 8))) & 1) : 0;
+			value = (value << 1) | set;
+		}
+		return value;
+	}
+
+	void Remove(int bits) { this->pos += static_cast<size_t>(bits); }
+
+	uint32_t Read(int bits) {
+		uint32_t value = this->Peek(bits);
+		this->Remove(bits);
+		return value;
+	}
+
+	bool Overflow() const { return this->pos > (this->len * 8); }
+
+	private:
+	const uint8_t *data;
+	size_t len;
+	size_t pos = 0;
+};
+
+// Canonical Huffman decoder for the 16 map compression codes (max 8 bits)
+class MapHuffman {
+	public:
+	// Reads the RLE encoded code lengths and builds the lookup table
+	bool Import(BitReader &bits) {
+		uint8_t lengths[16] = {};
+		int code = 0;
+		while(code < 16) {
+			uint32_t len = bits.Read(4);
+			if(len != 1) {
+				lengths[code++] = static_cast<uint8_t>(len);
+				continue;
+			}
+
+			// 1 is an escape: "1 1" is a literal 1, else a repeated length
+			len = bits.Read(4);
+			if(len == 1) {
+				lengths[code++] = 1;
+			} else {
+				uint32_t repeat = bits.Read(4) + 3;
+				while(repeat-- && code < 16) lengths[code++] = static_cast<uint8_t>(len);
+			}
+		}
+
+		// Assign canonical codes, longest codes get the lowest values
+		uint32_t histo[33] = {};
+		for(uint8_t len : lengths) {
+			if(len > 8) return false;
+			histo[len]++;
+		}
+		uint32_t start = 0;
+		for(int len = 32; len > 0; len--) {
+			uint32_t next = (start + histo[len]) >> 1;
+			if(len != 1 && next * 2 != start + histo[len]) return false;
+			histo[len] = start;
+			start = next;
+		}
+
+		for(uint8_t sym = 0; sym < 16; sym++) {
+			uint8_t len = lengths[sym];
+			if(len == 0) continue;
+			uint32_t first = histo[len]++ << (8 - len);
+			for(uint32_t i = 0; i < (1u << (8 - len)); i++)
+				this->lookup[first + i] = static_cast<uint16_t>((sym << 4) | len);
+		}
+		return !bits.Overflow();
+	}
+
+	uint8_t Decode(BitReader &bits) const {
+		uint16_t entry = this->lookup[bits.Peek(8)];
+		bits.Remove(entry & 0x0F);
+		return static_cast<uint8_t>(entry >> 4);
+	}
+
+	private:
+	uint16_t lookup[256] = {};
+};
+
+/*** Codecs ******************************************************************/
+// Compresses src into the end of out. Fails if the result is larger than limit
+using BaseCodec = bool (*)(const uint8_t *src, size_t len,
+                           std::vector<uint8_t> &out, size_t limit);
+
+// Per-thread deflate state, reset between hunks instead of reallocated
+struct Deflater {
+	z_stream strm = {};
+	Deflater() {
+		deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+		             Z_DEFAULT_STRATEGY);
+	}
+	~Deflater() { deflateEnd(&strm); }
+};
+
+bool DeflateRaw(const uint8_t *src, size_t len, std::vector<uint8_t> &out,
+                size_t limit) {
+	thread_local Deflater deflater;
+	z_stream &strm = deflater.strm;
+	deflateReset(&strm);
+
+	size_t start = out.size();
+	out.resize(start + limit);
+	strm.next_in   = const_cast<Bytef *>(src);
+	strm.avail_in  = static_cast<uInt>(len);
+	strm.next_out  = out.data() + start;
+	strm.avail_out = static_cast<uInt>(limit);
+
+	int ret = deflate(&strm, Z_FINISH);
+	out.resize(start + (limit - strm.avail_out));
+	return ret == Z_STREAM_END;
+}
+
+// Mirrors the LZMA SDK dictionary reduction chdman applies for small hunks
+uint32_t LzmaDictSize(size_t len) {
+	for(uint32_t i = 11; i <= 30; i++) {
+		if(len <= (2u << i)) return 2u << i;
+		if(len <= (3u << i)) return 3u << i;
+	}
+	return 1u << 26;
+}
+
+bool LzmaRaw(const uint8_t *src, size_t len, std::vector<uint8_t> &out,
+             size_t limit) {
+	lzma_options_lzma opt;
+	lzma_lzma_preset(&opt, 9);
+	opt.dict_size = LzmaDictSize(len);
+	// CHD streams carry no end marker, the hunk size is known
+	opt.ext_flags = 0;
+	opt.ext_size_low = opt.ext_size_high = UINT32_MAX;
+
+	lzma_filter filters[2] = {
+		{LZMA_FILTER_LZMA1EXT, &opt},
+		{LZMA_VLI_UNKNOWN, nullptr}
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	if(lzma_raw_encoder(&strm, filters) != LZMA_OK) return false;
+
+	size_t start = out.size();
+	out.resize(start + limit);
+	strm.next_in   = src;
+	strm.avail_in  = len;
+	strm.next_out  = out.data() + start;
+	strm.avail_out = limit;
+
+	lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+	out.resize(start + (limit - strm.avail_out));
+	lzma_end(&strm);
+	return ret == LZMA_STREAM_END;
+}
+
+// CD codec wrapper: ECC is stripped from verifiable sectors, then sector data
+// is compressed with the base codec and subcode data with deflate.
+// Output: ECC bitmap, base length, base data, subcode data
+bool CompressCd(const uint8_t *hunk, BaseCodec base, std::vector<uint8_t> &out) {
+	constexpr uint32_t frames = chd::frames_per_hunk;
+	constexpr size_t ecc_bytes = (frames + 7) / 8;
+	constexpr size_t complen_bytes = (hunk_bytes < 65536) ? 2 : 3;
+
+	uint8_t sectors[frames * cdsector::raw_bytes];
+	uint8_t subcode[frames * cdsector::subcode_bytes];
+
+	out.assign(ecc_bytes + complen_bytes, 0x00);
+	for(uint32_t f = 0; f < frames; f++) {
+		const uint8_t *frame = hunk + (f * cdsector::frame_bytes);
+		uint8_t *sector = sectors + (f * cdsector::raw_bytes);
+
+		std::memcpy(sector, frame, cdsector::raw_bytes);
+		std::memcpy(subcode + (f * cdsector::subcode_bytes),
+		            frame + cdsector::raw_bytes, cdsector::subcode_bytes);
+
+		// The decoder regenerates sync and ECC for flagged sectors
+		if(cdsector::HasSync(sector) && cdsector::VerifyEcc(sector)) {
+			out[f / 8] = static_cast<uint8_t>(out[f / 8] | (1 << (f % 8)));
+			std::memset(sector, 0x00, cdsector::sync_bytes);
+			cdsector::ClearEcc(sector);
+		}
+	}
+
+	size_t base_start = out.size();
+	if(!base(sectors, sizeof(sectors), out, hunk_bytes - base_start)) return false;
+	PutBE(out.data() + ecc_bytes, out.size() - base_start, complen_bytes);
+
+	if(out.size() >= hunk_bytes) return false;
+	if(!DeflateRaw(subcode, sizeof(subcode), out, hunk_bytes - out.size())) return false;
+
+	return out.size() < hunk_bytes;
+}
+
+// Raw deflate decompression of exactly len bytes into dest
+bool InflateRaw(const uint8_t *src, size_t src_len, uint8_t *dest, size_t len) {
+	z_stream strm = {};
+	if(inflateInit2(&strm, -MAX_WBITS) != Z_OK) return false;
+
+	strm.next_in   = const_cast<Bytef *>(src);
+	strm.avail_in  = static_cast<uInt>(src_len);
+	strm.next_out  = dest;
+	strm.avail_out = static_cast<uInt>(len);
+
+	int ret = inflate(&strm, Z_FINISH);
+	bool ok = (ret == Z_STREAM_END || ret == Z_OK || ret == Z_BUF_ERROR) &&
+	          strm.avail_out == 0;
+	inflateEnd(&strm);
+	return ok;
+}
+
+// Raw LZMA decompression of exactly len bytes, with or without end marker
+bool LzmaRawDecode(const uint8_t *src, size_t src_len, uint8_t *dest, size_t len) {
+	lzma_options_lzma opt;
+	lzma_lzma_preset(&opt, 9);
+	opt.dict_size = LzmaDictSize(len);
+	opt.ext_flags = LZMA_LZMA1EXT_ALLOW_EOPM;
+	opt.ext_size_low = static_cast<uint32_t>(len);
+	opt.ext_size_high = static_cast<uint32_t>(static_cast<uint64_t>(len) >> 32);
+
+	lzma_filter filters[2] = {
+		{LZMA_FILTER_LZMA1EXT, &opt},
+		{LZMA_VLI_UNKNOWN, nullptr}
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	if(lzma_raw_decoder(&strm, filters) != LZMA_OK) return false;
+
+	strm.next_in   = src;
+	strm.avail_in  = src_len;
+	strm.next_out  = dest;
+	strm.avail_out = len;
+
+	lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+	bool ok = (ret == LZMA_STREAM_END || ret == LZMA_OK) && strm.avail_out == 0;
+	lzma_end(&strm);
+	return ok;
+}
+
+// Reverses CompressCd(), restoring sync and ECC for flagged sectors
+bool DecompressCd(const uint8_t *src, size_t src_len, uint8_t *dest,
+                  size_t dest_len, bool lzma_base) {
+	const size_t frames = dest_len / cdsector::frame_bytes;
+	const size_t ecc_bytes = (frames + 7) / 8;
+	const size_t complen_bytes = (dest_len < 65536) ? 2 : 3;
+	const size_t header_bytes = ecc_bytes + complen_bytes;
+	if(src_len < header_bytes) return false;
+
+	size_t base_len = GetBE(src + ecc_bytes, static_cast<int>(complen_bytes));
+	if(header_bytes + base_len > src_len) return false;
+
+	std::vector<uint8_t> sectors(frames * cdsector::raw_bytes);
+	std::vector<uint8_t> subcode(frames * cdsector::subcode_bytes);
+
+	const uint8_t *base = src + header_bytes;
+	bool ok = lzma_base ? LzmaRawDecode(base, base_len, sectors.data(), sectors.size())
+	                    : InflateRaw(base, base_len, sectors.data(), sectors.size());
+	if(!ok) return false;
+	if(!InflateRaw(base + base_len, src_len - header_bytes - base_len,
+	               subcode.data(), subcode.size())) return false;
+
+	for(size_t f = 0; f < frames; f++) {
+		uint8_t *frame = dest + (f * cdsector::frame_bytes);
+		std::memcpy(frame, sectors.data() + (f * cdsector::raw_bytes), cdsector::raw_bytes);
+		std::memcpy(frame + cdsector::raw_bytes,
+		            subcode.data() + (f * cdsector::subcode_bytes), cdsector::subcode_bytes);
+
+		if(src[f / 8] & (1 << (f % 8))) {
+			std::memcpy(frame, cdsector::sync_pattern, cdsector::sync_bytes);
+			cdsector::GenerateEcc(frame);
+		}
+	}
+	return true;
+}
+
+// Pipeline job. Output layout: [compression type][crc16 BE][payload]
+void CompressHunk(const std::vector<uint8_t> &hunk, std::vector<uint8_t> &out) {
+	static const BaseCodec codecs[2] = {LzmaRaw, DeflateRaw};
+
+	uint16_t crc = chd::Crc16(hunk.data(), hunk.size());
+	std::vector<uint8_t> best, attempt;
+	uint8_t best_type = chd::None;
+
+	for(uint8_t type = 0; type < 2; type++) {
+		if(CompressCd(hunk.data(), codecs[type], attempt) &&
+		   (best.empty() || attempt.size() < best.size())) {
+			best.swap(attempt);
+			best_type = type;
+		}
+	}
+	if(best_type == chd::None) best = hunk;
+
+	out.resize(3 + best.size());
+	out[0] = best_type;
+	PutBE(out.data() + 1, crc, 2);
+	std::memcpy(out.data() + 3, best.data(), best.size());
+}
+} // namespace
+
+/*** CHD Helpers **************************************************************/
+std::string chd::TrackTypeToChd(const CueSheet::TrackType type) {
+	std::string type_str;
+	     if(type == CueSheet::TrackType::AUDIO)      type_str = "AUDIO";
+	else if(type == CueSheet::TrackType::CDG)        type_str = "AUDIO";
+	else if(type == CueSheet::TrackType::MODE1_2048) type_str = "MODE1";
+	else if(type == CueSheet::TrackType::MODE1_2352) type_str = "MODE1_RAW";
+	else if(type == CueSheet::TrackType::MODE2_2336) type_str = "MODE2_FORM_MIX";
+	else if(type == CueSheet::TrackType::MODE2_2352) type_str = "MODE2_RAW";
+	else if(type == CueSheet::TrackType::CDI_2336)   type_str = "MODE2_FORM_MIX";
+	else if(type == CueSheet::TrackType::CDI_2352)   type_str = "MODE2_RAW";
+
+	return type_str;
+}
+
+CueSheet::TrackType chd::ChdToTrackType(const std::string &type,
+                                        const std::string &subtype) {
+	CueSheet::TrackType track_type = CueSheet::TrackType::Invalid;
+	     if(type == "AUDIO" && subtype == "RW_RAW") track_type = CueSheet::TrackType::CDG;
+	else if(type == "AUDIO")                       track_type = CueSheet::TrackType::AUDIO;
+	else if(type == "MODE1")                       track_type = CueSheet::TrackType::MODE1_2048;
+	else if(type == "MODE1_RAW")                   track_type = CueSheet::TrackType::MODE1_2352;
+	else if(type == "MODE2")                       track_type = CueSheet::TrackType::MODE2_2336;
+	else if(type == "MODE2_FORM_MIX")              track_type = CueSheet::TrackType::MODE2_2336;
+	else if(type == "MODE2_RAW")                   track_type = CueSheet::TrackType::MODE2_2352;
+
+	return track_type;
+}
+
+uint16_t chd::Crc16(const uint8_t *data, size_t len) {
+	// CRC-16/CCITT, poly 0x1021, init 0xFFFF, table built at compile time
+	struct Table {
+		uint16_t v[256];
+		constexpr Table() : v() {
+			for(uint32_t i = 0; i < 256; i++) {
+				uint32_t crc = i << 8;
+				for(int b = 0; b < 8; b++) crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+				v[i] = static_cast<uint16_t>(crc);
+			}
+		}
+	};
+	static constexpr Table table;
+
+	uint16_t crc = 0xFFFF;
+	while(len--) crc = static_cast<uint16_t>((crc << 8) ^ table.v[(crc >> 8) ^ *data++]);
+	return crc;
+}
+
+/*** CHD Writer ***************************************************************/
+ChdWriter::ChdWriter(const std::filesystem::path &path, const CueSheet &combined,
+                     unsigned threads)
+                     : logical_bytes(0), next_hunk_offset(0), track_idx(0),
+                       track_frame(0), sector_fill(0), hunk(hunk_bytes, 0x00),
+                       hunk_frames(0), closed(false) {
+	if(combined.FileList.size() != 1)
+		throw std::runtime_error("CHD output requires a combined single FILE cue sheet");
+
+	// Work out each track's frames from its first index to the next track's
+	const CueSheet::FileObj &file = combined.FileList.front();
+	std::vector<uint32_t> starts;
+	for(const auto &t_itr : file.TrackList) {
+		InputTrack track = {};
+		track.meta.type = t_itr.type;
+		track.sector_bytes = CueSheet::GetSectorBytesInTrackType(t_itr.type);
+		track.swap_audio = (t_itr.type == CueSheet::TrackType::AUDIO ||
+		                    t_itr.type == CueSheet::TrackType::CDG);
+		if(track.sector_bytes == 0 || chd::TrackTypeToChd(t_itr.type).empty())
+			throw std::runtime_error("CHD output does not support this TRACK type");
+
+		// The first track also owns anything before its first index. A bad or
+		// backwards INDEX would wrap the sizes below, and the frame count with it
+		for(const auto &i_itr : t_itr.IndexList) {
+			if(i_itr.sector == CueSheet::timestamp_nval)
+				throw std::runtime_error("CHD output needs valid INDEX timestamps");
+		}
+		uint32_t start = 0;
+		if(!starts.empty()) {
+			start = t_itr.IndexList.empty() ? starts.back()
+			                                : t_itr.IndexList.front().Bytes(t_itr.type);
+			if(start < starts.back())
+				throw std::runtime_error("CHD output needs TRACKs in INDEX order");
+		}
+		uint32_t index_one = start;
+		for(const auto &i_itr : t_itr.IndexList) {
+			if(i_itr.id == 1) index_one = i_itr.Bytes(t_itr.type);
+		}
+		if(index_one < start)
+			throw std::runtime_error("CHD output needs INDEX 01 after the TRACK's first INDEX");
+
+		track.meta.pregap = (index_one - start) / track.sector_bytes;
+		track.meta.pregap_data = (track.meta.pregap != 0);
+
+		// PREGAP/POSTGAP commands are silence that is not in the .bin. A
+		// PREGAP only fits where there is no INDEX 00 region already
+		if(!track.meta.pregap_data && t_itr.pregap) track.meta.pregap = t_itr.pregap;
+		track.meta.postgap = t_itr.postgap;
+		starts.push_back(start);
+		this->tracks.push_back(track);
+	}
+
+	for(size_t t = 0; t < this->tracks.size(); t++) {
+		uint32_t end = (t + 1 < starts.size()) ? starts[t + 1] : file.bytes;
+		uint32_t bytes = end > starts[t] ? end - starts[t] : 0;
+		uint16_t sect = this->tracks[t].sector_bytes;
+
+		this->tracks[t].meta.frames = (bytes + sect - 1) / sect;
+		this->logical_bytes += static_cast<uint64_t>(
+			chd::PaddedFrames(this->tracks[t].meta.frames)) * cdsector::frame_bytes;
+	}
+
+	this->file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!this->file) throw std::runtime_error("Output CHD file could not be created");
+
+	// Reserve the header, then write the metadata. Hunks follow directly
+	this->BuildMetadata();
+	std::vector<uint8_t> blank(header_v5_bytes, 0x00);
+	this->file.write(reinterpret_cast<const char *>(blank.data()), header_v5_bytes);
+	this->file.write(reinterpret_cast<const char *>(this->metadata.data()),
+	                 static_cast<std::streamsize>(this->metadata.size()));
+	this->next_hunk_offset = header_v5_bytes + this->metadata.size();
+
+	this->pipeline.reset(new OrderedPipeline(
+		[this](OrderedPipeline::Buffer &out) { this->WriteHunk(out); }, threads));
+}
+
+ChdWriter::~ChdWriter() {
+	// Stop the workers before the members they reference are destroyed
+	this->pipeline.reset();
+}
+
+void ChdWriter::BuildMetadata() {
+	// One CHT2 entry per track. The overall SHA1 covers each entry's tag and
+	// data hash, sorted
+	std::vector<std::array<uint8_t, 24>> hashes;
+
+	for(size_t t = 0; t < this->tracks.size(); t++) {
+		const chd::TrackMeta &meta = this->tracks[t].meta;
+		std::string type = chd::TrackTypeToChd(meta.type);
+		std::string sub = (meta.type == CueSheet::TrackType::CDG) ? "RW_RAW" : "NONE";
+
+		std::string text = "TRACK:" + std::to_string(t + 1)
+		                 + " TYPE:" + type
+		                 + " SUBTYPE:" + sub
+		                 + " FRAMES:" + std::to_string(meta.frames)
+		                 + " PREGAP:" + std::to_string(meta.pregap)
+		                 + " PGTYPE:" + (meta.pregap_data ? "V" + type : "MODE1")
+		                 + " PGSUB:" + sub
+		                 + " POSTGAP:" + std::to_string(meta.postgap);
+		size_t len = text.length() + 1;
+
+		// Entry: tag, flags, 24-bit length, next entry offset, data
+		uint64_t entry_offset = header_v5_bytes + this->metadata.size();
+		bool last = (t + 1 == this->tracks.size());
+		AppendBE(this->metadata, meta_track_tag, 4);
+		AppendBE(this->metadata, (static_cast<uint32_t>(meta_checksum) << 24) | len, 4);
+		AppendBE(this->metadata, last ? 0 : entry_offset + 16 + len, 8);
+		this->metadata.insert(this->metadata.end(), text.c_str(), text.c_str() + len);
+
+		Sha1 sha;
+		sha.Update(text.c_str(), len);
+		Sha1::Digest digest = sha.Final();
+		std::array<uint8_t, 24> hash;
+		PutBE(hash.data(), meta_track_tag, 4);
+		std::copy(digest.begin(), digest.end(), hash.begin() + 4);
+		hashes.push_back(hash);
+	}
+
+	std::sort(hashes.begin(), hashes.end());
+	for(const auto &hash : hashes) {
+		this->metadata_hashes.insert(this->metadata_hashes.end(), hash.begin(), hash.end());
+	}
+}
+
+void ChdWriter::Write(const char *data, size_t len) {
+	const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+
+	while(len) {
+		this->SkipFinishedTracks();
+		// Data past the end of the described layout is dropped
+		if(this->track_idx >= this->tracks.size()) break;
+
+		const InputTrack &track = this->tracks[this->track_idx];
+		uint8_t *frame = this->hunk.data() + (this->hunk_frames * cdsector::frame_bytes);
+
+		size_t take = std::min(len, track.sector_bytes - this->sector_fill);
+		std::memcpy(frame + this->sector_fill, src, take);
+		this->sector_fill += take;
+		src += take;
+		len -= take;
+
+		if(this->sector_fill == track.sector_bytes) this->FinishFrame();
+	}
+}
+
+void ChdWriter::FinishFrame() {
+	const InputTrack &track = this->tracks[this->track_idx];
+	uint8_t *frame = this->hunk.data() + (this->hunk_frames * cdsector::frame_bytes);
+
+	// CHD stores audio samples big-endian. CDG subcode follows them unswapped
+	if(track.swap_audio) SwapAudioBytes(frame, cdsector::raw_bytes);
+
+	this->sector_fill = 0;
+	++this->track_frame;
+	if(++this->hunk_frames == chd::frames_per_hunk) this->SubmitHunk();
+}
+
+void ChdWriter::SkipFinishedTracks() {
+	while(this->track_idx < this->tracks.size() &&
+	      this->track_frame >= this->tracks[this->track_idx].meta.frames) {
+		// Pad the finished track with blank frames
+		uint32_t frames = this->tracks[this->track_idx].meta.frames;
+		for(uint32_t f = frames; f < chd::PaddedFrames(frames); f++) {
+			if(++this->hunk_frames == chd::frames_per_hunk) this->SubmitHunk();
+		}
+
+		++this->track_idx;
+		this->track_frame = 0;
+	}
+}
+
+void ChdWriter::SubmitHunk() {
+	size_t bytes = this->hunk_frames * cdsector::frame_bytes;
+	this->raw_sha1.Update(this->hunk.data(), bytes);
+
+	std::vector<uint8_t> job_hunk(hunk_bytes, 0x00);
+	job_hunk.swap(this->hunk);
+	this->hunk_frames = 0;
+
+	this->pipeline->Submit([job_hunk](OrderedPipeline::Buffer &out) {
+		CompressHunk(job_hunk, out);
+	});
+}
+
+void ChdWriter::WriteHunk(std::vector<uint8_t> &compressed) {
+	MapEntry entry;
+	entry.compression = compressed[0];
+	entry.crc = static_cast<uint16_t>((compressed[1] << 8) | compressed[2]);
+	entry.length = static_cast<uint32_t>(compressed.size() - 3);
+	entry.offset = this->next_hunk_offset;
+
+	this->file.write(reinterpret_cast<const char *>(compressed.data() + 3), entry.length);
+	if(!this->file) throw std::runtime_error("Failed to write to output CHD file");
+
+	this->next_hunk_offset += entry.length;
+	this->map.push_back(entry);
+}
+
+void ChdWriter::Close() {
+	if(this->closed) return;
+	this->closed = true;
+
+	// Finish a partial sector, then blank-fill anything the stream was missing
+	if(this->sector_fill) {
+		uint8_t *frame = this->hunk.data() + (this->hunk_frames * cdsector::frame_bytes);
+		std::memset(frame + this->sector_fill, 0x00,
+		            cdsector::frame_bytes - this->sector_fill);
+		this->FinishFrame();
+	}
+	while(this->track_idx < this->tracks.size()) {
+		this->SkipFinishedTracks();
+		if(this->track_idx >= this->tracks.size()) break;
+		this->FinishFrame();
+	}
+	if(this->hunk_frames) this->SubmitHunk();
+	this->pipeline->Finish();
+
+	uint64_t map_offset = this->next_hunk_offset;
+	this->WriteMap();
+	this->WriteHeader(map_offset);
+
+	this->file.close();
+	if(this->file.fail()) throw std::runtime_error("Failed to close output CHD file");
+}
+
+void ChdWriter::WriteMap() {
+	// Build the raw map first, its CRC is stored to validate decoding
+	std::vector<uint8_t> raw(this->map.size() * 12, 0x00);
+	uint32_t max_length = 0;
+	for(size_t h = 0; h < this->map.size(); h++) {
+		const MapEntry &entry = this->map[h];
+		uint8_t *dest = raw.data() + (h * 12);
+		dest[0] = entry.compression;
+		PutBE(dest + 1, entry.length, 3);
+		PutBE(dest + 4, entry.offset, 6);
+		PutBE(dest + 10, entry.crc, 2);
+		if(entry.compression < chd::None) max_length = std::max(max_length, entry.length);
+	}
+	uint8_t length_bits = BitsForValue(max_length);
+
+	// Huffman tree: all 16 compression codes get a 4 bit code, so each code
+	// is its own value. Lengths are written raw, 4 bits each
+	BitWriter bits;
+	for(int code = 0; code < 16; code++) bits.Write(4, 4);
+
+	// Compression types, with runs of the previous type RLE encoded
+	uint8_t last = 0;
+	for(size_t h = 0; h < this->map.size(); ) {
+		uint8_t comp = this->map[h].compression;
+		size_t run = 1;
+		while(h + run < this->map.size() && this->map[h + run].compression == comp) ++run;
+		h += run;
+
+		if(comp != last) {
+			bits.Write(comp, 4);
+			last = comp;
+			--run;
+		}
+		while(run) {
+			if(run >= 19) {
+				size_t n = std::min<size_t>(run, 19 + 255);
+				bits.Write(chd::RleLarge, 4);
+				bits.Write(static_cast<uint32_t>((n - 19) >> 4), 4);
+				bits.Write(static_cast<uint32_t>((n - 19) & 0x0F), 4);
+				run -= n;
+			} else if(run >= 3) {
+				bits.Write(chd::RleSmall, 4);
+				bits.Write(static_cast<uint32_t>(run - 3), 4);
+				run = 0;
+			} else {
+				bits.Write(comp, 4);
+				--run;
+			}
+		}
+	}
+
+	// Per-hunk lengths and CRCs. Offsets are implied by the hunk order
+	for(const MapEntry &entry : this->map) {
+		if(entry.compression < chd::None) bits.Write(entry.length, length_bits);
+		bits.Write(entry.crc, 16);
+	}
+	std::vector<uint8_t> &packed = bits.Flush();
+
+	uint8_t map_header[16] = {};
+	PutBE(map_header + 0, packed.size(), 4);
+	PutBE(map_header + 4, header_v5_bytes + this->metadata.size(), 6);
+	PutBE(map_header + 10, chd::Crc16(raw.data(), raw.size()), 2);
+	map_header[12] = length_bits;
+
+	this->file.write(reinterpret_cast<const char *>(map_header), sizeof(map_header));
+	this->file.write(reinterpret_cast<const char *>(packed.data()),
+	                 static_cast<std::streamsize>(packed.size()));
+	if(!this->file) throw std::runtime_error("Failed to write CHD hunk map");
+}
+
+void ChdWriter::WriteHeader(uint64_t map_offset) {
+	Sha1::Digest raw_digest = this->raw_sha1.Final();
+
+	// The overall SHA1 combines the raw data hash with the metadata hashes
+	Sha1 overall;
+	overall.Update(raw_digest.data(), raw_digest.size());
+	overall.Update(this->metadata_hashes.data(), this->metadata_hashes.size());
+	Sha1::Digest overall_digest = overall.Final();
+
+	uint8_t header[header_v5_bytes] = {};
+	std::memcpy(header, "MComprHD", 8);
+	PutBE(header + 8, header_v5_bytes, 4);
+	PutBE(header + 12, header_version, 4);
+	for(int i = 0; i < 4; i++) PutBE(header + 16 + (i * 4), compressors[i], 4);
+	PutBE(header + 32, this->logical_bytes, 8);
+	PutBE(header + 40, map_offset, 8);
+	PutBE(header + 48, this->metadata.empty() ? 0 : header_v5_bytes, 8);
+	PutBE(header + 56, hunk_bytes, 4);
+	PutBE(header + 60, cdsector::frame_bytes, 4);
+	std::memcpy(header + 64, raw_digest.data(), 20);
+	std::memcpy(header + 84, overall_digest.data(), 20);
+
+	this->file.seekp(0, std::ios::beg);
+	this->file.write(reinterpret_cast<const char *>(header), sizeof(header));
+	if(!this->file) throw std::runtime_error("Failed to write CHD header");
+}
+
+/*** CHD Reader ***************************************************************/
+ChdReader::ChdReader(const std::filesystem::path &path) {
+	this->file.open(path, std::ios::in | std::ios::binary);
+	if(!this->file) throw std::runtime_error("Input CHD file could not be opened");
+
+	uint8_t header[header_v5_bytes];
+	this->ReadAt(0, header, sizeof(header));
+	if(std::memcmp(header, "MComprHD", 8) != 0)
+		throw std::runtime_error("Input file is not a CHD");
+	if(GetBE(header + 12, 4) != header_version)
+		throw std::runtime_error("Only CHD version 5 is supported");
+
+	for(int i = 0; i < 4; i++)
+		this->compressors[i] = static_cast<uint32_t>(GetBE(header + 16 + (i * 4), 4));
+	this->logical_bytes = GetBE(header + 32, 8);
+	this->hunk_bytes = static_cast<uint32_t>(GetBE(header + 56, 4));
+	this->unit_bytes = static_cast<uint32_t>(GetBE(header + 60, 4));
+
+	if(this->unit_bytes != cdsector::frame_bytes || this->hunk_bytes == 0 ||
+	   this->hunk_bytes % cdsector::frame_bytes != 0)
+		throw std::runtime_error("CHD is not a CD-ROM image");
+
+	for(int i = 20; i > 0; i--) {
+		if(header[103 + i] != 0) throw std::runtime_error("CHDs with a parent are not supported");
+	}
+
+	this->ReadMap(GetBE(header + 40, 8));
+	this->ReadMetadata(GetBE(header + 48, 8));
+}
+
+void ChdReader::ReadAt(uint64_t offset, uint8_t *dest, size_t len) {
+	std::lock_guard<std::mutex> lock(this->file_mtx);
+	this->file.clear();
+	this->file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	this->file.read(reinterpret_cast<char *>(dest), static_cast<std::streamsize>(len));
+	if(!this->file) throw std::runtime_error("Failed to read from CHD file");
+}
+
+void ChdReader::ReadMap(uint64_t map_offset) {
+	uint64_t hunk_count = (this->logical_bytes + this->hunk_bytes - 1) / this->hunk_bytes;
+	this->map.resize(hunk_count);
+
+	// Uncompressed map: one 32-bit hunk index per hunk, 0 means a blank hunk
+	if(this->compressors[0] == 0) {
+		std::vector<uint8_t> raw(hunk_count * 4);
+		this->ReadAt(map_offset, raw.data(), raw.size());
+		for(size_t h = 0; h < hunk_count; h++) {
+			MapEntry &entry = this->map[h];
+			entry.compression = chd::None;
+			entry.offset = GetBE(raw.data() + (h * 4), 4) * this->hunk_bytes;
+			entry.length = entry.offset ? this->hunk_bytes : 0;
+			entry.crc = 0;
+		}
+		return;
+	}
+
+	uint8_t map_header[16];
+	this->ReadAt(map_offset, map_header, sizeof(map_header));
+	uint32_t map_bytes = static_cast<uint32_t>(GetBE(map_header + 0, 4));
+	uint64_t offset = GetBE(map_header + 4, 6);
+	uint16_t map_crc = static_cast<uint16_t>(GetBE(map_header + 10, 2));
+	int length_bits = map_header[12];
+	int self_bits = map_header[13];
+	int parent_bits = map_header[14];
+
+	std::vector<uint8_t> packed(map_bytes);
+	this->ReadAt(map_offset + sizeof(map_header), packed.data(), packed.size());
+	BitReader bits(packed.data(), packed.size());
+
+	MapHuffman huffman;
+	if(!huffman.Import(bits)) throw std::runtime_error("CHD hunk map is corrupt");
+
+	// Compression types, with RLE runs of the previous type
+	uint8_t last = 0;
+	uint32_t repeat = 0;
+	for(auto &entry : this->map) {
+		if(repeat > 0) {
+			entry.compression = last;
+			--repeat;
+			continue;
+		}
+
+		uint8_t value = huffman.Decode(bits);
+		if(value == chd::RleSmall) {
+			entry.compression = last;
+			repeat = 2 + huffman.Decode(bits);
+		} else if(value == chd::RleLarge) {
+			entry.compression = last;
+			repeat = 2 + 16 + (static_cast<uint32_t>(huffman.Decode(bits)) << 4);
+			repeat += huffman.Decode(bits);
+		} else {
+			entry.compression = last = value;
+		}
+	}
+
+	// Lengths, offsets and CRCs. Rebuild the raw map to check its CRC
+	std::vector<uint8_t> raw(hunk_count * 12);
+	uint64_t last_self = 0;
+	for(size_t h = 0; h < hunk_count; h++) {
+		MapEntry &entry = this->map[h];
+		entry.offset = offset;
+		entry.length = 0;
+		entry.crc = 0;
+
+		switch(entry.compression) {
+			case chd::Type0: case chd::Type1: case chd::Type2: case chd::Type3:
+				entry.length = bits.Read(length_bits);
+				entry.crc = static_cast<uint16_t>(bits.Read(16));
+				offset += entry.length;
+				break;
+
+			case chd::None:
+				entry.length = this->hunk_bytes;
+				entry.crc = static_cast<uint16_t>(bits.Read(16));
+				offset += entry.length;
+				break;
+
+			case chd::Self:
+				entry.offset = last_self = bits.Read(self_bits);
+				break;
+
+			case chd::Self1:
+				++last_self;
+				// fall through
+			case chd::Self0:
+				entry.compression = chd::Self;
+				entry.offset = last_self;
+				break;
+
+			case chd::Parent:
+				bits.Read(parent_bits);
+				// fall through
+			default:
+				throw std::runtime_error("CHDs with a parent are not supported");
+		}
+
+		// A hunk can only repeat an earlier one, or reading it never ends
+		if(entry.compression == chd::Self && entry.offset >= h)
+			throw std::runtime_error("CHD hunk map is corrupt");
+
+		uint8_t *dest = raw.data() + (h * 12);
+		dest[0] = entry.compression;
+		PutBE(dest + 1, entry.length, 3);
+		PutBE(dest + 4, entry.offset, 6);
+		PutBE(dest + 10, entry.crc, 2);
+	}
+
+	if(bits.Overflow() || chd::Crc16(raw.data(), raw.size()) != map_crc)
+		throw std::runtime_error("CHD hunk map is corrupt");
+
+	// Point repeats of repeats at the hunk with the data, so ReadHunk() only
+	// has one step to take however long the chain
+	for(auto &entry : this->map) {
+		if(entry.compression == chd::Self && this->map[entry.offset].compression == chd::Self)
+			entry.offset = this->map[entry.offset].offset;
+	}
+}
+
+void ChdReader::ReadMetadata(uint64_t meta_offset) {
+	uint32_t start_frame = 0;
+
+	while(meta_offset != 0) {
+		uint8_t entry[16];
+		this->ReadAt(meta_offset, entry, sizeof(entry));
+		uint32_t tag = static_cast<uint32_t>(GetBE(entry, 4));
+		uint32_t len = static_cast<uint32_t>(GetBE(entry + 5, 3));
+		uint64_t data_offset = meta_offset + sizeof(entry);
+		meta_offset = GetBE(entry + 8, 8);
+
+		if(tag != meta_track_tag && tag != meta_track_v1) continue;
+
+		std::string text(len, '\0');
+		this->ReadAt(data_offset, reinterpret_cast<uint8_t *>(&text[0]), len);
+		text.resize(text.find('\0') == std::string::npos ? len : text.find('\0'));
+
+		// "KEY:VALUE" pairs separated by spaces
+		std::string type, subtype = "NONE", pgtype;
+		InputTrack track = {};
+		std::istringstream fields(text);
+		std::string field;
+		while(fields >> field) {
+			size_t colon = field.find(':');
+			if(colon == std::string::npos) continue;
+			std::string key = field.substr(0, colon), value = field.substr(colon + 1);
+
+			     if(key == "TYPE")    type = value;
+			else if(key == "SUBTYPE") subtype = value;
+			else if(key == "PGTYPE")  pgtype = value;
+			else if(key == "FRAMES")  track.meta.frames  = static_cast<uint32_t>(std::stoul(value));
+			else if(key == "PREGAP")  track.meta.pregap  = static_cast<uint32_t>(std::stoul(value));
+			else if(key == "POSTGAP") track.meta.postgap = static_cast<uint32_t>(std::stoul(value));
+		}
+
+		track.meta.type = chd::ChdToTrackType(type, subtype);
+		if(track.meta.type == CueSheet::TrackType::Invalid)
+			throw std::runtime_error("CHD contains a track type with no cue equivalent");
+
+		track.meta.pregap_data = (!pgtype.empty() && pgtype[0] == 'V');
+		track.sector_bytes = CueSheet::GetSectorBytesInTrackType(track.meta.type);
+		track.swap_audio = (track.meta.type == CueSheet::TrackType::AUDIO ||
+		                    track.meta.type == CueSheet::TrackType::CDG);
+		track.start_frame = start_frame;
+		start_frame += chd::PaddedFrames(track.meta.frames);
+
+		this->tracks.push_back(track);
+	}
+
+	if(this->tracks.empty()) throw std::runtime_error("CHD has no CD track metadata");
+}
+
+void ChdReader::GetCueSheet(CueSheet &cs, const std::string &bin_name) const {
+	cs.Clear();
+
+	cs.PushFile(CueSheet::FileObj(bin_name, "BINARY", static_cast<uint32_t>(this->BinaryBytes())));
+
+	uint32_t offset = 0;
+	for(size_t t = 0; t < this->tracks.size(); t++) {
+		const InputTrack &track = this->tracks[t];
+		CueSheet::FileObj::TrackObj cue_track(static_cast<uint16_t>(t + 1), track.meta.type);
+
+		// A pregap that is not stored, and any postgap, become PREGAP/POSTGAP
+		if(!track.meta.pregap_data) cue_track.pregap = track.meta.pregap;
+		cue_track.postgap = track.meta.postgap;
+		cs.PushTrack(&cue_track);
+
+		// INDEXs are in sectors of the track's own type from the start of the
+		// .BIN, so each track has to start on a whole one
+		if(offset % track.sector_bytes != 0) throw timestamp_bytes_mismatch;
+		uint32_t sector = offset / track.sector_bytes;
+
+		// A stored pregap becomes the INDEX 00 to INDEX 01 region
+		if(track.meta.pregap_data && track.meta.pregap) {
+			CueSheet::FileObj::TrackObj::IndexObj index0(0, sector);
+			cs.PushIndex(&index0);
+		}
+		uint32_t pregap = track.meta.pregap_data ? track.meta.pregap : 0;
+		CueSheet::FileObj::TrackObj::IndexObj index1(1, sector + pregap);
+		cs.PushIndex(&index1);
+
+		offset += track.meta.frames * track.sector_bytes;
+	}
+}
+
+uint64_t ChdReader::BinaryBytes() const {
+	uint64_t bytes = 0;
+	for(const auto &track : this->tracks) {
+		bytes += static_cast<uint64_t>(track.meta.frames) * track.sector_bytes;
+	}
+	return bytes;
+}
+
+void ChdReader::Stream(const StreamCallback &out, unsigned threads) {
+	// Only hunks up to the end of the last track's data are needed
+	const InputTrack &last = this->tracks.back();
+	uint64_t frames = static_cast<uint64_t>(last.start_frame) + last.meta.frames;
+	uint32_t frames_per_hunk = this->hunk_bytes / cdsector::frame_bytes;
+	uint32_t hunks = static_cast<uint32_t>((frames + frames_per_hunk - 1) / frames_per_hunk);
+
+	OrderedPipeline pipeline([&out](OrderedPipeline::Buffer &data) {
+		out(reinterpret_cast<const char *>(data.data()), data.size());
+	}, threads);
+
+	for(uint32_t hunk = 0; hunk < hunks; hunk++) {
+		pipeline.Submit([this, hunk](OrderedPipeline::Buffer &data) {
+			std::vector<uint8_t> raw;
+			this->ReadHunk(hunk, raw);
+			this->ExtractSectors(hunk, raw, data);
+		});
+	}
+	pipeline.Finish();
+}
+
+void ChdReader::ReadHunk(uint32_t hunk, std::vector<uint8_t> &out) {
+	if(hunk >= this->map.size()) throw std::runtime_error("CHD hunk out of range");
+	const MapEntry &entry = this->map[hunk];
+	out.assign(this->hunk_bytes, 0x00);
+
+	if(entry.compression == chd::Self) {
+		this->ReadHunk(static_cast<uint32_t>(entry.offset), out);
+		return;
+	}
+	if(entry.length == 0) return;
+
+	std::vector<uint8_t> src(entry.length);
+	this->ReadAt(entry.offset, src.data(), src.size());
+
+	if(entry.compression == chd::None) {
+		out.swap(src);
+	} else {
+		this->Decompress(this->compressors[entry.compression], src.data(), src.size(), out.data());
+	}
+
+	if(this->compressors[0] != 0 && chd::Crc16(out.data(), out.size()) != entry.crc)
+		throw std::runtime_error("CHD hunk failed its CRC check");
+}
+
+void ChdReader::Decompress(uint32_t codec, const uint8_t *src, size_t len, uint8_t *dest) {
+	bool ok = false;
+	     if(codec == codec_cd_lzma) ok = DecompressCd(src, len, dest, this->hunk_bytes, true);
+	else if(codec == codec_cd_zlib) ok = DecompressCd(src, len, dest, this->hunk_bytes, false);
+	else if(codec == codec_lzma)    ok = LzmaRawDecode(src, len, dest, this->hunk_bytes);
+	else if(codec == codec_zlib)    ok = InflateRaw(src, len, dest, this->hunk_bytes);
+	else throw std::runtime_error("CHD uses an unsupported codec (FLAC, Huffman or zstd)");
+
+	if(!ok) throw std::runtime_error("CHD hunk failed to decompress");
+}
+
+void ChdReader::ExtractSectors(uint32_t hunk, const std::vector<uint8_t> &frames,
+                               std::vector<uint8_t> &out) const {
+	uint32_t frames_per_hunk = this->hunk_bytes / cdsector::frame_bytes;
+	uint32_t first = hunk * frames_per_hunk;
+	out.clear();
+	out.reserve(static_cast<size_t>(frames_per_hunk) * cdsector::raw_bytes);
+
+	// Find the track containing the first frame, then walk forward
+	auto track = std::upper_bound(this->tracks.begin(), this->tracks.end(), first,
+		[](uint32_t frame, const InputTrack &t) { return frame < t.start_frame; });
+	if(track != this->tracks.begin()) --track;
+
+	for(uint32_t f = 0; f < frames_per_hunk; f++) {
+		uint32_t frame_num = first + f;
+		while(track != this->tracks.end() &&
+		      frame_num >= track->start_frame + chd::PaddedFrames(track->meta.frames)) ++track;
+		if(track == this->tracks.end()) break;
+
+		// Padding frames between tracks are not part of the .bin
+		if(frame_num >= track->start_frame + track->meta.frames) continue;
+
+		const uint8_t *frame = frames.data() + (static_cast<size_t>(f) * cdsector::frame_bytes);
+		size_t pos = out.size();
+		out.insert(out.end(), frame, frame + track->sector_bytes);
+
+		// Only the samples are swapped, never CDG subcode after them
+		if(track->swap_audio) SwapAudioBytes(out.data() + pos, cdsector::raw_bytes);
+	}
+}
@@ -10,18 +10,27 @@
 * See example.cpp for an example how to use the library
 *******************************************************************************/
 #include <string>
-#include <list>
+#include <string_view>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <charconv>
+#include <system_error>
 #include <cctype>
 #include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <array>
 
 #include "cuehandler.hpp"
+#include "audiofile.hpp"
 
 /*** Cue File/Sheet Exceptions ************************************************/
 CueException file_invalid("Filename given cannot be opened or is invalid");
 CueException internal_file_invalid("A file defined in .cue cannot be opened or is invalid");
-CueException line_invalid("A TRACK type in the cue file is not recognised");
+CueException internal_file_bad_audio("A WAVE/AIFF file in .cue is not 44.1kHz 16-bit stereo PCM");
+CueException line_invalid("A line in the cue file is not recognised");
+CueException command_invalid("A command in the cue file has a missing or invalid value");
 
 CueException file_push_null_input("Push To File has nullptr input pointer");
 CueException track_push_null_input("Push To Track has nullptr input pointer");
@@ -37,6 +46,12 @@ CueException timestamp_bytes_mismatch("Bytes given and bytes-per-sector are not
 CueException track_push_null_file("Push To Track has no valid parent File");
 CueException index_push_null_track("Push To Index has no valid parent Track");
 
+CueException split_multiple_files("Only a cue sheet with a single FILE can be split");
+CueException split_index_order("Track indexes are out of order or outside of the FILE");
+
+CueException track_type_invalid("A TRACK type in the cue file is not recognised");
+CueException index_timestamp_invalid("An INDEX in the cue file has an invalid timestamp");
+
 /*** Staitc Helpers ***********************************************************/
 //Change file delim based on the host OS. eg / on Linux \ on Windows
 #ifdef _WIN32
@@ -47,25 +62,139 @@ CueException index_push_null_track("Push To Index has no valid parent Track");
 	static const char _file_delim = '/';
 #endif
 
-static bool IsValidTimestamp(const std::string &ts) {
-	bool valid = false;
+/*** Keyword Tables ***********************************************************/
+//Keywords of each LineType and TrackType, indexed by the enum value
+static constexpr std::string_view line_type_names[] = {
+	"INVALID", "FILE", "TRACK", "INDEX", "REM", "CATALOG", "CDTEXTFILE", "FLAGS",
+	"ISRC", "PERFORMER", "TITLE", "SONGWRITER", "PREGAP", "POSTGAP"
+};
+
+static constexpr std::string_view track_type_names[] = {
+	"INVALID", "AUDIO", "CDG", "MODE1/2048", "MODE1/2352", "MODE2/2336",
+	"MODE2/2352", "CDI/2336", "CDI/2352"
+};
+
+//Perfect hash of the keywords above, no two of a table share a slot. Words
+//shorter than two chars are never keywords, and all go to slot 0
+static constexpr size_t keyword_slots = 32;
+static constexpr size_t KeywordHash(const std::string_view word) {
+	size_t len = word.length();
+	if(len < 2) return 0;
 	
-	//Check length, then each char one at a time. 
-	if(ts.length() == 8 && isdigit(ts[0]) && isdigit(ts[1]) && ts[2] == ':'
-	                    && isdigit(ts[3]) && isdigit(ts[4]) && ts[5] == ':'
-	                    && isdigit(ts[6]) && isdigit(ts[7])) {
-		valid = true;
+	auto chr = [&word](size_t i) { return static_cast<unsigned char>(word[i]); };
+	return (len + chr(len > 4 ? 4 : len - 1) + (5 * chr(len - 1)) + chr(len - 2))
+	                                                            % keyword_slots;
+}
+
+//Builds a slot to enum value table (0 is an empty slot) at compile time. A 
+//hash collision fails the build
+using KeywordSlots = std::array<uint8_t, keyword_slots>;
+template<size_t N>
+static constexpr KeywordSlots BuildKeywordSlots(const std::string_view (&names)[N]) {
+	KeywordSlots slots {};
+	for(size_t i = 1; i < N; i++) {
+		size_t slot = KeywordHash(names[i]);
+		if(slots[slot] != 0) throw std::logic_error("Keyword hash collision");
+		slots[slot] = static_cast<uint8_t>(i);
+	}
+	
+	return slots;
+}
+
+static constexpr KeywordSlots line_type_slots  = BuildKeywordSlots(line_type_names);
+static constexpr KeywordSlots track_type_slots = BuildKeywordSlots(track_type_names);
+
+//Returns the enum value of a keyword, 0 (Invalid) if it is not one. One hash
+//and one compare, rather than comparing against every keyword
+template<size_t N>
+static size_t FindKeyword(const std::string_view word, 
+                          const std::string_view (&names)[N], const KeywordSlots &slots) {
+	size_t idx = slots[KeywordHash(word)];
+	if(idx != 0 && names[idx] == word) return idx;
+	return 0;
+}
+
+/*** Timestamp Formatting *****************************************************/
+//"00" to "99" back to back, so each two digit field is one two byte copy
+static constexpr std::array<char, 200> BuildDigitPairs() {
+	std::array<char, 200> pairs {};
+	for(size_t i = 0; i < 100; i++) {
+		pairs[i * 2]     = static_cast<char>('0' + (i / 10));
+		pairs[i * 2 + 1] = static_cast<char>('0' + (i % 10));
 	}
-	return valid;	
+	
+	return pairs;
 }
 
-//Convers an unsigned value to a padded string of n length
-static std::string NumToStrPad(const size_t num, const size_t len) {
-	std::string num_str = std::to_string(num);
+static constexpr std::array<char, 200> digit_pairs = BuildDigitPairs();
+
+//Writes a sector count as "MM:SS:FF" into out, 8 chars with no terminator.
+//Returns false if it is over 99 minutes
+static bool SectorsToMsf(const uint32_t sectors, char *out) {
+	//75 sectors per second, 60 seconds per minute
+	uint32_t frames  = sectors % 75;
+	uint32_t seconds = sectors / 75;
+	uint32_t minutes = seconds / 60;
+	seconds %= 60;
+	if(minutes > 99) return false;
 	
-	//If len is larger than str.length, padd with '0' for remaining chars.
-	if(len > num_str.length()) num_str.insert(0, (len - num_str.length()), '0');
-	return num_str;
+	std::memcpy(out,     &digit_pairs[minutes * 2], 2);
+	std::memcpy(out + 3, &digit_pairs[seconds * 2], 2);
+	std::memcpy(out + 6, &digit_pairs[frames * 2],  2);
+	out[2] = out[5] = ':';
+	return true;
+}
+
+/*** Cue Serialiser ***********************************************************/
+//Sheets are written by the same code twice: once into a SizeSink to find the
+//exact length, then into a BufferSink over a buffer of that size. Nothing is
+//concatenated or reallocated along the way
+struct SizeSink {
+	size_t bytes = 0;
+	void Put(const std::string_view str) { this->bytes += str.size(); }
+};
+
+struct BufferSink {
+	char *pos;
+	void Put(const std::string_view str) {
+		std::memcpy(this->pos, str.data(), str.size());
+		this->pos += str.size();
+	}
+};
+
+//Appends to a string, for the single line Str functions
+struct StringSink {
+	std::string &output;
+	void Put(const std::string_view str) { this->output.append(str.data(), str.size()); }
+};
+
+//Puts a sector count as a timestamp.
+//Throws if sectors is timestamp_nval or more than 99 minutes
+template<typename Sink>
+static void PutTimestamp(Sink &sink, const uint32_t sectors) {
+	if(sectors == CueSheet::timestamp_nval) throw timestamp_invalid_bytes;
+	
+	char msf[8];
+	if(!SectorsToMsf(sectors, msf)) throw timestamp_invalid_minutes;
+	sink.Put(std::string_view(msf, sizeof(msf)));
+}
+
+//Puts an unsigned number in decimal
+template<typename Sink>
+static void PutNumber(Sink &sink, const uint64_t num) {
+	char digits[20];
+	char *end = std::to_chars(digits, digits + sizeof(digits), num).ptr;
+	sink.Put(std::string_view(digits, static_cast<size_t>(end - digits)));
+}
+
+//Puts a TRACK or INDEX ID, padded to two digits
+template<typename Sink>
+static void PutId(Sink &sink, const uint16_t id) {
+	if(id < 100) {
+		sink.Put(std::string_view(&digit_pairs[id * 2], 2));
+	} else {
+		PutNumber(sink, id);
+	}
 }
 
 //Strip and return the parent directory of a given filename/directory
@@ -80,153 +209,464 @@ static std::string GetParentDir(const std::string &input) {
 	return dir;
 }
 
-//Gets nth word starting from the front of an input string
-static std::string GetWordFromFront(const size_t word_index,
-                                                     const std::string &input) {
-	const char *delims = " \t\r";
-	std::string word_str;
+//Words in a .cue line are separated by spaces or tabs. The \r of a CRLF line
+//ending is treated as whitespace too
+static bool IsCueSpace(const char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+//Returns the line without leading and trailing whitespace
+static std::string_view TrimView(std::string_view line) {
+	while(!line.empty() && IsCueSpace(line.front())) line.remove_prefix(1);
+	while(!line.empty() && IsCueSpace(line.back())) line.remove_suffix(1);
+	return line;
+}
+
+//Removes the next word from the front of a line and returns it. Returns an 
+//empty view if there are no words left
+static std::string_view TakeWord(std::string_view &line) {
+	line = TrimView(line);
 	
-	//Don't execute if requested word is 0
-	if(word_index > 0) {	
-		//Current word_start(ws), word_end(we), and word_count(wc)
-		size_t ws = 0, we = 0, wc = 0;	
-		
-		//While the start of a new word exists
-		while((ws = input.find_first_not_of(delims, we)) != std::string::npos) {
-			//Find the end of that word, incriment word count, find match and return
-			we = input.find_first_of(delims, ws);
-		
-			if(++wc == word_index) {
-				word_str = input.substr(ws, we - ws);
-				break;
-			}
-		}
+	size_t we = 0;
+	while(we < line.size() && !IsCueSpace(line[we])) ++we;
+	
+	std::string_view word = line.substr(0, we);
+	line.remove_prefix(we);
+	return word;
+}
+
+//Returns the last word of a line, or an empty view if there is none
+static std::string_view LastWord(std::string_view line) {
+	line = TrimView(line);
+	
+	size_t ws = line.size();
+	while(ws > 0 && !IsCueSpace(line[ws - 1])) --ws;
+	return line.substr(ws);
+}
+
+//Parses an unsigned decimal number (TRACK and INDEX IDs). Leading digits are
+//used, like stoi, so 01abc is 1. Returns false if there are no digits
+static bool ViewToNum(const std::string_view word, uint32_t &num) {
+	num = 0;
+	auto result = std::from_chars(word.data(), word.data() + word.size(), num);
+	return result.ec == std::errc();
+}
+
+//Takes the line, and returns the text between the first and last double 
+//quote marks. Returns an empty view if there are not two
+static std::string_view GetTextInQuotes(const std::string_view input) {
+	size_t first = input.find('"');	
+	size_t last = input.rfind('"');
+	
+	if(first == std::string_view::npos || first == last) return std::string_view();
+	return input.substr(first + 1, last - first - 1);
+}
+
+//Returns a command's value (the line after its first word) trimmed, without 
+//any surrounding double quotes. eg "Some Band" returns Some Band
+static std::string_view GetCommandValue(std::string_view value) {
+	value = TrimView(value);
+	if(value.length() >= 2 && value.front() == '"' && value.back() == '"') {
+		value = value.substr(1, value.length() - 2);
 	}
 	
-	return word_str;
+	return value;
+}
+
+//Returns the text commands, creating them the first time they are set
+static CueSheet::TextObj &GetText(std::unique_ptr<CueSheet::TextObj> &text) {
+	if(!text) text.reset(new CueSheet::TextObj);
+	return *text;
+}
+
+//Returns a deep copy of text commands, nullptr if there are none
+static std::unique_ptr<CueSheet::TextObj> CopyText(
+                                   const std::unique_ptr<CueSheet::TextObj> &text) {
+	return std::unique_ptr<CueSheet::TextObj>(text ? new CueSheet::TextObj(*text) : nullptr);
+}
+
+//Puts a command line, e.g. TITLE "Game", with the value quoted if asked
+template<typename Sink>
+static void PutCommand(Sink &sink, const std::string_view command, 
+                       const std::string &value, const bool quoted, const char *eol) {
+	sink.Put(command);
+	if(quoted) sink.Put("\"");
+	sink.Put(value);
+	if(quoted) sink.Put("\"");
+	sink.Put(eol);
 }
 
-//Gets nth word starting from the back of an input string
-static std::string GetWordFromBack(const size_t word_index,
-                                                     const std::string &input) {	
-	const char *delims = " \t\r";
-	std::string word_str;
+//Puts the disc command lines of a CueSheet, each ending in eol
+template<typename Sink>
+static void PutDiscCommands(Sink &sink, const CueSheet &cs, const char *eol) {
+	if(!cs.text) return;
+	const CueSheet::TextObj &text = *cs.text;
 	
-	//Don't execute if requested word is 0
-	if(word_index > 0) {	
-		//Current word_start(ws), word_end(we), and word_count(wc)
-		size_t ws = std::string::npos, we = std::string::npos, wc = 0;	
+	for(const auto &r_itr : text.RemarkList) PutCommand(sink, "REM ", r_itr, false, eol);
+	
+	if(!text.catalog.empty())    PutCommand(sink, "CATALOG ", text.catalog, false, eol);
+	if(!text.cdtextfile.empty()) PutCommand(sink, "CDTEXTFILE ", text.cdtextfile, true, eol);
+	if(!text.performer.empty())  PutCommand(sink, "PERFORMER ", text.performer, true, eol);
+	if(!text.songwriter.empty()) PutCommand(sink, "SONGWRITER ", text.songwriter, true, eol);
+	if(!text.title.empty())      PutCommand(sink, "TITLE ", text.title, true, eol);
+}
+
+//Puts the command lines of a TRACK that go before its INDEXs
+template<typename Sink>
+static void PutTrackCommands(Sink &sink, const CueSheet::FileObj::TrackObj &track,
+                             const char *eol) {
+	if(track.text) {
+		const CueSheet::TextObj &text = *track.text;
 		
-		do {
-			we = input.find_last_not_of(delims, ws);
-			ws = input.find_last_of(delims, we);
+		if(!text.title.empty())      PutCommand(sink, "    TITLE ", text.title, true, eol);
+		if(!text.performer.empty())  PutCommand(sink, "    PERFORMER ", text.performer, true, eol);
+		if(!text.songwriter.empty()) PutCommand(sink, "    SONGWRITER ", text.songwriter, true, eol);
+		for(const auto &r_itr : text.RemarkList) PutCommand(sink, "    REM ", r_itr, false, eol);
 		
-			if(++wc == word_index) {
-				word_str = input.substr(ws + 1, we - ws);
-				break;
-			} 
-			
-		} while(ws != std::string::npos && we != std::string::npos);
+		if(!text.flags.empty())      PutCommand(sink, "    FLAGS ", text.flags, false, eol);
+		if(!text.isrc.empty())       PutCommand(sink, "    ISRC ", text.isrc, false, eol);
 	}
-	
-	return word_str;
+	if(track.pregap) {
+		sink.Put("    PREGAP ");
+		PutTimestamp(sink, track.pregap);
+		sink.Put(eol);
+	}
+}
+
+//Puts the FILE, TRACK and INDEX lines, without a line ending
+template<typename Sink>
+static void PutFile(Sink &sink, const CueSheet::FileObj &file) {
+	sink.Put("FILE \"");
+	sink.Put(file.filename);
+	sink.Put("\" ");
+	sink.Put(file.filetype);
 }
 
-//Takes a value and divisor, (uint32_t) and sets passed quotient & remainder 
-//variables (uint32_t)
-static void DivideWithRemainder32(const uint32_t value, const uint32_t divisor,
-                                      uint32_t &quotient, uint32_t &remainder) {
-	quotient = value / divisor;
-	remainder = value % divisor;
+template<typename Sink>
+static void PutTrack(Sink &sink, const CueSheet::FileObj::TrackObj &track) {
+	sink.Put("  TRACK ");
+	PutId(sink, track.id);
+	sink.Put(" ");
+	sink.Put(track_type_names[static_cast<size_t>(track.type)]);
 }
 
-//Takes a string with text in double quote marks, removes the first child in
-//quotes, returns it without quotes.
-static std::string GetTextInQuotes(const std::string &input) {
-	//Empty string. Return on error, or set to substr of input if success
-	std::string substr;
+template<typename Sink>
+static void PutIndex(Sink &sink, const CueSheet::FileObj::TrackObj::IndexObj &index,
+                     const CueSheet::TrackType type) {
+	if(type == CueSheet::TrackType::Invalid) throw timestamp_invalid_track;
 	
-	//Find the first and last Double Quote mark, and get a substring from it
-	size_t first = input.find_first_of("\"");	
-	size_t last = input.find_last_of("\"");
+	sink.Put("    INDEX ");
+	PutId(sink, index.id);
+	sink.Put(" ");
+	PutTimestamp(sink, index.sector);
+}
+
+//Puts a whole CueSheet, each line ending in eol. Verbose adds the FILE sizes
+//and INDEX byte offsets, for Print()
+template<typename Sink>
+static void PutSheet(Sink &sink, const CueSheet &cs, const char *eol, const bool verbose) {
+	PutDiscCommands(sink, cs, eol);
+	for(const auto &f_itr : cs.FileList) {
+		PutFile(sink, f_itr);
+		if(verbose) {
+			sink.Put("    ");
+			PutNumber(sink, f_itr.bytes);
+			sink.Put(" bytes");
+		}
+		sink.Put(eol);
 		
-	//Only get a substr if both "s are present. Only first will be set if there
-	//is only one ", if there's non, first & last will be string::npos
-	if(first != last && first != std::string::npos) {
-		//Incriment first to skip first "
-		++first;
-		substr = input.substr(first, last-first);
+		for(const auto &t_itr : f_itr.TrackList) {
+			PutTrack(sink, t_itr);
+			sink.Put(eol);
+			PutTrackCommands(sink, t_itr, eol);
+			
+			for(const auto &i_itr : t_itr.IndexList) {
+				PutIndex(sink, i_itr, t_itr.type);
+				if(verbose) {
+					sink.Put("    ");
+					PutNumber(sink, i_itr.Bytes(t_itr.type));
+					sink.Put(" bytes offset");
+				}
+				sink.Put(eol);
+			}
+			if(t_itr.postgap) {
+				sink.Put("    POSTGAP ");
+				PutTimestamp(sink, t_itr.postgap);
+				sink.Put(eol);
+			}
+		}
+	}
+}
+
+//Serialises a CueSheet into one string of exactly the right size. Throws 
+//from the sizing pass, before anything is allocated
+static std::string SheetToStr(const CueSheet &cs, const char *eol, const bool verbose) {
+	SizeSink size;
+	PutSheet(size, cs, eol, verbose);
+	
+	std::string output(size.bytes, '\0');
+	BufferSink buffer {&output[0]};
+	PutSheet(buffer, cs, eol, verbose);
+	return output;
+}
+
+//Copies the disc commands (CATALOG, TITLE, REM etc) of one CueSheet to another
+static void CopyDiscCommands(const CueSheet &src, CueSheet &dest) {
+	dest.text = CopyText(src.text);
+}
+
+/*** Cue Diagnostics **********************************************************/
+std::string CueDiagnostic::ToString() const {
+	std::string str;
+	if(this->line) {
+		str = std::to_string(this->line) + ":" + std::to_string(this->column) + ": ";
 	}
 	
-	return substr;
+	str += this->severity == Severity::Error ? "error: " : "warning: ";
+	str += this->reason->what();
+	if(!this->text.empty()) str += ": \"" + this->text + "\"";
+	if(this->track) str += " (TRACK " + std::to_string(this->track) + ")";
+	return str;
+}
+
+void CueResult::Add(const CueDiagnostic::Severity severity, const CueException &reason,
+                    const uint32_t line, const uint32_t column, const uint16_t track,
+                    const std::string_view text) {
+	this->diagnostics.push_back({severity, &reason, line, column, track, std::string(text)});
+	if(severity == CueDiagnostic::Severity::Error) {
+		this->errors++;
+	} else {
+		this->warnings++;
+	}
+}
+
+const CueDiagnostic *CueResult::FirstError() const {
+	for(const auto &d_itr : this->diagnostics) {
+		if(d_itr.severity == CueDiagnostic::Severity::Error) return &d_itr;
+	}
+	return nullptr;
+}
+
+void CueResult::ThrowIfFailed() const {
+	const CueDiagnostic *error = this->FirstError();
+	if(error) throw *error->reason;
 }
 
 /*** Cue File Functions *******************************************************/
-//Reads the given file, Parses it, sets up the CueData structure tree
 int CueFile::ReadCueData(CueSheet &cs) {
+	this->TryReadCueData(cs).ThrowIfFailed();
+	return 0;
+}
+
+int CueFile::ReadCueStream(CueSheet &cs, std::istream &in) {
+	this->TryReadCueStream(cs, in).ThrowIfFailed();
+	return 0;
+}
+
+int CueFile::ReadCueText(CueSheet &cs, std::string_view text) {
+	this->TryReadCueText(cs, text).ThrowIfFailed();
+	return 0;
+}
+
+//Reads the given file into one buffer, then parses it into the CueData tree
+CueResult CueFile::TryReadCueData(CueSheet &cs) {
 	//Guard against use without a set filename, Attempt to open the file.
 	if(this->filename.empty() || this->OpenRead() != 0) {
-		throw file_invalid;
-		return -1;
+		CueResult result;
+		result.Add(CueDiagnostic::Severity::Error, file_invalid, 0, 0, 0, this->filename);
+		return result;
 	}
-		
-	//Reset file pointer/flags, then read the file into a RAM File
+	
+	//Read the whole file at once, .cue files are only a few KiB
 	this->cue_file.clear();
+	this->cue_file.seekg(0, std::ios::end);
+	std::streamoff file_bytes = this->cue_file.tellg();
 	this->cue_file.seekg(0, std::ios::beg);
 	
-	//Read the File line by line.
-	std::string line_str;
-	while(getline(this->cue_file, line_str)) {
-		//Skip Blank Lines
-		if(line_str.empty()) continue;
+	std::string text(file_bytes > 0 ? static_cast<size_t>(file_bytes) : 0, '\0');
+	this->cue_file.read(&text[0], static_cast<std::streamsize>(text.size()));
+	text.resize(static_cast<size_t>(this->cue_file.gcount()));
+	
+	//Close the File, then parse the text
+	this->Close();
+	return this->TryReadCueText(cs, text);
+}
+
+CueResult CueFile::TryReadCueStream(CueSheet &cs, std::istream &in) {
+	std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	return this->TryReadCueText(cs, text);
+}
+
+CueResult CueFile::TryReadCueText(CueSheet &cs, std::string_view text) {
+	using Severity = CueDiagnostic::Severity;
+	CueResult result;
+	
+	//Skip the UTF-8 byte order mark some tools write
+	if(text.substr(0, 3) == "\xEF\xBB\xBF") text.remove_prefix(3);
+	
+	//Go through the text line by line. Every view points into the text, so
+	//only the values stored in the CueSheet are copied
+	uint32_t line_num = 0;
+	while(!text.empty()) {
+		size_t eol = text.find('\n');
+		std::string_view line_str = text.substr(0, eol);
+		text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+		line_num++;
+		
+		//Get the type of line this current line is. Skip Blank Lines
+		std::string_view args = line_str;
+		std::string_view command = TakeWord(args);
+		if(command.empty()) continue;
 		
-		//Get the type of line this current line is
-		CueSheet::LineType l_type = 
-			             CueSheet::StrToLineType(GetWordFromFront(1, line_str));
+		//Reports a problem with a word of this line. Errors skip the line
+		CueSheet::FileObj::TrackObj *t_last = cs.GetLastTrack();
+		auto report = [&](const Severity severity, const CueException &reason,
+		                  const std::string_view word) {
+			uint32_t column = static_cast<uint32_t>(word.data() - line_str.data()) + 1;
+			result.Add(severity, reason, line_num, column, t_last ? t_last->id : 0, word);
+		};
 		
-		//Exit if the line is invalid
+		CueSheet::LineType l_type = CueSheet::StrToLineType(command);
+		
+		//Skip the line if the command is invalid
 		if(l_type == CueSheet::LineType::Invalid) {
-			throw line_invalid;
-			return -2;
+			report(Severity::Error, line_invalid, command);
+			continue;
+		}
+		
+		//Commands that describe the disc, or the last TRACK if there is one
+		std::unique_ptr<CueSheet::TextObj> &text_obj = t_last ? t_last->text : cs.text;
+		if(l_type == CueSheet::LineType::Remark) {
+			GetText(text_obj).RemarkList.emplace_back(GetCommandValue(args));
+		}
+		
+		if(l_type == CueSheet::LineType::Performer) {
+			GetText(text_obj).performer = GetCommandValue(args);
+		}
+		if(l_type == CueSheet::LineType::Title) {
+			GetText(text_obj).title = GetCommandValue(args);
+		}
+		if(l_type == CueSheet::LineType::Songwriter) {
+			GetText(text_obj).songwriter = GetCommandValue(args);
+		}
+		
+		//Disc only commands
+		if(l_type == CueSheet::LineType::Catalog) {
+			GetText(cs.text).catalog = GetCommandValue(args);
+		}
+		if(l_type == CueSheet::LineType::CdTextFile) {
+			GetText(cs.text).cdtextfile = GetCommandValue(args);
+		}
+		
+		//TRACK only commands
+		bool track_only = l_type == CueSheet::LineType::Flags   ||
+		                  l_type == CueSheet::LineType::Isrc    ||
+		                  l_type == CueSheet::LineType::Pregap  ||
+		                  l_type == CueSheet::LineType::Postgap;
+		if(track_only && t_last == nullptr) {
+			report(Severity::Error, command_invalid, command);
+			continue;
+		}
+		
+		if(l_type == CueSheet::LineType::Flags) {
+			GetText(text_obj).flags = GetCommandValue(args);
+		}
+		if(l_type == CueSheet::LineType::Isrc) {
+			GetText(text_obj).isrc = GetCommandValue(args);
+		}
+		if(l_type == CueSheet::LineType::Pregap || l_type == CueSheet::LineType::Postgap) {
+			std::string_view ts = TakeWord(args);
+			uint32_t sectors = CueSheet::TimestampToSectors(ts);
+			if(sectors == CueSheet::timestamp_nval) {
+				report(Severity::Error, command_invalid, ts);
+				continue;
+			}
+			
+			if(l_type == CueSheet::LineType::Pregap) {
+				t_last->pregap = sectors;
+			} else {
+				t_last->postgap = sectors;
+			}
 		}
 		
 		//Strip the Filename and Type, then push it to the CueSheet FileList
 		if(l_type == CueSheet::LineType::File) {
-			std::string fname = GetTextInQuotes(line_str);
-			std::string ftype = GetWordFromBack(1, line_str);
+			std::string_view ftype = LastWord(args);
+			std::string_view fname = GetTextInQuotes(args);
 			
+			//Repair unquoted filenames, everything up to the type
+			if(fname.empty()) {
+				std::string_view trimmed = TrimView(args);
+				fname = TrimView(trimmed.substr(0, trimmed.size() - ftype.size()));
+			}
 			
-			CueSheet::FileObj temp_file(fname, ftype, 0);
-			cs.PushFile(&temp_file);
+			cs.PushFile(CueSheet::FileObj(std::string(fname), std::string(ftype), 0));
 		}
 		
-		//Strip the Track ID and type and push it to a TrackList
+		//Strip the Track ID and type and push it to a TrackList. An unknown
+		//type is kept, as TrackType::Invalid
 		if(l_type == CueSheet::LineType::Track) {
-			uint16_t t_id = (uint16_t)std::stoi(GetWordFromFront(2, line_str));
+			std::string_view id_str = TakeWord(args);
+			std::string_view type_str = TakeWord(args);
 			
-			CueSheet::TrackType t_ty = 
-			            CueSheet::StrToTrackType(GetWordFromFront(3, line_str));
+			uint32_t id_num;
+			if(!ViewToNum(id_str, id_num)) {
+				report(Severity::Error, line_invalid, id_str);
+				continue;
+			}
+			uint16_t t_id = static_cast<uint16_t>(id_num);
+			if(t_id > 99) {
+				report(Severity::Error, track_id_too_high, id_str);
+				continue;
+			}
+			if(cs.GetLastFile() == nullptr) {
+				report(Severity::Error, track_push_null_file, command);
+				continue;
+			}
 			
+			CueSheet::TrackType t_ty = CueSheet::StrToTrackType(type_str);
 			CueSheet::FileObj::TrackObj temp_track(t_id, t_ty);
 			cs.PushTrack(&temp_track);
+			
+			t_last = cs.GetLastTrack();
+			if(t_ty == CueSheet::TrackType::Invalid) {
+				report(Severity::Warning, track_type_invalid, type_str);
+			}
 		}
 		
-		//Strip Index ID and Bytes and push it to an IndexList
+		//Strip Index ID and Bytes and push it to an IndexList. An invalid
+		//timestamp is kept, as timestamp_nval
 		if(l_type == CueSheet::LineType::Index) {
-			//CueSheet::FileObj::TrackObj *t_ptr = ;
-			uint16_t i_id = (uint16_t)std::stoi(GetWordFromFront(2, line_str));
-						
-			uint32_t i_offset = CueSheet::TimestampToBytes(
-			            GetWordFromFront(3, line_str), cs.GetLastTrack()->type);
+			if(t_last == nullptr) {
+				report(Severity::Error, index_push_null_track, command);
+				continue;
+			}
+			
+			std::string_view id_str = TakeWord(args);
+			std::string_view ts = TakeWord(args);
 			
-			CueSheet::FileObj::TrackObj::IndexObj tmp(i_id, i_offset);
+			uint32_t id_num;
+			if(!ViewToNum(id_str, id_num)) {
+				report(Severity::Error, line_invalid, id_str);
+				continue;
+			}
+			uint16_t i_id = static_cast<uint16_t>(id_num);
+			if(i_id > 99) {
+				report(Severity::Error, index_id_too_high, id_str);
+				continue;
+			}
+			
+			uint32_t i_sector = CueSheet::TimestampToSectors(ts);
+			CueSheet::FileObj::TrackObj::IndexObj tmp(i_id, i_sector);
 			cs.PushIndex(&tmp);
+			
+			if(i_sector == CueSheet::timestamp_nval) {
+				report(Severity::Warning, index_timestamp_invalid, ts);
+			}
 		}
 	}
 	
-	//Close the File and return success
-	this->Close();
-	return 0;
+	return result;
 }
 
 int CueFile::GetCueFileSizes(CueSheet &cs, std::string base_dir) {
@@ -234,30 +674,41 @@ int CueFile::GetCueFileSizes(CueSheet &cs, std::string base_dir) {
 	
 	for(auto &f_itr : cs.FileList) {
 		if(f_itr.filename.empty()) {throw internal_file_invalid; return -1;}
-		f_itr.bytes = GetFileBytes(base_dir + f_itr.filename);
+		
+		//Only count the PCM payload of WAVE/AIFF files, not their headers
+		std::string filepath = base_dir + f_itr.filename;
+		if(f_itr.filetype == "WAVE" || f_itr.filetype == "AIFF") {
+			try {
+				f_itr.bytes = static_cast<uint32_t>(
+				                  GetAudioLayout(filepath, f_itr.filetype).data_bytes);
+			} catch(const std::runtime_error &) {
+				GetFileBytes(filepath);  //Throws if the file cannot be opened
+				throw internal_file_bad_audio;
+			}
+		} else {
+			f_itr.bytes = GetFileBytes(filepath);
+		}
 	}
 	
 	return 0;
 }
 
 int CueFile::WriteCueData(const CueSheet &cs) {
+	//The sheet is serialised into one exactly sized buffer first, so a sheet
+	//that cannot be written throws before the file is truncated
+	std::string cue_data = cs.ToString();
+	
 	//Guard against use without a set filename, Attempt to open the file.
 	if(this->filename.empty() || this->OpenWrite() != 0) {
 		throw file_invalid;
 		return -1;
 	}
 	
-	//Reset file pointer/flags, then read the file into a RAM File
+	//Reset file pointer/flags. The stream is unbuffered (see OpenWrite), so 
+	//the sheet goes to the file in a single write
 	this->cue_file.clear();
-	this->cue_file.seekg(0, std::ios::beg);
-	
-	//this->cue_file << cs.ToString();
-	// Write the CueSheet data with Windows-style line endings (\r\n)
-	std::string cueData = cs.ToString();
-	this->cue_file.write(
-		cueData.c_str(), 
-		static_cast<std::streamsize>(cueData.length())
-	);
+	this->cue_file.seekp(0, std::ios::beg);
+	this->cue_file.write(cue_data.data(), static_cast<std::streamsize>(cue_data.size()));
 
 	//Close the File and return success
 	this->Close();
@@ -303,6 +754,10 @@ int CueFile::OpenRead() {
 int CueFile::OpenWrite() {
 	int errcode = 0;
 
+	//Writes are always one whole sheet, so skip the stream's own buffer. This
+	//only takes effect before the file is opened
+	this->cue_file.rdbuf()->pubsetbuf(nullptr, 0);
+	
 	// Open file in Binary Mode to avoid extra \r's from being added
 	this->cue_file.open(
 		this->filename, 
@@ -323,8 +778,51 @@ int CueFile::Close() {
 }
 
 /*** API Functions ************************************************************/
-CueSheet::~CueSheet() {
-	this->Clear();
+CueSheet::CueSheet(const CueSheet &other) {
+	other.CopyTo(*this);
+}
+
+CueSheet::CueSheet(CueSheet &&other) noexcept {
+	*this = std::move(other);
+}
+
+CueSheet &CueSheet::operator=(const CueSheet &other) {
+	if(this != &other) other.CopyTo(*this);
+	return *this;
+}
+
+CueSheet &CueSheet::operator=(CueSheet &&other) noexcept {
+	if(this != &other) {
+		this->FileList   = std::move(other.FileList);
+		this->TrackData  = std::move(other.TrackData);
+		this->IndexData  = std::move(other.IndexData);
+		this->text       = std::move(other.text);
+		
+		this->BindRanges();
+		other.Clear();
+	}
+	return *this;
+}
+
+CueSheet::FileObj::TrackObj::TrackObj(const TrackObj &other)
+	: id(other.id), type(other.type), pregap(other.pregap), postgap(other.postgap),
+	  text(CopyText(other.text)), IndexList(other.IndexList) {}
+
+CueSheet::FileObj::TrackObj &CueSheet::FileObj::TrackObj::operator=(const TrackObj &other) {
+	if(this != &other) {
+		this->id        = other.id;
+		this->type      = other.type;
+		this->pregap    = other.pregap;
+		this->postgap   = other.postgap;
+		this->text      = CopyText(other.text);
+		this->IndexList = other.IndexList;
+	}
+	return *this;
+}
+
+void CueSheet::BindRanges() {
+	for(auto &f_itr : this->FileList) f_itr.TrackList.items = &this->TrackData;
+	for(auto &t_itr : this->TrackData) t_itr.IndexList.items = &this->IndexData;
 }
 
 CueSheet::FileObj *CueSheet::GetLastFile() {
@@ -357,8 +855,16 @@ int CueSheet::PushFile(FileObj *file_ptr) {
 	//Guard against nullptr input
 	if(file_ptr == nullptr) {throw file_push_null_input; return -1;}
 	
-	//Push the file to the list
-	this->FileList.push_back(*file_ptr);
+	return this->PushFile(FileObj(*file_ptr));
+}
+
+int CueSheet::PushFile(FileObj &&file) {
+	//Push the file to the list. Its TRACKs start after every existing TRACK
+	this->FileList.push_back(std::move(file));
+	CueItemRange<FileObj::TrackObj> &tracks = this->FileList.back().TrackList;
+	tracks.items = &this->TrackData;
+	tracks.first = static_cast<uint32_t>(this->TrackData.size());
+	tracks.count = 0;
 	return 0;
 }
 
@@ -371,8 +877,15 @@ int CueSheet::PushTrack(FileObj::TrackObj *track_ptr) {
 	FileObj *f_last = this->GetLastFile();
 	if(f_last == nullptr) {throw track_push_null_file; return -3;}
 	
-	//Push the track passed to the file pointer
-	f_last->TrackList.push_back(*track_ptr);
+	//Push the track passed to the end of the track array, which is the end of
+	//the last file's range. Its INDEXs start after every existing INDEX
+	this->TrackData.push_back(*track_ptr);
+	f_last->TrackList.count++;
+	
+	CueItemRange<FileObj::TrackObj::IndexObj> &indexes = this->TrackData.back().IndexList;
+	indexes.items = &this->IndexData;
+	indexes.first = static_cast<uint32_t>(this->IndexData.size());
+	indexes.count = 0;
 	return 0;
 }
 
@@ -385,8 +898,9 @@ int CueSheet::PushIndex(FileObj::TrackObj::IndexObj *index_ptr) {
 	FileObj::TrackObj *t_last = this->GetLastTrack();
 	if(t_last == nullptr) {throw index_push_null_track; return -3;}
 	
-	//Push the index passed to the track
-	t_last->IndexList.push_back(*index_ptr);
+	//Push the index passed to the end of the index array, and the last track
+	this->IndexData.push_back(*index_ptr);
+	t_last->IndexList.count++;
 	return 0;
 }
 
@@ -404,13 +918,14 @@ int CueSheet::PopTrack() {
 	FileObj *f_last = this->GetLastFile();
 	if(!f_last) return -1;
 	
-	//Clear the index array to dealocate RAM If it is not empty
+	//Pop off the track and its indexes, which are the last in their arrays
 	FileObj::TrackObj *t_last = this->GetLastTrack();
-	if(t_last && !t_last->IndexList.empty()) t_last->IndexList.clear();
+	if(t_last == nullptr) return -2;
 	
-	//Pop off the track
-	if(f_last->TrackList.empty()) return -2;
-	f_last->TrackList.pop_back();
+	this->IndexData.erase(this->IndexData.begin() + t_last->IndexList.first,
+	                      this->IndexData.end());
+	this->TrackData.pop_back();
+	f_last->TrackList.count--;
 	return 0;
 }
 
@@ -421,270 +936,340 @@ int CueSheet::PopIndex() {
 	if(t_last == nullptr) return -1;
 	if(t_last->IndexList.empty()) return -2;
 	
-	t_last->IndexList.pop_back();
+	this->IndexData.pop_back();
+	t_last->IndexList.count--;
 	return 0;
 }
 
 std::string CueSheet::ToString() const {
-	std::string output;
-	
-	if(!this->FileList.empty()) {
-		for(const auto &f_itr : this->FileList) {
-			output.append(FileToStr(&f_itr) + "\r\n");
-			for(const auto &t_itr : f_itr.TrackList) {
-				output.append(TrackToStr(&t_itr) + "\r\n");
-				for(const auto &i_itr : t_itr.IndexList) {
-					output.append(IndexToStr(&i_itr, t_itr.type) + "\r\n");
-				}
-			}
-		}
-	}
-	
-	return output;
+	if(this->FileList.empty()) return std::string();
+	return SheetToStr(*this, "\r\n", false);
 }
 
 int CueSheet::Print() const {
 	if(this->FileList.empty()) return -1;
 
-	for(const auto &f_itr : this->FileList) {
-		std::cout << FileToStr(&f_itr) + "    " << f_itr.bytes << " bytes\n";
-		for(const auto &t_itr : f_itr.TrackList) {
-			std::cout << TrackToStr(&t_itr) << "\n";
-			for(const auto &i_itr : t_itr.IndexList) {
-				std::cout << IndexToStr(&i_itr, t_itr.type) << "    " 
-					      << i_itr.offset << " bytes offset\n";
-			}
-		}
-	}
-	
+	std::string output = SheetToStr(*this, "\n", true);
+	std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
 	return 0;
 }
 
-void CueSheet::Combine(std::string op_filename, std::string op_filetype) {
+void CueSheet::Combine(std::string op_filename, std::string op_filetype,
+                       bool write_gaps) {
+	this->TryCombine(std::move(op_filename), std::move(op_filetype), write_gaps).ThrowIfFailed();
+}
+
+CueResult CueSheet::TryCombine(std::string op_filename, std::string op_filetype,
+                               bool write_gaps) {
+	CueResult result;
+	
 	//If the file list is empty, exit early
-	if(this->FileList.empty()) return;	
+	if(this->FileList.empty()) return result;	
 	
 	//Check input strings and set them to the parent FileObjs strings if they
 	//were not specified
-	if(op_filename.empty()) op_filename = this->FileList.begin()->filename;
-	if(op_filetype.empty()) op_filetype = this->FileList.begin()->filetype;
+	if(op_filename.empty()) op_filename = this->FileList.front().filename;
+	if(op_filetype.empty()) op_filetype = this->FileList.front().filetype;
 	
-	//Create a temp cue sheet to copy to, this will be the new Combined File
-	CueSheet temp_cue;
-	FileObj temp_file(op_filename, op_filetype, 0);
-	if(temp_cue.PushFile(&temp_file) != 0) return;
+	//The TRACKs and INDEXs already lie in FILE order, so the offsets are
+	//rewritten in place. Only a written PREGAP, which adds an INDEX 00, needs
+	//the INDEXs rebuilt, into one array reserved up front
+	bool rebuild = false;
+	for(const auto &t_itr : this->TrackData) {
+		if(write_gaps && t_itr.pregap && !t_itr.IndexList.empty()) rebuild = true;
+	}
 	
-	//Keep track of the total bytes in all files so far, for index offsets
-	uint32_t total_file_bytes = 0;
+	//INDEXs are kept in sectors of their TRACK, so every TRACK must start on
+	//a whole sector of the combined FILE. Checked before anything is changed,
+	//and every TRACK that does not is reported. An invalid INDEX timestamp is
+	//only a warning when parsing, but nothing can be laid out from it
+	uint64_t start_bytes = 0;
+	for(const auto &f_itr : this->FileList) {
+		for(const auto &t_itr : f_itr.TrackList) {
+			for(const auto &i_itr : t_itr.IndexList) {
+				if(i_itr.sector != timestamp_nval) continue;
+				result.Add(CueDiagnostic::Severity::Error, index_timestamp_invalid,
+				           0, 0, t_itr.id, f_itr.filename);
+			}
+			
+			uint16_t sect_bytes = GetSectorBytesInTrackType(t_itr.type);
+			if(sect_bytes == 0) continue;
+			if(!t_itr.IndexList.empty() && start_bytes % sect_bytes != 0) {
+				result.Add(CueDiagnostic::Severity::Error, timestamp_bytes_mismatch,
+				           0, 0, t_itr.id, f_itr.filename);
+			}
+			
+			if(write_gaps && !t_itr.IndexList.empty()) {
+				start_bytes += static_cast<uint64_t>(t_itr.pregap) * sect_bytes;
+			}
+			if(write_gaps) start_bytes += static_cast<uint64_t>(t_itr.postgap) * sect_bytes;
+		}
+		start_bytes += f_itr.bytes;
+	}
+	if(!result.ok()) return result;
+	
+	std::vector<FileObj::TrackObj::IndexObj> indexes;
+	if(rebuild) indexes.reserve(this->IndexData.size() + this->TrackData.size());
+	
+	//Keep track of the total bytes in all files so far, and of the zero bytes
+	//written for gaps so far, for index offsets
+	uint32_t total_file_bytes = 0, total_gap_bytes = 0;
 	
 	//Go through all Files
 	for(auto &f_itr : this->FileList) {
-	
-		//Copy the track data to a new obj and push it to the temp sheet
 		for(auto &t_itr : f_itr.TrackList) {
-			FileObj::TrackObj temp_track(t_itr.id, t_itr.type);
-			temp_cue.PushTrack(&temp_track);
+			//Written gaps are part of the FILE, so no longer need commands
+			uint16_t sect_bytes = GetSectorBytesInTrackType(t_itr.type);
+			uint32_t pregap = write_gaps ? t_itr.pregap * sect_bytes : 0;
+			uint32_t postgap = write_gaps ? t_itr.postgap * sect_bytes : 0;
+			if(write_gaps) t_itr.pregap = t_itr.postgap = 0;
 			
-			//Copy the index data, but offset from total bytes in the new file
-			for(auto &i_itr : t_itr.IndexList) {
-				FileObj::TrackObj::IndexObj temp_index
-				                    (i_itr.id, i_itr.offset + total_file_bytes);
-				temp_cue.PushIndex(&temp_index);
+			//Sectors of this TRACK's type before the start of its FILE. An 
+			//Invalid TRACK is left alone, and fails when it is written
+			uint32_t shift = sect_bytes ? (total_file_bytes + total_gap_bytes) / sect_bytes : 0;
+			
+			if(!rebuild) {
+				for(auto &i_itr : t_itr.IndexList) {
+					i_itr.sector += shift;
+				}
+			} else {
+				uint32_t first = static_cast<uint32_t>(indexes.size());
+				
+				//A written PREGAP goes before the TRACK's first INDEX, and 
+				//starts at INDEX 00. An existing INDEX 00 is moved back to it
+				if(pregap && !t_itr.IndexList.empty()) {
+					indexes.emplace_back(0, t_itr.IndexList.front().sector + shift);
+					total_gap_bytes += pregap;
+					shift += pregap / sect_bytes;
+				}
+				
+				for(const auto &i_itr : t_itr.IndexList) {
+					if(pregap && i_itr.id == 0) continue;
+					indexes.emplace_back(i_itr.id, i_itr.sector + shift);
+				}
+				
+				t_itr.IndexList.first = first;
+				t_itr.IndexList.count = static_cast<uint32_t>(indexes.size()) - first;
 			}
+			
+			total_gap_bytes += postgap;
 		}
 		//Update total bytes so far, for index offsets
 		total_file_bytes += f_itr.bytes;
 	}
 	
-	//Fix the file bytes to reflect its actual size
-	temp_cue.FileList.begin()->bytes = total_file_bytes;
-	temp_cue.CopyTo(*this);
+	//The ranges still point at IndexData, which takes the rebuilt INDEXs
+	if(rebuild) this->IndexData.swap(indexes);
+	
+	//The first FILE becomes the combined FILE, holding every TRACK
+	FileObj &combined = this->FileList.front();
+	combined.filename = std::move(op_filename);
+	combined.filetype = std::move(op_filetype);
+	combined.bytes = total_file_bytes + total_gap_bytes;
+	combined.TrackList.first = 0;
+	combined.TrackList.count = static_cast<uint32_t>(this->TrackData.size());
+	this->FileList.erase(this->FileList.begin() + 1, this->FileList.end());
+	return result;
 }
 
-void CueSheet::Clear() {
-	for(auto &f_itr : this->FileList) {
-		for(auto &t_itr : f_itr.TrackList) {
-			t_itr.IndexList.clear();
+std::vector<CueSheet::GapObj> CueSheet::GetGaps() const {
+	std::vector<GapObj> gaps;
+	
+	//FILEs are laid end to end. A PREGAP goes at its TRACK's first INDEX, and
+	//a POSTGAP at the next TRACK's first INDEX, or the end of the FILE
+	uint64_t file_start = 0;
+	for(const auto &f_itr : this->FileList) {
+		uint32_t postgap = 0;
+		
+		for(const auto &t_itr : f_itr.TrackList) {
+			if(t_itr.IndexList.empty()) continue;
+			uint16_t sect_bytes = GetSectorBytesInTrackType(t_itr.type);
+			uint64_t track_start = file_start + t_itr.IndexList.front().Bytes(t_itr.type);
+			
+			if(postgap) gaps.push_back({track_start, postgap});
+			if(t_itr.pregap) gaps.push_back({track_start, t_itr.pregap * sect_bytes});
+			postgap = t_itr.postgap * sect_bytes;
 		}
-		f_itr.TrackList.clear();
+		
+		file_start += f_itr.bytes;
+		if(postgap) gaps.push_back({file_start, postgap});
 	}
 	
-	this->FileList.clear();
+	return gaps;
 }
 
-int CueSheet::CopyTo(CueSheet &target) {	
-	//Clear the input first, then copy all data to it
-	target.Clear();
+void CueSheet::Split(std::string op_basename) {
+	//Only a single FILE can be split, exit early if it is empty
+	if(this->FileList.empty()) return;
+	if(this->FileList.size() != 1) throw split_multiple_files;
 	
-	//NOTE: I could do this by just pushing a pointer to each file iterator,
-	//but I am not sure if this is a safe thing to do if the object calling the
-	//copy goes out of scope or invalidates its own pointers
-	for(auto &f_itr : this->FileList) {
-		FileObj tf(f_itr.filename, f_itr.filetype, f_itr.bytes);
-		if(target.PushFile(&tf) != 0) return -1;
-
-		for(auto &t_itr : f_itr.TrackList) {
-			FileObj::TrackObj tt(t_itr.id, t_itr.type);
-			if(target.PushTrack(&tt) != 0) return -2;
-			
-			for(auto &i_itr : t_itr.IndexList) {
-				FileObj::TrackObj::IndexObj ti(i_itr.id, i_itr.offset);
-				if(target.PushIndex(&ti) != 0) return -3;
+	const FileObj &in_file = this->FileList.front();
+	if(in_file.TrackList.empty()) return;
+	
+	//Default the base name to the input filename without its extension, and
+	//keep the extension for the output FILEs
+	std::string ext;
+	size_t dot = in_file.filename.find_last_of('.');
+	if(dot != std::string::npos && dot != 0) ext = in_file.filename.substr(dot);
+	if(op_basename.empty()) op_basename = in_file.filename.substr(0, dot);
+	
+	//Pad track numbers to 2 digits when there are 10 or more tracks
+	bool pad = in_file.TrackList.size() >= 10;
+	
+	//Find where every TRACK starts in the input FILE. The first TRACK keeps
+	//any data before its first INDEX so the FILEs cover the whole input
+	std::vector<uint32_t> starts;
+	starts.reserve(in_file.TrackList.size());
+	for(const auto &t_itr : in_file.TrackList) {
+		uint32_t start = 0;
+		if(!starts.empty() && !t_itr.IndexList.empty()) {
+			if(t_itr.type == TrackType::Invalid) throw timestamp_invalid_track;
+			if(t_itr.IndexList.front().sector == timestamp_nval) throw timestamp_invalid_bytes;
+			start = t_itr.IndexList.front().Bytes(t_itr.type);
+		}
+		
+		if((!starts.empty() && start < starts.back()) || start > in_file.bytes) {
+			throw split_index_order;
+		}
+		starts.push_back(start);
+	}
+	
+	//Create a temp cue sheet to copy to, this will be the new Split Sheet
+	CueSheet temp_cue;
+	auto s_itr = starts.begin();
+	for(const auto &t_itr : in_file.TrackList) {
+		uint32_t start = *s_itr;
+		uint32_t end = (++s_itr == starts.end()) ? in_file.bytes : *s_itr;
+		
+		std::string track_num = std::to_string(t_itr.id);
+		if(pad && track_num.length() < 2) track_num.insert(0, "0");
+		
+		temp_cue.PushFile(FileObj(op_basename + " (Track " + track_num + ")" + ext,
+		                          in_file.filetype, end - start));
+		
+		FileObj::TrackObj temp_track = t_itr;
+		temp_track.IndexList.clear();
+		temp_cue.PushTrack(&temp_track);
+		
+		//Copy the index data, rebased to the start of the new file. Every
+		//TRACK starts on a whole sector, so the INDEXs stay whole sectors
+		uint16_t sect_bytes = GetSectorBytesInTrackType(t_itr.type);
+		if(sect_bytes == 0 && !t_itr.IndexList.empty()) throw timestamp_invalid_track;
+		for(const auto &i_itr : t_itr.IndexList) {
+			uint32_t offset = i_itr.Bytes(t_itr.type);
+			if(i_itr.sector == timestamp_nval || offset < start || offset > end) {
+				throw split_index_order;
 			}
+			
+			FileObj::TrackObj::IndexObj temp_index(i_itr.id, i_itr.sector - (start / sect_bytes));
+			temp_cue.PushIndex(&temp_index);
 		}
 	}
 	
+	//Move the new sheet in, keeping the disc commands
+	temp_cue.text = std::move(this->text);
+	*this = std::move(temp_cue);
+}
+
+void CueSheet::Clear() {
+	this->FileList.clear();
+	this->TrackData.clear();
+	this->IndexData.clear();
+	
+	this->text.reset();
+}
+
+int CueSheet::CopyTo(CueSheet &target) const {	
+	if(&target == this) return 0;
+	
+	//The arrays are copied whole, then the ranges pointed at the target's
+	target.FileList  = this->FileList;
+	target.TrackData = this->TrackData;
+	target.IndexData = this->IndexData;
+	target.BindRanges();
+	
+	CopyDiscCommands(*this, target);
 	return 0;
 }
 
 /*** Structure Functions ******************************************************/
-CueSheet::LineType CueSheet::StrToLineType(const std::string &input) {	
-	//Default to Invalid. Set to value if compare matches
-	LineType type = LineType::Invalid;
-	     if(input.compare("FILE") == 0)    type = LineType::File;
-	else if(input.compare("TRACK") == 0)   type = LineType::Track;
-	else if(input.compare("INDEX") == 0)   type = LineType::Index;
-	else if(input.compare("REM") == 0)     type = LineType::Remark;
-	
-	return type;
+CueSheet::LineType CueSheet::StrToLineType(const std::string_view input) {	
+	return static_cast<LineType>(FindKeyword(input, line_type_names, line_type_slots));
 }
 
 std::string CueSheet::LineTypeToStr(const LineType type) {
-	std::string type_str;
-	     if(type == LineType::Invalid)    type_str = "INVALID";
-	else if(type == LineType::File)       type_str = "FILE";
-	else if(type == LineType::Track)      type_str = "TRACK";
-	else if(type == LineType::Index)      type_str = "INDEX";
-	else if(type == LineType::Remark)     type_str = "REM";
-	
-	return type_str;
+	size_t idx = static_cast<size_t>(type);
+	if(idx >= std::size(line_type_names)) return std::string();
+	return std::string(line_type_names[idx]);
 }
 
-CueSheet::TrackType CueSheet::StrToTrackType(const std::string &input) {
-	//Default to Invalid. Set to value if compare matches
-	TrackType type = TrackType::Invalid;
-	     if(input.compare("AUDIO") == 0)      type = TrackType::AUDIO;
-	else if(input.compare("CDG") == 0)        type = TrackType::CDG;
-	else if(input.compare("MODE1/2048") == 0) type = TrackType::MODE1_2048;
-	else if(input.compare("MODE1/2352") == 0) type = TrackType::MODE1_2352;
-	else if(input.compare("MODE2/2336") == 0) type = TrackType::MODE2_2336;
-	else if(input.compare("MODE2/2352") == 0) type = TrackType::MODE2_2352;
-	else if(input.compare("CDI/2336") == 0)   type = TrackType::CDI_2336;
-	else if(input.compare("CDI/2352") == 0)   type = TrackType::CDI_2352;
-	
-	return type;
+CueSheet::TrackType CueSheet::StrToTrackType(const std::string_view input) {
+	return static_cast<TrackType>(FindKeyword(input, track_type_names, track_type_slots));
 }
 
 std::string CueSheet::TrackTypeToStr(const TrackType type) {
-	std::string type_str;
-	     if(type == TrackType::Invalid)       type_str = "INVALID";
-	else if(type == TrackType::AUDIO)         type_str = "AUDIO";
-	else if(type == TrackType::CDG)           type_str = "CDG";
-	else if(type == TrackType::MODE1_2048)    type_str = "MODE1/2048";
-	else if(type == TrackType::MODE1_2352)    type_str = "MODE1/2352";
-	else if(type == TrackType::MODE2_2336)    type_str = "MODE2/2336";
-	else if(type == TrackType::MODE2_2352)    type_str = "MODE2/2352";
-	else if(type == TrackType::CDI_2336)      type_str = "CDI/2336";
-	else if(type == TrackType::CDI_2352)      type_str = "CDI/2352";
-	
-	return type_str;
-}
-
-uint16_t CueSheet::GetSectorBytesInTrackType(const TrackType type) {
-	uint16_t bytes = 0;
-	     if(type == TrackType::Invalid)       bytes = 0;
-	else if(type == TrackType::AUDIO)         bytes = 2352;
-	else if(type == TrackType::CDG)           bytes = 2448;
-	else if(type == TrackType::MODE1_2048)    bytes = 2048;
-	else if(type == TrackType::MODE1_2352)    bytes = 2352;
-	else if(type == TrackType::MODE2_2336)    bytes = 2336;
-	else if(type == TrackType::MODE2_2352)    bytes = 2352;
-	else if(type == TrackType::CDI_2336)      bytes = 2336;
-	else if(type == TrackType::CDI_2352)      bytes = 2352;
-	
-	return bytes;
+	size_t idx = static_cast<size_t>(type);
+	if(idx >= std::size(track_type_names)) return std::string();
+	return std::string(track_type_names[idx]);
 }
 
-std::string CueSheet::BytesToTimestamp(const uint32_t bytes,
-                                       const TrackType type) {
+std::string CueSheet::SectorsToTimestamp(const uint32_t sectors) {
 	std::string timestamp;
+	StringSink sink {timestamp};
+	PutTimestamp(sink, sectors);
+	return timestamp;
+}
+
+uint32_t CueSheet::TimestampToSectors(const std::string_view timestamp) {
+	//Timestamps are always "MM:SS:ff". Minutes are guarded from being over 99
+	//by only allowing two digits
+	if(timestamp.length() != 8 || timestamp[2] != ':' || timestamp[5] != ':') 
+		return timestamp_nval;
 	
-	if(type == TrackType::Invalid || bytes == timestamp_nval) {
-		if(type == TrackType::Invalid) throw timestamp_invalid_track;
-		if(bytes == timestamp_nval) throw timestamp_invalid_bytes;
-		return timestamp;
-	}
-	
-	uint32_t sector_quo, sector_rem;
-	uint16_t sect_bytes = GetSectorBytesInTrackType(type);
-	DivideWithRemainder32(bytes, sect_bytes, sector_quo, sector_rem);
-	
-	//Make sure the remainder is 0 to make sure the bytes-per-sector and bytes
-	//align properly
-	if(sector_rem != 0) {
-		throw timestamp_bytes_mismatch;
-		return timestamp;
-	}
-	
-	//Convert bytes into minutes seconds and frames only if the bytes and 
-	//tracktype bytes-per-sector match.
 	uint32_t minutes, seconds, frames;
+	const char *ts = timestamp.data();
+	if(std::from_chars(ts, ts + 2, minutes).ptr != ts + 2 ||
+	   std::from_chars(ts + 3, ts + 5, seconds).ptr != ts + 5 ||
+	   std::from_chars(ts + 6, ts + 8, frames).ptr != ts + 8) return timestamp_nval;
 	
-	//Get seconds and frames from sectors (75 sectors per sec)
-	DivideWithRemainder32(sector_quo, 75, seconds, frames);
-	//Convert Seconds into minutes while keeping remainder seconds
-	DivideWithRemainder32(seconds, 60, minutes, seconds);
+	//75 sectors per second, convert mins to secs, plus the leftover frames
+	//Which are 1 sector each
+	return ((seconds + (minutes * 60)) * 75) + frames;
+}
 
-	//Guard against out of spec minutes value (over 99)
-	if(minutes > 99) {
-		throw timestamp_invalid_minutes;
-		return timestamp;
-	}
+std::string CueSheet::BytesToTimestamp(const uint32_t bytes,
+                                       const TrackType type) {
+	if(type == TrackType::Invalid) throw timestamp_invalid_track;
+	if(bytes == timestamp_nval) throw timestamp_invalid_bytes;
 	
-	timestamp = NumToStrPad(minutes, 2) + ":" + NumToStrPad(seconds, 2) 
-		                                    + ":" + NumToStrPad(frames, 2);
+	//Make sure the bytes-per-sector and bytes align properly
+	uint16_t sect_bytes = GetSectorBytesInTrackType(type);
+	if(bytes % sect_bytes != 0) throw timestamp_bytes_mismatch;
 	
-	return timestamp;
+	return SectorsToTimestamp(bytes / sect_bytes);
 }
 
-uint32_t CueSheet::TimestampToBytes(const std::string &timestamp, 
+uint32_t CueSheet::TimestampToBytes(const std::string_view timestamp, 
                                     const TrackType type) {
-    uint32_t total_bytes = timestamp_nval;
-        
-	if(type != TrackType::Invalid && IsValidTimestamp(timestamp)) {
-		//Strip values from the timestamp. "MM:SS:ff"
-		//NOTE: Minutes are already guarded from being over 99 because 
-		//of IsValidTimestamp
-		uint32_t minutes, seconds, frames;
-		minutes = static_cast<uint32_t>(std::stoul(timestamp.substr(0, 2)));
-		seconds = static_cast<uint32_t>(std::stoul(timestamp.substr(3, 2)));
-		frames  = static_cast<uint32_t>(std::stoul(timestamp.substr(6, 2)));
-		
-		//75 sectors per second, convert mins to secs, plus the leftover frames
-		//Which are 1 sector each
-		uint32_t sectors = ((seconds + (minutes * 60)) * 75) + frames;
-		uint16_t sect_bytes = GetSectorBytesInTrackType(type);
-		total_bytes = sectors * sect_bytes;
-	}
-		
-	return total_bytes;
+	if(type == TrackType::Invalid) return timestamp_nval;
+	
+	uint32_t sectors = TimestampToSectors(timestamp);
+	if(sectors == timestamp_nval) return timestamp_nval;
+	return sectors * GetSectorBytesInTrackType(type);
 }
 
 std::string CueSheet::FileToStr(const FileObj *file_ptr) {
 	std::string output;
-	if(file_ptr != nullptr) {
-		output = "FILE \"" + file_ptr->filename + "\" " + file_ptr->filetype;
-	}
+	StringSink sink {output};
+	if(file_ptr != nullptr) PutFile(sink, *file_ptr);
 	
 	return output;
 }
 
 std::string CueSheet::TrackToStr(const FileObj::TrackObj *track_ptr) {
 	std::string output;
-	if(track_ptr != nullptr) {
-		output = "  TRACK " + NumToStrPad(track_ptr->id, 2) + " " 
-							+ TrackTypeToStr(track_ptr->type);
-	}
+	StringSink sink {output};
+	if(track_ptr != nullptr) PutTrack(sink, *track_ptr);
 	
 	return output;
 }				          
@@ -692,10 +1277,8 @@ std::string CueSheet::TrackToStr(const FileObj::TrackObj *track_ptr) {
 std::string CueSheet::IndexToStr(const FileObj::TrackObj::IndexObj *index_ptr,
                                                          const TrackType type) {
 	std::string output;
-	if(index_ptr != nullptr) {
-		output = "    INDEX " + NumToStrPad(index_ptr->id, 2) + " " 
-		            		  + BytesToTimestamp(index_ptr->offset, type);
-	}
+	StringSink sink {output};
+	if(index_ptr != nullptr) PutIndex(sink, *index_ptr, type);
 	
 	return output;
 }
@@ -0,0 +1,90 @@
+/******************************************************************************
+* psx-comBINe disc sets
+* Groups the .cue files of a folder into multi-disc sets, by the disc marker
+* in their names, e.g. "Game (Disc 1).cue" and "Game (Disc 2).cue"
+* ADBeta (c)
+******************************************************************************/
+#include "discset.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <regex>
+#include <map>
+
+namespace {
+// (Disc 1), (Disc 1 of 2), [CD2], - Disk B, _disc2. Disc letters go up to D
+const std::regex disc_marker(
+	"[ _-]*[([]?[ _]*\\b(?:disc|disk|cd)[ _-]*([0-9]+|[a-d]\\b)(?:[ _]*of[ _]*[0-9]+)?[ _]*[)\\]]?",
+	std::regex::icase);
+
+// A file's set name and disc number
+struct DiscName {
+	std::string name;
+	unsigned    number;
+};
+
+DiscName SplitDiscName(const std::string &stem) {
+	std::smatch match;
+	if(!std::regex_search(stem, match, disc_marker)) return {stem, 0};
+
+	std::string id = match.str(1);
+	unsigned number;
+	if(isdigit(static_cast<unsigned char>(id[0]))) {
+		number = static_cast<unsigned>(std::stoul(id));
+	} else {
+		number = static_cast<unsigned>(tolower(static_cast<unsigned char>(id[0])) - 'a') + 1;
+	}
+
+	// Keep whatever follows the marker, e.g. the region
+	std::string name = match.prefix().str() + match.suffix().str();
+	while(!name.empty() && name.back() == ' ') name.pop_back();
+	if(name.empty()) name = stem;
+
+	return {name, number};
+}
+} // namespace
+
+unsigned GetDiscNumber(const std::string &filename) {
+	return SplitDiscName(std::filesystem::path(filename).stem().string()).number;
+}
+
+std::vector<DiscSet> GroupDiscSets(const std::vector<std::filesystem::path> &files) {
+	struct Disc {
+		unsigned              number;
+		std::filesystem::path path;
+	};
+
+	// Set names are matched case-insensitively, in the order first seen
+	std::vector<std::string> order;
+	std::map<std::string, std::pair<std::string, std::vector<Disc>>> sets;
+	for(const auto &file : files) {
+		DiscName disc = SplitDiscName(file.stem().string());
+
+		// Files without a marker are never merged with anything
+		std::string key = disc.number ? StringToLower(disc.name) : "\n" + file.string();
+		auto found = sets.find(key);
+		if(found == sets.end()) {
+			order.push_back(key);
+			found = sets.emplace(key, std::make_pair(disc.name, std::vector<Disc>())).first;
+		}
+		found->second.second.push_back({disc.number, file});
+	}
+
+	std::vector<DiscSet> result;
+	for(const std::string &key : order) {
+		std::vector<Disc> &discs = sets[key].second;
+		std::stable_sort(discs.begin(), discs.end(),
+		                 [](const Disc &a, const Disc &b) { return a.number < b.number; });
+
+		DiscSet set;
+		set.name = sets[key].first;
+		for(const Disc &disc : discs) set.discs.push_back(disc.path);
+		result.push_back(std::move(set));
+	}
+
+	return result;
+}
@@ -0,0 +1,142 @@
+/******************************************************************************
+* psx-comBINe file range copying
+* Copies byte ranges between files using the fastest method the OS offers:
+* reflinks (FICLONERANGE), then in-kernel copy_file_range(), then a plain
+* buffered copy.
+* ADBeta (c)
+******************************************************************************/
+#include "filecopy.hpp"
+#include "workpool.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+
+namespace {
+// Buffer size for the fallback copy
+constexpr size_t copy_buffer_bytes = 1024 * 1024;
+
+// Plain read/write copy, used where the OS cannot copy for us
+void BufferedCopy(const CopyJob &job, uint64_t dest_offset, uint64_t done) {
+	std::ifstream in(job.src, std::ios::in | std::ios::binary);
+	std::fstream out(job.dest, std::ios::in | std::ios::out | std::ios::binary);
+	if(!in || !out) throw std::runtime_error("Failed to open files for copying");
+
+	in.seekg(static_cast<std::streamoff>(job.offset + done), std::ios::beg);
+	out.seekp(static_cast<std::streamoff>(dest_offset + done), std::ios::beg);
+
+	std::vector<char> buffer(copy_buffer_bytes);
+	while(done < job.bytes) {
+		size_t take = static_cast<size_t>(std::min<uint64_t>(buffer.size(), job.bytes - done));
+		in.read(buffer.data(), static_cast<std::streamsize>(take));
+		out.write(buffer.data(), static_cast<std::streamsize>(take));
+		if(!in || !out) throw std::runtime_error("Failed to copy file data");
+		done += take;
+	}
+}
+
+#ifdef __linux__
+// Closes a file descriptor when it goes out of scope
+struct FileDescriptor {
+	int fd;
+	explicit FileDescriptor(int f) : fd(f) {}
+	~FileDescriptor() { if(this->fd >= 0) close(this->fd); }
+};
+
+// Tries a reflink, then copy_file_range(). Returns the bytes copied, which
+// may be less than asked for if neither is supported for these files. Sets
+// reflinked if the range shares its data with the source
+uint64_t KernelCopy(const CopyJob &job, uint64_t dest_offset, bool &reflinked) {
+	FileDescriptor in(open(job.src.c_str(), O_RDONLY));
+	FileDescriptor out(open(job.dest.c_str(), O_WRONLY));
+	if(in.fd < 0 || out.fd < 0) throw std::runtime_error("Failed to open files for copying");
+
+	// Reflinks need block aligned offsets. The length may end at EOF
+	struct stat st;
+	if(fstat(in.fd, &st) == 0 && st.st_blksize > 0 &&
+	   job.offset % static_cast<uint64_t>(st.st_blksize) == 0 &&
+	   dest_offset % static_cast<uint64_t>(st.st_blksize) == 0) {
+		struct file_clone_range range = {};
+		range.src_fd      = in.fd;
+		range.src_offset  = job.offset;
+		range.src_length  = job.bytes;
+		range.dest_offset = dest_offset;
+		if(ioctl(out.fd, FICLONERANGE, &range) == 0) {
+			reflinked = true;
+			return job.bytes;
+		}
+	}
+
+	uint64_t done = 0;
+	while(done < job.bytes) {
+		loff_t in_off = static_cast<loff_t>(job.offset + done);
+		loff_t out_off = static_cast<loff_t>(dest_offset + done);
+		size_t take = static_cast<size_t>(std::min<uint64_t>(job.bytes - done, 1u << 30));
+
+		ssize_t copied = copy_file_range(in.fd, &in_off, out.fd, &out_off, take, 0);
+		if(copied < 0) {
+			// Not supported here (old kernel, cross filesystem): fall back
+			if(errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+			   errno == EOPNOTSUPP || errno == EBADF) break;
+			throw std::runtime_error("Failed to copy file data");
+		}
+		if(copied == 0) throw std::runtime_error("Source file ended early while copying");
+		done += static_cast<uint64_t>(copied);
+	}
+
+	return done;
+}
+#endif
+
+// Copies a range into an existing file, at dest_offset. Returns true if it
+// was reflinked
+bool CopyInto(const CopyJob &job, uint64_t dest_offset) {
+	uint64_t done = 0;
+	bool reflinked = false;
+#ifdef __linux__
+	done = KernelCopy(job, dest_offset, reflinked);
+#endif
+	if(done < job.bytes) BufferedCopy(job, dest_offset, done);
+	return reflinked;
+}
+
+// Creates (or truncates) a file
+void CreateEmptyFile(const std::filesystem::path &path) {
+	std::ofstream create(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!create) throw std::runtime_error("Output binary file could not be created");
+}
+} // namespace
+
+void CopyFileRange(const CopyJob &job) {
+	CreateEmptyFile(job.dest);
+	CopyInto(job, 0);
+}
+
+uint64_t ConcatenateFiles(const std::vector<std::filesystem::path> &srcs,
+                          const std::filesystem::path &dest) {
+	CreateEmptyFile(dest);
+
+	uint64_t offset = 0, reflinked = 0;
+	for(const auto &src : srcs) {
+		uint64_t bytes = std::filesystem::file_size(src);
+		if(CopyInto({src, 0, bytes, dest}, offset)) reflinked += bytes;
+		offset += bytes;
+	}
+	return reflinked;
+}
+
+void CopyFileRanges(const std::vector<CopyJob> &jobs, unsigned threads) {
+	ParallelFor(jobs.size(), [&jobs](size_t idx) { CopyFileRange(jobs[idx]); }, threads);
+}
@@ -0,0 +1,269 @@
+/******************************************************************************
+* psx-comBINe FUSE mount
+* Presents every multi-bin set in a library as a single combined .cue and
+* .bin pair, read on the fly from the original bins through a sector cache.
+* Only built with FUSE support (make FUSE=1), see PSXCOMBINE_FUSE.
+* ADBeta (c)
+******************************************************************************/
+#include "fusemount.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef PSXCOMBINE_FUSE
+#include "cuehandler.hpp"
+#include "virtualimage.hpp"
+#include "sectorcache.hpp"
+#include "utils.hpp"
+
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+
+#include <system_error>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <map>
+#include <set>
+
+/*** Mounted Library **********************************************************/
+namespace {
+// A multi-FILE set, served as one combined image
+struct MountedImage {
+	CueSheet                      sheet;      // Original sheet, sizes filled in
+	std::filesystem::path         base_dir;
+	std::string                   cue_text;   // Combined .cue file
+	uint64_t                      bytes;
+	std::unique_ptr<VirtualImage> image;      // Opened on first use
+	std::once_flag                opened;
+};
+
+// A file or directory in the mount
+struct Node {
+	bool                  directory = false;
+	bool                  cue = false;      // The .cue rather than the .bin
+	size_t                image = 0;        // Index into Library::images
+	std::set<std::string> children;         // Names, for directories
+};
+
+struct Library {
+	std::vector<std::unique_ptr<MountedImage>> images;
+	std::map<std::string, Node>                nodes;  // Keyed by full path
+	SectorCache                                cache{fusemount::cache_sectors,
+	                                                 fusemount::readahead_sectors};
+};
+
+Library &GetLibrary() {
+	return *static_cast<Library *>(fuse_get_context()->private_data);
+}
+
+// Adds a node, and any missing parent directories
+void AddNode(Library &lib, const std::string &path, const Node &node) {
+	lib.nodes[path] = node;
+
+	std::string child = path;
+	while(child != "/") {
+		size_t slash = child.find_last_of('/');
+		std::string parent = (slash == 0) ? "/" : child.substr(0, slash);
+
+		Node &dir = lib.nodes[parent];
+		dir.directory = true;
+		dir.children.insert(child.substr(slash + 1));
+		child = parent;
+	}
+}
+
+// Finds every multi-FILE .cue under the library, and adds its .cue and .bin
+void ScanLibrary(Library &lib, const std::filesystem::path &library) {
+	lib.nodes["/"].directory = true;
+
+	auto options = std::filesystem::directory_options::skip_permission_denied;
+	for(const auto &dir_entry : std::filesystem::recursive_directory_iterator(library, options)) {
+		const std::filesystem::path &cue_path = dir_entry.path();
+		if(!dir_entry.is_regular_file() || StringToLower(cue_path.extension().string()) != ".cue")
+			continue;
+
+		std::unique_ptr<MountedImage> mounted(new MountedImage);
+		mounted->base_dir = cue_path.parent_path();
+		try {
+			CueFile cue_in(cue_path.string().c_str());
+			cue_in.ReadCueData(mounted->sheet);
+			cue_in.GetCueFileSizes(mounted->sheet, (mounted->base_dir / "").string());
+		} catch(const std::exception &e) {
+			std::cerr << "Skipping " << cue_path << ": " << e.what() << std::endl;
+			continue;
+		}
+
+		// Single bin sets need no combining
+		if(mounted->sheet.FileList.size() < 2) continue;
+
+		// A set that cannot be combined, or written out, is skipped too
+		std::string stem = cue_path.stem().string();
+		CueSheet combined;
+		mounted->sheet.CopyTo(combined);
+		CueResult result = combined.TryCombine(stem + ".bin", "BINARY");
+		if(!result.ok()) {
+			std::cerr << "Skipping " << cue_path << ": " << result.FirstError()->ToString() << std::endl;
+			continue;
+		}
+		try {
+			mounted->cue_text = combined.ToString();
+		} catch(const std::exception &e) {
+			std::cerr << "Skipping " << cue_path << ": " << e.what() << std::endl;
+			continue;
+		}
+		mounted->bytes = combined.FileList.front().bytes;
+
+		// Mirror the library's folders
+		std::string dir = "/" + std::filesystem::relative(mounted->base_dir, library).generic_string();
+		if(dir == "/.") dir = "/";
+		if(dir.back() != '/') dir += "/";
+
+		Node node;
+		node.image = lib.images.size();
+		node.cue = true;
+		AddNode(lib, dir + stem + ".cue", node);
+		node.cue = false;
+		AddNode(lib, dir + stem + ".bin", node);
+
+		lib.images.push_back(std::move(mounted));
+	}
+}
+
+/*** FUSE Operations **********************************************************/
+void *OpInit(struct fuse_conn_info *, struct fuse_config *cfg) {
+	// The images never change, so the kernel may cache them freely
+	cfg->kernel_cache = 1;
+	cfg->entry_timeout = 3600;
+	cfg->attr_timeout = 3600;
+	return fuse_get_context()->private_data;
+}
+
+int OpGetattr(const char *path, struct stat *st, struct fuse_file_info *) {
+	Library &lib = GetLibrary();
+	auto found = lib.nodes.find(path);
+	if(found == lib.nodes.end()) return -ENOENT;
+
+	std::memset(st, 0, sizeof(*st));
+	const Node &node = found->second;
+	if(node.directory) {
+		st->st_mode = S_IFDIR | 0555;
+		st->st_nlink = 2;
+	} else {
+		const MountedImage &mounted = *lib.images[node.image];
+		st->st_mode = S_IFREG | 0444;
+		st->st_nlink = 1;
+		st->st_size = static_cast<off_t>(node.cue ? mounted.cue_text.size() : mounted.bytes);
+	}
+
+	return 0;
+}
+
+int OpReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t,
+              struct fuse_file_info *, enum fuse_readdir_flags) {
+	Library &lib = GetLibrary();
+	auto found = lib.nodes.find(path);
+	if(found == lib.nodes.end()) return -ENOENT;
+	if(!found->second.directory) return -ENOTDIR;
+
+	filler(buf, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	filler(buf, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	for(const std::string &name : found->second.children) {
+		filler(buf, name.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	}
+
+	return 0;
+}
+
+int OpOpen(const char *path, struct fuse_file_info *fi) {
+	Library &lib = GetLibrary();
+	auto found = lib.nodes.find(path);
+	if(found == lib.nodes.end()) return -ENOENT;
+	if(found->second.directory) return -EISDIR;
+	if((fi->flags & O_ACCMODE) != O_RDONLY) return -EROFS;
+
+	// Open the original bins the first time the image is opened
+	const Node &node = found->second;
+	if(!node.cue) {
+		MountedImage &mounted = *lib.images[node.image];
+		try {
+			std::call_once(mounted.opened, [&mounted]() {
+				mounted.image.reset(new VirtualImage(mounted.sheet, mounted.base_dir));
+			});
+		} catch(const std::exception &e) {
+			std::cerr << "Failed to open " << path << ": " << e.what() << std::endl;
+			return -EIO;
+		}
+	}
+
+	fi->fh = reinterpret_cast<uint64_t>(&node);
+	fi->keep_cache = 1;
+	return 0;
+}
+
+int OpRead(const char *, char *buf, size_t size, off_t off, struct fuse_file_info *fi) {
+	Library &lib = GetLibrary();
+	const Node &node = *reinterpret_cast<const Node *>(fi->fh);
+	MountedImage &mounted = *lib.images[node.image];
+
+	uint64_t bytes = node.cue ? mounted.cue_text.size() : mounted.bytes;
+	uint64_t offset = static_cast<uint64_t>(off);
+	if(offset >= bytes) return 0;
+	size = static_cast<size_t>(std::min<uint64_t>(size, bytes - offset));
+
+	if(node.cue) {
+		std::memcpy(buf, mounted.cue_text.data() + offset, size);
+		return static_cast<int>(size);
+	}
+
+	try {
+		lib.cache.Read(*mounted.image, static_cast<uint32_t>(node.image), offset,
+		               reinterpret_cast<uint8_t *>(buf), size);
+	} catch(const std::exception &) {
+		return -EIO;
+	}
+
+	return static_cast<int>(size);
+}
+} // namespace
+
+/*** Mount ********************************************************************/
+size_t MountLibrary(const std::filesystem::path &library,
+                    const std::filesystem::path &mountpoint) {
+	Library lib;
+	ScanLibrary(lib, library);
+	std::cout << "Mounting " << lib.images.size() << " combined images on " << mountpoint
+			  << "\nUnmount with: fusermount -u " << mountpoint << std::endl;
+
+	struct fuse_operations ops;
+	std::memset(&ops, 0, sizeof(ops));
+	ops.init    = OpInit;
+	ops.getattr = OpGetattr;
+	ops.readdir = OpReaddir;
+	ops.open    = OpOpen;
+	ops.read    = OpRead;
+
+	// Run in the foreground, multithreaded, read-only
+	std::string mount_str = mountpoint.string();
+	std::vector<std::string> args = {"psx-combine", mount_str, "-f", "-o", "ro,fsname=psx-combine"};
+	std::vector<char *> argv;
+	for(std::string &arg : args) argv.push_back(&arg[0]);
+
+	if(fuse_main(static_cast<int>(argv.size()), argv.data(), &ops, &lib) != 0)
+		throw std::runtime_error("FUSE mount failed");
+
+	return lib.images.size();
+}
+
+#else
+size_t MountLibrary(const std::filesystem::path &, const std::filesystem::path &) {
+	throw std::runtime_error("This build has no FUSE support, rebuild with: make FUSE=1");
+}
+#endif
@@ -0,0 +1,336 @@
+/******************************************************************************
+* psx-comBINe seekable gzip support
+* The combined binary stream is split into sector-aligned frames, and each
+* frame is compressed (in parallel) as its own gzip member. A frame index is
+* kept in empty trailing members, so any sector range can be decompressed
+* without reading the whole file. Standard gzip tools see a normal .gz file.
+* ADBeta (c)
+******************************************************************************/
+#include "gzipfile.hpp"
+#include "cdsector.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include <zlib.h>
+
+/*** Seekable gzip Format *****************************************************/
+// Data frames are plain gzip members. After the last frame come one or more
+// empty "index" members, each holding the compressed sizes of the next run
+// of frames in a 'PI' FEXTRA subfield. The file ends with a fixed size empty
+// "locator" member with a 'PL' subfield:
+//   [frame bytes u32][total bytes u64][index offset u64][frame count u32]
+// All values are little-endian, as in the rest of the gzip format.
+namespace {
+constexpr uint32_t data_frame_bytes = seekgz::frame_sectors * cdsector::raw_bytes;
+constexpr size_t   header_bytes     = 10;
+constexpr size_t   trailer_bytes    = 8;
+constexpr size_t   locator_data     = 24;
+constexpr size_t   locator_bytes    = header_bytes + 2 + 4 + locator_data + 2 + trailer_bytes;
+
+constexpr uint8_t  gz_id1 = 0x1F, gz_id2 = 0x8B, gz_deflate = 0x08;
+constexpr uint8_t  gz_fextra = 0x04;
+constexpr uint8_t  gz_os_unknown = 0xFF;
+
+// An empty deflate stream (a single final fixed-Huffman block)
+constexpr uint8_t  empty_deflate[2] = {0x03, 0x00};
+
+/*** Byte Helpers *************************************************************/
+void AppendLE(std::vector<uint8_t> &dest, uint64_t value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		dest.push_back(static_cast<uint8_t>(value));
+		value >>= 8;
+	}
+}
+
+uint64_t GetLE(const uint8_t *src, int bytes) {
+	uint64_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--) value = (value << 8) | src[i];
+	return value;
+}
+
+// Appends a gzip member header. The FEXTRA field is added if extra is given
+void AppendHeader(std::vector<uint8_t> &dest, const std::vector<uint8_t> *extra) {
+	dest.insert(dest.end(), {gz_id1, gz_id2, gz_deflate,
+	                         static_cast<uint8_t>(extra ? gz_fextra : 0x00),
+	                         0x00, 0x00, 0x00, 0x00, 0x00, gz_os_unknown});
+	if(extra) {
+		AppendLE(dest, extra->size(), 2);
+		dest.insert(dest.end(), extra->begin(), extra->end());
+	}
+}
+
+// Appends an empty gzip member carrying a single FEXTRA subfield
+void AppendEmptyMember(std::vector<uint8_t> &dest, char id1, char id2,
+                       const std::vector<uint8_t> &payload) {
+	std::vector<uint8_t> extra;
+	extra.push_back(static_cast<uint8_t>(id1));
+	extra.push_back(static_cast<uint8_t>(id2));
+	AppendLE(extra, payload.size(), 2);
+	extra.insert(extra.end(), payload.begin(), payload.end());
+
+	AppendHeader(dest, &extra);
+	dest.insert(dest.end(), std::begin(empty_deflate), std::end(empty_deflate));
+	AppendLE(dest, 0, 4);  // CRC32
+	AppendLE(dest, 0, 4);  // ISIZE
+}
+
+// Checks an empty member's header and returns its subfield payload
+const uint8_t *ParseEmptyMember(const uint8_t *src, size_t len, char id1, char id2,
+                                size_t &payload_len, size_t &member_len) {
+	if(len < header_bytes + 2 || src[0] != gz_id1 || src[1] != gz_id2 ||
+	   src[2] != gz_deflate || src[3] != gz_fextra) return nullptr;
+
+	size_t xlen = static_cast<size_t>(GetLE(src + header_bytes, 2));
+	member_len = header_bytes + 2 + xlen + sizeof(empty_deflate) + trailer_bytes;
+	if(xlen < 4 || member_len > len) return nullptr;
+
+	const uint8_t *sub = src + header_bytes + 2;
+	payload_len = static_cast<size_t>(GetLE(sub + 2, 2));
+	if(sub[0] != static_cast<uint8_t>(id1) || sub[1] != static_cast<uint8_t>(id2) ||
+	   payload_len + 4 != xlen) return nullptr;
+
+	return sub + 4;
+}
+
+// Compresses one frame into a complete gzip member
+void CompressFrame(const std::vector<uint8_t> &frame, std::vector<uint8_t> &out) {
+	z_stream strm = {};
+	if(deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9,
+	                Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("Failed to initialise deflate");
+	}
+
+	out.clear();
+	AppendHeader(out, nullptr);
+	out.resize(header_bytes + deflateBound(&strm, static_cast<uLong>(frame.size())));
+
+	strm.next_in   = const_cast<Bytef *>(frame.data());
+	strm.avail_in  = static_cast<uInt>(frame.size());
+	strm.next_out  = out.data() + header_bytes;
+	strm.avail_out = static_cast<uInt>(out.size() - header_bytes);
+
+	int ret = deflate(&strm, Z_FINISH);
+	size_t compressed = strm.total_out;
+	deflateEnd(&strm);
+	if(ret != Z_STREAM_END) throw std::runtime_error("Failed to compress frame");
+
+	out.resize(header_bytes + compressed);
+	AppendLE(out, crc32(0L, frame.data(), static_cast<uInt>(frame.size())), 4);
+	AppendLE(out, frame.size(), 4);
+}
+} // namespace
+
+/*** Seekable gzip Writer *****************************************************/
+GzipWriter::GzipWriter(const std::filesystem::path &path, unsigned threads)
+	: frame(data_frame_bytes), frame_fill(0), total_bytes(0), file_bytes(0),
+	  closed(false) {
+
+	this->file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!this->file) throw std::runtime_error("Output gzip file could not be created");
+
+	this->pipeline.reset(new OrderedPipeline(
+		[this](OrderedPipeline::Buffer &out) { this->WriteMember(out); }, threads));
+}
+
+GzipWriter::~GzipWriter() {
+	// Stop the workers before the members they reference are destroyed
+	this->pipeline.reset();
+}
+
+void GzipWriter::Write(const char *data, size_t len) {
+	const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+	this->total_bytes += len;
+
+	while(len) {
+		size_t take = std::min(len, data_frame_bytes - this->frame_fill);
+		std::memcpy(this->frame.data() + this->frame_fill, src, take);
+		this->frame_fill += take;
+		src += take;
+		len -= take;
+
+		if(this->frame_fill == data_frame_bytes) this->SubmitFrame();
+	}
+}
+
+void GzipWriter::SubmitFrame() {
+	std::vector<uint8_t> job_frame(data_frame_bytes);
+	job_frame.swap(this->frame);
+	job_frame.resize(this->frame_fill);
+	this->frame_fill = 0;
+
+	this->pipeline->Submit([job_frame](OrderedPipeline::Buffer &out) {
+		CompressFrame(job_frame, out);
+	});
+}
+
+void GzipWriter::WriteMember(const std::vector<uint8_t> &member) {
+	this->file.write(reinterpret_cast<const char *>(member.data()),
+	                 static_cast<std::streamsize>(member.size()));
+	if(!this->file) throw std::runtime_error("Failed to write to output gzip file");
+
+	this->file_bytes += member.size();
+	this->frame_sizes.push_back(static_cast<uint32_t>(member.size()));
+}
+
+void GzipWriter::Close() {
+	if(this->closed) return;
+	this->closed = true;
+
+	if(this->frame_fill) this->SubmitFrame();
+	this->pipeline->Finish();
+
+	this->WriteIndex();
+	this->file.close();
+	if(this->file.fail()) throw std::runtime_error("Failed to close output gzip file");
+}
+
+void GzipWriter::WriteIndex() {
+	std::vector<uint8_t> tail, payload;
+
+	// Frame sizes, split over as many index members as needed
+	for(size_t first = 0; first < this->frame_sizes.size(); first += seekgz::index_entries) {
+		size_t last = std::min(this->frame_sizes.size(), first + seekgz::index_entries);
+
+		payload.clear();
+		for(size_t i = first; i < last; i++) AppendLE(payload, this->frame_sizes[i], 4);
+		AppendEmptyMember(tail, 'P', 'I', payload);
+	}
+
+	payload.clear();
+	AppendLE(payload, data_frame_bytes, 4);
+	AppendLE(payload, this->total_bytes, 8);
+	AppendLE(payload, this->file_bytes, 8);
+	AppendLE(payload, this->frame_sizes.size(), 4);
+	AppendEmptyMember(tail, 'P', 'L', payload);
+
+	this->file.write(reinterpret_cast<const char *>(tail.data()),
+	                 static_cast<std::streamsize>(tail.size()));
+	if(!this->file) throw std::runtime_error("Failed to write gzip frame index");
+}
+
+/*** Seekable gzip Reader *****************************************************/
+GzipReader::GzipReader(const std::filesystem::path &path) {
+	this->file.open(path, std::ios::in | std::ios::binary);
+	if(!this->file) throw std::runtime_error("Input gzip file could not be opened");
+
+	this->file.seekg(0, std::ios::end);
+	uint64_t file_size = static_cast<uint64_t>(this->file.tellg());
+	if(file_size < locator_bytes) throw std::runtime_error("gzip file has no frame index");
+
+	// Locator member
+	uint8_t locator[locator_bytes];
+	this->ReadAt(file_size - locator_bytes, locator, locator_bytes);
+
+	size_t payload_len, member_len;
+	const uint8_t *loc = ParseEmptyMember(locator, locator_bytes, 'P', 'L',
+	                                      payload_len, member_len);
+	if(!loc || payload_len != locator_data || member_len != locator_bytes)
+		throw std::runtime_error("gzip file has no frame index");
+
+	this->frame_bytes = static_cast<uint32_t>(GetLE(loc, 4));
+	this->total_bytes = GetLE(loc + 4, 8);
+	uint64_t index_offset = GetLE(loc + 12, 8);
+	uint64_t frames = GetLE(loc + 20, 4);
+
+	if(this->frame_bytes == 0 || index_offset > file_size - locator_bytes ||
+	   frames != (this->total_bytes + this->frame_bytes - 1) / this->frame_bytes)
+		throw std::runtime_error("gzip frame index is corrupt");
+
+	// Index members, turned into member offsets
+	std::vector<uint8_t> index(static_cast<size_t>(file_size - locator_bytes - index_offset));
+	this->ReadAt(index_offset, index.data(), index.size());
+
+	this->frame_offsets.reserve(static_cast<size_t>(frames) + 1);
+	this->frame_offsets.push_back(0);
+
+	size_t pos = 0;
+	while(pos < index.size()) {
+		const uint8_t *sizes = ParseEmptyMember(index.data() + pos, index.size() - pos,
+		                                        'P', 'I', payload_len, member_len);
+		if(!sizes || payload_len % 4 != 0) throw std::runtime_error("gzip frame index is corrupt");
+
+		for(size_t i = 0; i < payload_len; i += 4) {
+			this->frame_offsets.push_back(this->frame_offsets.back() + GetLE(sizes + i, 4));
+		}
+		pos += member_len;
+	}
+
+	if(this->frame_offsets.size() != frames + 1 || this->frame_offsets.back() != index_offset)
+		throw std::runtime_error("gzip frame index is corrupt");
+}
+
+uint64_t GzipReader::BinaryBytes() const {
+	return this->total_bytes;
+}
+
+void GzipReader::ReadAt(uint64_t offset, uint8_t *dest, size_t len) {
+	std::lock_guard<std::mutex> lock(this->file_mtx);
+	this->file.clear();
+	this->file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	this->file.read(reinterpret_cast<char *>(dest), static_cast<std::streamsize>(len));
+	if(!this->file) throw std::runtime_error("Failed to read from gzip file");
+}
+
+void GzipReader::ReadFrame(uint32_t index, std::vector<uint8_t> &out) {
+	if(index + 1 >= this->frame_offsets.size()) throw std::runtime_error("gzip frame out of range");
+
+	uint64_t start = static_cast<uint64_t>(index) * this->frame_bytes;
+	size_t len = static_cast<size_t>(
+		std::min<uint64_t>(this->frame_bytes, this->total_bytes - start));
+
+	std::vector<uint8_t> src(static_cast<size_t>(
+		this->frame_offsets[index + 1] - this->frame_offsets[index]));
+	if(src.size() < header_bytes + trailer_bytes) throw std::runtime_error("gzip frame is corrupt");
+	this->ReadAt(this->frame_offsets[index], src.data(), src.size());
+
+	if(src[0] != gz_id1 || src[1] != gz_id2 || src[2] != gz_deflate || src[3] != 0x00)
+		throw std::runtime_error("gzip frame is corrupt");
+
+	out.resize(len);
+	z_stream strm = {};
+	if(inflateInit2(&strm, -MAX_WBITS) != Z_OK) throw std::runtime_error("Failed to initialise inflate");
+
+	strm.next_in   = src.data() + header_bytes;
+	strm.avail_in  = static_cast<uInt>(src.size() - header_bytes - trailer_bytes);
+	strm.next_out  = out.data();
+	strm.avail_out = static_cast<uInt>(len);
+
+	int ret = inflate(&strm, Z_FINISH);
+	bool ok = ret == Z_STREAM_END && strm.avail_out == 0;
+	inflateEnd(&strm);
+
+	const uint8_t *trailer = src.data() + src.size() - trailer_bytes;
+	if(!ok || GetLE(trailer, 4) != crc32(0L, out.data(), static_cast<uInt>(len)) ||
+	   GetLE(trailer + 4, 4) != (len & 0xFFFFFFFF))
+		throw std::runtime_error("gzip frame failed its CRC check");
+}
+
+void GzipReader::Read(uint64_t offset, size_t len, std::vector<uint8_t> &out) {
+	out.clear();
+	if(offset >= this->total_bytes) return;
+	len = static_cast<size_t>(std::min<uint64_t>(len, this->total_bytes - offset));
+	out.reserve(len);
+
+	std::vector<uint8_t> frame;
+	uint32_t index = static_cast<uint32_t>(offset / this->frame_bytes);
+	size_t skip = static_cast<size_t>(offset % this->frame_bytes);
+
+	while(out.size() < len) {
+		this->ReadFrame(index++, frame);
+		size_t take = std::min(frame.size() - skip, len - out.size());
+		out.insert(out.end(), frame.begin() + static_cast<std::ptrdiff_t>(skip),
+		           frame.begin() + static_cast<std::ptrdiff_t>(skip + take));
+		skip = 0;
+	}
+}
+
+void GzipReader::ReadSectors(uint32_t lba, uint32_t count, std::vector<uint8_t> &out) {
+	this->Read(static_cast<uint64_t>(lba) * cdsector::raw_bytes,
+	           static_cast<size_t>(count) * cdsector::raw_bytes, out);
+}
@@ -0,0 +1,222 @@
+/******************************************************************************
+* psx-comBINe ISO9660 reader
+* Builds a directory index of the data track of a (multi-bin) cue sheet, and
+* extracts files from it with random access, without combining the image.
+* CD-XA Mode 2 Form 2 files (XA audio, STR video) can be extracted with their
+* full 2336 or 2324 byte sector payload.
+* ADBeta (c)
+******************************************************************************/
+#include "iso9660.hpp"
+#include "cdsector.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <string>
+#include <vector>
+
+/*** ISO9660 Format Constants *************************************************/
+namespace {
+constexpr uint32_t pvd_lba          = 16;     // First volume descriptor
+constexpr uint32_t max_descriptors  = 32;
+constexpr size_t   root_record      = 156;    // Root directory record in the PVD
+constexpr size_t   record_min_bytes = 33;
+constexpr uint8_t  flag_directory   = 0x02;
+constexpr int      max_depth        = 32;
+
+// CD-XA system use field, found after the name in each directory record
+constexpr uint16_t xa_form2         = 0x1000;
+constexpr uint16_t xa_interleaved   = 0x2000;
+
+// Sectors read per batch while extracting
+constexpr uint32_t batch_sectors    = 64;
+
+uint32_t GetLE32(const uint8_t *src) {
+	return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8) |
+	       (static_cast<uint32_t>(src[2]) << 16) | (static_cast<uint32_t>(src[3]) << 24);
+}
+
+// Normalises a path for lookups: upper case, leading /, no ;version
+std::string NormalisePath(std::string path) {
+	std::replace(path.begin(), path.end(), '\\', '/');
+	if(path.empty() || path.front() != '/') path.insert(path.begin(), '/');
+	while(path.size() > 1 && path.back() == '/') path.pop_back();
+
+	size_t semi = path.find(';');
+	if(semi != std::string::npos) path.erase(semi);
+
+	std::transform(path.begin(), path.end(), path.begin(),
+	               [](unsigned char c) { return static_cast<char>(toupper(c)); });
+	return path;
+}
+} // namespace
+
+/*** ISO9660 Reader ***********************************************************/
+Iso9660Reader::Iso9660Reader(const CueSheet &sheet, const std::filesystem::path &base_dir)
+	: image(sheet, base_dir), track_offset(0), sector_bytes(0) {
+
+	// Find the first data track. LBA 0 is the first track's INDEX 01
+	bool have_lba0 = false;
+	for(const auto &t_itr : this->image.Combined().FileList.front().TrackList) {
+		for(const auto &i_itr : t_itr.IndexList) {
+			if(!have_lba0 && i_itr.id == 1) {
+				this->track_offset = i_itr.Bytes(t_itr.type);
+				have_lba0 = true;
+			}
+		}
+
+		if(this->sector_bytes == 0 && t_itr.type != CueSheet::TrackType::AUDIO &&
+		   t_itr.type != CueSheet::TrackType::CDG) {
+			this->sector_bytes = CueSheet::GetSectorBytesInTrackType(t_itr.type);
+		}
+	}
+
+	if(this->sector_bytes == 0) throw std::runtime_error("Image has no data TRACK");
+
+	// Find the Primary Volume Descriptor
+	uint8_t sector[cdsector::user_bytes];
+	bool found = false;
+	for(uint32_t lba = pvd_lba; lba < pvd_lba + max_descriptors && !found; lba++) {
+		this->ReadUserSector(lba, sector);
+		if(std::memcmp(sector + 1, "CD001", 5) != 0) break;
+		if(sector[0] == 0xFF) break;
+		found = (sector[0] == 0x01);
+	}
+	if(!found) throw std::runtime_error("Data track has no ISO9660 filesystem");
+
+	const uint8_t *root = sector + root_record;
+	this->entries.push_back({"/", GetLE32(root + 2), GetLE32(root + 10), true, false});
+	this->ReadDirectory(GetLE32(root + 2), GetLE32(root + 10), "", 0);
+}
+
+const std::vector<Iso9660Reader::Entry> &Iso9660Reader::Entries() const {
+	return this->entries;
+}
+
+const Iso9660Reader::Entry *Iso9660Reader::Find(const std::string &path) const {
+	std::string wanted = NormalisePath(path);
+	for(const Entry &entry : this->entries) {
+		if(NormalisePath(entry.path) == wanted) return &entry;
+	}
+
+	return nullptr;
+}
+
+size_t Iso9660Reader::SectorBytes() const {
+	return this->sector_bytes;
+}
+
+void Iso9660Reader::ReadDirectory(uint32_t lba, uint32_t bytes, const std::string &path,
+                                  int depth) {
+	if(depth > max_depth) throw std::runtime_error("ISO9660 directories nest too deep");
+
+	uint32_t sectors = (bytes + cdsector::user_bytes - 1) / cdsector::user_bytes;
+	std::vector<uint8_t> dir(static_cast<size_t>(sectors) * cdsector::user_bytes);
+	for(uint32_t s = 0; s < sectors; s++) {
+		this->ReadUserSector(lba + s, dir.data() + (s * cdsector::user_bytes));
+	}
+
+	// Records never cross a sector. A zero length means skip to the next one
+	size_t pos = 0;
+	while(pos < bytes) {
+		uint8_t rec_len = dir[pos];
+		if(rec_len == 0) {
+			pos = ((pos / cdsector::user_bytes) + 1) * cdsector::user_bytes;
+			continue;
+		}
+		if(rec_len < record_min_bytes || pos + rec_len > dir.size())
+			throw std::runtime_error("ISO9660 directory record is corrupt");
+
+		const uint8_t *rec = dir.data() + pos;
+		uint8_t name_len = rec[32];
+		pos += rec_len;
+
+		// Skip the . and .. entries
+		if(name_len == 1 && (rec[33] == 0x00 || rec[33] == 0x01)) continue;
+		if(static_cast<size_t>(33) + name_len > rec_len)
+			throw std::runtime_error("ISO9660 directory record is corrupt");
+
+		Entry entry;
+		std::string name(reinterpret_cast<const char *>(rec + 33), name_len);
+		size_t semi = name.find(';');
+		if(semi != std::string::npos) name.erase(semi);
+
+		// Names become paths when extracted, so one that could leave the
+		// output directory (.., separators, drive letters) is skipped
+		if(name.empty() || name == "." || name == ".." ||
+		   name.find_first_of(std::string("/\\:\0", 4)) != std::string::npos) continue;
+
+		entry.path      = path + "/" + name;
+		entry.lba       = GetLE32(rec + 2);
+		entry.bytes     = GetLE32(rec + 10);
+		entry.directory = (rec[25] & flag_directory) != 0;
+		entry.xa_form2  = false;
+
+		// The XA field follows the name, padded to an even offset
+		size_t xa = 33 + name_len + ((name_len & 1) ? 0 : 1);
+		if(xa + 14 <= rec_len && rec[xa + 6] == 'X' && rec[xa + 7] == 'A') {
+			uint16_t attr = static_cast<uint16_t>((rec[xa + 4] << 8) | rec[xa + 5]);
+			entry.xa_form2 = (attr & (xa_form2 | xa_interleaved)) != 0;
+		}
+
+		this->entries.push_back(entry);
+		if(entry.directory) this->ReadDirectory(entry.lba, entry.bytes, entry.path, depth + 1);
+	}
+}
+
+void Iso9660Reader::ReadSectors(uint32_t lba, uint32_t count, std::vector<uint8_t> &out) {
+	out.resize(static_cast<size_t>(count) * this->sector_bytes);
+	this->image.Read(this->track_offset + (static_cast<uint64_t>(lba) * this->sector_bytes),
+	                 out.data(), out.size());
+}
+
+void Iso9660Reader::ReadUserSector(uint32_t lba, uint8_t *dest) {
+	std::vector<uint8_t> raw;
+	this->ReadSectors(lba, 1, raw);
+	cdsector::ExtractUserData(raw.data(), 1, this->sector_bytes, dest);
+}
+
+void Iso9660Reader::ExtractFile(const Entry &entry, std::ostream &out, size_t xa_payload) {
+	if(entry.directory) throw std::runtime_error("Cannot extract a directory as a file");
+
+	// XA payloads live outside the 2048 byte user data, so need raw sectors
+	bool xa = entry.xa_form2;
+	if(xa && this->sector_bytes != cdsector::raw_bytes)
+		throw std::runtime_error("XA files can only be extracted from raw (2352) data tracks");
+	if(xa && xa_payload != xa_payload_full && xa_payload != xa_payload_data)
+		throw std::runtime_error("XA payload must be 2336 or 2324 bytes");
+
+	// The directory size counts 2048 bytes for every sector, XA or not
+	uint32_t sectors = (entry.bytes + cdsector::user_bytes - 1) / cdsector::user_bytes;
+	uint64_t remaining = entry.bytes;
+	size_t xa_offset = (xa_payload == xa_payload_full) ? cdsector::subhead_offset
+	                                                   : cdsector::user_offset_mode2;
+
+	std::vector<uint8_t> raw, data;
+	for(uint32_t done = 0; done < sectors; ) {
+		uint32_t count = std::min(batch_sectors, sectors - done);
+		this->ReadSectors(entry.lba + done, count, raw);
+
+		if(xa) {
+			data.resize(static_cast<size_t>(count) * xa_payload);
+			for(uint32_t s = 0; s < count; s++) {
+				std::memcpy(data.data() + (s * xa_payload),
+				            raw.data() + (s * this->sector_bytes) + xa_offset, xa_payload);
+			}
+		} else {
+			data.resize(static_cast<size_t>(count) * cdsector::user_bytes);
+			cdsector::ExtractUserData(raw.data(), count, this->sector_bytes, data.data());
+			data.resize(static_cast<size_t>(std::min<uint64_t>(data.size(), remaining)));
+			remaining -= data.size();
+		}
+
+		out.write(reinterpret_cast<const char *>(data.data()),
+		          static_cast<std::streamsize>(data.size()));
+		if(!out) throw std::runtime_error("Failed to write extracted file");
+		done += count;
+	}
+}
@@ -0,0 +1,104 @@
+/******************************************************************************
+* psx-comBINe ISO support
+* Writes the cooked 2048 byte user data of a disc's data track out as an .iso
+* ADBeta (c)
+******************************************************************************/
+#include "isofile.hpp"
+#include "cdsector.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <vector>
+
+/*** ISO Writer ***************************************************************/
+IsoWriter::IsoWriter(const std::filesystem::path &path, const CueSheet &combined)
+	: track_start(0), track_end(0), sector_bytes(0), offset(0) {
+	if(combined.FileList.size() != 1)
+		throw std::runtime_error("ISO output requires a combined single FILE cue sheet");
+
+	// Find the first data track. It runs from its first INDEX (or the start of
+	// the file for track 1) to the next track's first INDEX. A bad or backwards
+	// INDEX would give the track a wrapped, huge size
+	const CueSheet::FileObj &file = combined.FileList.front();
+	bool found = false, first = true;
+	for(const auto &t_itr : file.TrackList) {
+		if(!t_itr.IndexList.empty() && t_itr.IndexList.front().sector == CueSheet::timestamp_nval)
+			throw std::runtime_error("ISO output needs valid INDEX timestamps");
+		uint64_t start = (first || t_itr.IndexList.empty())
+		                 ? this->track_start : t_itr.IndexList.front().Bytes(t_itr.type);
+		if(start < this->track_start)
+			throw std::runtime_error("ISO output needs TRACKs in INDEX order");
+		first = false;
+
+		if(found) {
+			this->track_end = start;
+			break;
+		}
+
+		this->track_start = start;
+		if(t_itr.type != CueSheet::TrackType::AUDIO && t_itr.type != CueSheet::TrackType::CDG) {
+			this->sector_bytes = CueSheet::GetSectorBytesInTrackType(t_itr.type);
+			this->track_end = file.bytes;
+			found = true;
+		}
+	}
+
+	if(!found || this->sector_bytes == 0)
+		throw std::runtime_error("ISO output needs a data TRACK");
+
+	this->file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!this->file) throw std::runtime_error("Output ISO file could not be created");
+}
+
+void IsoWriter::Write(const char *data, size_t len) {
+	const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+
+	// Clip the buffer to the data track
+	uint64_t start = std::max(this->offset, this->track_start);
+	uint64_t stop  = std::min(this->offset + len, this->track_end);
+	uint64_t buffer_offset = this->offset;
+	this->offset += len;
+	if(start >= stop) return;
+
+	src += start - buffer_offset;
+	len = static_cast<size_t>(stop - start);
+
+	// Complete a held back partial sector first
+	if(!this->pending.empty()) {
+		size_t take = std::min(len, this->sector_bytes - this->pending.size());
+		this->pending.insert(this->pending.end(), src, src + take);
+		src += take;
+		len -= take;
+
+		if(this->pending.size() < this->sector_bytes) return;
+		this->WriteSectors(this->pending.data(), 1);
+		this->pending.clear();
+	}
+
+	// Whole sectors straight from the buffer, then hold back the rest
+	size_t sectors = len / this->sector_bytes;
+	this->WriteSectors(src, sectors);
+	this->pending.assign(src + (sectors * this->sector_bytes), src + len);
+}
+
+void IsoWriter::WriteSectors(const uint8_t *data, size_t sectors) {
+	if(sectors == 0) return;
+
+	this->user.resize(sectors * cdsector::user_bytes);
+	cdsector::ExtractUserData(data, sectors, this->sector_bytes, this->user.data());
+
+	this->file.write(reinterpret_cast<const char *>(this->user.data()),
+	                 static_cast<std::streamsize>(this->user.size()));
+	if(!this->file) throw std::runtime_error("Failed to write to output ISO file");
+}
+
+void IsoWriter::Close() {
+	// A trailing partial sector is not a whole sector of user data, drop it
+	this->pending.clear();
+
+	this->file.close();
+	if(this->file.fail()) throw std::runtime_error("Failed to close output ISO file");
+}
@@ -0,0 +1,350 @@
+/******************************************************************************
+* psx-comBINe library check
+* Lints every .cue under a directory, on all CPU cores: each must parse, every
+* FILE it names must exist, and its TRACKs and INDEXs must fit their FILEs in
+* whole sectors of their TrackType. The results are reported as JSON.
+* ADBeta (c)
+******************************************************************************/
+#include "librarycheck.hpp"
+#include "cuehandler.hpp"
+#include "audiofile.hpp"
+#include "workpool.hpp"
+#include "utils.hpp"
+
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <exception>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace {
+using TrackObj = CueSheet::FileObj::TrackObj;
+
+// A regular file found while listing the library
+struct ListedFile {
+	std::string                      name;
+	std::filesystem::directory_entry entry;
+};
+
+// Every regular file of one directory, sorted by name. A FILE is looked up
+// here instead of being opened, and on Windows its size comes with the entry
+struct DirListing {
+	std::vector<ListedFile> files;
+
+	const ListedFile *Find(const std::string &name) const {
+		auto itr = std::lower_bound(this->files.begin(), this->files.end(), name,
+			[](const ListedFile &file, const std::string &n) { return file.name < n; });
+		return (itr != this->files.end() && itr->name == name) ? &*itr : nullptr;
+	}
+
+	// Only used for FILEs that were not found, to say why
+	const ListedFile *FindNoCase(const std::string &name) const {
+		std::string lower = StringToLower(name);
+		for(const auto &file : this->files) {
+			if(StringToLower(file.name) == lower) return &file;
+		}
+		return nullptr;
+	}
+};
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void AddIssue(DiscCheck &disc, const char *code, std::string message,
+              const std::string &file = "", const uint16_t track = 0) {
+	disc.issues.push_back({code, std::move(message), file, track});
+}
+
+std::string IndexName(const TrackObj::IndexObj &index) {
+	char name[40];
+	std::snprintf(name, sizeof(name), "INDEX %02u at %s", static_cast<unsigned>(index.id),
+	              CueSheet::SectorsToTimestamp(index.sector).c_str());
+	return name;
+}
+
+// Finds a FILE and gets its size, only the PCM payload for WAVE and AIFF.
+// Returns false, with an issue added, if it cannot
+bool GetListedBytes(DiscCheck &disc, const CueSheet::FileObj &file,
+                    const std::filesystem::path &dir, const DirListing &listing, uint64_t &bytes) {
+	std::filesystem::directory_entry entry;
+	std::error_code ec;
+
+	// FILEs in other folders are not in the listing, and are looked up alone
+	if(file.filename.find_first_of("/\\") == std::string::npos) {
+		const ListedFile *listed = listing.Find(file.filename);
+		if(listed == nullptr) {
+			const ListedFile *other_case = listing.FindNoCase(file.filename);
+			AddIssue(disc, "file_missing", other_case
+			         ? "The FILE was not found, but \"" + other_case->name + "\" differs only in case"
+			         : "The FILE was not found", file.filename);
+			return false;
+		}
+		entry = listed->entry;
+	} else {
+		entry.assign(dir / file.filename, ec);
+		if(ec || !entry.is_regular_file(ec)) {
+			AddIssue(disc, "file_missing", "The FILE was not found", file.filename);
+			return false;
+		}
+	}
+
+	if(file.filetype == "WAVE" || file.filetype == "AIFF") {
+		try {
+			bytes = GetAudioLayout(entry.path(), file.filetype).data_bytes;
+		} catch(const std::exception &e) {
+			AddIssue(disc, "audio_invalid", e.what(), file.filename);
+			return false;
+		}
+	} else {
+		bytes = entry.file_size(ec);
+		if(ec) {
+			AddIssue(disc, "file_unreadable", ec.message(), file.filename);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Checks every INDEX is in order and inside the FILE, and that every TRACK is
+// a whole number of its sectors. A TRACK runs from its first INDEX to the next
+// TRACK's, or to the end of the FILE
+void CheckTracks(DiscCheck &disc, const CueSheet::FileObj &file, const bool sized,
+                 const uint64_t bytes) {
+	if(file.TrackList.empty()) AddIssue(disc, "file_no_tracks", "The FILE has no TRACKs", file.filename);
+
+	// Where a TRACK starts in the FILE, if that can be known
+	auto start_bytes = [](const TrackObj &track, uint64_t &start) {
+		if(CueSheet::GetSectorBytesInTrackType(track.type) == 0 || track.IndexList.empty() ||
+		   track.IndexList.front().sector == CueSheet::timestamp_nval) return false;
+		start = track.IndexList.front().Bytes(track.type);
+		return true;
+	};
+
+	const TrackObj *tracks = file.TrackList.begin();
+	uint32_t last_sector = 0;
+	for(size_t t = 0; t < file.TrackList.size(); t++) {
+		const TrackObj &track = tracks[t];
+		uint16_t sector_bytes = CueSheet::GetSectorBytesInTrackType(track.type);
+		if(sector_bytes == 0) {
+			AddIssue(disc, "track_type_invalid", "The TRACK has an unknown type", file.filename, track.id);
+			continue;
+		}
+		if(track.IndexList.empty()) {
+			AddIssue(disc, "track_no_index", "The TRACK has no INDEXs", file.filename, track.id);
+			continue;
+		}
+
+		for(const auto &i_itr : track.IndexList) {
+			if(i_itr.sector == CueSheet::timestamp_nval) {
+				AddIssue(disc, "index_invalid", "INDEX " + std::to_string(i_itr.id) +
+				         " has an invalid timestamp", file.filename, track.id);
+				continue;
+			}
+			if(i_itr.sector < last_sector) {
+				AddIssue(disc, "index_order", IndexName(i_itr) + " is before the INDEX ahead of it",
+				         file.filename, track.id);
+			}
+			last_sector = std::max(last_sector, i_itr.sector);
+
+			if(sized && i_itr.Bytes(track.type) > bytes) {
+				AddIssue(disc, "index_out_of_range", IndexName(i_itr) + " is past the end of the FILE",
+				         file.filename, track.id);
+			}
+		}
+
+		uint64_t start = 0, end = bytes;
+		if(!sized || !start_bytes(track, start)) continue;
+		if(t + 1 < file.TrackList.size() && !start_bytes(tracks[t + 1], end)) continue;
+
+		if(start <= end && (end - start) % sector_bytes != 0) {
+			AddIssue(disc, "track_misaligned", std::to_string(end - start) +
+			         " bytes is not a whole number of " + std::to_string(sector_bytes) +
+			         " byte sectors", file.filename, track.id);
+		}
+	}
+}
+
+DiscCheck CheckDisc(const std::filesystem::path &cue_path, const DirListing &listing) {
+	DiscCheck disc;
+	disc.cue = cue_path;
+
+	// Every line that does not parse is reported, with where it is. Warnings
+	// are left to CheckTracks, which says more about them
+	CueSheet sheet;
+	CueFile cue_in(cue_path.string().c_str());
+	CueResult parsed = cue_in.TryReadCueData(sheet);
+	for(const auto &d_itr : parsed.diagnostics) {
+		if(d_itr.severity != CueDiagnostic::Severity::Error) continue;
+
+		std::string message = d_itr.reason->what();
+		if(!d_itr.text.empty()) message += ": \"" + d_itr.text + "\"";
+		AddIssue(disc, "parse_failed", std::move(message), "", d_itr.track);
+		disc.issues.back().line = d_itr.line;
+		disc.issues.back().column = d_itr.column;
+	}
+	if(!parsed.ok()) return disc;
+
+	disc.files = sheet.FileList.size();
+	disc.tracks = sheet.TrackData.size();
+	if(sheet.FileList.empty()) AddIssue(disc, "no_files", "The .cue has no FILEs");
+
+	// Combine() needs every TRACK to start on a whole sector of the combined
+	// FILE, which is only known while every FILE before it has been found
+	bool start_known = true;
+	for(const auto &f_itr : sheet.FileList) {
+		if(start_known) {
+			for(const auto &t_itr : f_itr.TrackList) {
+				uint16_t sector_bytes = CueSheet::GetSectorBytesInTrackType(t_itr.type);
+				if(sector_bytes == 0 || t_itr.IndexList.empty() || disc.bytes % sector_bytes == 0) continue;
+
+				AddIssue(disc, "combine_misaligned", "The FILE would start at byte " +
+				         std::to_string(disc.bytes) + " of the combined image, not on a whole " +
+				         std::to_string(sector_bytes) + " byte sector", f_itr.filename, t_itr.id);
+			}
+		}
+
+		uint64_t bytes = 0;
+		bool sized = GetListedBytes(disc, f_itr, cue_path.parent_path(), listing, bytes);
+		if(sized) disc.bytes += bytes;
+		start_known = start_known && sized;
+		CheckTracks(disc, f_itr, sized, bytes);
+	}
+
+	// The combined FILE's size and offsets are 32 bit
+	if(disc.bytes > std::numeric_limits<uint32_t>::max()) {
+		AddIssue(disc, "disc_too_large", "The FILEs are over 4GiB together, too large to combine");
+	}
+
+	return disc;
+}
+
+} // namespace
+
+/*** Library Check ************************************************************/
+LibraryCheck CheckLibrary(const std::filesystem::path &root, unsigned threads) {
+	LibraryCheck check;
+	check.root = root;
+	check.threads = threads ? threads : DefaultThreadCount();
+
+	// List the tree once. Entries arrive a directory at a time, so the map is
+	// only searched when the directory changes
+	auto scan_start = std::chrono::steady_clock::now();
+	std::map<std::string, DirListing> dirs;
+	std::vector<std::pair<std::filesystem::path, const DirListing *>> cues;
+
+	DirListing *listing = nullptr;
+	std::string listing_dir;
+	auto add_entry = [&](const std::filesystem::directory_entry &entry, const bool want_cue) {
+		std::error_code ec;
+		if(!entry.is_regular_file(ec)) return;
+
+		const std::filesystem::path &path = entry.path();
+		std::string dir = path.parent_path().string();
+		if(listing == nullptr || dir != listing_dir) {
+			listing = &dirs[dir];
+			listing_dir = std::move(dir);
+		}
+
+		listing->files.push_back({path.filename().string(), entry});
+		if(want_cue && StringToLower(path.extension().string()) == ".cue") {
+			cues.emplace_back(path, listing);
+		}
+	};
+
+	auto options = std::filesystem::directory_options::skip_permission_denied;
+	if(std::filesystem::is_regular_file(root)) {
+		// A single .cue only needs its own folder listed
+		std::filesystem::path parent = root.parent_path();
+		if(parent.empty()) parent = ".";
+		for(const auto &entry : std::filesystem::directory_iterator(parent, options)) {
+			add_entry(entry, false);
+		}
+		cues.emplace_back(parent / root.filename(), &dirs[parent.string()]);
+	} else {
+		for(const auto &entry : std::filesystem::recursive_directory_iterator(root, options)) {
+			add_entry(entry, true);
+		}
+	}
+
+	for(auto &d_itr : dirs) {
+		std::sort(d_itr.second.files.begin(), d_itr.second.files.end(),
+			[](const ListedFile &a, const ListedFile &b) { return a.name < b.name; });
+	}
+	std::sort(cues.begin(), cues.end());
+	check.scan_seconds = SecondsSince(scan_start);
+
+	// Check the discs, each worker taking the next one as it finishes
+	auto check_start = std::chrono::steady_clock::now();
+	check.discs.resize(cues.size());
+	ParallelFor(cues.size(), [&check, &cues](size_t disc) {
+		try {
+			check.discs[disc] = CheckDisc(cues[disc].first, *cues[disc].second);
+		} catch(const std::exception &e) {
+			check.discs[disc].cue = cues[disc].first;
+			AddIssue(check.discs[disc], "check_failed", e.what());
+		}
+	}, check.threads);
+	check.check_seconds = SecondsSince(check_start);
+
+	for(const auto &disc : check.discs) {
+		if(!disc.issues.empty()) check.failed++;
+	}
+
+	return check;
+}
+
+std::string CheckReportToJson(const LibraryCheck &check) {
+	// A single .cue is reported relative to its folder
+	std::filesystem::path base = check.root;
+	if(std::filesystem::is_regular_file(base)) base = base.parent_path();
+
+	char seconds[96];
+	std::snprintf(seconds, sizeof(seconds), "  \"scan_seconds\": %.3f,\n  \"check_seconds\": %.3f,\n",
+	              check.scan_seconds, check.check_seconds);
+
+	std::string json = "{\n  \"root\": " + JsonString(check.root.generic_string()) + ",\n";
+	json += "  \"discs\": " + std::to_string(check.discs.size()) + ",\n";
+	json += "  \"failed\": " + std::to_string(check.failed) + ",\n";
+	json += "  \"threads\": " + std::to_string(check.threads) + ",\n";
+	json += seconds;
+	json += "  \"results\": [";
+
+	for(size_t d = 0; d < check.discs.size(); d++) {
+		const DiscCheck &disc = check.discs[d];
+		std::string cue = disc.cue.lexically_relative(base).generic_string();
+		if(cue.empty()) cue = disc.cue.generic_string();
+
+		json += d ? ",\n    " : "\n    ";
+		json += "{\"cue\": " + JsonString(cue) + ", \"ok\": " + (disc.issues.empty() ? "true" : "false") +
+		        ", \"files\": " + std::to_string(disc.files) + ", \"tracks\": " +
+		        std::to_string(disc.tracks) + ", \"bytes\": " + std::to_string(disc.bytes);
+
+		if(!disc.issues.empty()) {
+			json += ", \"issues\": [";
+			for(size_t i = 0; i < disc.issues.size(); i++) {
+				const CheckIssue &issue = disc.issues[i];
+				json += std::string(i ? ", " : "") + "{\"code\": " + JsonString(issue.code) +
+				        ", \"file\": " + JsonString(issue.file) + ", \"track\": " +
+				        std::to_string(issue.track);
+				if(issue.line) {
+					json += ", \"line\": " + std::to_string(issue.line) + ", \"column\": " +
+					        std::to_string(issue.column);
+				}
+				json += ", \"message\": " + JsonString(issue.message) + "}";
+			}
+			json += "]";
+		}
+		json += "}";
+	}
+
+	json += check.discs.empty() ? "]\n}\n" : "\n  ]\n}\n";
+	return json;
+}
@@ -12,11 +12,31 @@
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <stdexcept>
 
 #include "cuehandler.hpp"
+#include "outputsink.hpp"
+#include "chdfile.hpp"
+#include "gzipfile.hpp"
+#include "isofile.hpp"
+#include "iso9660.hpp"
+#include "ziparchive.hpp"
+#include "ppfpatch.hpp"
+#include "filecopy.hpp"
+#include "audiofile.hpp"
+#include "trackstore.hpp"
+#include "fusemount.hpp"
+#include "discset.hpp"
+#include "librarycheck.hpp"
+#include "catalog.hpp"
+#include "workpool.hpp"
 #include "clampp.hpp"
 #include "utils.hpp"
 
@@ -34,8 +54,9 @@
 #pragma GCC diagnostic pop
 
 /*** Globals *****************************************************************/
-//Define how large the RAM byte array while dumping should be. (4KB)
-#define _BINARY_ARRAY_SIZE 4096
+//Define how large the RAM byte array while dumping should be. (16 sectors)
+//Kept a whole number of 2352 byte sectors so patched buffers stay aligned
+#define _BINARY_ARRAY_SIZE (2352 * 16)
 
 namespace message {
 const char *copyright = "\npsx-comBINe v4.9.3 01 Jan 2024 ADBeta(c)";
@@ -49,7 +70,11 @@ const char *long_help =
 By default psx-comBINe takes a single input.cue file, creates a directory in\n\
 the .cue's parent directory called \"psx-comBINe\".\n\
 it will then output the combined .bin and .cue file, leaving the original \n\
-files untouched.\n\n\
+files untouched.\n\
+A directory holding several .cue files has every disc combined at once, and\n\
+an .m3u playlist written for each multi-disc game, e.g. \"Game (Disc 1).cue\"\n\
+A .chd image can also be given as the input, to unpack it to .cue/.bin\n\
+and a .zip holding a .cue and its .bin files is read without extracting it\n\n\
 Options:\n\
 -h, --help\t\tShow this help message\n\
 -g, --gui\t\tStarts the Application in GUI Mode (Default with no arguments)\n\
@@ -57,17 +82,64 @@ Options:\n\
 -d, --directory\t\tChange the output directory\n\
 \t\t\tpsx-combine ./input.cue -d /home/user/games\n\n\
 -f, --filename\t\tSpecify the output .cue filename\n\
-\t\t\tpsx-combine ./input.cue -f combined_game.cue (or combined_game)\n\n";
+\t\t\tpsx-combine ./input.cue -f combined_game.cue (or combined_game)\n\n\
+--format\t\tOutput format, bin (default), chd, gz or iso\n\
+\t\t\tchd writes a single compressed CD CHD v5 instead of .cue/.bin\n\
+\t\t\tgz writes a seekable .bin.gz with a .cue for the unpacked .bin\n\
+\t\t\tiso writes the 2048 byte sectors of the data track as an .iso\n\n\
+--patch\t\t\tApply a PPF (1.0, 2.0 or 3.0) patch while combining\n\
+\t\t\tpsx-combine ./input.cue --patch translation.ppf\n\n\
+--patch-edc\t\tRegenerate the EDC/ECC of data sectors changed by --patch\n\n\
+--write-gaps\t\tWrite PREGAP/POSTGAP silence into the image as zero sectors\n\
+\t\t\t(sparse for .bin output), instead of keeping the commands\n\n\
+--extract\t\tCopy a file or directory out of the disc's ISO9660 filesystem\n\
+\t\t\tinto the output directory, without combining the image\n\
+\t\t\tpsx-combine ./input.cue --extract /SYSTEM.CNF\n\n\
+--store\t\t\tKeep every track in a shared, content-addressed store, and\n\
+\t\t\tbuild the .bin from it, so identical tracks are kept once\n\
+\t\t\tpsx-combine ./input.cue --store ~/psx-store\n\n\
+--split\t\t\tSplit a single .bin image back into one .bin per TRACK,\n\
+\t\t\twith a matching multi-FILE .cue\n\n\
+--mount\t\t\tMount every multi-bin game in a library directory as a\n\
+\t\t\tcombined .cue/.bin pair, read-only (needs FUSE support)\n\
+\t\t\tpsx-combine ~/games --mount ~/combined\n\n\
+--check\t\t\tCheck every .cue under a directory (or one .cue) without\n\
+\t\t\tcombining: that it parses, its FILEs exist, and its TRACKs\n\
+\t\t\tare whole sectors. Writes a JSON report of every disc\n\
+\t\t\tpsx-combine ~/games --check report.json\n\n\
+--catalog\t\tScan a library into a catalog file. Rescans only look at\n\
+\t\t\tthe directories and .cue files that changed since\n\
+\t\t\tpsx-combine ~/games --catalog ~/games.cat\n\n\
+--catalog-hash\t\tAlso SHA-1 every FILE the catalog has no hash for yet\n\n";
 
 //Messages for throw()
 const char *missing_filepath = "Filename or directory was not specified";
 const char *invalid_filepath = "Input path is invalid, or does not exist";
-const char *filepath_bad_extension = "Input file must be a .cue file";
-const char *dir_missing_cue = "Input directory does not contain any .cue files";
+const char *filepath_bad_extension = "Input file must be a .cue, .chd or .zip file";
+const char *dir_missing_cue = "Input directory does not contain any .cue, .chd or .zip files";
 const char *cue_has_no_files = "Input .cue file has no FILEs";
+const char *zip_missing_cue = "Input .zip file does not contain a .cue file";
+const char *zip_missing_bin = "A FILE in the .cue is missing from the .zip file";
+const char *zip_bin_too_big = "A FILE in the .zip file is larger than 4GiB";
+const char *zip_audio_header = "WAVE and AIFF FILEs cannot be read from a .zip file";
 
 const char *filename_has_dir = "filename argument must only contain a filename";
 const char *filename_bad_extension = "filename extension must be .cue";
+const char *format_invalid = "format must be one of: bin, chd, gz, iso";
+const char *patch_edc_no_patch = "--patch-edc needs a --patch file";
+const char *extract_needs_cue = "--extract needs a .cue input";
+const char *extract_not_found = "Path was not found in the disc's filesystem";
+const char *store_needs_bin = "--store only works with bin output";
+const char *split_needs_cue = "--split needs a .cue input";
+const char *split_with_extract = "--split and --extract cannot be used together";
+const char *split_audio_header = "WAVE and AIFF FILEs cannot be split";
+const char *batch_only_combine = "--extract, --split and --patch need a single .cue, not a directory of discs";
+const char *batch_with_filename = "filename cannot be set for a directory of several discs";
+const char *mount_needs_dir = "--mount needs a library directory as the input";
+const char *mount_bad_mountpoint = "--mount must be given an existing directory";
+const char *check_bad_input = "--check needs a library directory or a .cue file as the input";
+const char *catalog_needs_dir = "--catalog needs a library directory as the input";
+const char *catalog_hash_no_catalog = "--catalog-hash needs a --catalog file";
 
 const char *input_bin_not_open = "The input file could not be opened";
 const char *output_bin_create_failed = "Output binary file could not be created";
@@ -77,6 +149,9 @@ const char *wx_failure = "WxWidgets Failed to Initialise Correctly";
 
 
 /*** Enums & Classes **********************************************************/
+// Type of image being read in
+enum class InputFormat {Cue, Chd, Zip};
+
 // clampp Argument Indexes
 struct ClamppArguments {
 	int help_idx;	   // Help flag
@@ -84,6 +159,17 @@ struct ClamppArguments {
 	int file_idx;	   // File flag
 	int gui_idx;		// GUI Mode flag
 	int verbose_idx;	// Verbose flag
+	int format_idx;		// Output format
+	int patch_idx;		// PPF patch file
+	int patch_edc_idx;	// Regenerate EDC/ECC of patched sectors
+	int extract_idx;	// ISO9660 path to extract
+	int split_idx;		// Split into one binary per TRACK
+	int write_gaps_idx;	// Write PREGAP/POSTGAP as zero sectors
+	int store_idx;		// Content-addressed track store
+	int mount_idx;		// FUSE mountpoint for a library
+	int check_idx;		// JSON report of a library check
+	int catalog_idx;	// Library catalog file
+	int catalog_hash_idx;	// Hash FILEs into the catalog
 };
 
 // System control variables, Set via CLI or GUI events
@@ -93,6 +179,23 @@ struct SystemVariables {
 	std::filesystem::path input_cue_path, output_cue_path; // Cue Paths
 	std::filesystem::path input_bin_path, output_bin_path; // Binary Paths
 	CueSheet input_cue_sheet, output_cue_sheet;			// Cue Sheet Objects
+	InputFormat input_format = InputFormat::Cue;		// Input image type
+	std::string zip_cue_dir;							// .cue folder inside a .zip
+	OutputFormat output_format = OutputFormat::Bin;		// Output file format
+	std::filesystem::path patch_path;					// PPF patch, if any
+	bool patch_edc = false;								// Fix patched EDC/ECC
+	std::string extract_path;							// ISO9660 path to extract
+	bool split = false;									// Split instead of combine
+	bool write_gaps = false;							// Write gaps as zeros
+	std::filesystem::path store_path;					// Track store, if any
+	std::filesystem::path mount_path;					// FUSE mountpoint, if any
+	std::filesystem::path check_report_path;			// --check JSON report, if any
+	std::filesystem::path catalog_path;					// Library catalog, if any
+	bool catalog_hash = false;							// SHA-1 FILEs into the catalog
+	std::vector<std::filesystem::path> batch_cues;		// Every .cue of a directory
+	unsigned threads = 0;								// Per disc workers, 0 for all
+	std::ostream *log = &std::cout;						// Progress output
+	int exit_status = EXIT_SUCCESS;						// Set by modes that report problems
 
 	bool verbose;
 	bool gui;
@@ -151,16 +254,54 @@ enum {
 void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 				SystemVariables &system_vars);
 
-/// @breif Combines the fields in the input cue into one, for the output file
+/// @breif Combines the fields in the input cue into one, for the output file.
+/// Problems are printed, with the line and column of the .cue they are on
 /// @param &system_vars System Variables from GUI or CLI
-/// @return none
-void CombineCue(SystemVariables &system_vars);
+/// @return true if the disc can be dumped, false if it failed
+bool CombineCue(SystemVariables &system_vars);
 
 /// @breiif Goes through the input .cue file, combining all .bin files within
-/// into a single output .bin file
+/// into a single output .bin file. Problems are printed, like CombineCue
 /// @param &system_vars System Variables from GUI or CLI
-/// @return status string for CLI or GUI printing
-std::string DumpBinaryFiles(SystemVariables &system_vars);
+/// @param &status, set to the status string for CLI or GUI printing
+/// @return true on success, false if the image could not be dumped
+bool DumpBinaryFiles(SystemVariables &system_vars, std::string &status);
+
+/// @brief Copies a file, or every file in a directory, out of the input's
+/// ISO9660 filesystem into the output directory
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string ExtractFiles(SystemVariables &system_vars);
+
+/// @brief Splits a single FILE image into one binary file per TRACK, and
+/// writes the matching multi-FILE .cue
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string SplitBinaryFile(SystemVariables &system_vars);
+
+/// @brief Mounts every multi-bin set in the input directory as combined
+/// images, until the filesystem is unmounted
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string MountImages(SystemVariables &system_vars);
+
+/// @brief Checks every .cue under the input directory, or the input .cue, and
+/// writes a JSON report. Sets exit_status if any disc has problems
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string CheckLibraryDiscs(SystemVariables &system_vars);
+
+/// @brief Scans the input directory into the catalog file, only rescanning
+/// what changed since the catalog was last written
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string UpdateCatalog(SystemVariables &system_vars);
+
+/// @brief Combines every .cue of the input directory at once, grouped into
+/// disc sets, and writes an .m3u playlist for each multi-disc set
+/// @param &system_vars System Variables from CLI
+/// @return status string for CLI printing
+std::string CombineDiscSets(SystemVariables &system_vars);
 
 
 // Define a global system variables struct
@@ -182,6 +323,17 @@ int main(const int argc, const char *argv[]) {
 	cli_args.file_idx	= cli_handler.AddDefinition("--filename", "-f", true);
 	cli_args.gui_idx	 = cli_handler.AddDefinition("--gui", "-g", false);
 	cli_args.verbose_idx = cli_handler.AddDefinition("--verbose", "-v", false);
+	cli_args.format_idx  = cli_handler.AddDefinition("--format", true);
+	cli_args.patch_idx   = cli_handler.AddDefinition("--patch", true);
+	cli_args.patch_edc_idx = cli_handler.AddDefinition("--patch-edc", false);
+	cli_args.extract_idx = cli_handler.AddDefinition("--extract", true);
+	cli_args.split_idx   = cli_handler.AddDefinition("--split", false);
+	cli_args.write_gaps_idx = cli_handler.AddDefinition("--write-gaps", false);
+	cli_args.store_idx   = cli_handler.AddDefinition("--store", true);
+	cli_args.mount_idx   = cli_handler.AddDefinition("--mount", true);
+	cli_args.check_idx   = cli_handler.AddDefinition("--check", true);
+	cli_args.catalog_idx = cli_handler.AddDefinition("--catalog", true);
+	cli_args.catalog_hash_idx = cli_handler.AddDefinition("--catalog-hash", false);
 
 
 	/** User Argument handling ************************************************/
@@ -235,14 +387,31 @@ int main(const int argc, const char *argv[]) {
 	} else {
 		// Get the CLI Arguments
 		CLIGetVars(cli_handler, cli_args, sys_vars);
-		// Combine the .cue file variables
-		CombineCue(sys_vars);
-		// Dump the .cue binary files into one output file
-		std::string status = DumpBinaryFiles(sys_vars);
+
+		// Extract mode reads files from the image instead of combining it
+		std::string status;
+		if(!sys_vars.mount_path.empty()) {
+			status = MountImages(sys_vars);
+		} else if(!sys_vars.check_report_path.empty()) {
+			status = CheckLibraryDiscs(sys_vars);
+		} else if(!sys_vars.catalog_path.empty()) {
+			status = UpdateCatalog(sys_vars);
+		} else if(!sys_vars.extract_path.empty()) {
+			status = ExtractFiles(sys_vars);
+		} else if(sys_vars.split) {
+			status = SplitBinaryFile(sys_vars);
+		} else if(!sys_vars.batch_cues.empty()) {
+			status = CombineDiscSets(sys_vars);
+		} else {
+			// Combine the .cue file variables
+			if(!CombineCue(sys_vars)) return EXIT_FAILURE;
+			// Dump the .cue binary files into one output file
+			if(!DumpBinaryFiles(sys_vars, status)) return EXIT_FAILURE;
+		}
 		std::cout << "\n" << status << std::endl;
 	}
 
-	return 0;
+	return sys_vars.exit_status;
 }
 
 
@@ -507,10 +676,16 @@ void MainFrame::OnCombine(wxCommandEvent& WXUNUSED(event)) {
     this->SetStatusText("Combining....");
     this->CombineBtn->Enable(false);
 
-	// Combine the input cue FILEs into one FILE
-	CombineCue(sys_vars);
+	// Combine the input cue FILEs into one FILE. A bad .cue leaves the
+	// window open, with the problems printed
+	if(!CombineCue(sys_vars)) {
+		this->CombineBtn->Enable(true);
+		this->SetStatusText("Could not combine the .cue file");
+		return;
+	}
 	// Dump the .cue binary files into one output file
-	std::string sta_str = DumpBinaryFiles(sys_vars);
+	std::string sta_str;
+	if(!DumpBinaryFiles(sys_vars, sta_str)) sta_str = "Could not write the output file";
 
 	// Set the stauts bar text and re-enable button
     this->CombineBtn->Enable(true);
@@ -538,17 +713,67 @@ void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 			throw std::invalid_argument(message::invalid_filepath);
 		}
 
+		/* Library mount */
+		// The input is a whole library, so no .cue is looked for
+		if(cli_handler.GetDetectedStatus(cli_args.mount_idx)) {
+			if(system_vars.input_fstype != FilesystemType::Directory) {
+				throw std::invalid_argument(message::mount_needs_dir);
+			}
+
+			system_vars.mount_path = cli_handler.GetSubstring(cli_args.mount_idx);
+			if(GetPathType(system_vars.mount_path) != FilesystemType::Directory) {
+				throw std::invalid_argument(message::mount_bad_mountpoint);
+			}
+
+			system_vars.input_dir_path = arg_filepath / "";
+			return;
+		}
+
+		/* Library check */
+		// Every .cue under the input is checked, nothing is combined
+		if(cli_handler.GetDetectedStatus(cli_args.check_idx)) {
+			if(system_vars.input_fstype == FilesystemType::File &&
+			   StringToLower(arg_filepath.extension().string()) != ".cue") {
+				throw std::invalid_argument(message::check_bad_input);
+			}
+
+			system_vars.check_report_path = cli_handler.GetSubstring(cli_args.check_idx);
+			system_vars.input_cue_path = arg_filepath;
+			return;
+		}
+
+		/* Library catalog */
+		system_vars.catalog_hash = cli_handler.GetDetectedStatus(cli_args.catalog_hash_idx);
+		if(cli_handler.GetDetectedStatus(cli_args.catalog_idx)) {
+			if(system_vars.input_fstype != FilesystemType::Directory) {
+				throw std::invalid_argument(message::catalog_needs_dir);
+			}
+
+			system_vars.catalog_path = cli_handler.GetSubstring(cli_args.catalog_idx);
+			system_vars.input_dir_path = arg_filepath / "";
+			return;
+		}
+		if(system_vars.catalog_hash) {
+			throw std::invalid_argument(message::catalog_hash_no_catalog);
+		}
+
 		/* Input .cue path */
 		// If the input is a file, check the extension
 		if(system_vars.input_fstype == FilesystemType::File) {
 			// Get the parent path of the passed file
 			system_vars.input_dir_path = arg_filepath.parent_path() / "";
 
-			// Make sure the file input is a .cue file
-			if(StringToLower(arg_filepath.extension().string()) != ".cue") {
+			// Make sure the file input is a .cue or .chd file
+			std::string ext = StringToLower(arg_filepath.extension().string());
+			if(ext == ".chd") {
+				system_vars.input_format = InputFormat::Chd;
+			} else if(ext == ".zip") {
+				system_vars.input_format = InputFormat::Zip;
+			} else if(ext != ".cue") {
 				throw std::invalid_argument(message::filepath_bad_extension);
 			}
 
+			// NOTE: For CHD and ZIP input this holds the .chd/.zip path
 			system_vars.input_cue_path = arg_filepath;
 		}
 
@@ -556,9 +781,24 @@ void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 		if(system_vars.input_fstype == FilesystemType::Directory) {
 			system_vars.input_dir_path = arg_filepath / "";
 
-			// Look for a .cue file in the directory. Error if one is not found
-			system_vars.input_cue_path =
-				FindFileWithExtension(system_vars.input_dir_path, ".cue");
+			// Look for .cue files in the directory, then a .chd or .zip file.
+			// Error if none are found. Several .cue files are combined together
+			std::vector<std::filesystem::path> cues =
+				FindFilesWithExtension(system_vars.input_dir_path, ".cue");
+			if(!cues.empty()) system_vars.input_cue_path = cues.front();
+			if(cues.size() > 1) system_vars.batch_cues = cues;
+
+			if(system_vars.input_cue_path.empty()) {
+				system_vars.input_cue_path =
+					FindFileWithExtension(system_vars.input_dir_path, ".chd");
+				system_vars.input_format = InputFormat::Chd;
+			}
+
+			if(system_vars.input_cue_path.empty()) {
+				system_vars.input_cue_path =
+					FindFileWithExtension(system_vars.input_dir_path, ".zip");
+				system_vars.input_format = InputFormat::Zip;
+			}
 
 			if(system_vars.input_cue_path.empty()) {
 				throw std::invalid_argument(message::dir_missing_cue);
@@ -566,6 +806,76 @@ void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 		}
 
 
+		/* Output format */
+		if(cli_handler.GetDetectedStatus(cli_args.format_idx)) {
+			system_vars.output_format =
+				StrToOutputFormat(cli_handler.GetSubstring(cli_args.format_idx));
+
+			if(system_vars.output_format == OutputFormat::Invalid) {
+				throw std::invalid_argument(message::format_invalid);
+			}
+		}
+
+
+		/* Patch */
+		if(cli_handler.GetDetectedStatus(cli_args.patch_idx)) {
+			system_vars.patch_path = cli_handler.GetSubstring(cli_args.patch_idx);
+			if(GetPathType(system_vars.patch_path) != FilesystemType::File) {
+				throw std::invalid_argument(message::invalid_filepath);
+			}
+		}
+
+		system_vars.patch_edc = cli_handler.GetDetectedStatus(cli_args.patch_edc_idx);
+		if(system_vars.patch_edc && system_vars.patch_path.empty()) {
+			throw std::invalid_argument(message::patch_edc_no_patch);
+		}
+
+
+		/* Extract */
+		if(cli_handler.GetDetectedStatus(cli_args.extract_idx)) {
+			system_vars.extract_path = cli_handler.GetSubstring(cli_args.extract_idx);
+			if(system_vars.input_format != InputFormat::Cue) {
+				throw std::invalid_argument(message::extract_needs_cue);
+			}
+		}
+
+
+		/* Track store */
+		if(cli_handler.GetDetectedStatus(cli_args.store_idx)) {
+			system_vars.store_path = cli_handler.GetSubstring(cli_args.store_idx);
+			if(system_vars.output_format != OutputFormat::Bin) {
+				throw std::invalid_argument(message::store_needs_bin);
+			}
+		}
+
+
+		/* Gaps */
+		system_vars.write_gaps = cli_handler.GetDetectedStatus(cli_args.write_gaps_idx);
+
+
+		/* Split */
+		system_vars.split = cli_handler.GetDetectedStatus(cli_args.split_idx);
+		if(system_vars.split) {
+			if(system_vars.input_format != InputFormat::Cue) {
+				throw std::invalid_argument(message::split_needs_cue);
+			}
+			if(!system_vars.extract_path.empty()) {
+				throw std::invalid_argument(message::split_with_extract);
+			}
+		}
+
+		// A directory of discs can only be combined
+		if(!system_vars.batch_cues.empty()) {
+			if(system_vars.split || !system_vars.extract_path.empty() ||
+			   !system_vars.patch_path.empty()) {
+				throw std::invalid_argument(message::batch_only_combine);
+			}
+			if(cli_handler.GetDetectedStatus(cli_args.file_idx)) {
+				throw std::invalid_argument(message::batch_with_filename);
+			}
+		}
+
+
 		/* Output dirctory path */
 		// Set the output directory to the -d argument if given; if not, set it
 		// to the input directory + /psx-comBINe/
@@ -597,9 +907,16 @@ void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 		// If no override was passed, use the input .cue filename for output
 		} else {
 			system_vars.output_cue_path = system_vars.output_dir_path / system_vars.input_cue_path.filename();
+			if(system_vars.input_format != InputFormat::Cue) {
+				system_vars.output_cue_path.replace_extension("cue");
+			}
 			(system_vars.output_bin_path = system_vars.output_cue_path).replace_extension("bin");
 		}
 
+		// Non-bin formats replace the .bin with their own file extension
+		system_vars.output_bin_path.replace_extension(
+			OutputFormatExtension(system_vars.output_format));
+
 	} catch(const std::exception &e) {
 		std::cerr << "Fatal Error: Filesystem: " << e.what() << "\n\n"
 				  << message::short_help << std::endl;
@@ -608,138 +925,403 @@ void CLIGetVars(ClamppClass &cli_handler, ClamppArguments &cli_args,
 }
 
 
-void CombineCue(SystemVariables &system_vars) {
-	// Clear the cuesheet data
-	sys_vars.input_cue_sheet.Clear();
-	sys_vars.output_cue_sheet.Clear();
+// Finds a cue FILE in a .zip, relative to the folder the .cue is in
+static const ZipArchive::Entry *FindZipMember(const ZipArchive &zip,
+                                              const std::string &cue_dir,
+                                              std::string filename) {
+	// Archive paths always use /
+	std::replace(filename.begin(), filename.end(), '\\', '/');
+	return zip.Find(cue_dir + filename);
+}
 
-	// If the directory does not already exists, create it
-	if(!std::filesystem::is_directory(system_vars.output_dir_path)) {
-		std::filesystem::create_directory(system_vars.output_dir_path);
-		std::cout << "Created Directory: " << system_vars.output_dir_path << "\n\n";
+
+// Prints the problems found in a .cue, one per line, as <cue>:<line>:<column>:
+// Written in one go, so discs combined at once do not print over each other
+static void PrintCueDiagnostics(const std::filesystem::path &cue_path, const CueResult &result) {
+	std::string lines;
+	for(const auto &d_itr : result.diagnostics) {
+		lines += cue_path.string() + (d_itr.line ? ":" : ": ") + d_itr.ToString() + "\n";
 	}
+	if(!lines.empty()) std::cerr << lines << std::flush;
+}
+
+bool CombineCue(SystemVariables &system_vars) {
+	// Clear the cuesheet data
+	system_vars.input_cue_sheet.Clear();
+	system_vars.output_cue_sheet.Clear();
 
 	// Create an input and output .cue file handlers from the filesystem paths
 	CueFile cue_in(system_vars.input_cue_path.string().c_str());
 	CueFile cue_out(system_vars.output_cue_path.string().c_str());
 
 	try {
-		// Read the cue sheet data in, make sure there is at least one FILE
-		cue_in.ReadCueData(system_vars.input_cue_sheet);
-		if(system_vars.input_cue_sheet.FileList.empty()) {
-			throw CueException(message::cue_has_no_files);
+		// If the directory does not already exists, create it
+		if(!std::filesystem::is_directory(system_vars.output_dir_path)) {
+			std::filesystem::create_directory(system_vars.output_dir_path);
+			*system_vars.log << "Created Directory: " << system_vars.output_dir_path << "\n\n";
 		}
 
-		// Read the FILE sizes. Throws an exception on failure
-		cue_in.GetCueFileSizes(system_vars.input_cue_sheet, system_vars.input_dir_path.string());
+		// CHD input: the sheet comes from the CHD track metadata, sized already
+		if(system_vars.input_format == InputFormat::Chd) {
+			ChdReader chd_in(system_vars.input_cue_path);
+			chd_in.GetCueSheet(system_vars.input_cue_sheet,
+			                   system_vars.output_bin_path.filename().string());
+
+		// ZIP input: parse the archived .cue, sizes come from the central directory
+		} else if(system_vars.input_format == InputFormat::Zip) {
+			ZipArchive zip_in(system_vars.input_cue_path);
+			const ZipArchive::Entry *cue_entry = zip_in.FindExtension(".cue");
+			if(!cue_entry) throw std::runtime_error(message::zip_missing_cue);
+
+			std::string cue_text;
+			zip_in.ReadEntry(*cue_entry, cue_text);
+			std::istringstream cue_stream(cue_text);
+			CueResult parsed = cue_in.TryReadCueStream(system_vars.input_cue_sheet, cue_stream);
+			PrintCueDiagnostics(system_vars.input_cue_path, parsed);
+			if(!parsed.ok()) return false;
+			if(system_vars.input_cue_sheet.FileList.empty()) {
+				throw CueException(message::cue_has_no_files);
+			}
+
+			// FILEs are relative to the .cue's folder in the archive
+			size_t slash = cue_entry->name.find_last_of('/');
+			system_vars.zip_cue_dir =
+				(slash == std::string::npos) ? "" : cue_entry->name.substr(0, slash + 1);
+
+			for(auto &f_itr : system_vars.input_cue_sheet.FileList) {
+				const ZipArchive::Entry *member =
+					FindZipMember(zip_in, system_vars.zip_cue_dir, f_itr.filename);
+
+				if(!member) throw std::runtime_error(message::zip_missing_bin);
+				if(f_itr.filetype == "WAVE" || f_itr.filetype == "AIFF") {
+					throw std::runtime_error(message::zip_audio_header);
+				}
+				if(member->bytes > UINT32_MAX) throw std::runtime_error(message::zip_bin_too_big);
+				f_itr.bytes = static_cast<uint32_t>(member->bytes);
+			}
+
+		} else {
+			// Read the cue sheet data in, make sure there is at least one FILE
+			CueResult parsed = cue_in.TryReadCueData(system_vars.input_cue_sheet);
+			PrintCueDiagnostics(system_vars.input_cue_path, parsed);
+			if(!parsed.ok()) return false;
+			if(system_vars.input_cue_sheet.FileList.empty()) {
+				throw CueException(message::cue_has_no_files);
+			}
+
+			// Read the FILE sizes. Throws an exception on failure
+			cue_in.GetCueFileSizes(system_vars.input_cue_sheet, system_vars.input_dir_path.string());
+		}
 
 		// Copy the original sheet info to the combined sheet, then combine.
+		// The FILE is always the raw .bin, even when it is written compressed
+		std::filesystem::path cue_bin_path = system_vars.output_cue_path;
+		cue_bin_path.replace_extension("bin");
+
 		system_vars.input_cue_sheet.CopyTo(system_vars.output_cue_sheet);
-		system_vars.output_cue_sheet.Combine(system_vars.output_bin_path.filename().string(), "BINARY");
+		CueResult combined = system_vars.output_cue_sheet.TryCombine(
+			cue_bin_path.filename().string(), "BINARY", system_vars.write_gaps);
+		PrintCueDiagnostics(system_vars.input_cue_path, combined);
+		if(!combined.ok()) return false;
 
 		// If the verbose flag was passed, print the combined sheet
 		if(system_vars.verbose) system_vars.output_cue_sheet.Print();
 
-		// Write the combined .cue file out
-		cue_out.WriteCueData(system_vars.output_cue_sheet);
+		// Write the combined .cue file out. CHD images carry their own layout,
+		// and ISOs have no use for one
+		if(system_vars.output_format == OutputFormat::Bin ||
+		   system_vars.output_format == OutputFormat::Gzip) {
+			cue_out.WriteCueData(system_vars.output_cue_sheet);
+		}
 
 	} catch(const CueException &e) {
-		std::cerr << "Fatal Error: Cue Handler: " << e.what() << std::endl;
-		exit(EXIT_FAILURE);
+		std::cerr << "Error: Cue Handler: " << system_vars.input_cue_path.string() << ": "
+				  << e.what() << std::endl;
+		return false;
+	} catch(const std::runtime_error &e) {
+		std::cerr << "Error: Input: " << system_vars.input_cue_path.string() << ": "
+				  << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A dump failure, already saying what was being done when it happened
+struct DumpError : public std::runtime_error {
+	DumpError(const std::string &doing, const std::exception &e)
+		: std::runtime_error(doing + ": " + e.what()) {}
+};
+
+// Writes a chunk to an output sink. A null chunk closes the sink
+static void WriteToSink(OutputSink &sink, const char *data, std::streamsize len) {
+	try {
+		if(data) {
+			sink.Write(data, static_cast<size_t>(len));
+		} else {
+			sink.Close();
+		}
+	} catch(const std::exception &e) {
+		throw DumpError("Writing output", e);
 	}
 }
 
 
-std::string DumpBinaryFiles(SystemVariables &system_vars) {
+// DumpBinaryFiles(), throwing DumpError on failure. Batch mode runs this on
+// worker threads, so nothing here may exit the program
+static std::string DumpImage(SystemVariables &system_vars) {
 	// Get the start millis
 	std::chrono::milliseconds start_millis = GetMillisecs();
 
-	// Create output binary file handler, and open the output file.
-	// Create placeholder for input binary file handler
-	std::fstream binary_file_in, binary_file_out;
+	// Create the output sink for the selected format, which opens the output
+	// file. Create placeholder for input binary file handler
+	// NOTE: The patch is declared first so it outlives the sink using it
+	std::unique_ptr<PpfPatch> patch;
+	std::unique_ptr<TrackStore> store;
+	std::unique_ptr<OutputSink> binary_out;
+	PatchSink *patch_sink = nullptr;
+	std::fstream binary_file_in;
+
+	// Load the patch, if one was given
+	if(!system_vars.patch_path.empty()) {
+		try {
+			patch.reset(new PpfPatch(system_vars.patch_path));
+		} catch(const std::exception &e) {
+			throw DumpError("Loading patch " + system_vars.patch_path.string(), e);
+		}
+
+		// Patches apply to the combined .bin, including any --write-gaps fill
+		uint64_t image_bytes = system_vars.output_cue_sheet.FileList.front().bytes;
+		if(patch->ImageBytes() && patch->ImageBytes() != image_bytes) {
+			std::cerr << "Warning: " << system_vars.patch_path
+					  << " was made for an image of a different size" << std::endl;
+		}
+	}
+
 	try {
-		binary_file_out.open(
-			system_vars.output_bin_path,
-			std::ios::out | std::ios::binary | std::ios::trunc
-		);
+		if(system_vars.output_format == OutputFormat::Chd) {
+			binary_out.reset(new ChdWriter(system_vars.output_bin_path,
+			                               system_vars.output_cue_sheet, system_vars.threads));
+		} else if(system_vars.output_format == OutputFormat::Gzip) {
+			binary_out.reset(new GzipWriter(system_vars.output_bin_path, system_vars.threads));
+		} else if(system_vars.output_format == OutputFormat::Iso) {
+			binary_out.reset(new IsoWriter(system_vars.output_bin_path,
+			                               system_vars.output_cue_sheet));
+		} else if(!system_vars.store_path.empty()) {
+			store.reset(new TrackStore(system_vars.store_path));
+			binary_out.reset(new StoreSink(*store, system_vars.output_cue_sheet,
+			                               system_vars.output_bin_path));
+		} else {
+			binary_out.reset(new RawOutputSink(system_vars.output_bin_path));
+		}
+
+		// Patch the stream on its way to the output sink
+		if(patch) {
+			std::unique_ptr<OutputSink> inner(std::move(binary_out));
+			patch_sink = new PatchSink(std::move(inner), *patch, system_vars.patch_edc);
+			binary_out.reset(patch_sink);
+		}
+
+		// Insert the PREGAP/POSTGAP zeros the combined sheet expects
+		if(system_vars.write_gaps) {
+			std::vector<ZeroFillSink::Fill> fills;
+			for(const auto &g_itr : system_vars.input_cue_sheet.GetGaps()) {
+				fills.push_back({g_itr.offset, g_itr.bytes});
+			}
 
-		if(!binary_file_out)
-			throw std::runtime_error(message::output_bin_create_failed);
+			if(!fills.empty()) {
+				std::unique_ptr<OutputSink> inner(std::move(binary_out));
+				binary_out.reset(new ZeroFillSink(std::move(inner), std::move(fills)));
+			}
+		}
 
 	} catch(const std::exception &e) {
-		std::cerr << "Fatal Error: Creating " << system_vars.output_bin_path << ": "
-				  << e.what() << std::endl;
-		exit(EXIT_FAILURE);
+		throw DumpError("Creating " + system_vars.output_bin_path.string(), e);
 	}
 
 	// Print that dumping is beginning
-	std::cout << "\n-------------------------------------------------------------------"
+	*system_vars.log << "\n-------------------------------------------------------------------"
 			  <<"\nDumping to " << system_vars.output_bin_path << "\n" << std::endl;
 
 	// Keep track of bytes written in total and per file
 	size_t total_output_bytes = 0, current_file_bytes = 0;
 
 	// Create an array on the heap for the binary copy operations
-	char *binary_array = new char[_BINARY_ARRAY_SIZE];
+	std::unique_ptr<char[]> binary_buffer(new char[_BINARY_ARRAY_SIZE]);
+	char *binary_array = binary_buffer.get();
+
+	/* CHD input */
+	// Hunks are decompressed in parallel and streamed straight to the sink
+	if(system_vars.input_format == InputFormat::Chd) {
+		*system_vars.log << "Dumping File " << system_vars.input_cue_path << std::flush;
+
+		try {
+			ChdReader chd_in(system_vars.input_cue_path);
+			chd_in.Stream([&](const char *data, size_t len) {
+				WriteToSink(*binary_out, data, static_cast<std::streamsize>(len));
+				total_output_bytes += len;
+			}, system_vars.threads);
+		} catch(const DumpError &) {
+			throw;
+		} catch(const std::runtime_error &e) {
+			throw DumpError("Reading CHD " + system_vars.input_cue_path.string(), e);
+		}
+
+		*system_vars.log << BytesToPaddedMiBString(total_output_bytes, 6) << std::endl;
+	}
+
+	/* ZIP input */
+	// Members are inflated in parallel and streamed to the sink in FILE order
+	if(system_vars.input_format == InputFormat::Zip) {
+		try {
+			ZipArchive zip_in(system_vars.input_cue_path);
+
+			// Every member was found when the sheet was read. MOTOROLA members
+			// are byte swapped as they stream
+			std::vector<const ZipArchive::Entry *> members;
+			std::vector<bool> swap;
+			for(const auto &f_itr : system_vars.input_cue_sheet.FileList) {
+				members.push_back(FindZipMember(zip_in, system_vars.zip_cue_dir, f_itr.filename));
+				swap.push_back(f_itr.filetype == "MOTOROLA");
+			}
+
+			// Chunks can split a sample, so an odd byte is carried to the next
+			std::vector<char> swapped;
+			bool carry = false;
+			char carry_byte = 0;
+
+			size_t current = members.size();
+			zip_in.Stream(members, [&](size_t member, const char *data, size_t len) {
+				// Report the previous member when the next one starts
+				if(member != current) {
+					if(current != members.size()) {
+						*system_vars.log << BytesToPaddedMiBString(current_file_bytes, 6) << std::endl;
+					}
+
+					// An odd length member's last byte has nothing to swap with
+					if(carry) {
+						WriteToSink(*binary_out, &carry_byte, 1);
+						carry = false;
+					}
+					*system_vars.log << "Dumping File \"" << members[member]->name << "\"" << std::flush;
+					current = member;
+					current_file_bytes = 0;
+				}
+
+				current_file_bytes += len;
+				total_output_bytes += len;
+
+				if(swap[member]) {
+					swapped.clear();
+					if(carry) swapped.push_back(carry_byte);
+					swapped.insert(swapped.end(), data, data + len);
+
+					carry = (swapped.size() & 1) != 0;
+					if(carry) {
+						carry_byte = swapped.back();
+						swapped.pop_back();
+					}
+
+					SwapAudioBytes(reinterpret_cast<uint8_t *>(swapped.data()), swapped.size());
+					data = swapped.data();
+					len = swapped.size();
+				}
+
+				WriteToSink(*binary_out, data, static_cast<std::streamsize>(len));
+			}, system_vars.threads);
+
+			if(carry) WriteToSink(*binary_out, &carry_byte, 1);
+			if(current != members.size()) {
+				*system_vars.log << BytesToPaddedMiBString(current_file_bytes, 6) << std::endl;
+			}
+		} catch(const DumpError &) {
+			throw;
+		} catch(const std::runtime_error &e) {
+			throw DumpError("Reading ZIP " + system_vars.input_cue_path.string(), e);
+		}
+	}
 
 	/* loop */
 	// Go through every file in the input cue sheet, dumping data to the output binary file
+	// NOTE: CHD and ZIP input has already been dumped above, and has no FILEs to open
 	for(const auto &f_itr : system_vars.input_cue_sheet.FileList) {
+		if(system_vars.input_format != InputFormat::Cue) break;
 
-		// Get the filepath for the current binary file, then try to open the file
+		// Get the filepath for the current binary file, then try to open the file.
+		// WAVE and AIFF FILEs only have their PCM payload dumped
 		std::filesystem::path current_binary_path(system_vars.input_dir_path / f_itr.filename);
+		AudioLayout layout;
 		try {
+			layout = GetAudioLayout(current_binary_path, f_itr.filetype);
+
 			binary_file_in.open(
 				current_binary_path,
 				std::ios::in | std::ios::binary
 			);
 
-			if(!binary_file_in) std::runtime_error(message::input_bin_not_open);
+			if(!binary_file_in) throw std::runtime_error(message::input_bin_not_open);
 		} catch(const std::exception &e) {
-			std::cerr << "Fatal Error: Opening input binary file "
-					  << current_binary_path << ": " << e.what() << std::endl;
-			exit(EXIT_FAILURE);
+			throw DumpError("Opening input binary file " + current_binary_path.string(), e);
 		}
 
 		// Print which file is being worked on
-		std::cout << "Dumping File " << current_binary_path << std::flush;
+		*system_vars.log << "Dumping File " << current_binary_path << std::flush;
 
-		// Reset the file flags and go to the beginning
+		// Reset the file flags and go to the start of the payload
 		binary_file_in.clear();
-		binary_file_in.seekg(0, std::ios::beg);
-
-		// Reset the number of bytes read for this file
-		current_file_bytes = 0;
+		binary_file_in.seekg(static_cast<std::streamoff>(layout.data_offset), std::ios::beg);
 
 		// Copy chunks from the input to the output file, until all bytes are copied
-		std::streamsize buffer_bytes = 0;
-		do {
-			// Read chunk from input
-			binary_file_in.read(binary_array, _BINARY_ARRAY_SIZE);
-			buffer_bytes = binary_file_in.gcount();
-
-			// Write chunk to output
-			binary_file_out.write(binary_array, buffer_bytes);
-
-			// Add the bytes read this loop to the current file bytes
-			current_file_bytes += static_cast<size_t>(buffer_bytes);
-		} while(buffer_bytes);
+		try {
+			current_file_bytes = static_cast<size_t>(CopyStreamToSink(binary_file_in,
+				layout.data_bytes, layout.swap, *binary_out, binary_array, _BINARY_ARRAY_SIZE));
+		} catch(const std::exception &e) {
+			throw DumpError("Writing output", e);
+		}
 
 
 		// Add this files bytes to the total
 		total_output_bytes += current_file_bytes;
 
 		// Report how many MiBs were copied for this file
-		std::cout << BytesToPaddedMiBString(current_file_bytes, 6) << std::endl;
+		*system_vars.log << BytesToPaddedMiBString(current_file_bytes, 6) << std::endl;
 
 		// Close this file for the next loop
 		binary_file_in.close();
 	}
 
 	/* loop done */
-	// Clear the RAM Buffer and close the output file
-	delete[] binary_array;
-	binary_file_out.close();
+	// Close the output file
+	WriteToSink(*binary_out, nullptr, 0);
+
+	// Report the EDC/ECC fixes made after patching
+	if(patch_sink && system_vars.patch_edc) {
+		*system_vars.log << "\nRegenerated EDC/ECC of " << patch_sink->FixedSectors()
+				  << " patched sectors" << std::endl;
+	}
+
+	// Report how much of the image the store already held, and how much of
+	// the .bin shares its data with the store. Whatever was copied into the
+	// .bin takes space on top of the store
+	if(store) {
+		const TrackStore::Stats &stats = store->GetStats();
+		uint64_t added = stats.bytes - stats.dup_bytes;
+		*system_vars.log << "\nStore: " << stats.dup_tracks << " of " << stats.tracks
+				  << " tracks already stored. "
+				  << BytesToPaddedMiBString(static_cast<size_t>(stats.linked_bytes), 0) << " of "
+				  << BytesToPaddedMiBString(static_cast<size_t>(stats.bytes), 0)
+				  << " of the .bin is linked to the store, ";
+		if(stats.linked_bytes >= added) {
+			*system_vars.log << "saving "
+				  << BytesToPaddedMiBString(static_cast<size_t>(stats.linked_bytes - added), 0);
+		} else {
+			*system_vars.log << "using "
+				  << BytesToPaddedMiBString(static_cast<size_t>(added - stats.linked_bytes), 0)
+				  << " more than the .bin alone";
+		}
+		*system_vars.log << std::endl;
+	}
 
 	// Get the end Milliseconds, and calculate how long it took to finish
 	std::chrono::milliseconds end_millis = GetMillisecs();
@@ -755,3 +1337,358 @@ std::string DumpBinaryFiles(SystemVariables &system_vars) {
 
 	return stream.str();
 }
+
+bool DumpBinaryFiles(SystemVariables &system_vars, std::string &status) {
+	try {
+		status = DumpImage(system_vars);
+	} catch(const std::exception &e) {
+		std::cerr << "\nError: " << system_vars.input_cue_path.string() << ": "
+				  << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+std::string ExtractFiles(SystemVariables &system_vars) {
+	// Get the start millis
+	std::chrono::milliseconds start_millis = GetMillisecs();
+
+	// Read the sheet and FILE sizes, the FILEs are read in place
+	CueFile cue_in(system_vars.input_cue_path.string().c_str());
+	system_vars.input_cue_sheet.Clear();
+	try {
+		cue_in.ReadCueData(system_vars.input_cue_sheet);
+		if(system_vars.input_cue_sheet.FileList.empty()) {
+			throw CueException(message::cue_has_no_files);
+		}
+		cue_in.GetCueFileSizes(system_vars.input_cue_sheet, system_vars.input_dir_path.string());
+	} catch(const CueException &e) {
+		std::cerr << "Fatal Error: Cue Handler: " << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	size_t files = 0, total_bytes = 0;
+	try {
+		Iso9660Reader iso(system_vars.input_cue_sheet, system_vars.input_dir_path);
+		const Iso9660Reader::Entry *wanted = iso.Find(system_vars.extract_path);
+		if(!wanted) throw std::runtime_error(message::extract_not_found);
+
+		// Paths are written relative to the requested entry's parent
+		std::string parent = wanted->path.substr(0, wanted->path.find_last_of('/') + 1);
+		std::string prefix = wanted->path;
+		if(prefix.back() != '/') prefix += "/";
+
+		for(const auto &entry : iso.Entries()) {
+			bool selected = (&entry == wanted) ||
+			                (wanted->directory && entry.path.compare(0, prefix.size(), prefix) == 0);
+			if(!selected || entry.directory) continue;
+
+			std::filesystem::path out_path =
+				system_vars.output_dir_path / entry.path.substr(parent.size());
+			std::filesystem::create_directories(out_path.parent_path());
+
+			std::cout << "Extracting " << entry.path << (entry.xa_form2 ? " (XA)" : "")
+					  << std::flush;
+
+			std::ofstream out(out_path, std::ios::out | std::ios::binary | std::ios::trunc);
+			if(!out) throw std::runtime_error(message::output_bin_create_failed);
+			iso.ExtractFile(entry, out);
+
+			size_t bytes = static_cast<size_t>(out.tellp());
+			std::cout << BytesToPaddedMiBString(bytes, 6) << std::endl;
+			total_bytes += bytes;
+			files++;
+		}
+	} catch(const std::exception &e) {
+		std::cerr << "\nFatal Error: Extracting " << system_vars.extract_path << ": "
+				  << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Get the end Milliseconds, and calculate how long it took to finish
+	std::chrono::milliseconds end_millis = GetMillisecs();
+	float runtime =
+		static_cast<float>((end_millis - start_millis).count()) / 1000.0f;
+
+	std::stringstream stream;
+	stream << "Successfully Extracted " << files << " files, "
+		   << BytesToPaddedMiBString(total_bytes, 0)
+		   << " in " << std::fixed << std::setprecision(2) << runtime
+		   << " seconds." << std::endl;
+
+	return stream.str();
+}
+
+std::string SplitBinaryFile(SystemVariables &system_vars) {
+	// Get the start millis
+	std::chrono::milliseconds start_millis = GetMillisecs();
+
+	system_vars.input_cue_sheet.Clear();
+	system_vars.output_cue_sheet.Clear();
+
+	// If the directory does not already exists, create it
+	if(!std::filesystem::is_directory(system_vars.output_dir_path)) {
+		std::filesystem::create_directory(system_vars.output_dir_path);
+		std::cout << "Created Directory: " << system_vars.output_dir_path << "\n\n";
+	}
+
+	CueFile cue_in(system_vars.input_cue_path.string().c_str());
+	CueFile cue_out(system_vars.output_cue_path.string().c_str());
+
+	// Read the sheet, then split it into one FILE per TRACK, named after the
+	// output .cue
+	try {
+		cue_in.ReadCueData(system_vars.input_cue_sheet);
+		if(system_vars.input_cue_sheet.FileList.empty()) {
+			throw CueException(message::cue_has_no_files);
+		}
+		cue_in.GetCueFileSizes(system_vars.input_cue_sheet, system_vars.input_dir_path.string());
+
+		// Tracks are copied as raw ranges, which a header would break
+		const std::string &filetype = system_vars.input_cue_sheet.FileList.front().filetype;
+		if(filetype == "WAVE" || filetype == "AIFF") {
+			throw CueException(message::split_audio_header);
+		}
+
+		system_vars.input_cue_sheet.CopyTo(system_vars.output_cue_sheet);
+		system_vars.output_cue_sheet.Split(system_vars.output_cue_path.stem().string());
+
+		if(system_vars.verbose) system_vars.output_cue_sheet.Print();
+		cue_out.WriteCueData(system_vars.output_cue_sheet);
+
+	} catch(const CueException &e) {
+		std::cerr << "Fatal Error: Cue Handler: " << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// The split FILEs lie end to end in the input, so each one is a range copy
+	std::filesystem::path input_bin_path =
+		system_vars.input_dir_path / system_vars.input_cue_sheet.FileList.front().filename;
+
+	std::vector<CopyJob> jobs;
+	uint64_t offset = 0;
+	for(const auto &f_itr : system_vars.output_cue_sheet.FileList) {
+		jobs.push_back({input_bin_path, offset, f_itr.bytes,
+		                system_vars.output_dir_path / f_itr.filename});
+		offset += f_itr.bytes;
+	}
+
+	std::cout << "Splitting " << input_bin_path.filename() << " into " << jobs.size()
+			  << " files" << std::endl;
+	try {
+		CopyFileRanges(jobs);
+	} catch(const std::exception &e) {
+		std::cerr << "\nFatal Error: Splitting: " << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Get the end Milliseconds, and calculate how long it took to finish
+	std::chrono::milliseconds end_millis = GetMillisecs();
+	float runtime =
+		static_cast<float>((end_millis - start_millis).count()) / 1000.0f;
+
+	std::stringstream stream;
+	stream << "Successfully Split " << jobs.size() << " tracks, "
+		   << BytesToPaddedMiBString(static_cast<size_t>(offset), 0)
+		   << " in " << std::fixed << std::setprecision(2) << runtime
+		   << " seconds." << std::endl;
+
+	return stream.str();
+}
+
+std::string MountImages(SystemVariables &system_vars) {
+	// Get the start millis
+	std::chrono::milliseconds start_millis = GetMillisecs();
+
+	size_t images = 0;
+	try {
+		images = MountLibrary(system_vars.input_dir_path, system_vars.mount_path);
+	} catch(const std::exception &e) {
+		std::cerr << "Fatal Error: Mounting " << system_vars.mount_path << ": "
+				  << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Get the end Milliseconds, and calculate how long it was mounted for
+	std::chrono::milliseconds end_millis = GetMillisecs();
+	float runtime =
+		static_cast<float>((end_millis - start_millis).count()) / 1000.0f;
+
+	std::stringstream stream;
+	stream << "Successfully Unmounted " << images << " images after "
+		   << std::fixed << std::setprecision(2) << runtime
+		   << " seconds." << std::endl;
+
+	return stream.str();
+}
+
+std::string CheckLibraryDiscs(SystemVariables &system_vars) {
+	LibraryCheck check;
+	try {
+		check = CheckLibrary(system_vars.input_cue_path);
+
+		std::ofstream report(system_vars.check_report_path, std::ios::out | std::ios::trunc);
+		report << CheckReportToJson(check);
+		if(!report) throw std::runtime_error("Could not write " + system_vars.check_report_path.string());
+	} catch(const std::exception &e) {
+		std::cerr << "Fatal Error: Checking " << system_vars.input_cue_path << ": "
+				  << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// List the problems, the report has the detail
+	for(const DiscCheck &disc : check.discs) {
+		for(const CheckIssue &issue : disc.issues) {
+			std::cout << disc.cue.string();
+			if(issue.line) std::cout << ":" << issue.line << ":" << issue.column;
+			std::cout << ": " << issue.code;
+			if(!issue.file.empty()) std::cout << " \"" << issue.file << "\"";
+			if(issue.track) std::cout << " TRACK " << issue.track;
+			std::cout << ": " << issue.message << "\n";
+		}
+	}
+	if(check.failed) system_vars.exit_status = EXIT_FAILURE;
+
+	std::stringstream stream;
+	stream << "Checked " << check.discs.size() << " discs in " << std::fixed
+		   << std::setprecision(2) << (check.scan_seconds + check.check_seconds)
+		   << " seconds, " << check.failed << " with problems. Report written to "
+		   << system_vars.check_report_path.string() << std::endl;
+
+	return stream.str();
+}
+
+std::string UpdateCatalog(SystemVariables &system_vars) {
+	Catalog::UpdateStats stats;
+	try {
+		stats = Catalog::Update(system_vars.catalog_path, system_vars.input_dir_path,
+		                        system_vars.catalog_hash);
+	} catch(const std::exception &e) {
+		std::cerr << "Fatal Error: Cataloguing " << system_vars.input_dir_path << ": "
+				  << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	std::stringstream stream;
+	stream << "Catalogued " << stats.discs << " discs (" << stats.game_ids << " with game IDs) in "
+		   << stats.dirs << " directories in " << std::fixed << std::setprecision(2)
+		   << stats.seconds << " seconds.\n"
+		   << "Listed " << stats.dirs_listed << " directories, parsed " << stats.cues_parsed
+		   << " .cue files, statted " << stats.files_statted << " FILEs and hashed "
+		   << stats.files_hashed << ". Written to " << system_vars.catalog_path.string()
+		   << std::endl;
+
+	return stream.str();
+}
+
+std::string CombineDiscSets(SystemVariables &system_vars) {
+	// Get the start millis
+	std::chrono::milliseconds start_millis = GetMillisecs();
+
+	std::vector<DiscSet> sets = GroupDiscSets(system_vars.batch_cues);
+
+	// Each disc is combined with its own copy of the variables, and its
+	// progress is kept until it finishes, so discs do not print over each other
+	std::vector<SystemVariables> discs;
+	for(const DiscSet &set : sets) {
+		for(const auto &cue_path : set.discs) {
+			SystemVariables disc_vars = system_vars;
+			disc_vars.batch_cues.clear();
+			disc_vars.input_cue_path = cue_path;
+			disc_vars.output_cue_path = system_vars.output_dir_path / cue_path.filename();
+			(disc_vars.output_bin_path = disc_vars.output_cue_path).replace_extension(
+				OutputFormatExtension(system_vars.output_format));
+			discs.push_back(std::move(disc_vars));
+		}
+	}
+
+	// Create the output directory once, rather than racing to in every disc
+	if(!std::filesystem::is_directory(system_vars.output_dir_path)) {
+		std::filesystem::create_directory(system_vars.output_dir_path);
+		std::cout << "Created Directory: " << system_vars.output_dir_path << "\n\n";
+	}
+
+	std::cout << "Combining " << discs.size() << " discs of " << sets.size() << " games"
+			  << std::endl;
+
+	// The cores are shared out between the discs, so the CHD and gzip
+	// compressors of each disc do not start a worker per core each
+	unsigned workers = static_cast<unsigned>(std::min<size_t>(DefaultThreadCount(), discs.size()));
+	unsigned disc_threads = std::max(1u, DefaultThreadCount() / std::max(1u, workers));
+	for(auto &disc_vars : discs) disc_vars.threads = disc_threads;
+
+	// A disc that fails to combine or dump is reported, and its output
+	// removed, then left out. The rest carry on
+	std::mutex print_mtx;
+	std::vector<char> disc_ok(discs.size(), 0);
+	ParallelFor(discs.size(), [&](size_t disc) {
+		std::ostringstream disc_log;
+		discs[disc].log = &disc_log;
+
+		std::string status;
+		if(CombineCue(discs[disc]) && DumpBinaryFiles(discs[disc], status)) {
+			disc_log << "\n" << status;
+			disc_ok[disc] = 1;
+		} else {
+			for(const auto &path : {discs[disc].output_bin_path, discs[disc].output_cue_path}) {
+				std::error_code ec;
+				if(std::filesystem::is_regular_file(path, ec)) std::filesystem::remove(path, ec);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(print_mtx);
+		std::cout << disc_log.str() << std::flush;
+	}, workers);
+
+	// Write a playlist for each multi-disc game, of what an emulator should load
+	size_t disc = 0, playlists = 0, total_bytes = 0, failed = 0;
+	for(const DiscSet &set : sets) {
+		std::vector<std::filesystem::path> entries;
+		for(size_t d = 0; d < set.discs.size(); d++, disc++) {
+			if(!disc_ok[disc]) {
+				failed++;
+				continue;
+			}
+
+			const SystemVariables &disc_vars = discs[disc];
+			for(const auto &f_itr : disc_vars.input_cue_sheet.FileList) total_bytes += f_itr.bytes;
+
+			bool has_cue = system_vars.output_format == OutputFormat::Bin ||
+			               system_vars.output_format == OutputFormat::Gzip;
+			entries.push_back(has_cue ? disc_vars.output_cue_path.filename()
+			                          : disc_vars.output_bin_path.filename());
+		}
+
+		if(entries.size() < 2) continue;
+
+		std::filesystem::path m3u_path = system_vars.output_dir_path / (set.name + ".m3u");
+		std::ofstream m3u(m3u_path, std::ios::out | std::ios::trunc);
+		for(const auto &entry : entries) m3u << entry.string() << "\n";
+		if(!m3u) {
+			std::cerr << "Fatal Error: Writing " << m3u_path << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		std::cout << "Wrote playlist " << m3u_path << std::endl;
+		playlists++;
+	}
+
+	// Get the end Milliseconds, and calculate how long it took to finish
+	std::chrono::milliseconds end_millis = GetMillisecs();
+	float runtime =
+		static_cast<float>((end_millis - start_millis).count()) / 1000.0f;
+
+	std::stringstream stream;
+	if(failed) {
+		system_vars.exit_status = EXIT_FAILURE;
+		stream << failed << " of " << discs.size() << " discs could not be combined, see above.\n";
+	}
+	stream << "Successfully Combined " << discs.size() - failed << " discs, "
+		   << BytesToPaddedMiBString(total_bytes, 0) << " with " << playlists
+		   << " playlists in " << std::fixed << std::setprecision(2) << runtime
+		   << " seconds." << std::endl;
+
+	return stream.str();
+}
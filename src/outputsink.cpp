@@ -0,0 +1,142 @@
+/******************************************************************************
+* psx-comBINe output sinks
+* The combined binary stream is pushed through an OutputSink, which writes it
+* out in the requested output format.
+* ADBeta (c)
+******************************************************************************/
+#include "outputsink.hpp"
+#include "audiofile.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <istream>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+OutputFormat StrToOutputFormat(const std::string &str) {
+	std::string lower = StringToLower(str);
+
+	OutputFormat format = OutputFormat::Invalid;
+	     if(lower == "bin")    format = OutputFormat::Bin;
+	else if(lower == "chd")    format = OutputFormat::Chd;
+	else if(lower == "gz")     format = OutputFormat::Gzip;
+	else if(lower == "iso")    format = OutputFormat::Iso;
+
+	return format;
+}
+
+std::string OutputFormatExtension(const OutputFormat format) {
+	std::string ext;
+	     if(format == OutputFormat::Bin)    ext = ".bin";
+	else if(format == OutputFormat::Chd)    ext = ".chd";
+	else if(format == OutputFormat::Gzip)   ext = ".bin.gz";
+	else if(format == OutputFormat::Iso)    ext = ".iso";
+
+	return ext;
+}
+
+void OutputSink::WriteZeros(uint64_t len) {
+	static const char zeros[64 * 1024] = {};
+
+	while(len) {
+		size_t take = static_cast<size_t>(std::min<uint64_t>(len, sizeof(zeros)));
+		this->Write(zeros, take);
+		len -= take;
+	}
+}
+
+uint64_t CopyStreamToSink(std::istream &in, uint64_t bytes, bool swap, OutputSink &sink,
+                          char *buffer, size_t buffer_bytes) {
+	uint64_t copied = 0;
+	while(copied < bytes) {
+		// Read a chunk, stopping at the end of the payload or the stream
+		std::streamsize wanted = static_cast<std::streamsize>(
+			std::min<uint64_t>(buffer_bytes, bytes - copied));
+		in.read(buffer, wanted);
+		std::streamsize got = in.gcount();
+		if(got <= 0) break;
+
+		// Big-endian samples are swapped to CD byte order. The buffer is an
+		// even size, so samples are never split between reads
+		if(swap) SwapAudioBytes(reinterpret_cast<uint8_t *>(buffer), static_cast<size_t>(got));
+
+		sink.Write(buffer, static_cast<size_t>(got));
+		copied += static_cast<uint64_t>(got);
+	}
+
+	return copied;
+}
+
+/*** Raw Output ***************************************************************/
+RawOutputSink::RawOutputSink(const std::filesystem::path &path) {
+	this->file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!this->file) throw std::runtime_error("Output binary file could not be created");
+}
+
+void RawOutputSink::Write(const char *data, size_t len) {
+	// Seeking past the end leaves a hole, which the filesystem reads as zeros
+	if(this->hole_bytes) {
+		this->file.seekp(static_cast<std::streamoff>(this->hole_bytes), std::ios::cur);
+		this->hole_bytes = 0;
+	}
+
+	this->file.write(data, static_cast<std::streamsize>(len));
+	if(!this->file) throw std::runtime_error("Failed to write to output binary file");
+}
+
+void RawOutputSink::WriteZeros(uint64_t len) {
+	this->hole_bytes += len;
+}
+
+void RawOutputSink::Close() {
+	// A trailing hole needs its last byte written, to set the file size
+	if(this->hole_bytes) {
+		this->hole_bytes--;
+		this->Write("", 1);
+	}
+
+	this->file.close();
+	if(this->file.fail()) throw std::runtime_error("Failed to close output binary file");
+}
+
+/*** Zero Filling *************************************************************/
+ZeroFillSink::ZeroFillSink(std::unique_ptr<OutputSink> in, std::vector<Fill> f)
+	: inner(std::move(in)), fills(std::move(f)), next_fill(0), offset(0) {}
+
+void ZeroFillSink::WriteFills() {
+	while(this->next_fill < this->fills.size() &&
+	      this->fills[this->next_fill].offset <= this->offset) {
+		this->inner->WriteZeros(this->fills[this->next_fill].bytes);
+		this->next_fill++;
+	}
+}
+
+void ZeroFillSink::Write(const char *data, size_t len) {
+	// Split the buffer wherever a fill goes
+	while(len) {
+		this->WriteFills();
+
+		size_t take = len;
+		if(this->next_fill < this->fills.size()) {
+			take = static_cast<size_t>(
+				std::min<uint64_t>(len, this->fills[this->next_fill].offset - this->offset));
+		}
+
+		this->inner->Write(data, take);
+		this->offset += take;
+		data += take;
+		len -= take;
+	}
+}
+
+void ZeroFillSink::Close() {
+	// Fills at (or past) the end of the stream, e.g. the last POSTGAP
+	this->offset = UINT64_MAX;
+	this->WriteFills();
+	this->inner->Close();
+}
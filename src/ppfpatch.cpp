@@ -0,0 +1,329 @@
+/******************************************************************************
+* psx-comBINe PPF (PlayStation Patch File) support
+* Loads PPF 1.0, 2.0 and 3.0 patches, and applies them to the combined binary
+* stream as it is written, optionally regenerating the EDC/ECC of patched
+* data sectors.
+* ADBeta (c)
+******************************************************************************/
+#include "ppfpatch.hpp"
+#include "cdsector.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*** PPF File Format Constants ************************************************/
+namespace {
+constexpr size_t   header_v1_bytes   = 56;    // Magic, encoding, description
+constexpr size_t   header_v3_bytes   = 60;    // + image type, flags
+constexpr size_t   block_check_bytes = 1024;
+constexpr uint64_t block_offset_bin  = 0x9320;
+constexpr uint64_t block_offset_gi   = 0x80A0;
+
+// FILE_ID.DIZ is wrapped in these markers, then followed by its length
+constexpr size_t   diz_begin_bytes   = 18;    // "@BEGIN_FILE_ID.DIZ"
+constexpr size_t   diz_end_bytes     = 16;    // "@END_FILE_ID.DIZ"
+
+uint64_t GetLE(const uint8_t *src, int bytes) {
+	uint64_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--) value = (value << 8) | src[i];
+	return value;
+}
+
+// A record as it appears in the file
+struct Record {
+	uint64_t offset;
+	size_t   data_idx;  // Start of the record's bytes in the file
+	size_t   len;
+	size_t   seq;       // Position in the file. Later records win
+};
+} // namespace
+
+/*** PPF Patch ****************************************************************/
+PpfPatch::PpfPatch(const std::filesystem::path &path)
+	: version(0), image_bytes(0), block_offset(block_offset_bin), cursor(0) {
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if(!file) throw std::runtime_error("PPF patch file could not be opened");
+	std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)),
+	                         std::istreambuf_iterator<char>());
+
+	if(buf.size() < header_v1_bytes || std::memcmp(buf.data(), "PPF", 3) != 0 ||
+	   buf[4] != '0' || buf[3] < '1' || buf[3] > '3') {
+		throw std::runtime_error("File is not a PPF 1.0, 2.0 or 3.0 patch");
+	}
+	this->version = buf[3] - '0';
+
+	size_t pos = header_v1_bytes, end = buf.size();
+	int offset_bytes = 4;
+	bool undo = false;
+
+	// Reads the length of a trailing FILE_ID.DIZ, if the patch has one
+	auto diz_bytes = [&buf](size_t len_bytes) -> size_t {
+		size_t tail = 4 + len_bytes;
+		if(buf.size() < tail || std::memcmp(buf.data() + buf.size() - tail, ".DIZ", 4) != 0)
+			return 0;
+		return static_cast<size_t>(GetLE(buf.data() + buf.size() - len_bytes,
+		                                 static_cast<int>(len_bytes)))
+		       + diz_begin_bytes + diz_end_bytes + len_bytes;
+	};
+
+	// PPF 2.0: image size and a block check always follow the header
+	if(this->version == 2) {
+		if(buf.size() < header_v1_bytes + 4 + block_check_bytes)
+			throw std::runtime_error("PPF patch header is truncated");
+
+		this->image_bytes = GetLE(buf.data() + header_v1_bytes, 4);
+		pos = header_v1_bytes + 4;
+		this->block_check.assign(buf.begin() + static_cast<std::ptrdiff_t>(pos),
+		                         buf.begin() + static_cast<std::ptrdiff_t>(pos + block_check_bytes));
+		pos += block_check_bytes;
+		end -= std::min(end, diz_bytes(4));
+	}
+
+	// PPF 3.0: image type, optional block check, optional undo data, 64-bit offsets
+	if(this->version == 3) {
+		if(buf.size() < header_v3_bytes) throw std::runtime_error("PPF patch header is truncated");
+
+		bool gi_image    = buf[56] != 0;
+		bool has_check   = buf[57] != 0;
+		undo             = buf[58] != 0;
+		offset_bytes     = 8;
+		pos              = header_v3_bytes;
+
+		if(has_check) {
+			if(buf.size() < pos + block_check_bytes) throw std::runtime_error("PPF patch header is truncated");
+			this->block_offset = gi_image ? block_offset_gi : block_offset_bin;
+			this->block_check.assign(buf.begin() + static_cast<std::ptrdiff_t>(pos),
+			                         buf.begin() + static_cast<std::ptrdiff_t>(pos + block_check_bytes));
+			pos += block_check_bytes;
+		}
+		end -= std::min(end, diz_bytes(2));
+	}
+
+	// Records: [offset][length u8][data][undo data (PPF 3.0 only)]
+	std::vector<Record> records;
+	while(pos < end) {
+		size_t rec_header = static_cast<size_t>(offset_bytes) + 1;
+		if(pos + rec_header > end) throw std::runtime_error("PPF patch record is truncated");
+
+		Record rec;
+		rec.offset   = GetLE(buf.data() + pos, offset_bytes);
+		rec.len      = buf[pos + static_cast<size_t>(offset_bytes)];
+		rec.data_idx = pos + rec_header;
+		rec.seq      = records.size();
+
+		pos = rec.data_idx + (undo ? rec.len * 2 : rec.len);
+		if(pos > end) throw std::runtime_error("PPF patch record is truncated");
+
+		if(rec.len) records.push_back(rec);
+	}
+
+	// Flatten overlapping records into runs, applying them in file order
+	std::stable_sort(records.begin(), records.end(),
+		[](const Record &a, const Record &b) { return a.offset < b.offset; });
+
+	for(size_t first = 0; first < records.size(); ) {
+		uint64_t run_start = records[first].offset;
+		uint64_t run_end = run_start + records[first].len;
+
+		size_t last = first + 1;
+		while(last < records.size() && records[last].offset <= run_end) {
+			run_end = std::max<uint64_t>(run_end, records[last].offset + records[last].len);
+			last++;
+		}
+
+		Run run = {run_start, run_end - run_start, this->run_data.size()};
+		this->run_data.resize(this->run_data.size() + static_cast<size_t>(run.len));
+
+		std::sort(records.begin() + static_cast<std::ptrdiff_t>(first),
+		          records.begin() + static_cast<std::ptrdiff_t>(last),
+		          [](const Record &a, const Record &b) { return a.seq < b.seq; });
+		for(size_t r = first; r < last; r++) {
+			std::memcpy(this->run_data.data() + run.data_idx + (records[r].offset - run_start),
+			            buf.data() + records[r].data_idx, records[r].len);
+		}
+
+		this->runs.push_back(run);
+		first = last;
+	}
+}
+
+int PpfPatch::Version() const {
+	return this->version;
+}
+
+uint64_t PpfPatch::ImageBytes() const {
+	return this->image_bytes;
+}
+
+const std::vector<uint8_t> &PpfPatch::BlockCheck() const {
+	return this->block_check;
+}
+
+uint64_t PpfPatch::BlockCheckOffset() const {
+	return this->block_offset;
+}
+
+void PpfPatch::Seek(uint64_t offset) {
+	// Going backwards needs a search, streaming forwards only steps
+	if(this->cursor > 0 &&
+	   this->runs[this->cursor - 1].offset + this->runs[this->cursor - 1].len > offset) {
+		this->cursor = static_cast<size_t>(std::partition_point(
+			this->runs.begin(), this->runs.end(),
+			[offset](const Run &run) { return run.offset + run.len <= offset; })
+			- this->runs.begin());
+	}
+
+	while(this->cursor < this->runs.size() &&
+	      this->runs[this->cursor].offset + this->runs[this->cursor].len <= offset) {
+		this->cursor++;
+	}
+}
+
+bool PpfPatch::Touches(uint64_t offset, size_t len) {
+	this->Seek(offset);
+	return this->cursor < this->runs.size() && this->runs[this->cursor].offset < offset + len;
+}
+
+void PpfPatch::Apply(uint64_t offset, uint8_t *data, size_t len) {
+	this->Seek(offset);
+
+	for(size_t r = this->cursor; r < this->runs.size() && this->runs[r].offset < offset + len; r++) {
+		const Run &run = this->runs[r];
+		uint64_t start = std::max(run.offset, offset);
+		uint64_t stop  = std::min(run.offset + run.len, offset + len);
+
+		std::memcpy(data + (start - offset),
+		            this->run_data.data() + run.data_idx + (start - run.offset),
+		            static_cast<size_t>(stop - start));
+	}
+}
+
+/*** Patching Output Sink *****************************************************/
+PatchSink::PatchSink(std::unique_ptr<OutputSink> in, PpfPatch &p, bool fix)
+	: inner(std::move(in)), patch(p), fix_edc(fix), offset(0), fixed_sectors(0) {}
+
+void PatchSink::Write(const char *data, size_t len) {
+	const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+	this->CheckBlock(src, len);
+
+	// Without EDC/ECC fixing there is no need to keep sectors whole
+	if(!this->fix_edc) {
+		if(this->patch.Touches(this->offset, len)) {
+			this->scratch.assign(src, src + len);
+			this->patch.Apply(this->offset, this->scratch.data(), len);
+			src = this->scratch.data();
+		}
+
+		this->inner->Write(reinterpret_cast<const char *>(src), len);
+		this->offset += len;
+		return;
+	}
+
+	// Complete a held back partial sector first
+	if(!this->pending.empty()) {
+		size_t take = std::min(len, cdsector::raw_bytes - this->pending.size());
+		this->pending.insert(this->pending.end(), src, src + take);
+		this->offset += take;
+		src += take;
+		len -= take;
+
+		if(this->pending.size() < cdsector::raw_bytes) return;
+		this->WriteSectors(this->offset - cdsector::raw_bytes, this->pending.data(),
+		                   cdsector::raw_bytes);
+		this->pending.clear();
+	}
+
+	// Whole sectors, then hold back any partial sector
+	size_t whole = len - (len % cdsector::raw_bytes);
+	this->WriteSectors(this->offset, src, whole);
+	this->offset += whole;
+
+	this->pending.assign(src + whole, src + len);
+	this->offset += len - whole;
+}
+
+void PatchSink::WriteZeros(uint64_t len) {
+	// Unpatched zeros are passed on, so the output can still skip over them.
+	// With fix_edc they must also keep the stream sector aligned
+	const std::vector<uint8_t> &block = this->patch.BlockCheck();
+	bool in_block = !block.empty() && this->patch.BlockCheckOffset() < this->offset + len &&
+	                this->patch.BlockCheckOffset() + block.size() > this->offset;
+	bool aligned = !this->fix_edc ||
+	               (this->pending.empty() && len % cdsector::raw_bytes == 0);
+
+	if(aligned && !in_block && len <= SIZE_MAX &&
+	   !this->patch.Touches(this->offset, static_cast<size_t>(len))) {
+		this->inner->WriteZeros(len);
+		this->offset += len;
+		return;
+	}
+
+	OutputSink::WriteZeros(len);
+}
+
+void PatchSink::WriteSectors(uint64_t base, const uint8_t *data, size_t len) {
+	if(len == 0) return;
+
+	// Fast path: nothing in this buffer is patched
+	if(!this->patch.Touches(base, len)) {
+		this->inner->Write(reinterpret_cast<const char *>(data), len);
+		return;
+	}
+
+	this->scratch.assign(data, data + len);
+	for(size_t s = 0; s < len; s += cdsector::raw_bytes) {
+		if(!this->patch.Touches(base + s, cdsector::raw_bytes)) continue;
+
+		// Only regenerate sectors that were valid to begin with, which leaves
+		// audio and deliberately broken sectors alone
+		uint8_t *sector = this->scratch.data() + s;
+		bool was_valid = cdsector::VerifyEdc(sector);
+		this->patch.Apply(base + s, sector, cdsector::raw_bytes);
+
+		if(was_valid && cdsector::RegenerateEdcEcc(sector)) this->fixed_sectors++;
+	}
+
+	this->inner->Write(reinterpret_cast<const char *>(this->scratch.data()), len);
+}
+
+void PatchSink::CheckBlock(const uint8_t *data, size_t len) {
+	const std::vector<uint8_t> &block = this->patch.BlockCheck();
+	if(block.empty()) return;
+
+	// Compare the part of the block that is inside this (unpatched) buffer
+	uint64_t block_start = this->patch.BlockCheckOffset();
+	uint64_t stream_start = this->offset;
+	uint64_t start = std::max(block_start, stream_start);
+	uint64_t stop  = std::min(block_start + block.size(), stream_start + len);
+	if(start >= stop) return;
+
+	if(std::memcmp(data + (start - stream_start), block.data() + (start - block_start),
+	               static_cast<size_t>(stop - start)) != 0) {
+		throw std::runtime_error("PPF patch was not made for this image (block check failed)");
+	}
+}
+
+void PatchSink::Close() {
+	// A trailing partial sector is patched, but cannot have its EDC fixed
+	if(!this->pending.empty()) {
+		uint64_t base = this->offset - this->pending.size();
+		this->patch.Apply(base, this->pending.data(), this->pending.size());
+		this->inner->Write(reinterpret_cast<const char *>(this->pending.data()),
+		                   this->pending.size());
+		this->pending.clear();
+	}
+
+	this->inner->Close();
+}
+
+size_t PatchSink::FixedSectors() const {
+	return this->fixed_sectors;
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+* psx-comBINe sector cache
+* A thread safe, sector granular LRU cache in front of VirtualImage reads,
+* with readahead. Used to serve combined images to several readers at once.
+* ADBeta (c)
+******************************************************************************/
+#include "sectorcache.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+SectorCache::SectorCache(size_t capacity, size_t ra)
+	: shard_capacity(std::max<size_t>(1, capacity / shard_count)),
+	  readahead(std::max<size_t>(1, ra)) {}
+
+SectorCache::Shard &SectorCache::GetShard(Key key) {
+	// Neighbouring sectors go to different shards, so one sequential reader
+	// does not hold a single lock
+	return this->shards[key % shard_count];
+}
+
+bool SectorCache::Lookup(Key key, size_t skip, uint8_t *dest, size_t len) {
+	Shard &shard = this->GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+
+	auto found = shard.index.find(key);
+	if(found == shard.index.end()) return false;
+
+	shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+	std::memcpy(dest, found->second->data.data() + skip, len);
+	return true;
+}
+
+void SectorCache::Insert(Key key, const uint8_t *data, size_t len) {
+	Shard &shard = this->GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+
+	auto found = shard.index.find(key);
+	if(found != shard.index.end()) {
+		shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+		return;
+	}
+
+	// Reuse the least recently used entry once the shard is full
+	if(shard.lru.size() >= this->shard_capacity) {
+		shard.index.erase(shard.lru.back().key);
+		shard.lru.splice(shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+	} else {
+		shard.lru.emplace_front();
+	}
+
+	Entry &entry = shard.lru.front();
+	entry.key = key;
+	std::memcpy(entry.data.data(), data, len);
+	shard.index[key] = shard.lru.begin();
+}
+
+void SectorCache::Read(const VirtualImage &image, uint32_t image_id, uint64_t offset,
+                       uint8_t *dest, size_t len) {
+	const uint64_t image_bytes = image.Bytes();
+	thread_local std::vector<uint8_t> run;
+
+	while(len) {
+		uint64_t sector = offset / sector_bytes;
+		size_t skip = static_cast<size_t>(offset % sector_bytes);
+		size_t take = std::min(len, sector_bytes - skip);
+		Key key = (static_cast<Key>(image_id) << 40) | sector;
+
+		// Miss: read this sector and the ones after it, and cache them all
+		if(!this->Lookup(key, skip, dest, take)) {
+			uint64_t run_start = sector * sector_bytes;
+			uint64_t run_bytes = std::min<uint64_t>(this->readahead * sector_bytes,
+			                                        image_bytes - run_start);
+			run.resize(static_cast<size_t>(run_bytes));
+			image.Read(run_start, run.data(), run.size());
+
+			for(size_t s = 0; s * sector_bytes < run.size(); s++) {
+				size_t bytes = std::min(sector_bytes, run.size() - (s * sector_bytes));
+				this->Insert(key + s, run.data() + (s * sector_bytes), bytes);
+			}
+
+			std::memcpy(dest, run.data() + skip, take);
+		}
+
+		dest += take;
+		offset += take;
+		len -= take;
+	}
+}
@@ -0,0 +1,122 @@
+/******************************************************************************
+* psx-comBINe SHA-1 hashing
+* Small streaming SHA-1 implementation (FIPS 180-4), used for CHD headers and
+* content-addressed track hashes.
+* ADBeta (c)
+******************************************************************************/
+#include "sha1.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+static inline uint32_t Rol32(const uint32_t val, const int bits) {
+	return (val << bits) | (val >> (32 - bits));
+}
+
+void Sha1::Reset() {
+	this->state[0] = 0x67452301;
+	this->state[1] = 0xEFCDAB89;
+	this->state[2] = 0x98BADCFE;
+	this->state[3] = 0x10325476;
+	this->state[4] = 0xC3D2E1F0;
+	this->total_bytes = 0;
+	this->block_len = 0;
+}
+
+void Sha1::Update(const void *data, size_t len) {
+	const uint8_t *src = static_cast<const uint8_t *>(data);
+	this->total_bytes += len;
+
+	// Top up a partial block first
+	if(this->block_len) {
+		size_t take = std::min(len, sizeof(this->block) - this->block_len);
+		std::memcpy(this->block + this->block_len, src, take);
+		this->block_len += take;
+		src += take;
+		len -= take;
+
+		if(this->block_len < sizeof(this->block)) return;
+		this->Transform(this->block);
+		this->block_len = 0;
+	}
+
+	// Hash whole blocks straight from the input, keep the tail
+	while(len >= sizeof(this->block)) {
+		this->Transform(src);
+		src += sizeof(this->block);
+		len -= sizeof(this->block);
+	}
+
+	std::memcpy(this->block, src, len);
+	this->block_len = len;
+}
+
+Sha1::Digest Sha1::Final() {
+	uint64_t total_bits = this->total_bytes * 8;
+
+	// Pad with 0x80, zeros, then the 64-bit big-endian bit count
+	uint8_t pad[72] = {0x80};
+	size_t pad_len = (this->block_len < 56) ? (56 - this->block_len)
+	                                        : (120 - this->block_len);
+	for(int i = 0; i < 8; i++)
+		pad[pad_len + static_cast<size_t>(i)] =
+			static_cast<uint8_t>(total_bits >> (56 - (8 * i)));
+	this->Update(pad, pad_len + 8);
+
+	Digest digest;
+	for(size_t i = 0; i < 20; i++)
+		digest[i] = static_cast<uint8_t>(this->state[i / 4] >> (24 - (8 * (i % 4))));
+
+	this->Reset();
+	return digest;
+}
+
+std::string Sha1::ToHex(const Digest &digest) {
+	static const char *hex = "0123456789abcdef";
+	std::string out;
+	out.reserve(40);
+	for(const uint8_t byte : digest) {
+		out.push_back(hex[byte >> 4]);
+		out.push_back(hex[byte & 0x0F]);
+	}
+	return out;
+}
+
+void Sha1::Transform(const uint8_t *chunk) {
+	uint32_t w[80];
+	for(int i = 0; i < 16; i++) {
+		w[i] = (static_cast<uint32_t>(chunk[(i * 4) + 0]) << 24) |
+		       (static_cast<uint32_t>(chunk[(i * 4) + 1]) << 16) |
+		       (static_cast<uint32_t>(chunk[(i * 4) + 2]) << 8)  |
+		       (static_cast<uint32_t>(chunk[(i * 4) + 3]));
+	}
+	for(int i = 16; i < 80; i++)
+		w[i] = Rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = this->state[0], b = this->state[1], c = this->state[2],
+	         d = this->state[3], e = this->state[4];
+
+	for(int i = 0; i < 80; i++) {
+		uint32_t f, k;
+		if(i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+		else if(i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+		else if(i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+		else            { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+		uint32_t temp = Rol32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = Rol32(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	this->state[0] += a;
+	this->state[1] += b;
+	this->state[2] += c;
+	this->state[3] += d;
+	this->state[4] += e;
+}
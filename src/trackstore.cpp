@@ -0,0 +1,170 @@
+/******************************************************************************
+* psx-comBINe content-addressed track store
+* Keeps one copy of every track across a library, named by its SHA-1. The
+* combined stream is split into tracks and hashed as it is written, and the
+* combined .bin is then built from the stored tracks with reflinks (or a
+* hardlink, for single track images).
+* ADBeta (c)
+******************************************************************************/
+#include "trackstore.hpp"
+#include "filecopy.hpp"
+
+#include <filesystem>
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <fstream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+/*** Track Store **************************************************************/
+TrackStore::TrackStore(const std::filesystem::path &d) : dir(d) {
+	std::error_code ec;
+	std::filesystem::create_directories(this->dir / "objects", ec);
+	std::filesystem::create_directories(this->dir / "tmp", ec);
+	if(!std::filesystem::is_directory(this->dir / "tmp"))
+		throw std::runtime_error("Store directory could not be created");
+}
+
+std::filesystem::path TrackStore::TempPath(const std::string &name) {
+	// Shared by every store of the process, as discs are combined at once
+	static std::atomic<uint64_t> temp_count(0);
+	return this->dir / "tmp" / (name + "." + std::to_string(getpid()) + "." +
+	                            std::to_string(temp_count++) + ".part");
+}
+
+std::filesystem::path TrackStore::Add(const std::filesystem::path &temp,
+                                      const Sha1::Digest &digest, uint64_t bytes) {
+	// objects/ab/cdef...bin, so no directory gets too large
+	std::string hex = Sha1::ToHex(digest);
+	std::filesystem::path object = this->dir / "objects" / hex.substr(0, 2) / (hex.substr(2) + ".bin");
+
+	this->stats.tracks++;
+	this->stats.bytes += bytes;
+
+	std::error_code ec;
+	if(std::filesystem::exists(object, ec)) {
+		if(std::filesystem::file_size(object) != bytes)
+			throw std::runtime_error("Stored track has the same hash but a different size");
+
+		std::filesystem::remove(temp, ec);
+		this->stats.dup_tracks++;
+		this->stats.dup_bytes += bytes;
+		return object;
+	}
+
+	// Renames are atomic, so another run adding the same track is harmless
+	std::filesystem::create_directories(object.parent_path());
+	std::filesystem::rename(temp, object);
+	return object;
+}
+
+void TrackStore::AddLinked(uint64_t bytes) {
+	this->stats.linked_bytes += bytes;
+}
+
+const TrackStore::Stats &TrackStore::GetStats() const {
+	return this->stats;
+}
+
+/*** Store Output Sink ********************************************************/
+StoreSink::StoreSink(TrackStore &s, const CueSheet &combined, const std::filesystem::path &p)
+	: store(s), path(p), track(0), offset(0), track_bytes(0) {
+
+	// Each track runs from its first INDEX (the first from 0) to the next one
+	if(combined.FileList.size() != 1)
+		throw std::runtime_error("Store needs a combined, single FILE cue sheet");
+
+	const auto &tracks = combined.FileList.front().TrackList;
+	if(tracks.empty()) throw std::runtime_error("Store needs a cue sheet with TRACKs");
+	// A bad or backwards INDEX would split the tracks at the wrong bytes
+	for(auto t_itr = std::next(tracks.begin()); t_itr != tracks.end(); ++t_itr) {
+		if(t_itr->IndexList.empty()) continue;
+		if(t_itr->IndexList.front().sector == CueSheet::timestamp_nval)
+			throw std::runtime_error("Store needs valid INDEX timestamps");
+
+		uint64_t end = t_itr->IndexList.front().Bytes(t_itr->type);
+		if(!this->track_ends.empty() && end < this->track_ends.back())
+			throw std::runtime_error("Store needs TRACKs in INDEX order");
+		this->track_ends.push_back(end);
+	}
+	this->track_ends.push_back(UINT64_MAX);
+
+	this->StartTrack();
+}
+
+void StoreSink::StartTrack() {
+	this->temp_path = this->store.TempPath(this->path.filename().string());
+	this->temp_file.open(this->temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!this->temp_file) throw std::runtime_error("Store track file could not be created");
+
+	this->sha.Reset();
+	this->track_bytes = 0;
+}
+
+void StoreSink::FinishTrack() {
+	this->temp_file.close();
+	if(this->temp_file.fail()) throw std::runtime_error("Failed to write store track file");
+
+	this->stored.push_back(this->store.Add(this->temp_path, this->sha.Final(), this->track_bytes));
+	this->track++;
+}
+
+void StoreSink::Write(const char *data, size_t len) {
+	// Split the buffer at track boundaries
+	while(len) {
+		if(this->offset >= this->track_ends[this->track]) {
+			this->FinishTrack();
+			this->StartTrack();
+			continue;
+		}
+
+		size_t take = static_cast<size_t>(
+			std::min<uint64_t>(len, this->track_ends[this->track] - this->offset));
+
+		this->sha.Update(data, take);
+		this->temp_file.write(data, static_cast<std::streamsize>(take));
+		if(!this->temp_file) throw std::runtime_error("Failed to write store track file");
+
+		this->track_bytes += take;
+		this->offset += take;
+		data += take;
+		len -= take;
+	}
+}
+
+void StoreSink::Close() {
+	this->FinishTrack();
+
+	// Trailing tracks with no data still need to be in the store
+	while(this->track < this->track_ends.size()) {
+		this->StartTrack();
+		this->FinishTrack();
+	}
+
+	// A single track image can be the stored file itself. Hardlinks share the
+	// data on any filesystem, but writing to one changes the store too
+	std::error_code ec;
+	std::filesystem::remove(this->path, ec);
+	if(this->stored.size() == 1) {
+		std::filesystem::create_hard_link(this->stored.front(), this->path, ec);
+		if(!ec) {
+			this->store.AddLinked(this->track_bytes);
+			return;
+		}
+	}
+
+	// Later tracks rarely start on a filesystem block, so only some (if any)
+	// of the tracks can be reflinked. The rest are copied
+	this->store.AddLinked(ConcatenateFiles(this->stored, this->path));
+}
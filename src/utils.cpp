@@ -55,6 +55,23 @@ std::filesystem::path FindFileWithExtension(const std::filesystem::path &dir,
 }
 
 
+// Finds every file with the extension, sorted so the order is repeatable
+std::vector<std::filesystem::path> FindFilesWithExtension(const std::filesystem::path &dir,
+                                                          const std::string &ext) {
+	std::vector<std::filesystem::path> found_files;
+	std::string ext_lower = StringToLower(ext);
+	for(const auto &entry : std::filesystem::directory_iterator(dir)) {
+		if(entry.is_regular_file() &&
+		   StringToLower(entry.path().extension().string()) == ext_lower) {
+			found_files.push_back(entry.path());
+		}
+	}
+
+	std::sort(found_files.begin(), found_files.end());
+	return found_files;
+}
+
+
 // Get and return the current Milliseconds
 std::chrono::milliseconds GetMillisecs() {
 	return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -74,3 +91,25 @@ std::string BytesToPaddedMiBString(const size_t bytes, const size_t pad_len) {
 	mib_str.append(" MiB");
 	return mib_str;
 }
+
+// Quotes a string for JSON, escaping quotes, backslashes and control chars
+std::string JsonString(std::string_view str) {
+	static const char hex[] = "0123456789abcdef";
+
+	std::string out = "\"";
+	for(char c : str) {
+		unsigned char uc = static_cast<unsigned char>(c);
+		if(c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back(c);
+		} else if(uc < 0x20) {
+			out.append("\\u00");
+			out.push_back(hex[uc >> 4]);
+			out.push_back(hex[uc & 0x0F]);
+		} else {
+			out.push_back(c);
+		}
+	}
+	out.push_back('"');
+	return out;
+}
@@ -0,0 +1,179 @@
+/******************************************************************************
+* psx-comBINe virtual combined image
+* A read-only view of a multi-FILE cue sheet as if it were already combined.
+* Reads are mapped onto the original FILEs through a binary searched offset
+* table and served with pread(), so any number of threads can read at once
+* without the image ever being written out.
+* ADBeta (c)
+******************************************************************************/
+#include "virtualimage.hpp"
+#include "audiofile.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+
+/*** Virtual Image ************************************************************/
+VirtualImage::VirtualImage(const CueSheet &sheet, const std::filesystem::path &base_dir,
+                           const std::string &combined_name)
+	: total_bytes(0), lba0_offset(0), sector_bytes(0) {
+
+	if(sheet.FileList.empty()) throw std::runtime_error("Cue sheet has no FILEs");
+	sheet.CopyTo(this->combined);
+	this->combined.Combine(combined_name, "BINARY");
+
+	// Lay the FILEs out end to end. Close whatever was opened if one fails
+	this->segments.reserve(sheet.FileList.size());
+	try {
+		for(const auto &f_itr : sheet.FileList) {
+			Segment seg;
+			seg.path = base_dir / f_itr.filename;
+			seg.bytes = f_itr.bytes;
+
+			AudioLayout layout = GetAudioLayout(seg.path, f_itr.filetype);
+			seg.data_offset = layout.data_offset;
+			seg.swap = layout.swap;
+
+#ifdef _WIN32
+			seg.file.reset(new std::ifstream(seg.path, std::ios::in | std::ios::binary));
+			if(!*seg.file) throw std::runtime_error("Input binary file could not be opened");
+#else
+			seg.fd = open(seg.path.c_str(), O_RDONLY);
+			if(seg.fd < 0) throw std::runtime_error("Input binary file could not be opened");
+#endif
+			this->starts.push_back(this->total_bytes);
+			this->segments.push_back(std::move(seg));
+			this->total_bytes += f_itr.bytes;
+		}
+	} catch(...) {
+#ifndef _WIN32
+		for(const Segment &seg : this->segments) close(seg.fd);
+#endif
+		throw;
+	}
+
+	// LBA 0 is the first TRACK's INDEX 01
+	const CueSheet::FileObj &file = this->combined.FileList.front();
+	if(!file.TrackList.empty()) {
+		const CueSheet::FileObj::TrackObj &track = file.TrackList.front();
+		this->sector_bytes = CueSheet::GetSectorBytesInTrackType(track.type);
+		for(const auto &i_itr : track.IndexList) {
+			if(i_itr.id == 1) {
+				this->lba0_offset = i_itr.Bytes(track.type);
+				break;
+			}
+		}
+	}
+}
+
+VirtualImage::~VirtualImage() {
+#ifndef _WIN32
+	for(const Segment &seg : this->segments) close(seg.fd);
+#endif
+}
+
+uint64_t VirtualImage::Bytes() const {
+	return this->total_bytes;
+}
+
+const CueSheet &VirtualImage::Combined() const {
+	return this->combined;
+}
+
+std::string VirtualImage::ToString() const {
+	return this->combined.ToString();
+}
+
+size_t VirtualImage::SectorBytes() const {
+	return this->sector_bytes;
+}
+
+void VirtualImage::ReadFile(const Segment &seg, uint64_t offset, uint8_t *dest,
+                            size_t len) const {
+	offset += seg.data_offset;
+
+#ifdef _WIN32
+	std::lock_guard<std::mutex> lock(this->file_mtx);
+	seg.file->clear();
+	seg.file->seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	seg.file->read(reinterpret_cast<char *>(dest), static_cast<std::streamsize>(len));
+	if(!*seg.file) throw std::runtime_error("Failed to read input binary file");
+#else
+	while(len) {
+		ssize_t got = pread(seg.fd, dest, len, static_cast<off_t>(offset));
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) throw std::runtime_error("Failed to read input binary file");
+
+		dest += got;
+		offset += static_cast<uint64_t>(got);
+		len -= static_cast<size_t>(got);
+	}
+#endif
+}
+
+void VirtualImage::ReadSegment(const Segment &seg, uint64_t offset, uint8_t *dest,
+                               size_t len) const {
+	if(!seg.swap) {
+		this->ReadFile(seg, offset, dest, len);
+		return;
+	}
+
+	// Byte i of swapped audio is byte i ^ 1 of the file. Read the whole
+	// samples in place, and an odd first or last byte on its own
+	uint64_t end = offset + len;
+	if(offset & 1) {
+		this->ReadFile(seg, offset - 1, dest, 1);
+		dest++;
+		offset++;
+	}
+
+	if(end > offset && (end & 1)) {
+		this->ReadFile(seg, end, dest + (end - 1 - offset), 1);
+		end--;
+	}
+
+	if(end > offset) {
+		this->ReadFile(seg, offset, dest, static_cast<size_t>(end - offset));
+		SwapAudioBytes(dest, static_cast<size_t>(end - offset));
+	}
+}
+
+void VirtualImage::Read(uint64_t offset, void *dest, size_t len) const {
+	if(offset > this->total_bytes || len > this->total_bytes - offset)
+		throw std::runtime_error("Read outside of the image");
+
+	// The last segment starting at or before offset. Empty segments share
+	// their start with the next one, so are never picked
+	size_t idx = static_cast<size_t>(
+		std::upper_bound(this->starts.begin(), this->starts.end(), offset) - this->starts.begin()) - 1;
+
+	uint8_t *out = static_cast<uint8_t *>(dest);
+	while(len) {
+		const Segment &seg = this->segments[idx];
+		uint64_t seg_offset = offset - this->starts[idx];
+		size_t take = static_cast<size_t>(std::min<uint64_t>(len, seg.bytes - seg_offset));
+
+		if(take) this->ReadSegment(seg, seg_offset, out, take);
+		out += take;
+		offset += take;
+		len -= take;
+		idx++;
+	}
+}
+
+void VirtualImage::ReadSectors(uint32_t lba, uint32_t count, void *dest) const {
+	this->Read(this->lba0_offset + (static_cast<uint64_t>(lba) * this->sector_bytes), dest,
+	           static_cast<size_t>(count) * this->sector_bytes);
+}
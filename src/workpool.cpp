@@ -0,0 +1,130 @@
+/******************************************************************************
+* psx-comBINe worker pool helpers
+* Threaded work primitives shared by the compressors and readers.
+* ADBeta (c)
+******************************************************************************/
+#include "workpool.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+unsigned DefaultThreadCount() {
+	unsigned threads = std::thread::hardware_concurrency();
+	return threads ? threads : 1;
+}
+
+/*** Parallel For *************************************************************/
+void ParallelFor(size_t count, const std::function<void(size_t)> &job, unsigned threads) {
+	if(threads == 0) threads = DefaultThreadCount();
+	threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex error_mtx;
+
+	auto worker = [&]() {
+		for(size_t idx = next++; idx < count && !failed; idx = next++) {
+			try {
+				job(idx);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(error_mtx);
+				if(!error) error = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned t = 1; t < threads; t++) workers.emplace_back(worker);
+	worker();
+	for(auto &w_itr : workers) w_itr.join();
+
+	if(error) std::rethrow_exception(error);
+}
+
+/*** Ordered Pipeline *********************************************************/
+OrderedPipeline::OrderedPipeline(Sink s, unsigned threads, size_t d)
+                          : sink(std::move(s)), dispatched(0), stopping(false) {
+	if(threads == 0) threads = DefaultThreadCount();
+	this->depth = d ? d : (static_cast<size_t>(threads) * 2);
+
+	for(unsigned i = 0; i < threads; i++)
+		this->workers.emplace_back(&OrderedPipeline::WorkerLoop, this);
+}
+
+OrderedPipeline::~OrderedPipeline() {
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+		this->stopping = true;
+	}
+	this->job_ready.notify_all();
+	for(auto &worker : this->workers) worker.join();
+}
+
+void OrderedPipeline::Submit(Job job) {
+	std::unique_lock<std::mutex> lock(this->mtx);
+
+	// Keep the reorder buffer bounded, delivering the oldest jobs as needed
+	while(this->slots.size() >= this->depth) this->DeliverFront(lock);
+
+	this->slots.emplace_back();
+	this->slots.back().job = std::move(job);
+	lock.unlock();
+	this->job_ready.notify_one();
+}
+
+void OrderedPipeline::Finish() {
+	std::unique_lock<std::mutex> lock(this->mtx);
+	while(!this->slots.empty()) this->DeliverFront(lock);
+}
+
+void OrderedPipeline::DeliverFront(std::unique_lock<std::mutex> &lock) {
+	Slot &front = this->slots.front();
+	this->job_done.wait(lock, [&front] { return front.done; });
+
+	// Take the slot out of the buffer before calling the sink, so a throwing
+	// job or sink leaves the pipeline in a consistent state
+	Buffer output = std::move(front.output);
+	std::exception_ptr error = front.error;
+	this->slots.pop_front();
+	--this->dispatched;
+
+	lock.unlock();
+	if(error) std::rethrow_exception(error);
+	this->sink(output);
+	lock.lock();
+}
+
+void OrderedPipeline::WorkerLoop() {
+	std::unique_lock<std::mutex> lock(this->mtx);
+	while(true) {
+		this->job_ready.wait(lock, [this] {
+			return this->stopping || this->dispatched < this->slots.size();
+		});
+		if(this->stopping) return;
+
+		// Deque references stay valid while other slots are pushed/popped
+		Slot &slot = this->slots[this->dispatched++];
+		lock.unlock();
+
+		try {
+			slot.job(slot.output);
+		} catch(...) {
+			slot.error = std::current_exception();
+		}
+		slot.job = nullptr;
+
+		lock.lock();
+		slot.done = true;
+		this->job_done.notify_all();
+	}
+}
@@ -0,0 +1,378 @@
+/******************************************************************************
+* psx-comBINe ZIP archive input
+* Reads the central directory of a .zip (including ZIP64), and streams stored
+* or deflated members without extracting them to disk. Several members are
+* inflated in parallel, and handed out in order.
+* ADBeta (c)
+******************************************************************************/
+#include "ziparchive.hpp"
+#include "workpool.hpp"
+#include "utils.hpp"
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <deque>
+#include <mutex>
+
+#include <zlib.h>
+
+/*** ZIP File Format Constants ************************************************/
+namespace {
+constexpr uint32_t sig_local        = 0x04034B50;
+constexpr uint32_t sig_central      = 0x02014B50;
+constexpr uint32_t sig_end          = 0x06054B50;
+constexpr uint32_t sig_end64        = 0x06064B50;
+constexpr uint32_t sig_end64_locate = 0x07064B50;
+
+constexpr size_t   local_bytes      = 30;
+constexpr size_t   central_bytes    = 46;
+constexpr size_t   end_bytes        = 22;
+constexpr size_t   end64_bytes      = 56;
+constexpr size_t   end64_loc_bytes  = 20;
+constexpr size_t   max_comment      = 0xFFFF;
+
+constexpr uint16_t extra_zip64      = 0x0001;
+constexpr uint16_t flag_encrypted   = 0x0001;
+constexpr uint16_t method_stored    = 0;
+constexpr uint16_t method_deflate   = 8;
+
+// Stream chunk size, and chunks buffered per member ahead of the writer
+constexpr size_t   chunk_bytes      = 1024 * 1024;
+constexpr size_t   queued_chunks    = 4;
+
+/*** Byte Helpers *************************************************************/
+uint64_t GetLE(const uint8_t *src, int bytes) {
+	uint64_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--) value = (value << 8) | src[i];
+	return value;
+}
+
+void ReadAt(std::ifstream &file, uint64_t offset, uint8_t *dest, size_t len) {
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	file.read(reinterpret_cast<char *>(dest), static_cast<std::streamsize>(len));
+	if(!file) throw std::runtime_error("Failed to read from ZIP file");
+}
+} // namespace
+
+/*** ZIP Archive **************************************************************/
+ZipArchive::ZipArchive(const std::filesystem::path &p) : path(p) {
+	std::ifstream file(this->path, std::ios::in | std::ios::binary);
+	if(!file) throw std::runtime_error("Input ZIP file could not be opened");
+
+	this->ReadCentralDirectory(file);
+}
+
+void ZipArchive::ReadCentralDirectory(std::ifstream &file) {
+	file.seekg(0, std::ios::end);
+	uint64_t file_size = static_cast<uint64_t>(file.tellg());
+	if(file_size < end_bytes) throw std::runtime_error("Input file is not a ZIP");
+
+	// The end of central directory record is followed by up to 64KiB of comment
+	size_t tail_len = static_cast<size_t>(std::min<uint64_t>(file_size, end_bytes + max_comment));
+	std::vector<uint8_t> tail(tail_len);
+	uint64_t tail_offset = file_size - tail_len;
+	ReadAt(file, tail_offset, tail.data(), tail_len);
+
+	size_t end_pos = tail_len - end_bytes + 1;
+	do {
+		end_pos--;
+		if(GetLE(tail.data() + end_pos, 4) == sig_end) break;
+	} while(end_pos != 0);
+	if(GetLE(tail.data() + end_pos, 4) != sig_end) throw std::runtime_error("Input file is not a ZIP");
+
+	const uint8_t *end = tail.data() + end_pos;
+	if(GetLE(end + 4, 2) != GetLE(end + 6, 2)) throw std::runtime_error("Multi-disk ZIPs are not supported");
+
+	uint64_t count      = GetLE(end + 10, 2);
+	uint64_t cd_bytes   = GetLE(end + 12, 4);
+	uint64_t cd_offset  = GetLE(end + 16, 4);
+
+	// ZIP64 archives keep the real values in the ZIP64 end record
+	if(count == 0xFFFF || cd_bytes == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF) {
+		uint64_t end_offset = tail_offset + end_pos;
+		if(end_offset < end64_loc_bytes) throw std::runtime_error("ZIP64 locator is missing");
+
+		uint8_t locator[end64_loc_bytes];
+		ReadAt(file, end_offset - end64_loc_bytes, locator, end64_loc_bytes);
+		if(GetLE(locator, 4) != sig_end64_locate) throw std::runtime_error("ZIP64 locator is missing");
+
+		uint8_t end64[end64_bytes];
+		ReadAt(file, GetLE(locator + 8, 8), end64, end64_bytes);
+		if(GetLE(end64, 4) != sig_end64) throw std::runtime_error("ZIP64 end record is corrupt");
+
+		count     = GetLE(end64 + 32, 8);
+		cd_bytes  = GetLE(end64 + 40, 8);
+		cd_offset = GetLE(end64 + 48, 8);
+	}
+
+	if(cd_offset + cd_bytes > file_size) throw std::runtime_error("ZIP central directory is corrupt");
+
+	std::vector<uint8_t> cd(static_cast<size_t>(cd_bytes));
+	ReadAt(file, cd_offset, cd.data(), cd.size());
+
+	size_t pos = 0;
+	for(uint64_t i = 0; i < count; i++) {
+		if(pos + central_bytes > cd.size() || GetLE(cd.data() + pos, 4) != sig_central)
+			throw std::runtime_error("ZIP central directory is corrupt");
+
+		const uint8_t *rec = cd.data() + pos;
+		size_t name_len    = static_cast<size_t>(GetLE(rec + 28, 2));
+		size_t extra_len   = static_cast<size_t>(GetLE(rec + 30, 2));
+		size_t comment_len = static_cast<size_t>(GetLE(rec + 32, 2));
+		if(pos + central_bytes + name_len + extra_len + comment_len > cd.size())
+			throw std::runtime_error("ZIP central directory is corrupt");
+
+		Entry entry;
+		entry.flags            = static_cast<uint16_t>(GetLE(rec + 8, 2));
+		entry.method           = static_cast<uint16_t>(GetLE(rec + 10, 2));
+		entry.crc              = static_cast<uint32_t>(GetLE(rec + 16, 4));
+		entry.compressed_bytes = GetLE(rec + 20, 4);
+		entry.bytes            = GetLE(rec + 24, 4);
+		entry.local_offset     = GetLE(rec + 42, 4);
+		entry.name.assign(reinterpret_cast<const char *>(rec + central_bytes), name_len);
+
+		// Saturated fields are replaced by the ZIP64 extra field, in order
+		const uint8_t *extra = rec + central_bytes + name_len;
+		for(size_t e = 0; e + 4 <= extra_len; ) {
+			uint16_t id  = static_cast<uint16_t>(GetLE(extra + e, 2));
+			size_t   len = static_cast<size_t>(GetLE(extra + e + 2, 2));
+			if(e + 4 + len > extra_len) break;
+
+			if(id == extra_zip64) {
+				const uint8_t *field = extra + e + 4, *field_end = field + len;
+				for(uint64_t *value : {&entry.bytes, &entry.compressed_bytes, &entry.local_offset}) {
+					if(*value != 0xFFFFFFFF) continue;
+					if(field + 8 > field_end) throw std::runtime_error("ZIP64 extra field is corrupt");
+					*value = GetLE(field, 8);
+					field += 8;
+				}
+			}
+			e += 4 + len;
+		}
+
+		this->entries.push_back(entry);
+		pos += central_bytes + name_len + extra_len + comment_len;
+	}
+}
+
+const std::vector<ZipArchive::Entry> &ZipArchive::Entries() const {
+	return this->entries;
+}
+
+const ZipArchive::Entry *ZipArchive::Find(const std::string &name) const {
+	for(const Entry &entry : this->entries) {
+		if(entry.name == name) return &entry;
+	}
+
+	std::string lower = StringToLower(name);
+	for(const Entry &entry : this->entries) {
+		if(StringToLower(entry.name) == lower) return &entry;
+	}
+
+	return nullptr;
+}
+
+const ZipArchive::Entry *ZipArchive::FindExtension(const std::string &ext) const {
+	std::string lower = StringToLower(ext);
+	for(const Entry &entry : this->entries) {
+		std::string name = StringToLower(entry.name);
+		if(name.size() >= lower.size() &&
+		   name.compare(name.size() - lower.size(), lower.size(), lower) == 0) {
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+void ZipArchive::ReadEntry(const Entry &entry, std::string &out) const {
+	out.clear();
+	out.reserve(static_cast<size_t>(entry.bytes));
+	this->Extract(entry, [&out](const uint8_t *data, size_t len) {
+		out.append(reinterpret_cast<const char *>(data), len);
+	});
+}
+
+void ZipArchive::Extract(const Entry &entry,
+                         const std::function<void(const uint8_t *, size_t)> &out) const {
+	if(entry.flags & flag_encrypted) throw std::runtime_error("Encrypted ZIP members are not supported");
+	if(entry.method != method_stored && entry.method != method_deflate)
+		throw std::runtime_error("ZIP member uses an unsupported compression method");
+
+	// Each call has its own handle, so members can be read in parallel
+	std::ifstream file(this->path, std::ios::in | std::ios::binary);
+	if(!file) throw std::runtime_error("Input ZIP file could not be opened");
+
+	// The local header's name and extra lengths can differ from the central
+	// directory's. Sizes always come from the central directory
+	uint8_t local[local_bytes];
+	ReadAt(file, entry.local_offset, local, local_bytes);
+	if(GetLE(local, 4) != sig_local) throw std::runtime_error("ZIP local header is corrupt");
+	uint64_t data_offset = entry.local_offset + local_bytes +
+	                       GetLE(local + 26, 2) + GetLE(local + 28, 2);
+
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(data_offset), std::ios::beg);
+
+	std::vector<uint8_t> in(chunk_bytes), chunk(chunk_bytes);
+	uint64_t remaining = entry.compressed_bytes, produced = 0;
+	uLong crc = crc32(0L, Z_NULL, 0);
+
+	z_stream strm = {};
+	if(entry.method == method_deflate && inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+		throw std::runtime_error("Failed to initialise inflate");
+
+	try {
+		bool finished = false;
+		while(!finished) {
+			size_t in_len = static_cast<size_t>(std::min<uint64_t>(remaining, chunk_bytes));
+			file.read(reinterpret_cast<char *>(in.data()), static_cast<std::streamsize>(in_len));
+			if(!file) throw std::runtime_error("Failed to read from ZIP file");
+			remaining -= in_len;
+
+			if(entry.method == method_stored) {
+				crc = crc32(crc, in.data(), static_cast<uInt>(in_len));
+				produced += in_len;
+				if(in_len) out(in.data(), in_len);
+				finished = (remaining == 0);
+				continue;
+			}
+
+			strm.next_in  = in.data();
+			strm.avail_in = static_cast<uInt>(in_len);
+			do {
+				strm.next_out  = chunk.data();
+				strm.avail_out = static_cast<uInt>(chunk_bytes);
+
+				int ret = inflate(&strm, Z_NO_FLUSH);
+				if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+					throw std::runtime_error("ZIP member failed to inflate");
+
+				size_t have = chunk_bytes - strm.avail_out;
+				crc = crc32(crc, chunk.data(), static_cast<uInt>(have));
+				produced += have;
+				if(have) out(chunk.data(), have);
+
+				if(ret == Z_STREAM_END) finished = true;
+			} while(!finished && strm.avail_out == 0);
+
+			if(!finished && remaining == 0) throw std::runtime_error("ZIP member is truncated");
+		}
+	} catch(...) {
+		if(entry.method == method_deflate) inflateEnd(&strm);
+		throw;
+	}
+	if(entry.method == method_deflate) inflateEnd(&strm);
+
+	if(produced != entry.bytes || crc != entry.crc)
+		throw std::runtime_error("ZIP member failed its CRC check");
+}
+
+void ZipArchive::Stream(const std::vector<const Entry *> &members,
+                        const StreamCallback &out, unsigned threads) const {
+	// Each member has its own small chunk queue. Workers take members in
+	// order, so the member being written always has a worker filling it
+	struct Queue {
+		std::deque<std::vector<uint8_t>> chunks;
+		std::exception_ptr               error;
+		bool                             done = false;
+	};
+
+	std::vector<Queue>      queues(members.size());
+	std::mutex              mtx;
+	std::condition_variable changed;
+	size_t                  next_member = 0;
+	bool                    aborting = false;
+
+	auto worker = [&]() {
+		for(;;) {
+			size_t idx;
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if(aborting || next_member == members.size()) return;
+				idx = next_member++;
+			}
+
+			Queue &queue = queues[idx];
+			std::vector<uint8_t> pending;
+			auto flush = [&]() {
+				std::unique_lock<std::mutex> lock(mtx);
+				changed.wait(lock, [&] { return aborting || queue.chunks.size() < queued_chunks; });
+				if(aborting) throw std::runtime_error("ZIP stream aborted");
+				queue.chunks.push_back(std::move(pending));
+				pending.clear();
+				lock.unlock();
+				changed.notify_all();
+			};
+
+			try {
+				this->Extract(*members[idx], [&](const uint8_t *data, size_t len) {
+					pending.insert(pending.end(), data, data + len);
+					if(pending.size() >= chunk_bytes) flush();
+				});
+				if(!pending.empty()) flush();
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(mtx);
+				queue.error = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				queue.done = true;
+			}
+			changed.notify_all();
+		}
+	};
+
+	if(threads == 0) threads = DefaultThreadCount();
+	threads = static_cast<unsigned>(std::min<size_t>(threads, members.size()));
+
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < threads; i++) workers.emplace_back(worker);
+
+	auto stop = [&]() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			aborting = true;
+		}
+		changed.notify_all();
+		for(auto &w : workers) w.join();
+	};
+
+	try {
+		for(size_t idx = 0; idx < members.size(); idx++) {
+			Queue &queue = queues[idx];
+			for(;;) {
+				std::unique_lock<std::mutex> lock(mtx);
+				changed.wait(lock, [&] { return !queue.chunks.empty() || queue.done; });
+
+				if(queue.chunks.empty()) {
+					if(queue.error) std::rethrow_exception(queue.error);
+					break;
+				}
+
+				std::vector<uint8_t> chunk = std::move(queue.chunks.front());
+				queue.chunks.pop_front();
+				lock.unlock();
+				changed.notify_all();
+
+				out(idx, reinterpret_cast<const char *>(chunk.data()), chunk.size());
+			}
+		}
+	} catch(...) {
+		stop();
+		throw;
+	}
+
+	stop();
+}